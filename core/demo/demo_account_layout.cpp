@@ -0,0 +1,154 @@
+/* Memory footprint of the account columns, with one std::string per customer field
+(the layout AccountColumns used before) and with the hot/cold split + StringPool.
+Usage: demo_account_layout [accounts] [customers] (default = 10000000 2000000, the
+seeder's 10M dataset). Needs no database, the rows are synthetic */
+#include "account_loader.hpp"
+
+#include <malloc.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    /* Same name lists and email format as tools/seed_database.cpp */
+    constexpr std::array<const char*, 16> FIRST_NAMES = {
+        "Alice", "Benjamin", "Clara", "Daniel", "Eva", "Frank", "Gloria", "Henry",
+        "Isabella", "Jake", "Karen", "Leonardo", "Maria", "Nathan", "Olivia", "Patrick"
+    };
+
+    constexpr std::array<const char*, 16> LAST_NAMES = {
+        "Johnson", "Carter", "Mendes", "Thompson", "Martins", "Liu", "Smith", "Ford",
+        "Costa", "Williams", "Davis", "Pereira", "Lopez", "Rogers", "Turner", "Kim"
+    };
+
+    constexpr std::array<const char*, 5> CURRENCIES = {"USD", "EUR", "GBP", "BRL", "JPY"};
+
+    /**
+     * @brief The columns as they were: 4-byte currency, a std::string per name and email
+     */
+    struct StringColumns {
+        std::vector<std::int32_t>        accountIDs;
+        std::vector<std::int32_t>        customerIDs;
+        std::vector<std::int64_t>        balanceCents;
+        std::vector<std::array<char, 4>> currencies;
+        std::vector<AccountType>         accountTypes;
+        std::vector<std::string>         customerNames;
+        std::vector<std::string>         customerEmails;
+    };
+
+    /** @brief Heap bytes in use, malloc chunks and mmap()ed blocks */
+    std::size_t heapInUse() {
+        struct mallinfo2 info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+    }
+
+    /** @brief Deterministic fields of row i, customer c owns accounts c, c + customers, ... */
+    template <typename Visit>
+    void generate(std::int64_t accounts, std::int64_t customers, Visit visit) {
+        std::string name;
+        std::string email;
+        for (std::int64_t i = 0; i < accounts; ++i) {
+            std::int64_t customer = 1 + i % customers;
+            std::uint64_t mix = static_cast<std::uint64_t>(customer) * 0x9E3779B97F4A7C15ull;
+
+            name.assign(FIRST_NAMES[(mix >> 32) % FIRST_NAMES.size()]);
+            name.append(" ").append(LAST_NAMES[(mix >> 40) % LAST_NAMES.size()]);
+            email.assign("customer").append(std::to_string(customer)).append("@seed.bank1.com");
+
+            visit(static_cast<std::int32_t>(i + 1), static_cast<std::int32_t>(customer),
+                  static_cast<std::int64_t>(mix % 10000000), CURRENCIES[i % CURRENCIES.size()],
+                  static_cast<AccountType>(i % 3), name, email);
+        }
+    }
+
+    void report(const char* layout, std::size_t bytes, std::int64_t accounts, double seconds) {
+        std::cout << layout << ": " << bytes / (1024 * 1024) << " MiB, "
+                  << static_cast<double>(bytes) / accounts << " bytes/account, built in "
+                  << seconds << "s\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::int64_t accounts = 10000000;
+    std::int64_t customers = 2000000;
+    try {
+        if (argc > 1) {
+            accounts = std::stoll(argv[1]);
+        }
+        if (argc > 2) {
+            customers = std::stoll(argv[2]);
+        }
+    } catch (const std::exception&) {
+        std::cerr << "[WARN] Invalid arguments. Using defaults: 10000000 2000000\n";
+    }
+    if (accounts <= 0 || customers <= 0) {
+        std::cerr << "[FATAL] accounts and customers must be positive\n";
+        return 1;
+    }
+
+    std::cout << "=== Account layout footprint ===\n\n"
+              << accounts << " accounts, " << customers << " customers\n\n";
+
+    std::size_t before;
+    {
+        std::size_t base = heapInUse();
+        auto started = std::chrono::steady_clock::now();
+
+        StringColumns columns;
+        auto rows = static_cast<std::size_t>(accounts);
+        columns.accountIDs.reserve(rows);
+        columns.customerIDs.reserve(rows);
+        columns.balanceCents.reserve(rows);
+        columns.currencies.reserve(rows);
+        columns.accountTypes.reserve(rows);
+        columns.customerNames.reserve(rows);
+        columns.customerEmails.reserve(rows);
+
+        generate(accounts, customers, [&](std::int32_t id, std::int32_t customer, std::int64_t cents,
+                                          const char* currency, AccountType type,
+                                          const std::string& name, const std::string& email) {
+            std::array<char, 4> code{currency[0], currency[1], currency[2], '\0'};
+            columns.accountIDs.push_back(id);
+            columns.customerIDs.push_back(customer);
+            columns.balanceCents.push_back(cents);
+            columns.currencies.push_back(code);
+            columns.accountTypes.push_back(type);
+            columns.customerNames.push_back(name);
+            columns.customerEmails.push_back(email);
+        });
+
+        before = heapInUse() - base;
+        report("std::string columns", before,
+               accounts, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+    }
+
+    std::size_t after;
+    {
+        std::size_t base = heapInUse();
+        auto started = std::chrono::steady_clock::now();
+
+        AccountColumns columns;
+        columns.reserve(static_cast<std::size_t>(accounts));
+
+        generate(accounts, customers, [&](std::int32_t id, std::int32_t customer, std::int64_t cents,
+                                          const char* currency, AccountType type,
+                                          const std::string& name, const std::string& email) {
+            columns.push(id, customer, cents, currency, type, name, email);
+        });
+
+        after = heapInUse() - base;
+        report("hot/cold + StringPool", after,
+               accounts, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+
+        std::cout << "  hot columns:  " << columns.size() * 16 / (1024 * 1024) << " MiB (16 bytes/account)\n"
+                  << "  interned:     " << columns.strings.size() << " distinct strings, "
+                  << columns.strings.memoryUsage() / (1024 * 1024) << " MiB\n";
+    }
+
+    std::cout << "\nReduction: " << 100.0 * (1.0 - static_cast<double>(after) / before) << "%\n";
+    return 0;
+}
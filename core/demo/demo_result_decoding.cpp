@@ -0,0 +1,142 @@
+/* Decode cost per row of a result fetched as text against the same result in
+binary format. Usage: demo_result_decoding [rows] (default = 1000000). Needs no
+database: the rows are encoded here exactly as the server sends them, the
+columns are those of a history row (account_id int4, transaction_id int8,
+amount numeric(14,2)) */
+#include "account_table.hpp"
+#include "pg_binary.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    struct EncodedRow {
+        std::string accountID;
+        std::string transactionID;
+        std::string amount;
+    };
+
+    void putBigEndian(std::string& out, std::uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    /* numeric as sent by the server: ndigits, weight, sign, dscale, base 10000 digits */
+    std::string encodeNumeric(std::int64_t cents) {
+        std::uint64_t abs = cents < 0 ? static_cast<std::uint64_t>(-cents) : static_cast<std::uint64_t>(cents);
+        std::vector<std::uint16_t> digits;
+        for (std::uint64_t units = abs / 100; units > 0; units /= 10000) {
+            digits.insert(digits.begin(), static_cast<std::uint16_t>(units % 10000));
+        }
+        int weight = static_cast<int>(digits.size()) - 1;
+        if (abs % 100 != 0) {
+            digits.push_back(static_cast<std::uint16_t>(abs % 100 * 100));
+        }
+        if (digits.empty()) {
+            weight = 0;
+        }
+
+        std::string field;
+        putBigEndian(field, digits.size(), 2);
+        putBigEndian(field, static_cast<std::uint16_t>(weight), 2);
+        putBigEndian(field, cents < 0 ? 0x4000 : 0x0000, 2);
+        putBigEndian(field, 2, 2);
+        for (auto digit : digits) {
+            putBigEndian(field, digit, 2);
+        }
+        return field;
+    }
+
+    template <typename Number>
+    Number parseInteger(std::string_view text) {
+        Number value = 0;
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+
+    /** @brief ns per row of decode over every row, best of passes */
+    template <typename Decode>
+    double nanosecondsPerRow(const std::vector<EncodedRow>& rows, Decode decode, std::int64_t& checksum) {
+        double best = 0.0;
+        for (int pass = 0; pass < 5; ++pass) {
+            auto started = std::chrono::steady_clock::now();
+            std::int64_t sum = 0;
+            for (const auto& row : rows) {
+                sum += decode(row);
+            }
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+            if (pass == 0 || ns < best) {
+                best = ns;
+            }
+            checksum = sum;
+        }
+        return best / rows.size();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t count = 1000000;
+    if (argc > 1) {
+        try {
+            count = std::stoul(argv[1]);
+        } catch (const std::exception&) {
+            std::cerr << "[WARN] Invalid rows argument. Using default: 1000000\n";
+        }
+    }
+    if (count == 0) {
+        count = 1;
+    }
+
+    std::mt19937_64 random(42);
+    std::vector<EncodedRow> text(count);
+    std::vector<EncodedRow> binary(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto accountID = static_cast<std::int32_t>(1 + random() % 10000000);
+        auto transactionID = static_cast<std::int64_t>(1 + random() % 100000000000LL);
+        auto cents = static_cast<std::int64_t>(random() % 100000000) - 10000000;
+
+        text[i] = {std::to_string(accountID), std::to_string(transactionID), formatCents(cents)};
+        binary[i].amount = encodeNumeric(cents);
+        putBigEndian(binary[i].accountID, static_cast<std::uint32_t>(accountID), 4);
+        putBigEndian(binary[i].transactionID, static_cast<std::uint64_t>(transactionID), 8);
+    }
+
+    std::cout << "=== Result decoding, " << count << " rows (int4, int8, numeric) ===\n\n";
+
+    std::int64_t doubles, fixed, decoded;
+
+    /* what getAccount()-style code does: as<int>() and as<double>() on text */
+    double textDouble = nanosecondsPerRow(text, [](const EncodedRow& row) {
+        return parseInteger<std::int32_t>(row.accountID) + parseInteger<std::int64_t>(row.transactionID) +
+               static_cast<std::int64_t>(std::stod(row.amount) * 100.0 + (row.amount[0] == '-' ? -0.5 : 0.5));
+    }, doubles);
+
+    /* text into the fixed-point representation */
+    double textCents = nanosecondsPerRow(text, [](const EncodedRow& row) {
+        return parseInteger<std::int32_t>(row.accountID) + parseInteger<std::int64_t>(row.transactionID) +
+               parseCents(row.amount);
+    }, fixed);
+
+    double binaryCents = nanosecondsPerRow(binary, [](const EncodedRow& row) {
+        return decodeInt4(row.accountID) + decodeInt8(row.transactionID) + decodeNumericCents(row.amount);
+    }, decoded);
+
+    std::cout << "text, numeric as double:  " << textDouble << " ns/row\n"
+              << "text, numeric as cents:   " << textCents << " ns/row\n"
+              << "binary, numeric as cents: " << binaryCents << " ns/row\n\n";
+
+    if (doubles != decoded || fixed != decoded) {
+        std::cerr << "[FATAL] Decoded values differ between the formats\n";
+        return 1;
+    }
+    std::cout << "[OK] All formats decode the same values, binary is "
+              << textDouble / binaryCents << "x faster than text as double\n";
+    return 0;
+}
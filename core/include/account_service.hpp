@@ -9,24 +9,45 @@ basic functionalities */
 #include <pqxx/pqxx>
 /* Handles string */
 #include <string>
+#include <memory_resource>
 #include <optional>
+#include <vector>
 /* Deals with exceptions */
 #include <stdexcept>
+/* ReadConsistency, reads may be served by a replica */
+#include "replica_router.hpp"
+/* RowMapper, Account rows are decoded by position */
+#include "row_mapper.hpp"
 
 /**
  * @brief structure to store account to be fetched from getAccount()
- * 
+ *
+ * Strings are allocated from RequestArena::resource(): inside a request of
+ * the threads backend they live in the request arena and must not outlive it
  */
 struct Account {
-    int         accountID;
-    int         customerID;
-    std::string customerName;
-    std::string customerEmail;
-    std::string accountType;
-    double      balance;
-    std::string currency;
+    int              accountID;
+    int              customerID;
+    std::pmr::string customerName;
+    std::pmr::string customerEmail;
+    std::pmr::string accountType;
+    double           balance;
+    std::pmr::string currency;
 };
 
+/**
+ * @brief Positional decoder of the rows getAccount() selects, the query
+ * names its columns in this order
+ */
+using AccountRow = RowMapper<Account,
+    Column<"account_id",     &Account::accountID>,
+    Column<"customer_id",    &Account::customerID>,
+    Column<"customer_name",  &Account::customerName>,
+    Column<"customer_email", &Account::customerEmail>,
+    Column<"account_type",   &Account::accountType>,
+    Column<"balance",        &Account::balance>,
+    Column<"currency",       &Account::currency>>;
+
 /**
  * @class Service class that provides high level operations for bank accounts 
  * 
@@ -41,9 +62,12 @@ class AccountService{
          * @brief Get the Account object by unique accountID
          * 
          * @param accountID integer, unique account identification 
+         * @param consistency BoundedStaleness lets ReplicaRouter serve it from
+         * a replica, Strong forces the primary
          * @return Account struct containing the account data if found,
          * or std::nullopt if no account exists with the given ID */
-        std::optional<Account> getAccount(int accountID);
+        std::optional<Account> getAccount(int accountID,
+                                          ReadConsistency consistency = ReadConsistency::BoundedStaleness);
 
         /**
          * @brief Check if account exists
@@ -56,18 +80,39 @@ class AccountService{
 
         /**
          * @brief Get the Account Balance object
+         *
+         * Read on the primary unless "balance_on_replica" is set, so a balance
+         * asked right after a transfer always includes it
          * 
          * @param accountID 
          * @return double as account balance
          */
         double getBalance(int accountID);
 
+        /**
+         * @brief Get the balances of several accounts in one round trip
+         *
+         * The SELECTs are queued in a pqxx::pipeline and flushed together,
+         * results come back in a single batch instead of one round trip
+         * per account. Same consistency as getBalance()
+         *
+         * @param accountIDs accounts to look up, duplicates allowed
+         * @return one entry per id, in the same order, std::nullopt when the
+         * account does not exist
+         */
+        std::vector<std::optional<double>> getBalances(const std::vector<int>& accountIDs);
+
         /**
          * @brief Prints account information
          * 
          * @param accountID 
          */
         void printAccount(int accountID);
+
+    private:
+        /** @brief getBalances() on a sharded database, one query per shard */
+        void getShardedBalances(const std::vector<int>& accountIDs,
+                                std::vector<std::optional<double>>& balances);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+/* Binary snapshot of the in-process account table for fast startup */
+#ifndef ACCOUNT_SNAPSHOT_HPP
+#define ACCOUNT_SNAPSHOT_HPP
+
+#include "account_table.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief On-disk header at offset 0 of a snapshot file
+ *
+ * File layout (all little endian, fixed width):
+ *
+ *   SnapshotHeader
+ *   SnapshotSection[sectionCount]
+ *   section payloads, each aligned to 64 bytes
+ *
+ * Account payloads are plain arrays of AccountRecord so the file can be
+ * mmap'ed and read in place. Each section has its own CRC32, so a torn or
+ * corrupted file is detected and sections can be verified in parallel.
+ */
+struct SnapshotHeader {
+    char          magic[8];          // "CBISNAP1"
+    std::uint32_t version;
+    std::uint32_t sectionCount;
+    std::int64_t  lastTransactionID; // watermark of the transactions log
+    std::int64_t  createdAt;         // unix time in seconds
+    std::uint32_t reserved;
+    std::uint32_t headerChecksum;    // CRC32 of header (this field = 0) + section table
+};
+
+/**
+ * @brief Describes one section of a snapshot file
+ */
+struct SnapshotSection {
+    std::uint32_t type;         // SECTION_ACCOUNTS or SECTION_PENDING
+    std::uint32_t recordSize;   // bytes per record
+    std::uint64_t recordCount;
+    std::uint64_t offset;       // from the start of the file
+    std::uint32_t checksum;     // CRC32 of the payload
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 40, "SnapshotHeader layout is part of the snapshot format");
+static_assert(sizeof(SnapshotSection) == 32, "SnapshotSection layout is part of the snapshot format");
+
+/**
+ * @class AccountSnapshot
+ *
+ * @brief Writes and loads account table snapshots
+ *
+ * Startup is: load() the snapshot (mmap + checksum verification) then
+ * AccountTable::replayTransactions() to apply the tail of the transactions
+ * log written after the snapshot. Only when no valid snapshot exists the
+ * full scan of accounts is needed.
+ */
+class AccountSnapshot {
+    public:
+        static constexpr std::uint32_t VERSION = 1;
+        static constexpr std::uint32_t SECTION_ACCOUNTS = 1;
+        static constexpr std::uint32_t SECTION_PENDING  = 2;
+
+        /** @brief Max accounts per section (24 MiB of records) */
+        static constexpr std::uint64_t RECORDS_PER_SECTION = 1u << 20;
+
+        /**
+         * @brief Writes a snapshot atomically (temp file, fsync, rename,
+         * fsync of the directory)
+         *
+         * Throws std::runtime_error if the file cannot be written
+         */
+        static void write(const std::string& path,
+                          const std::vector<AccountRecord>& records,
+                          std::int64_t lastTransactionID,
+                          const std::vector<std::int64_t>& pending);
+
+        /**
+         * @brief Writes a snapshot of the current content of a table
+         */
+        static void write(const std::string& path, const AccountTable& table);
+
+        /**
+         * @brief Maps a snapshot file, verifies it and loads it into table
+         *
+         * @return true if the table was loaded, false if the file does not
+         * exist or is invalid (bad magic, version or checksum)
+         */
+        static bool load(const std::string& path, AccountTable& table);
+
+        /**
+         * @brief Brings a table up to date at startup
+         *
+         * Loads the snapshot and replays the transaction tail when possible,
+         * otherwise falls back to a full scan of the accounts table
+         */
+        static void warmStart(const std::string& path, AccountTable& table);
+
+        /**
+         * @brief CRC32 (IEEE 802.3) of a memory block
+         */
+        static std::uint32_t crc32(const void* data, std::size_t size, std::uint32_t crc = 0);
+};
+
+/**
+ * @class SnapshotWriter
+ *
+ * @brief Background thread that warms the table up, then periodically
+ * catches it up with the transactions log and writes a new snapshot
+ *
+ * The warm start (snapshot + replay, or the full scan) runs on this thread
+ * so it never delays startup; until it succeeds the table stays empty and
+ * is not snapshotted. Request handling never waits on it either: the table
+ * is copied under a shared lock and the file is written from the copy.
+ */
+class SnapshotWriter {
+    public:
+        SnapshotWriter(AccountTable& table, std::string path, std::chrono::seconds interval);
+
+        /** @brief Stops the background thread if it is still running */
+        ~SnapshotWriter();
+
+        /** @brief Starts the background thread (warm start first), no-op if already running */
+        void start();
+
+        /** @brief Wakes the thread up and waits for it to finish */
+        void stop();
+
+    private:
+        /** @brief Loop run by the background thread */
+        void run();
+
+        AccountTable&        table;
+        std::string          snapshotPath;
+        std::chrono::seconds interval;
+
+        std::atomic<bool>       running{false};
+        std::mutex              waitMutex;
+        std::condition_variable wakeUp;
+        std::thread             writerThread;
+};
+
+#endif
@@ -0,0 +1,184 @@
+/* In-process copy of the accounts table, rebuilt at startup from a snapshot
+ * plus the tail of the transactions log (see account_snapshot.hpp) */
+#ifndef ACCOUNT_TABLE_HPP
+#define ACCOUNT_TABLE_HPP
+
+/* Includes */
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+/* to use std::shared_mutex for readers/writer access */
+#include <shared_mutex>
+
+/**
+ * @brief Account types allowed by the CHECK constraint on accounts.account_type
+ */
+enum class AccountType : std::uint8_t {
+    Checking = 0,
+    Savings  = 1,
+    Credit   = 2
+};
+
+/**
+ * @brief Fixed-width account record (24 bytes, no pointers)
+ *
+ * This is the exact layout stored inside a snapshot file, so a mapped
+ * snapshot section can be read as an array of AccountRecord directly.
+ * Balances are kept as integer cents, accounts.balance is NUMERIC(14,2)
+ * so it always fits in 64 bits without any rounding.
+ */
+struct AccountRecord {
+    std::int32_t accountID;
+    std::int32_t customerID;
+    std::int64_t balanceCents;
+    char         currency[4];   // ISO code, NUL terminated ("USD\0")
+    AccountType  accountType;
+    std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(AccountRecord) == 24, "AccountRecord layout is part of the snapshot format");
+
+/**
+ * @brief Parses a NUMERIC(14,2) text value ("-12.5", "1500.00") into cents
+ *
+ * Throws std::invalid_argument if the text is not a valid decimal number
+ */
+std::int64_t parseCents(std::string_view text);
+
+/**
+ * @brief Formats cents back as a NUMERIC literal ("1500.00")
+ */
+std::string formatCents(std::int64_t cents);
+
+/**
+ * @brief Converts accounts.account_type text into AccountType
+ *
+ * Throws std::invalid_argument for unknown types
+ */
+AccountType parseAccountType(std::string_view text);
+
+/**
+ * @brief Converts AccountType back into its database text
+ */
+const char* accountTypeName(AccountType type);
+
+/**
+ * @class AccountTable
+ *
+ * @brief In-memory view of the accounts table
+ *
+ * Keeps every account as an AccountRecord plus two watermarks describing which
+ * rows of the transactions table are already reflected in the balances:
+ *
+ *   - lastTransactionID: highest transaction_id applied
+ *   - pendingTransactionIDs: ids below the watermark that were not yet visible
+ *     when the table was loaded (in flight at that time), they must still be
+ *     applied once they commit
+ *
+ * Readers take a shared lock, loaders and replay take an exclusive one.
+ */
+class AccountTable {
+    public:
+        /**
+         * @brief Replaces the whole content of the table
+         *
+         * @param records accounts, any order
+         * @param lastTransactionID watermark of the transactions log
+         * @param pending ids below the watermark not yet applied
+         */
+        void reset(std::vector<AccountRecord> records,
+                   std::int64_t lastTransactionID,
+                   std::vector<std::int64_t> pending = {});
+
+        /**
+         * @brief Full scan of accounts from Postgres (slow path, no snapshot)
+         *
+         * Uses the parallel AccountLoader and reads the transactions watermark
+         * in its leader transaction so both describe the same instant.
+         */
+        void loadFromDatabase();
+
+        /**
+         * @brief Applies every committed transaction that is not reflected yet
+         *
+         * This is the "WAL tail" replay: rows of the append only transactions
+         * table above the watermark (or listed as pending) are applied as
+         * balance deltas
+         *
+         * @return number of transactions applied
+         */
+        std::size_t replayTransactions();
+
+        /**
+         * @brief Applies a single committed transfer to the balances
+         *
+         * Used by replay, returns false if it was already applied
+         */
+        bool applyTransaction(std::int64_t transactionID,
+                              std::int32_t fromAccount,
+                              std::int32_t toAccount,
+                              std::int64_t amountCents);
+
+        /**
+         * @brief Adds accounts created after the table was loaded
+         *
+         * Their balances must already include every transaction applied so
+         * far, records whose id is already in the table are ignored
+         *
+         * @return number of accounts added
+         */
+        std::size_t addAccounts(const std::vector<AccountRecord>& newRecords);
+
+        /**
+         * @brief Finds an account by id
+         *
+         * @return copy of the record or std::nullopt if not found
+         */
+        std::optional<AccountRecord> find(std::int32_t accountID) const;
+
+        /**
+         * @brief Consistent copy of the table used by the snapshot writer
+         *
+         * Only a memcpy of the records happens under the shared lock, so taking
+         * a snapshot never blocks readers for long
+         */
+        void copyTo(std::vector<AccountRecord>& records,
+                    std::int64_t& lastTransactionID,
+                    std::vector<std::int64_t>& pending) const;
+
+        /** @brief Number of accounts currently loaded */
+        std::size_t size() const;
+
+        /** @brief Highest transaction_id applied to the balances */
+        std::int64_t lastTransactionID() const;
+
+        /** @brief Highest account_id loaded, 0 when empty */
+        std::int32_t highestAccountID() const;
+
+    private:
+        /** @brief Rebuilds index from records, caller holds the exclusive lock */
+        void rebuildIndex();
+
+        /** @brief Account rows, the layout written into snapshots */
+        std::vector<AccountRecord> records;
+
+        /** @brief account_id -> position inside records */
+        std::unordered_map<std::int32_t, std::size_t> index;
+
+        /** @brief Highest transaction_id applied */
+        std::int64_t lastTxID = 0;
+
+        /** @brief Highest account_id in records, replay loads the ones above */
+        std::int32_t maxAccountID = 0;
+
+        /** @brief Ids below lastTxID that were in flight when loaded */
+        std::unordered_set<std::int64_t> pendingTx;
+
+        mutable std::shared_mutex tableMutex;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/* Non-blocking database access on top of libpq, driven by an EventLoop */
+#ifndef ASYNC_DB_HPP
+#define ASYNC_DB_HPP
+
+#include "event_loop.hpp"
+
+/* libpq, the C library under libpqxx (non-blocking and pipeline API) */
+#include <libpq-fe.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Outcome of one asynchronous query
+ *
+ * Owns the PGresult (released with PQclear). When ok() is false, error()
+ * holds the message reported by the server or by libpq
+ */
+class AsyncResult {
+    public:
+        AsyncResult(PGresult* result, std::string error);
+
+        /** @brief True when the query succeeded */
+        bool ok() const;
+
+        /** @brief Error message, empty on success */
+        const std::string& error() const;
+
+        /** @brief Number of rows returned (0 for commands or failures) */
+        int rows() const;
+
+        /** @brief True if the field is NULL */
+        bool isNull(int row, int column) const;
+
+        /**
+         * @brief Raw value of a field, valid while this object lives: the text
+         * of the value, or its binary encoding in a binary format column
+         */
+        std::string_view value(int row, int column) const;
+
+        /**
+         * @brief int4/int8 field as a number, decoded straight from a binary
+         * format column or parsed from a text one
+         *
+         * Throws std::invalid_argument for another type or a malformed value
+         */
+        std::int64_t integer(int row, int column) const;
+
+        /**
+         * @brief numeric field in cents, decoded straight from a binary format
+         * column or parsed from a text one (see decodeNumericCents())
+         *
+         * Throws std::invalid_argument for another type or a malformed value
+         */
+        std::int64_t cents(int row, int column) const;
+
+    private:
+        struct Clear {
+            void operator()(PGresult* result) const { PQclear(result); }
+        };
+
+        std::unique_ptr<PGresult, Clear> result;
+        std::string message;
+};
+
+/**
+ * @brief Format the server sends the result fields of a statement in
+ *
+ * Binary skips printing the values on the server and parsing ASCII here,
+ * read its fields with AsyncResult::integer() and AsyncResult::cents()
+ */
+enum class ResultFormat {
+    Text   = 0,
+    Binary = 1
+};
+
+/**
+ * @class AsyncDBConnection
+ *
+ * @brief One libpq connection in non-blocking pipeline mode
+ *
+ * Queries are sent with PQsendQueryPrepared and complete through a callback,
+ * the calling thread never waits for the server. The connection socket is
+ * registered in the caller's EventLoop, the same epoll set as the client
+ * sockets, and results are read with PQconsumeInput when it is readable.
+ *
+ * Pipeline mode lets any number of queries be in flight on the connection.
+ * Each query is followed by its own sync point, so it runs in its own
+ * implicit transaction and a failing query never aborts its neighbours.
+ * Callbacks run on the loop thread, in the order the queries were sent.
+ *
+ * NOT thread safe: create and use it only from the thread running the loop.
+ */
+class AsyncDBConnection {
+    public:
+        using Callback = std::function<void(AsyncResult)>;
+
+        /**
+         * @brief Connects, switches to non-blocking pipeline mode and
+         * registers the socket in loop
+         *
+         * The connection handshake itself is blocking, it happens once at startup.
+         * Throws std::runtime_error if the connection fails
+         *
+         * @param conninfo libpq connection string (DBConnection::getConnectionString())
+         */
+        AsyncDBConnection(EventLoop& loop, const std::string& conninfo);
+
+        /**
+         * @brief Takes over a connection opened by open(), so the blocking
+         * handshake can happen on another thread (config reload)
+         *
+         * Closes connected and throws std::runtime_error if pipeline mode fails
+         */
+        AsyncDBConnection(EventLoop& loop, PGconn* connected);
+
+        /**
+         * @brief Blocking libpq handshake, the result is meant for the
+         * constructor above. Throws std::runtime_error if the connection fails
+         */
+        static PGconn* open(const std::string& conninfo);
+
+        /**
+         * @brief Unregisters the socket and closes the connection, queries
+         * still in flight complete with an error
+         */
+        ~AsyncDBConnection();
+
+        AsyncDBConnection(const AsyncDBConnection&) = delete;
+        AsyncDBConnection& operator=(const AsyncDBConnection&) = delete;
+
+        /**
+         * @brief Queues the creation of a prepared statement
+         *
+         * Pipelined like any query, statements prepared here can be used by
+         * queryPrepared() right away. A failure is logged
+         *
+         * @param results format every execution of the statement asks for
+         */
+        void prepare(const std::string& name, const std::string& sql,
+                     ResultFormat results = ResultFormat::Text);
+
+        /**
+         * @brief Sends a prepared statement with text parameters
+         *
+         * @param name statement given to prepare()
+         * @param params parameters in text format ($1, $2, ...)
+         * @param callback called once with the result, on the loop thread
+         * @param timeout statement_timeout and lock_timeout of this query
+         * only, set with set_config(..., true) in the same sync group: the
+         * server cancels it past the timeout (a DEADLINE request)
+         */
+        void queryPrepared(const std::string& name,
+                           const std::vector<std::string>& params,
+                           Callback callback,
+                           std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+        /**
+         * @brief Awaitable result of a query sent by query()
+         *
+         * The query is already on its way when this object is created, so
+         * several of them can be created first and awaited afterwards: their
+         * queries are pipelined on the connection
+         */
+        class Query {
+            public:
+                bool await_ready() const noexcept { return state->result.has_value(); }
+                void await_suspend(std::coroutine_handle<> handle) { state->waiting = handle; }
+                AsyncResult await_resume() { return std::move(*state->result); }
+
+            private:
+                friend class AsyncDBConnection;
+
+                struct State {
+                    std::optional<AsyncResult> result;
+                    std::coroutine_handle<> waiting;
+                };
+
+                /* shared with the completion callback, outlives an abandoned Query */
+                std::shared_ptr<State> state = std::make_shared<State>();
+        };
+
+        /**
+         * @brief Coroutine form of queryPrepared(): auto r = co_await db.query(...)
+         *
+         * The awaiting coroutine is resumed on the loop thread when the result
+         * arrives, failures are reported through AsyncResult::ok()
+         */
+        Query query(const std::string& name, const std::vector<std::string>& params,
+                    std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+        /**
+         * @brief Asks the server to cancel the query it is running (PQcancel),
+         * that query completes with an error. Does nothing once disconnected
+         */
+        void cancel();
+
+        /** @brief Queries sent and not completed yet */
+        std::size_t inFlight() const;
+
+        /** @brief False once the connection to the server was lost */
+        bool isConnected() const;
+
+    private:
+        /** @brief A query waiting for its results */
+        struct Pending {
+            Callback callback;
+            PGresult* result = nullptr;
+            std::string error;
+            /** @brief Results of statements sent ahead of the query (set_config) */
+            int skipResults = 0;
+        };
+
+        /** @brief Epoll handler of the connection socket */
+        void onEvents(std::uint32_t events);
+
+        /** @brief Sends the sync point of the last query and flushes */
+        void endQuery(Callback callback, int skipResults = 0);
+
+        /** @brief Reads every complete result available and runs callbacks */
+        void readResults();
+
+        /** @brief Writes buffered output, watches EPOLLOUT while some is left */
+        void flushOutput();
+
+        /** @brief Connection lost: every pending query fails with message */
+        void failAll(const std::string& message);
+
+        /** @brief Completes every pending query with message as error */
+        void failPending(const std::string& message);
+
+        EventLoop& loop;
+        PGconn* conn = nullptr;
+        int socket = -1;
+        bool broken = false;
+        bool watchingWrite = false;
+
+        std::deque<Pending> pending;
+
+        /** @brief Result format of each statement given to prepare() */
+        std::unordered_map<std::string, ResultFormat> resultFormats;
+};
+
+#endif
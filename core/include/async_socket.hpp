@@ -0,0 +1,73 @@
+/* Coroutine friendly non-blocking socket registered in an EventLoop */
+#ifndef ASYNC_SOCKET_HPP
+#define ASYNC_SOCKET_HPP
+
+#include "event_loop.hpp"
+#include "client_stream.hpp"
+
+#include <sys/types.h>
+
+#include <coroutine>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @class AsyncSocket
+ *
+ * @brief Owns a non-blocking socket, read() and write() suspend the calling
+ * coroutine until epoll reports the socket ready instead of blocking a thread
+ *
+ * Only one coroutine should read and one write at a time. Like the loop
+ * itself, an AsyncSocket is used only from the loop thread.
+ */
+class AsyncSocket : public ClientStream {
+    public:
+        /**
+         * @brief Registers fd (already non-blocking) in loop and takes ownership
+         */
+        AsyncSocket(EventLoop& loop, int fd);
+
+        /** @brief Unregisters and closes the socket */
+        ~AsyncSocket() override;
+
+        AsyncSocket(const AsyncSocket&) = delete;
+        AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+        /** @brief recv(), suspends while nothing is available */
+        Task<ssize_t> read(char* buffer, std::size_t size) override;
+
+        /** @brief send(), suspends while the socket buffer is full */
+        Task<bool> write(std::string_view data) override;
+
+        void shutdown() override;
+
+        /** @brief False after shutdown() or once an I/O error was seen */
+        bool isOpen() const;
+
+    private:
+        /** @brief Suspends until the socket is readable (or writable) */
+        struct Readiness {
+            AsyncSocket& socket;
+            bool writing;
+
+            bool await_ready() const noexcept { return socket.closed; }
+            void await_suspend(std::coroutine_handle<> handle);
+            void await_resume() const noexcept {}
+        };
+
+        /** @brief Epoll handler, resumes the coroutines waiting on fd */
+        void onEvents(std::uint32_t events);
+
+        /** @brief Watches EPOLLOUT only while a writer waits */
+        void watchWrite(bool enable);
+
+        EventLoop& loop;
+        int fd = -1;
+        bool closed = false;
+        bool watchingWrite = false;
+
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+};
+
+#endif
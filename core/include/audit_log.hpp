@@ -0,0 +1,172 @@
+/* Asynchronous audit trail: events queued by request threads, written to audit_logs in batches */
+#ifndef AUDIT_LOG_HPP
+#define AUDIT_LOG_HPP
+
+#include "bounded_queue.hpp"
+
+/* libpqxx */
+#include <pqxx/pqxx>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief What AuditLog::record() does when the queue is full
+ */
+enum class AuditOverflow {
+    Block,  // waits for the writer to make room, the request is slowed down
+    Drop,   // drops the event and counts it ("audit.events_dropped")
+    Spill   // appends it to a local file, copied to audit_logs once the database keeps up
+};
+
+/**
+ * @brief Audit pipeline settings, the "audit_*" keys of config/server.json
+ */
+struct AuditSettings {
+    /** @brief Events the queue holds ("audit_queue_capacity"), rounded up to a power of two */
+    std::size_t queueCapacity = 8192;
+
+    /** @brief How often the writer copies the queue to audit_logs ("audit_flush_interval_ms") */
+    std::chrono::milliseconds flushInterval{100};
+
+    /** @brief Max events per COPY ("audit_batch_size") */
+    std::size_t batchSize = 1024;
+
+    /** @brief "audit_overflow": "block", "drop" or "spill" */
+    AuditOverflow overflow = AuditOverflow::Drop;
+
+    /** @brief File of the spilled events ("audit_spill_path") */
+    std::string spillPath = "data/audit_spill.log";
+};
+
+/**
+ * @brief One audited operation, turned into an audit_logs row by the writer
+ *
+ * Only the fields that are set end up in details ("outcome=failed from=1
+ * to=2 amount=10.5 detail=...")
+ */
+struct AuditEvent {
+    std::chrono::system_clock::time_point time = std::chrono::system_clock::now();
+    std::string operation;      // audit_logs.operation: "transfer", "reload"
+    std::string outcome;        // "ok", "failed", "refused"
+    int         fromAccountID = 0;
+    int         toAccountID = 0;
+    double      amount = 0.0;
+    std::string detail;         // description or error message
+
+    /** @brief Event of a transfer attempt */
+    static AuditEvent transfer(int fromAccountID, int toAccountID, double amount,
+                               std::string outcome, std::string detail);
+
+    /** @brief Event of a RELOAD command */
+    static AuditEvent reload(std::string outcome);
+};
+
+/**
+ * @brief audit_logs row of event in COPY text format (log_timestamp in UTC,
+ * operation, details), tabs, newlines and backslashes escaped, no trailing newline
+ */
+std::string auditCopyLine(const AuditEvent& event);
+
+/**
+ * @class AuditLog
+ *
+ * @brief Keeps audit writes off the request path
+ *
+ * record() only moves the event into a lock-free BoundedQueue. A writer
+ * thread wakes every flushInterval, takes up to batchSize events and COPYs
+ * them to audit_logs in one transaction on its own connection. A batch that
+ * fails is kept and retried first, while the queue fills up behind it and
+ * the overflow policy applies. Spilled events are copied back from the file
+ * at the end of a cycle that emptied the queue.
+ *
+ * record() is a no-op until start(), so the services work without it
+ * (tests, tools)
+ */
+class AuditLog {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the audit log
+         */
+        static AuditLog& getInstance();
+
+        /** @brief Writes what is queued and stops the writer thread */
+        ~AuditLog();
+
+        /**
+         * @brief Starts the writer thread, no-op if running
+         *
+         * The queue is created by the first start(), its capacity stays for
+         * the life of the process
+         */
+        void start(const AuditSettings& settings);
+
+        /** @brief Writes what is still queued (one attempt) and joins the writer */
+        void stop();
+
+        /**
+         * @brief Queues event for audit_logs, never waits for the database
+         * (except with AuditOverflow::Block on a full queue)
+         */
+        void record(AuditEvent event);
+
+        /**
+         * @brief Writes one batch now (run by the writer thread)
+         *
+         * @return number of events written, 0 if the write failed
+         */
+        std::size_t flush();
+
+        /** @brief Events the queue currently holds */
+        std::size_t queued() const;
+
+    private:
+        AuditLog() = default;
+        AuditLog(const AuditLog&) = delete;
+        AuditLog& operator=(const AuditLog&) = delete;
+
+        void run();
+
+        /** @brief Appends a COPY line to the spill file, false if it cannot be written */
+        bool spill(const std::string& line);
+
+        /** @brief Copies the spill file to audit_logs, true when nothing is left */
+        bool replaySpill();
+
+        /**
+         * @brief COPYs the lines next() gives to audit_logs in one
+         * transaction, reconnecting first if needed
+         *
+         * @return false (logged, counted in "audit.write_failures") if nothing was written
+         */
+        bool copyLines(const std::function<bool(std::string&)>& next);
+
+        AuditSettings settings;
+        std::unique_ptr<BoundedQueue<AuditEvent>> queue;
+
+        std::atomic<bool> running{false};
+        std::thread writer;
+        std::mutex writerMutex;
+        std::condition_variable wakeWriter;
+        std::atomic<bool> flushRequested{false};
+
+        /** @brief Batch taken from the queue and not written yet (writer thread only) */
+        std::vector<std::string> batch;
+        std::unique_ptr<pqxx::connection> conn;
+        bool failing = false;
+
+        std::mutex spillMutex;
+        std::ofstream spillFile;
+        std::atomic<bool> spilled{false};
+};
+
+#endif
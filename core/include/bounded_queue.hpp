@@ -0,0 +1,111 @@
+/* Fixed capacity lock-free queue for many producers and consumers */
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @class BoundedQueue
+ *
+ * @brief Ring of cells each guarded by a sequence number (D. Vyukov's
+ * bounded MPMC queue)
+ *
+ * A producer claims a cell with one compare-and-swap on the enqueue
+ * position and publishes it by bumping the cell's sequence, a consumer does
+ * the same on the dequeue side. No lock, no allocation after construction,
+ * and a full queue is reported to the producer instead of making it wait,
+ * so the caller picks what happens on overflow.
+ *
+ * The capacity is rounded up to a power of two
+ */
+template <typename T>
+class BoundedQueue {
+    public:
+        explicit BoundedQueue(std::size_t capacity) {
+            std::size_t size = 2;
+            while (size < capacity) {
+                size *= 2;
+            }
+            mask = size - 1;
+            cells = std::make_unique<Cell[]>(size);
+            for (std::size_t i = 0; i < size; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        /** @brief Moves value in, false (value untouched) when the queue is full */
+        bool tryPush(T& value) {
+            std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[position & mask];
+                std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+
+                if (lag == 0) {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (lag < 0) {
+                    /* the cell still holds the value of the previous lap */
+                    return false;
+                } else {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /** @brief Moves the oldest value out, false when the queue is empty */
+        bool tryPop(T& value) {
+            std::size_t position = dequeuePosition.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& cell = cells[position & mask];
+                std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                auto lag = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+
+                if (lag == 0) {
+                    if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        value = std::move(cell.value);
+                        cell.sequence.store(position + mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (lag < 0) {
+                    return false;
+                } else {
+                    position = dequeuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /** @brief Number of cells */
+        std::size_t capacity() const { return mask + 1; }
+
+        /** @brief Values queued, exact only while nobody pushes or pops */
+        std::size_t sizeApprox() const {
+            std::size_t pushed = enqueuePosition.load(std::memory_order_relaxed);
+            std::size_t popped = dequeuePosition.load(std::memory_order_relaxed);
+            return pushed > popped ? pushed - popped : 0;
+        }
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence{0};
+            T value{};
+        };
+
+        std::unique_ptr<Cell[]> cells;
+        std::size_t mask = 0;
+
+        /* on their own cache lines, producers and the consumer do not share one */
+        alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+        alignas(64) std::atomic<std::size_t> dequeuePosition{0};
+};
+
+#endif
@@ -0,0 +1,87 @@
+/* Circuit breaker with exponential backoff, guards reconnects to the database */
+#ifndef CIRCUIT_BREAKER_HPP
+#define CIRCUIT_BREAKER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Tuning of a CircuitBreaker, read from the DB config
+ */
+struct BreakerSettings {
+    /**
+     * @brief Consecutive failed attempts before the circuit opens
+     * ("reconnect_failure_threshold"), below it the next request retries at once
+     */
+    int failureThreshold = 2;
+
+    /** @brief First open period ("reconnect_initial_backoff_ms"), doubled on every failed probe */
+    std::chrono::milliseconds initialBackoff{100};
+
+    /** @brief Longest open period ("reconnect_max_backoff_ms") */
+    std::chrono::milliseconds maxBackoff{10000};
+};
+
+/**
+ * @class CircuitBreaker
+ *
+ * @brief Decides when a failing resource (the primary DB connection) may be
+ * tried again
+ *
+ *   Closed   : attempts go through. failureThreshold failures in a row open it
+ *   Open     : attempts are refused (fail fast) until the backoff elapsed
+ *   HalfOpen : one caller probes, the others are still refused. Success
+ *              closes the circuit, failure opens it for twice as long
+ *
+ * Thread safe. Every transition counts "<name>.circuit.<state>" in Metrics,
+ * "<name>.circuit.state" is a gauge (0 closed, 1 open, 2 half open) and
+ * "<name>.circuit.rejected" counts refused attempts
+ */
+class CircuitBreaker {
+    public:
+        enum class State { Closed, Open, HalfOpen };
+
+        /** @param name metric prefix, "db" for the primary connection */
+        explicit CircuitBreaker(std::string name, BreakerSettings settings = BreakerSettings{});
+
+        /** @brief New tuning, applies from the next failure on */
+        void configure(const BreakerSettings& settings);
+
+        /**
+         * @brief Whether the caller may attempt now
+         *
+         * Moves Open to HalfOpen once the backoff elapsed and lets exactly one
+         * caller probe. The caller must report recordSuccess() or recordFailure()
+         */
+        bool allowAttempt();
+
+        /** @brief The attempt worked, the circuit closes */
+        void recordSuccess();
+
+        /** @brief The attempt failed, the circuit may open */
+        void recordFailure();
+
+        State state() const;
+
+        /** @brief Time left before the next probe, zero unless Open */
+        std::chrono::milliseconds retryIn() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        /** @brief Moves to next and records it, breakerMutex held */
+        void transition(State next);
+
+        std::string     name;
+        BreakerSettings settings;
+
+        mutable std::mutex        breakerMutex;
+        State                     current = State::Closed;
+        int                       consecutiveFailures = 0;
+        std::chrono::milliseconds backoff{0};
+        Clock::time_point         retryAt{};
+};
+
+#endif
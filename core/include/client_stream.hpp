@@ -0,0 +1,47 @@
+/* Byte stream of a client connection, as seen by the coroutine serving it */
+#ifndef CLIENT_STREAM_HPP
+#define CLIENT_STREAM_HPP
+
+#include "task.hpp"
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @class ClientStream
+ *
+ * @brief Awaitable reads and writes on a client connection
+ *
+ * Lets Server::serveClient() stay the same whatever delivers the bytes:
+ * AsyncSocket (epoll readiness + recv/send) or the io_uring socket
+ * (completions of multishot recv and send).
+ */
+class ClientStream {
+    public:
+        virtual ~ClientStream() = default;
+
+        /**
+         * @brief Receives up to size bytes, suspending until some arrive
+         *
+         * @return bytes read, 0 when the peer closed or shutdown() was called,
+         * negative on error
+         */
+        virtual Task<ssize_t> read(char* buffer, std::size_t size) = 0;
+
+        /**
+         * @brief Sends all of data, suspending until it was handed to the kernel
+         *
+         * @return false if the connection was closed before everything was sent
+         */
+        virtual Task<bool> write(std::string_view data) = 0;
+
+        /**
+         * @brief Shuts the connection down and wakes up any suspended read()
+         * or write(), which then report a closed connection
+         */
+        virtual void shutdown() = 0;
+};
+
+#endif
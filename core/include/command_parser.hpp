@@ -0,0 +1,75 @@
+/* Allocation free parsing of protocol command lines */
+#ifndef COMMAND_PARSER_HPP
+#define COMMAND_PARSER_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+/**
+ * @class CommandParser
+ *
+ * @brief Reads the words and numbers of a command line like a
+ * std::istringstream would, over a std::string_view
+ *
+ * Same semantics as the stream extractions it replaces: words are split on
+ * blanks, a number is read from the start of its word ("12abc" gives 12) and
+ * the first failure sticks, so "p >> a >> b; if (!p)" checks both
+ */
+class CommandParser {
+    public:
+        explicit CommandParser(std::string_view line) : rest(line) {}
+
+        /** @brief Next blank separated word, empty at the end of the line */
+        std::string_view word() {
+            std::size_t start = rest.find_first_not_of(" \t\r\n");
+            if (start == std::string_view::npos) {
+                rest = {};
+                return {};
+            }
+            rest.remove_prefix(start);
+
+            std::size_t end = std::min(rest.find_first_of(" \t\r\n"), rest.size());
+            std::string_view found = rest.substr(0, end);
+            rest.remove_prefix(end);
+            return found;
+        }
+
+        /** @brief What follows the words read so far, leading blanks skipped */
+        std::string_view remainder() {
+            std::size_t start = rest.find_first_not_of(" \t\r\n");
+            return start == std::string_view::npos ? std::string_view{} : rest.substr(start);
+        }
+
+        CommandParser& operator>>(std::string_view& value) {
+            value = word();
+            good = good && !value.empty();
+            return *this;
+        }
+
+        CommandParser& operator>>(int& value) { return number(value); }
+        CommandParser& operator>>(long long& value) { return number(value); }
+        CommandParser& operator>>(double& value) { return number(value); }
+
+        explicit operator bool() const { return good; }
+        bool operator!() const { return !good; }
+
+    private:
+        template <typename Number>
+        CommandParser& number(Number& value) {
+            std::string_view text = word();
+            /* operator>> takes a leading '+', from_chars does not */
+            if (text.size() > 1 && text.front() == '+') {
+                text.remove_prefix(1);
+            }
+            auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+            good = good && !text.empty() && result.ec == std::errc();
+            return *this;
+        }
+
+        std::string_view rest;
+        bool good = true;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/* Reloads the DB config on SIGHUP or RELOAD without stopping the server */
+#ifndef CONFIG_RELOADER_HPP
+#define CONFIG_RELOADER_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+class Server;
+
+/**
+ * @class ConfigReloader
+ *
+ * @brief Background thread applying a new db_credential.json while requests
+ * are being served
+ *
+ * A reload is requested by SIGHUP or by requestReload() (RELOAD command), and
+ * runs on this thread, never on a request thread:
+ *
+ *   1. DBConnection::reload() parses the file, opens the new primary
+ *      connection and, from its beforeSwap hook, the event loops' ones
+ *      (Server::openDatabase()), then hot-swaps the primary
+ *   2. the event loops get their new connections
+ *   3. ReplicaRouter::reload() swaps the replica list
+ *
+ * A bad file or an unreachable server is logged and changes nothing. Shards
+ * are not reloaded. Outcomes are counted in Metrics ("config.reload*") and
+ * recorded in the audit log
+ */
+class ConfigReloader {
+    public:
+        /**
+         * @param path DB config file, the one given to DBConnection::loadConfig()
+         * @param server its event loops follow the primary, may outlive start()/stop() only
+         */
+        ConfigReloader(std::string path, Server& server);
+
+        /** @brief Stops the thread if it is still running */
+        ~ConfigReloader();
+
+        /**
+         * @brief Blocks SIGHUP in the calling thread, so it is only received
+         * by the reloader. Call at the top of main(), before any thread exists
+         */
+        static void blockReloadSignal();
+
+        /** @brief Starts the thread, no-op if already running */
+        void start();
+
+        /** @brief Waits for the reload in progress, if any, and stops the thread */
+        void stop();
+
+        /** @brief Asks the thread for a reload, returns right away */
+        void requestReload();
+
+        /**
+         * @brief Runs one reload on the calling thread (used by the thread)
+         *
+         * @return false if it failed, nothing changed then
+         */
+        bool reload();
+
+    private:
+        /** @brief Loop run by the background thread */
+        void run();
+
+        std::string configPath;
+        Server&     server;
+
+        std::atomic<bool> reloadRequested{false};
+        std::atomic<bool> running{false};
+        std::thread       reloaderThread;
+};
+
+#endif
@@ -0,0 +1,221 @@
+/* Connection cap, idle and read timeouts of the client connections */
+#ifndef CONNECTION_TRACKER_HPP
+#define CONNECTION_TRACKER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class TimerWheel
+ *
+ * @brief Hashed timing wheel: timers land in the slot of their tick, so
+ * scheduling and cancelling are O(1) and advancing only looks at the slots
+ * of the ticks that passed
+ *
+ * A timer due more than one revolution ahead stays in its slot until its
+ * tick comes around. Timers fire at most one tick late. Not thread safe
+ */
+class TimerWheel {
+    public:
+        using Clock    = std::chrono::steady_clock;
+        using TimerID  = std::uint64_t;
+        using Callback = std::function<void()>;
+
+        /**
+         * @param tick resolution of the wheel
+         * @param slots number of ticks in one revolution
+         */
+        explicit TimerWheel(std::chrono::milliseconds tick, std::size_t slots = 512,
+                            Clock::time_point now = Clock::now());
+
+        /**
+         * @brief Runs callback from the first advance() at or past when
+         *
+         * @return id for cancel(), never 0
+         */
+        TimerID schedule(Clock::time_point when, Callback callback);
+
+        /** @brief Forgets a timer, false if it already fired or was cancelled */
+        bool cancel(TimerID id);
+
+        /**
+         * @brief Fires every timer due at now, in no particular order
+         *
+         * Callbacks run after the wheel was updated, they may schedule and
+         * cancel timers
+         *
+         * @return number of timers fired
+         */
+        std::size_t advance(Clock::time_point now);
+
+        /** @brief Timers scheduled and not fired yet */
+        std::size_t size() const { return timers.size(); }
+
+    private:
+        struct Timer {
+            TimerID       id;
+            std::uint64_t dueTick;
+            Callback      callback;
+        };
+
+        using Slot = std::list<Timer>;
+
+        /** @brief First tick at or after when */
+        std::uint64_t tickOf(Clock::time_point when) const;
+
+        std::chrono::milliseconds tick;
+        Clock::time_point         origin;
+
+        /** @brief Last tick advance() went through */
+        std::uint64_t currentTick = 0;
+
+        std::vector<Slot> slots;
+
+        /** @brief Where each pending timer is, for cancel() */
+        std::unordered_map<TimerID, std::pair<std::size_t, Slot::iterator>> timers;
+
+        TimerID nextID = 1;
+};
+
+/**
+ * @brief How long client connections may stay, 0 disables a limit
+ */
+struct ConnectionLimits {
+    /** @brief Open connections, past it new ones evict an idle one or are refused */
+    std::size_t maxConnections = 0;
+
+    /** @brief Time a connection may wait between two commands */
+    std::chrono::milliseconds idleTimeout{0};
+
+    /** @brief Time to receive the rest of a command once its first bytes arrived */
+    std::chrono::milliseconds readTimeout{0};
+
+    /** @brief Idle time from which a connection may be evicted for a new one */
+    std::chrono::milliseconds evictIdleAfter{1000};
+
+    bool timeouts() const { return idleTimeout.count() > 0 || readTimeout.count() > 0; }
+};
+
+/**
+ * @class ConnectionTracker
+ *
+ * @brief Knows what every client connection is doing and closes the ones
+ * that overstay
+ *
+ * Whoever serves a connection reports its state: idle (waiting for the next
+ * command), reading (part of a command received) or busy (a request is
+ * running, no timer). Each state change reschedules the connection's timer
+ * in a TimerWheel, advanced by a thread every tick.
+ *
+ * Closing is left to the close callback given to open(), which must only
+ * wake the server up (shutdown() of the socket): the connection stays tracked
+ * until its server calls close(). Thread safe, callbacks run under the
+ * tracker's lock and must not call it back
+ */
+class ConnectionTracker {
+    public:
+        using Clock        = TimerWheel::Clock;
+        using ConnectionID = std::uint64_t;
+        using CloseHandler = std::function<void(ConnectionID)>;
+
+        explicit ConnectionTracker(ConnectionLimits limits);
+
+        /** @brief Stops the timer thread */
+        ~ConnectionTracker();
+
+        /** @brief Starts the timer thread, no-op without timeouts */
+        void start();
+
+        /** @brief Stops the timer thread, connections stay tracked */
+        void stop();
+
+        /**
+         * @brief Tracks a new connection, idle
+         *
+         * At maxConnections the connection idle the longest is evicted if it
+         * has been idle for evictIdleAfter, otherwise the new one is refused
+         *
+         * @return id of the connection, 0 if refused
+         */
+        ConnectionID open(CloseHandler close);
+
+        /** @brief Forgets a connection, before its socket is closed */
+        void close(ConnectionID id);
+
+        /** @brief Waiting for the next command, idleTimeout applies */
+        void idle(ConnectionID id);
+
+        /** @brief Part of a command received, readTimeout applies */
+        void reading(ConnectionID id);
+
+        /** @brief A request is running, no timeout */
+        void busy(ConnectionID id);
+
+        /** @brief Connections tracked and not being closed */
+        std::size_t active() const;
+
+        /** @brief Connections waiting for their next command */
+        std::size_t idleCount() const;
+
+        /**
+         * @brief Closes the connections whose timeout passed at now (run by
+         * the timer thread)
+         *
+         * @return number of connections closed
+         */
+        std::size_t expire(Clock::time_point now = Clock::now());
+
+        const ConnectionLimits& limits() const { return settings; }
+
+    private:
+        enum class State { Idle, Reading, Busy, Closing };
+
+        struct Connection {
+            CloseHandler          close;
+            State                 state = State::Idle;
+            TimerWheel::TimerID   timer = 0;
+            Clock::time_point     idleSince;
+            std::list<ConnectionID>::iterator idlePosition;
+        };
+
+        /** @brief Resolution of the timeouts */
+        static constexpr std::chrono::milliseconds TICK{100};
+
+        /** @brief Moves a connection to state, under trackerMutex */
+        void enter(ConnectionID id, State state, Clock::time_point now);
+
+        /** @brief Calls the close callback of a connection, under trackerMutex */
+        void shut(ConnectionID id, const char* metric);
+
+        /** @brief Loop run by the timer thread */
+        void run();
+
+        ConnectionLimits settings;
+
+        mutable std::mutex trackerMutex;
+        TimerWheel         wheel;
+
+        std::unordered_map<ConnectionID, Connection> connections;
+
+        /** @brief Idle connections, the one idle the longest first */
+        std::list<ConnectionID> idleOrder;
+
+        /** @brief Connections shut but not closed by their server yet */
+        std::size_t closing = 0;
+
+        ConnectionID nextID = 1;
+
+        std::condition_variable stopRequested;
+        bool                    running = false;
+        std::thread             timerThread;
+};
+
+#endif
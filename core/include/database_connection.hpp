@@ -10,10 +10,94 @@
 #include <sstream>
 /* handles file stream */
 #include <fstream>
+
+/* reload() hook */
+#include <functional>
+
 /* Error handling library */
 #include <stdexcept>
 /* to use std::mutex */
 #include <mutex>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+#include "circuit_breaker.hpp"
+#include "fair_queue.hpp"
+#include "request_deadline.hpp"
+
+/**
+ * @brief Streaming replicas listed under "read_replicas" in the DB config,
+ * used by ReplicaRouter
+ */
+struct ReplicaSettings {
+    /** @brief One libpq connection string per replica */
+    std::vector<std::string> connectionStrings;
+
+    /** @brief Replicas lagging more than this are skipped ("replica_max_lag_ms") */
+    std::chrono::milliseconds maxLag{1000};
+
+    /** @brief Period of the health and lag checks ("replica_check_interval_ms") */
+    std::chrono::milliseconds checkInterval{1000};
+
+    /**
+     * @brief Serve BALANCE from replicas too ("balance_on_replica"), off by
+     * default so a balance read right after a transfer always sees it
+     */
+    bool balanceOnReplica = false;
+};
+
+/**
+ * @brief How account ids are spread between shards
+ */
+enum class ShardPlacement {
+    /** @brief hash(account_id) modulo the number of shards */
+    Hash,
+    /** @brief Contiguous account_id ranges, see ShardSettings::rangeBounds */
+    Range
+};
+
+/**
+ * @brief Shards listed under "shards" in the DB config, used by
+ * ShardCoordinator. Every shard holds the full schema and its own accounts
+ */
+struct ShardSettings {
+    /** @brief One libpq connection string per shard, in shard order */
+    std::vector<std::string> connectionStrings;
+
+    /** @brief "shard_placement": "hash" (default) or "range" */
+    ShardPlacement placement = ShardPlacement::Hash;
+
+    /**
+     * @brief "shard_ranges", Range placement only: ascending exclusive upper
+     * bounds, one less than the number of shards. account_id < rangeBounds[0]
+     * lives on shard 0, the last shard takes everything above the last bound
+     */
+    std::vector<int> rangeBounds;
+
+    /**
+     * @brief Decisions of cross shard transfers ("shard_recovery_log"), read
+     * back to settle prepared transactions left behind by a crash
+     */
+    std::string recoveryLogPath = "data/shard_recovery.log";
+
+    /**
+     * @brief Names this server in the gids it prepares ("shard_node_id",
+     * letters and digits). recover() only settles the gids of its own node,
+     * so every server sharing the shards needs its own id and recovery log,
+     * kept across restarts
+     */
+    std::string nodeID = "node0";
+};
+
+/**
+ * @brief Thrown instead of touching the primary while its circuit is open,
+ * the request can be retried later (the server answers "ERROR RETRY ...")
+ */
+class DatabaseUnavailable : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
 
 /**
  * @class db_connection
@@ -49,6 +133,25 @@ public:
      * or contains invalid fields. */
     void loadConfig(const std::string& path);
 
+    /**
+     * @brief Reloads the JSON file while requests are being served
+     *
+     * The file is parsed aside, and when the primary's endpoint or
+     * credentials changed a new connection is opened before anything is
+     * touched: a bad file or an unreachable server throws std::runtime_error
+     * and leaves the running configuration as it was. The new connection is
+     * then swapped in under lock(), so the query in flight finishes on the
+     * old one, which is closed right after. Replica settings are replaced,
+     * shard changes are ignored (they need a restart)
+     *
+     * @param beforeSwap called with the new connection string when the
+     * primary changed, after the handshake and before the swap: connections
+     * of other components open there, and a throw still changes nothing
+     * @return true when the primary connection was replaced
+     */
+    bool reload(const std::string& path,
+                const std::function<void(const std::string& conninfo)>& beforeSwap = {});
+
     /**
      * @brief Function to stabilish a connection to the database
      *  
@@ -65,15 +168,33 @@ public:
 
     /**
      * @brief Get the Connection object (pqxx::connection object)
-     * 
+     *
+     * A connection that broke (server restart, network) is reopened here,
+     * transparently for the caller. A server that went away since the last
+     * statement is noticed without a round trip (the EOF already sitting on
+     * the socket). Only one thread reconnects: the ones queued for lock() are
+     * sent away and newcomers are refused with DatabaseUnavailable while it
+     * does, instead of waiting up to connect_timeout behind it. Failed
+     * reopens open a circuit breaker: while it is open no socket is touched
+     * and DatabaseUnavailable is thrown right away (by lock() already), then
+     * one caller probes after an exponential backoff. A statement that
+     * started on the broken connection is not retried, its caller gets
+     * pqxx::broken_connection as before
+     *
+     * Throws std::runtime_error if connect() never succeeded
      * @return reference to object, pqxx::connection& 
      */
     pqxx::connection& getConnection();
 
+    /** @brief State of the primary's circuit breaker, see getConnection() */
+    CircuitBreaker::State circuitState() const;
+
     /**
      * @brief Create a Write Transaction object (pqxx::work)
      * 
-     * This function will be used for INSERT, UPDATE, DELETE operations
+     * This function will be used for INSERT, UPDATE, DELETE operations.
+     * A BEGIN that finds the connection broken is sent again, once, on a
+     * reopened connection (same for createReadTransaction())
      *
      * @return std::unique_ptr<pqxx::work> 
      */
@@ -88,14 +209,101 @@ public:
      */
     std::unique_ptr<pqxx::read_transaction> createReadTransaction();
 
+    /**
+     * @brief Create an autocommit "transaction" (pqxx::nontransaction)
+     *
+     * No BEGIN/COMMIT is sent, so a single SELECT costs one round trip instead
+     * of three. Only for statements that are atomic on their own (one query),
+     * or for pqxx::pipeline batches of independent reads.
+     *
+     * Under a RequestDeadline it is a pqxx::work instead, SET LOCAL timeouts
+     * need a transaction block
+     * @return std::unique_ptr<pqxx::transaction_base>
+     */
+    std::unique_ptr<pqxx::transaction_base> createAutocommitTransaction();
+
+    /**
+     * @brief Open a new connection with the loaded configuration
+     *
+     * The returned connection is NOT the shared one and does not need lock().
+     * Meant for background jobs (loaders, snapshot writers) that run long
+     * queries and must not block request handling on the shared connection
+     *
+     * Returns an error std::runtime_error iff the connection fails
+     * @return std::unique_ptr<pqxx::connection>
+     */
+    std::unique_ptr<pqxx::connection> openDedicatedConnection() const;
+
+    /**
+     * @brief libpq connection string built by loadConfig()
+     *
+     * Used by components that drive libpq directly, like AsyncDBConnection
+     * @return const std::string&
+     */
+    std::string getConnectionString() const;
+
+    /**
+     * @brief Read replicas loaded by loadConfig(), empty when none is configured
+     *
+     * Each entry of "read_replicas" overrides the primary's fields it names
+     * (usually host and port), the others are inherited
+     */
+    ReplicaSettings getReplicaSettings() const;
+
+    /**
+     * @brief Shards loaded by loadConfig(), empty when the database is not sharded
+     *
+     * Like replicas, each entry of "shards" only names the fields that differ
+     * from the primary. Throws std::runtime_error from loadConfig() on an
+     * unknown placement or inconsistent ranges
+     */
+    ShardSettings getShardSettings() const;
+
+    /**
+     * @brief Ask the server to cancel the query running on the shared connection
+     *
+     * Safe to call from any thread WITHOUT holding lock(): the holder of the
+     * lock gets a pqxx::sql_error and rolls back. Does nothing if not connected
+     */
+    void cancelQuery();
+
+    /**
+     * @brief cancelQuery() if the lock is still held by the acquisition
+     * numbered generation (or was not taken again since), see DeadlineWatchdog
+     *
+     * @return true if a cancel request was sent
+     */
+    bool cancelQueryOf(std::uint64_t generation);
+
     /**
      * @brief Acquire a scoped lock for DB operations in multithreaded contexts
      *
      * Any code path that uses the shared pqxx::connection from multiple threads
      * should hold this lock to avoid concurrent access
+     *
+     * Waiting threads get the lock in weighted fair order of their
+     * RequestClass (see FairQueue), not in whatever order the mutex picks, so
+     * a bulk client cannot starve interactive ones
+     *
+     * Under a RequestDeadline, throws DeadlineExceeded instead of waiting past
+     * it, and the query is cancelled if the lock is still held at the deadline.
+     * Between closeLock() and reopenLock() throws DatabaseUnavailable
      */
     std::unique_lock<std::mutex> lock();
 
+    /**
+     * @brief Refuses the lock to waiters and newcomers alike (lock() throws
+     * DatabaseUnavailable), used when Server::stop() runs out of drain time so
+     * only the query already running is left to cancel
+     */
+    void closeLock();
+
+    /** @brief Hands the lock out again after closeLock() */
+    void reopenLock();
+
+    /** @brief Shares of the lock between interactive and bulk requests, see lock() */
+    void setLockWeights(unsigned interactive, unsigned bulk);
+
 private:
     /**
      * @brief Private constructor for Singleton pattern.
@@ -118,6 +326,38 @@ private:
      */
     DBConnection& operator=(const DBConnection&) = delete;
 
+    /** @brief Body of loadConfig(), also used by reload() on a staging instance */
+    void parse(const std::string& path);
+
+    /**
+     * @brief Replaces a broken conn when the breaker allows it, lock() held
+     *
+     * Throws DatabaseUnavailable when refused or when the attempt failed
+     */
+    void reconnect();
+
+    /**
+     * @brief Opens a replacement connection if the breaker allows an attempt
+     * and no other thread is already probing, after sending the waiters of
+     * lock() away
+     *
+     * Throws DatabaseUnavailable otherwise, or when the connect failed
+     */
+    std::unique_ptr<pqxx::connection> probe();
+
+    /**
+     * @brief Builds a transaction on the shared connection, again on a
+     * reopened one if its BEGIN found the connection broken
+     */
+    template <typename Transaction>
+    std::unique_ptr<Transaction> beginTransaction();
+
+    /** @brief The shared connection was found broken, the next user reconnects */
+    std::atomic<bool> broken{false};
+
+    /** @brief Set by the thread reconnecting, see probe() */
+    std::atomic<bool> probing{false};
+
     /**
      * @brief Constructed PostgreSQL connection string in libpq format
      * 
@@ -154,7 +394,37 @@ private:
     /** @brief Timeout (seconds) for connection attempt */
     int connect_timeout = 5;
 
+    /** @brief Read replicas, see getReplicaSettings() */
+    ReplicaSettings replicaSettings;
+
+    /** @brief Shards, see getShardSettings() */
+    ShardSettings shardSettings;
+
+    /** @brief "reconnect_*" fields of the config, applied to breaker */
+    BreakerSettings breakerSettings;
+
+    /** @brief Guards reconnects of the primary, see getConnection() */
+    CircuitBreaker breaker{"db"};
+
     mutable std::mutex dbMutex;
+
+    /** @brief Orders the threads waiting for dbMutex, see lock() */
+    FairQueue lockQueue;
+
+    /** @brief Numbers lock() acquisitions, so a late cancel can tell the holder changed */
+    std::uint64_t lockGeneration = 0;
+
+    /** @brief Guards lockGeneration and conn against cancelling threads */
+    std::mutex cancelMutex;
+
+    /** @brief Body of cancelQuery(), cancelMutex held */
+    void cancelRunningQuery();
+
+    /**
+     * @brief Guards the configuration fields against reload(), held briefly
+     * by the getters (dbMutex may be held for a whole transaction)
+     */
+    mutable std::mutex configMutex;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+/* Minimal epoll based event loop shared by client and database sockets */
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class EventLoop
+ *
+ * @brief Single threaded reactor around one epoll instance
+ *
+ * File descriptors are registered with a handler that receives the epoll
+ * event mask. Everything registered on a loop (client sockets, listening
+ * sockets, libpq sockets) is served by the thread that calls run(), so
+ * handlers never need locks between themselves.
+ *
+ * Only post() and stop() may be called from other threads.
+ */
+class EventLoop {
+    public:
+        using Handler = std::function<void(std::uint32_t events)>;
+
+        /**
+         * @brief Creates the epoll instance and the wake up eventfd
+         *
+         * Throws std::runtime_error if any of them cannot be created
+         */
+        EventLoop();
+
+        /** @brief Closes the epoll instance and the eventfd */
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        /**
+         * @brief Starts watching fd for events (EPOLLIN, EPOLLOUT, ...)
+         *
+         * Throws std::runtime_error if epoll_ctl fails
+         */
+        void add(int fd, std::uint32_t events, Handler handler);
+
+        /** @brief Changes the events watched for fd */
+        void modify(int fd, std::uint32_t events);
+
+        /**
+         * @brief Stops watching fd, does NOT close it
+         *
+         * Safe to call from inside a handler, including the handler of fd
+         */
+        void remove(int fd);
+
+        /**
+         * @brief Runs task on the loop thread (thread safe)
+         */
+        void post(std::function<void()> task);
+
+        /**
+         * @brief Dispatches events until stop() is called
+         */
+        void run();
+
+        /**
+         * @brief One iteration of run(): waits up to timeoutMs (-1 forever) for
+         * events, dispatches them, then runs the posted tasks
+         *
+         * For drivers that wait on fd() themselves (the io_uring backend polls
+         * it from its ring) and call poll(0) when it becomes readable
+         */
+        void poll(int timeoutMs);
+
+        /** @brief Makes run() return after the current iteration (thread safe) */
+        void stop();
+
+        /** @brief True once stop() was called */
+        bool isStopped() const;
+
+        /** @brief The epoll descriptor, readable whenever poll() has work to do */
+        int fd() const;
+
+        /** @brief True when called from the thread executing run() */
+        bool inLoopThread() const;
+
+    private:
+        /** @brief Runs every task queued by post() */
+        void runPostedTasks();
+
+        int epollFd = -1;
+
+        /** @brief eventfd written by post() and stop() to wake epoll_wait up */
+        int wakeFd = -1;
+
+        /** @brief Handlers by fd, shared_ptr so a handler survives its own remove() */
+        std::unordered_map<int, std::shared_ptr<Handler>> handlers;
+
+        std::mutex tasksMutex;
+        std::vector<std::function<void()>> tasks;
+
+        std::atomic<bool> stopRequested{false};
+        std::atomic<std::thread::id> loopThread{};
+};
+
+#endif
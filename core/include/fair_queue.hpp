@@ -0,0 +1,119 @@
+/* Weighted fair ordering of the threads waiting for the shared DB connection */
+#ifndef FAIR_QUEUE_HPP
+#define FAIR_QUEUE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief Scheduling class of the request running on a thread
+ */
+enum class RequestClass {
+    /** @brief Single commands of interactive clients (BALANCE, TRANSFER) */
+    Interactive = 0,
+    /** @brief Big pipelined batches and background jobs */
+    Bulk = 1
+};
+
+/**
+ * @class RequestClassScope
+ *
+ * @brief Tags the calling thread with a RequestClass until it goes out of
+ * scope. Untagged threads are Interactive
+ */
+class RequestClassScope {
+    public:
+        explicit RequestClassScope(RequestClass requestClass);
+        ~RequestClassScope();
+
+        RequestClassScope(const RequestClassScope&) = delete;
+        RequestClassScope& operator=(const RequestClassScope&) = delete;
+
+        /** @brief Class of the calling thread */
+        static RequestClass current();
+
+    private:
+        RequestClass previous;
+};
+
+/**
+ * @class FairQueue
+ *
+ * @brief Decides which waiting thread goes next, by start time fair queueing
+ *
+ * Each arrival gets a virtual start tag, max(virtual time, end of the
+ * previous arrival of its class), and its class advances by 1 / weight. The
+ * smallest start tag is served first. With weights 4 and 1, four interactive
+ * requests go through for every bulk one while both are queued, and a lone
+ * class gets everything. Within a class order is FIFO
+ *
+ * One thread at a time holds the turn, between enter() and leave()
+ */
+class FairQueue {
+    public:
+        FairQueue() = default;
+
+        /** @brief Relative shares of the two classes, both at least 1 */
+        void setWeights(unsigned interactive, unsigned bulk);
+
+        /**
+         * @brief Blocks until the calling thread has the turn
+         *
+         * @param deadline gives up waiting then
+         * @return false if the deadline passed first or the queue is closed,
+         * the caller does not have the turn
+         */
+        bool enter(RequestClass requestClass,
+                   std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt);
+
+        /** @brief Gives the turn to the next waiter, if any */
+        void leave();
+
+        /**
+         * @brief Sends every waiter away (enter() returns false) and refuses
+         * new ones until reopen(). The thread holding the turn keeps it
+         */
+        void close();
+
+        /**
+         * @brief Sends the threads waiting right now away (enter() returns
+         * false), later arrivals queue as usual
+         */
+        void dismissWaiters();
+
+        /** @brief Takes waiters again after close() */
+        void reopen();
+
+        /** @brief True between close() and reopen() */
+        bool isClosed() const;
+
+    private:
+        /** @brief A thread blocked in enter() */
+        struct Waiter {
+            std::condition_variable wakeUp;
+            bool                    admitted = false;
+            bool                    dismissed = false;
+        };
+
+        /** @brief Hands the turn to the smallest start tag, queueMutex held */
+        void admitNext();
+
+        mutable std::mutex queueMutex;
+
+        /** @brief (start tag, arrival number) -> waiter, smallest first */
+        std::map<std::pair<double, std::uint64_t>, Waiter*> waiting;
+
+        std::uint64_t arrivals = 0;
+        double        virtualTime = 0;
+        double        lastFinish[2] = {0, 0};
+        unsigned      weights[2] = {4, 1};
+        bool          busy = false;
+        bool          closed = false;
+};
+
+#endif
@@ -0,0 +1,56 @@
+/* Process wide counters and gauges exposed for monitoring */
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @class Metrics
+ *
+ * @brief Singleton registry of named 64-bit metrics
+ *
+ * A metric is created the first time its name is used and lives until the
+ * process exits, so the reference returned by get() can be cached (e.g. in a
+ * function local static) and updated without any lookup or lock on hot paths
+ *
+ * Names are dotted, prefixed with the module: "server.drain_ms"
+ */
+class Metrics {
+public:
+    /**
+     * @brief Retrieve the unique (global) singleton instance of the registry
+     */
+    static Metrics& getInstance();
+
+    /**
+     * @brief Get (or create with value 0) the metric called name
+     */
+    std::atomic<std::int64_t>& get(const std::string& name);
+
+    /** @brief Adds delta to a counter */
+    void increment(const std::string& name, std::int64_t delta = 1);
+
+    /** @brief Overwrites the value of a gauge */
+    void set(const std::string& name, std::int64_t value);
+
+    /**
+     * @brief Copy of every metric, sorted by name
+     */
+    std::map<std::string, std::int64_t> snapshot() const;
+
+private:
+    Metrics() = default;
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /** @brief std::map nodes never move, references stay valid */
+    std::map<std::string, std::atomic<std::int64_t>> values;
+
+    mutable std::mutex metricsMutex;
+};
+
+#endif
@@ -0,0 +1,126 @@
+/* Nets high frequency transfers between internal accounts before they hit the DB */
+#ifndef NETTING_SERVICE_HPP
+#define NETTING_SERVICE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class NettingService
+ *
+ * @brief Batches transfers between internal accounts (table internal_accounts)
+ * and applies one net transfer per account pair
+ *
+ * transfer() queues the request and blocks until the flush holding it has
+ * committed. The flusher thread waits for the first request, lets more of them
+ * accumulate for the netting window (less if maxBatch requests are queued),
+ * then, in one DB transaction:
+ *
+ *   1. applies the net amount of each pair with applyTransferBalances(), in
+ *      its own savepoint: a pair without funds is rejected, the others go on
+ *   2. COPYs every individual transfer of the accepted pairs to transactions
+ *      (status 'netted'), so the ledger is the same as without netting
+ *
+ * A→B 10 followed by B→A 9 locks the two rows once and moves 1. Funds are
+ * checked on the net amount: transfers of a window may lean on each other
+ */
+class NettingService {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the service
+         */
+        static NettingService& getInstance();
+
+        /** @brief Flushes what is queued and stops the flusher thread */
+        ~NettingService();
+
+        /**
+         * @brief Loads the internal accounts and starts the flusher thread
+         *
+         * No-op if running, if there is no internal account or if the
+         * database is sharded (cross shard pairs cannot be netted in one
+         * transaction). stop() then start() picks up new internal accounts
+         *
+         * @param window how long transfers accumulate before a flush
+         * @param maxBatch queued transfers that trigger a flush right away
+         */
+        void start(std::chrono::milliseconds window, std::size_t maxBatch = 1024);
+
+        /** @brief Flushes what is queued and waits for the flusher thread */
+        void stop();
+
+        /** @brief true when transfer() would net this transfer */
+        bool eligible(int fromAccountID, int toAccountID) const;
+
+        /**
+         * @brief Queues a transfer and waits until its flush committed
+         *
+         * Throws std::runtime_error("Transfer failed: ...") like
+         * TransactionService::transfer(), in which case nothing was recorded.
+         * DatabaseUnavailable of the flush (circuit open, closeLock()) comes
+         * through as is, the transfer can be retried.
+         *
+         * Under a RequestDeadline, a transfer no flush has taken yet when the
+         * deadline passes is withdrawn and DeadlineExceeded thrown. Once the
+         * flush holding the database has taken it, its outcome is awaited
+         */
+        void transfer(int fromAccountID, int toAccountID, double amount, const std::string& description);
+
+        /**
+         * @brief Applies the queued transfers now (run by the flusher thread)
+         *
+         * @return number of transfers committed
+         */
+        std::size_t flush();
+
+    private:
+        NettingService() = default;
+        NettingService(const NettingService&) = delete;
+        NettingService& operator=(const NettingService&) = delete;
+
+        /**
+         * @brief Decided once, by the flush taking the transfer or by its
+         * caller's deadline withdrawing it
+         */
+        enum class Claim { Queued, Taken, Withdrawn };
+
+        /** @brief One queued transfer, amounts in cents so nets are exact */
+        struct PendingTransfer {
+            int                 fromAccountID;
+            int                 toAccountID;
+            std::int64_t        cents;
+            std::string         description;
+            std::promise<void>  done;
+            std::shared_ptr<std::atomic<Claim>> claim;
+        };
+
+        /** @brief Loop run by the flusher thread */
+        void run();
+
+        /** @brief Internal account -> currency, only written while stopped */
+        std::unordered_map<int, std::string> internalAccounts;
+
+        std::chrono::milliseconds window{5};
+        std::size_t               maxBatch = 1024;
+
+        std::mutex                   pendingMutex;
+        std::condition_variable      pendingChanged;
+        std::vector<PendingTransfer> pending;
+
+        /** @brief One flush at a time (flusher thread, stop(), tests) */
+        std::mutex flushMutex;
+
+        std::atomic<bool> running{false};
+        std::thread       flusherThread;
+};
+
+#endif
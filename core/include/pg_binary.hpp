@@ -0,0 +1,41 @@
+/* Decoders for PostgreSQL binary result fields (int4, int8, numeric) */
+#ifndef PG_BINARY_HPP
+#define PG_BINARY_HPP
+
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Type OIDs of the columns decoded here (pg_type.oid, fixed by PostgreSQL)
+ */
+constexpr std::uint32_t INT8_OID    = 20;
+constexpr std::uint32_t INT4_OID    = 23;
+constexpr std::uint32_t NUMERIC_OID = 1700;
+
+/**
+ * @brief Decodes an int4 field sent in binary format (4 bytes, big endian)
+ *
+ * Throws std::invalid_argument if the field is not 4 bytes long
+ */
+std::int32_t decodeInt4(std::string_view field);
+
+/**
+ * @brief Decodes an int8 field sent in binary format (8 bytes, big endian)
+ *
+ * Throws std::invalid_argument if the field is not 8 bytes long
+ */
+std::int64_t decodeInt8(std::string_view field);
+
+/**
+ * @brief Decodes a numeric field sent in binary format into cents
+ *
+ * The wire format is a header of four int16 (ndigits, weight, sign, dscale)
+ * followed by ndigits base 10000 digits, the first one worth
+ * 10000^weight. Like parseCents(), digits past the second decimal are dropped.
+ *
+ * Throws std::invalid_argument for a malformed field, NaN or infinity, and
+ * std::out_of_range if the value does not fit in 64-bit cents
+ */
+std::int64_t decodeNumericCents(std::string_view field);
+
+#endif
@@ -0,0 +1,117 @@
+/* Token bucket limits on the commands of each connection and each client address */
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Sustained rate and burst of a token bucket, in commands
+ */
+struct RateLimit {
+    /** @brief Tokens added per second, 0 disables the limit */
+    double perSecond = 0;
+
+    /** @brief Bucket capacity, commands a quiet client may send at once */
+    double burst = 0;
+
+    bool enabled() const { return perSecond > 0; }
+};
+
+/**
+ * @class TokenBucket
+ *
+ * @brief One token per command, refilled at limit.perSecond up to limit.burst.
+ * Not thread safe
+ */
+class TokenBucket {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit TokenBucket(RateLimit limit = RateLimit{}, Clock::time_point now = Clock::now());
+
+        /**
+         * @brief Takes up to wanted tokens
+         *
+         * @return tokens taken, wanted when the limit is disabled
+         */
+        std::size_t take(std::size_t wanted, Clock::time_point now);
+
+        /** @brief Gives back tokens taken but not used */
+        void refund(std::size_t count);
+
+        /** @brief Time until one token is available, zero if one is */
+        std::chrono::milliseconds waitTime(Clock::time_point now);
+
+        /** @brief Refilled to the brim, the bucket can be forgotten */
+        bool full(Clock::time_point now) const;
+
+    private:
+        void refill(Clock::time_point now);
+
+        RateLimit         limit;
+        double            tokens;
+        Clock::time_point last;
+};
+
+/**
+ * @class RateLimiter
+ *
+ * @brief Admits the commands of a client while both its connection bucket
+ * and the bucket of its address have tokens
+ *
+ * Connection buckets live in Client, owned by whoever serves the connection.
+ * Address buckets are shared by all the connections of an address and kept
+ * here, so reconnecting does not reset them. Thread safe
+ */
+class RateLimiter {
+    public:
+        /** @brief Limits of one connection, created by client() */
+        class Client {
+            public:
+                Client() = default;
+
+            private:
+                friend class RateLimiter;
+
+                TokenBucket bucket;
+                std::string address;
+        };
+
+        /** @brief Outcome of admit() */
+        struct Admission {
+            /** @brief Leading commands that may run */
+            std::size_t admitted = 0;
+
+            /** @brief When the others may be sent again */
+            std::chrono::milliseconds retryAfter{0};
+        };
+
+        RateLimiter(RateLimit perConnection, RateLimit perAddress);
+
+        /** @brief Limits of the connection on socket (address from getpeername()) */
+        Client client(int socket) const;
+
+        /**
+         * @brief Admits as many of the next count commands as the limits allow
+         *
+         * Commands are admitted in order: the first admitted ones run, the
+         * rest is refused with retryAfter
+         */
+        Admission admit(Client& client, std::size_t count);
+
+    private:
+        /** @brief Address buckets tracked before full ones are forgotten */
+        static constexpr std::size_t MAX_TRACKED_ADDRESSES = 4096;
+
+        RateLimit perConnection;
+        RateLimit perAddress;
+
+        std::mutex                                   addressMutex;
+        std::unordered_map<std::string, TokenBucket> addressBuckets;
+};
+
+#endif
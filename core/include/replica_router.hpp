@@ -0,0 +1,201 @@
+/* Routes read-only work to streaming replicas, falling back to the primary */
+#ifndef REPLICA_ROUTER_HPP
+#define REPLICA_ROUTER_HPP
+
+#include "database_connection.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief How fresh the data of a read must be
+ */
+enum class ReadConsistency {
+    /** @brief Primary only: sees every committed transfer (BALANCE) */
+    Strong,
+    /**
+     * @brief A healthy, streaming replica lagging at most ReplicaSettings::maxLag,
+     * the primary when there is none
+     */
+    BoundedStaleness
+};
+
+/**
+ * @brief A connection reserved for one read, released by the destructor
+ *
+ * Holds the lock of the connection it points to (the shared primary lock or
+ * the replica's), so it must not outlive the caller's scope
+ */
+class ReadLease {
+    public:
+        ReadLease(ReadLease&&) = default;
+        /* a defaulted one would release owner before unlocking guard */
+        ReadLease& operator=(ReadLease&&) = delete;
+
+        /** @brief The leased connection */
+        pqxx::connection& getConnection() const;
+
+        /** @brief Read transaction on the leased connection, bounded by the RequestDeadline */
+        std::unique_ptr<pqxx::read_transaction> createReadTransaction() const;
+
+        /**
+         * @brief Autocommit "transaction" on the leased connection, single
+         * SELECTs. A read transaction under a RequestDeadline, whose timeouts
+         * need a transaction block
+         */
+        std::unique_ptr<pqxx::transaction_base> createAutocommitTransaction() const;
+
+        /** @brief true when served by a replica, false on the primary */
+        bool onReplica() const;
+
+    private:
+        friend class ReplicaRouter;
+        friend class ShardCoordinator;
+
+        ReadLease(std::unique_lock<std::mutex> guard, pqxx::connection& conn, bool replica,
+                  std::shared_ptr<void> owner = nullptr);
+
+        /* declared first, released last: keeps a replica dropped by a reload
+         * (its mutex and connection) alive until the lease is gone */
+        std::shared_ptr<void> owner;
+        std::unique_lock<std::mutex> guard;
+        pqxx::connection* conn;
+        bool replica;
+};
+
+/**
+ * @class ReplicaRouter
+ *
+ * @brief Sends read-only work to the streaming replicas of the DB config
+ *
+ * A background thread checks every replica each checkInterval: it reconnects
+ * the ones that are down and measures their replay lag. acquireRead() picks
+ * the healthy replicas within maxLag round robin, and returns the primary
+ * (DBConnection, under its lock) when the read must be strongly consistent or
+ * no replica qualifies, so callers never fail because a replica is gone
+ *
+ * Routing decisions are published in Metrics ("db.reads_*")
+ */
+class ReplicaRouter {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the router
+         */
+        static ReplicaRouter& getInstance();
+
+        /** @brief Stops the health check thread */
+        ~ReplicaRouter();
+
+        /**
+         * @brief Replaces the replica list, connections are opened by the next
+         * health check. Called with DBConnection::getReplicaSettings() by start()
+         */
+        void configure(const ReplicaSettings& settings);
+
+        /**
+         * @brief Configures the router from DBConnection and starts the
+         * health check thread, no-op if it is running or no replica is configured
+         */
+        void start();
+
+        /**
+         * @brief Replaces the replica list while reads go on (config reload)
+         *
+         * Replicas kept by the new settings keep their connection, new ones
+         * are connected and checked before they take reads, dropped ones are
+         * closed once their last ReadLease is released. Starts or stops the
+         * health check thread as needed
+         */
+        void reload(const ReplicaSettings& settings);
+
+        /** @brief Wakes the health check thread up and waits for it to finish */
+        void stop();
+
+        /**
+         * @brief A connection for one read
+         *
+         * @param consistency Strong always returns the primary
+         */
+        ReadLease acquireRead(ReadConsistency consistency = ReadConsistency::BoundedStaleness);
+
+        /**
+         * @brief Consistency of BALANCE reads: Strong unless "balance_on_replica"
+         */
+        ReadConsistency balanceConsistency() const;
+
+        /**
+         * @brief One health check round: reconnects replicas that are down and
+         * refreshes their lag (run by the background thread)
+         */
+        void checkReplicas();
+
+        /** @brief Number of replicas currently eligible for reads */
+        std::size_t usableReplicas() const;
+
+    private:
+        ReplicaRouter() = default;
+        ReplicaRouter(const ReplicaRouter&) = delete;
+        ReplicaRouter& operator=(const ReplicaRouter&) = delete;
+
+        /** @brief One streaming replica and its last health check */
+        struct Replica {
+            std::string connectionString;
+
+            /** @brief host:port for the logs */
+            std::string name;
+
+            /** @brief Guards conn, held by a ReadLease for the length of a read */
+            std::mutex mutex;
+            std::unique_ptr<pqxx::connection> conn;
+
+            std::atomic<bool> healthy{false};
+            std::atomic<std::int64_t> lagMs{0};
+
+            /** @brief A walreceiver is up, without it lagMs is stale and the replica is not used */
+            std::atomic<bool> streaming{false};
+
+            /** @brief Logs a replica going down once, not on every failed check */
+            bool downLogged = false;
+        };
+
+        /** @brief Connects if needed and measures the lag of one replica */
+        void checkReplica(Replica& replica);
+
+        /** @brief healthy, streaming and within maxLag */
+        bool usable(const Replica& replica) const;
+
+        /** @brief Loop run by the background thread */
+        void run();
+
+        /** @brief Starts the health check thread */
+        void startThread();
+
+        using ReplicaList = std::vector<std::shared_ptr<Replica>>;
+
+        /** @brief The current list, a reload swaps it while others still walk the old one */
+        std::shared_ptr<const ReplicaList> currentReplicas() const;
+
+        mutable std::mutex                 listMutex;
+        std::shared_ptr<const ReplicaList> replicas = std::make_shared<const ReplicaList>();
+
+        std::atomic<std::int64_t> maxLagMs{1000};
+        /** @brief Written under waitMutex, read by the thread while waiting */
+        std::chrono::milliseconds checkInterval{1000};
+        std::atomic<bool> balanceOnReplica{false};
+
+        /** @brief Round robin position */
+        std::atomic<std::size_t> nextReplica{0};
+
+        std::atomic<bool>       running{false};
+        std::mutex              waitMutex;
+        std::condition_variable wakeUp;
+        std::thread             checkerThread;
+};
+
+#endif
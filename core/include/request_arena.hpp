@@ -0,0 +1,62 @@
+/* Per thread memory arena for the short lived objects of a request */
+#ifndef REQUEST_ARENA_HPP
+#define REQUEST_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+/**
+ * @class RequestArena
+ *
+ * @brief Monotonic allocator of the calling thread, emptied after each request
+ *
+ * While a Scope is alive, resource() is a std::pmr::monotonic_buffer_resource
+ * owned by the thread: allocations are a pointer bump in a buffer kept from
+ * request to request, deallocations are free, and the Scope's end releases
+ * everything at once. Without a Scope resource() is the default (heap)
+ * resource, so the same code runs outside requests.
+ *
+ * Whatever is allocated from it must not outlive the Scope. Only for code
+ * that runs a request start to end on one thread (the threads backend): a
+ * coroutine of the event loops may be suspended while another one runs
+ */
+class RequestArena {
+    public:
+        /** @brief Bytes reserved per thread up front, bigger requests go on to the heap */
+        static constexpr std::size_t INITIAL_BYTES = 16 * 1024;
+
+        /** @brief Makes resource() the thread's arena for one request */
+        class Scope {
+            public:
+                Scope();
+
+                /** @brief Releases every allocation of the request */
+                ~Scope();
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+        };
+
+        /** @brief The arena of the calling thread inside a Scope, the default resource otherwise */
+        static std::pmr::memory_resource* resource();
+};
+
+/**
+ * @class AllocationCounter
+ *
+ * @brief Heap allocations (operator new) of the calling thread
+ *
+ * Only counted in builds with -DCOUNT_ALLOCATIONS (make COUNT_ALLOCATIONS=1),
+ * which replace the global operator new. Otherwise always 0
+ */
+class AllocationCounter {
+    public:
+        /** @brief true when the build counts allocations */
+        static bool enabled();
+
+        /** @brief Allocations made by the calling thread so far */
+        static std::uint64_t threadAllocations();
+};
+
+#endif
@@ -0,0 +1,156 @@
+/* Per request deadlines, from the protocol down to Postgres */
+#ifndef REQUEST_DEADLINE_HPP
+#define REQUEST_DEADLINE_HPP
+
+#include <pqxx/pqxx>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Thrown when a request runs out of time before or while it uses the
+ * database. Nothing was committed
+ */
+class DeadlineExceeded : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+struct DeadlineWatch;
+
+/**
+ * @class RequestDeadline
+ *
+ * @brief Deadline of the request running on the calling thread
+ *
+ * Set by the server for "DEADLINE <ms> <command>" and honoured by the layers
+ * below without passing it around:
+ *
+ *   - DBConnection::lock() gives up waiting for the lock at the deadline
+ *   - transactions get SET LOCAL statement_timeout and lock_timeout from the
+ *     time left (applyTo())
+ *   - DeadlineWatchdog cancels the query still holding the primary past it
+ */
+class RequestDeadline {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /** @brief Sets the deadline of the calling thread until destroyed */
+        class Scope {
+            public:
+                explicit Scope(Clock::time_point deadline);
+
+                /** @brief Ends the request: its watches can no longer cancel anything */
+                ~Scope();
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+            private:
+                friend class RequestDeadline;
+
+                Clock::time_point deadline;
+                Scope*            previous;
+
+                /** @brief Primary lock acquisitions watched by DeadlineWatchdog */
+                std::vector<std::shared_ptr<DeadlineWatch>> watches;
+        };
+
+        /** @brief Deadline of the calling thread, nullopt without one */
+        static std::optional<Clock::time_point> current();
+
+        /** @brief true when the calling thread has a deadline and it passed */
+        static bool expired();
+
+        /** @brief Throws DeadlineExceeded("Deadline exceeded " + where) if expired() */
+        static void check(const char* where);
+
+        /**
+         * @brief Bounds the statements of tx by the time left, no-op without
+         * a deadline. One round trip, SET LOCAL ends with the transaction
+         */
+        static void applyTo(pqxx::transaction_base& tx);
+
+        /**
+         * @brief Asks DeadlineWatchdog to cancel the primary's query at the
+         * deadline while lock generation is still the holder. No-op without a
+         * deadline
+         */
+        static void watchPrimary(std::uint64_t generation);
+};
+
+/** @brief One primary lock acquisition made under a deadline */
+struct DeadlineWatch {
+    RequestDeadline::Clock::time_point deadline;
+    std::uint64_t                      generation = 0;
+    /** @brief Set when the request ended, guarded by the watchdog's mutex */
+    bool                               finished = false;
+};
+
+/**
+ * @class DeadlineWatchdog
+ *
+ * @brief Thread cancelling (PQcancel) the query of a request that holds the
+ * shared primary connection past its deadline
+ *
+ * statement_timeout bounds each statement, the watchdog bounds the whole
+ * request: a transfer of several statements, or a client that went away,
+ * stops holding the lock at the deadline. A watch only cancels if nobody
+ * took the lock since (DBConnection::cancelQueryOf()), so the next request
+ * is never hit. Cancels are counted in Metrics ("db.deadline_cancels")
+ */
+class DeadlineWatchdog {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the watchdog
+         */
+        static DeadlineWatchdog& getInstance();
+
+        /** @brief Stops the thread if it is still running */
+        ~DeadlineWatchdog();
+
+        /** @brief Starts the thread, no-op if already running */
+        void start();
+
+        /** @brief Stops the thread, pending watches are dropped */
+        void stop();
+
+        /** @brief Watches one lock acquisition until its deadline, no-op if stopped */
+        void watch(std::shared_ptr<DeadlineWatch> watch);
+
+        /** @brief The request of the watch ended */
+        void finish(DeadlineWatch& watch);
+
+    private:
+        DeadlineWatchdog() = default;
+        DeadlineWatchdog(const DeadlineWatchdog&) = delete;
+        DeadlineWatchdog& operator=(const DeadlineWatchdog&) = delete;
+
+        /** @brief Loop run by the watchdog thread */
+        void run();
+
+        struct LaterFirst {
+            bool operator()(const std::shared_ptr<DeadlineWatch>& a,
+                            const std::shared_ptr<DeadlineWatch>& b) const {
+                return a->deadline > b->deadline;
+            }
+        };
+
+        std::mutex              watchMutex;
+        std::condition_variable wakeUp;
+        std::priority_queue<std::shared_ptr<DeadlineWatch>,
+                            std::vector<std::shared_ptr<DeadlineWatch>>, LaterFirst> watches;
+
+        bool        running = false;
+        std::thread watchdogThread;
+};
+
+#endif
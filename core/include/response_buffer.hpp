@@ -0,0 +1,119 @@
+/* Response bytes of a connection, gathered from fragments and sent with one sendmsg() */
+#ifndef RESPONSE_BUFFER_HPP
+#define RESPONSE_BUFFER_HPP
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class ResponseBuffer
+ *
+ * @brief Responses built as a list of fragments instead of one string
+ *
+ * Constant parts ("BALANCE ", "OK\n", error messages) are referenced where
+ * they are, never copied. Numbers are formatted with std::to_chars and, like
+ * any other text that does not outlive the request, copied into an internal
+ * store. flush() hands every fragment to the kernel at once as an iovec
+ * array, resuming after short writes.
+ *
+ * Kept per connection: clear() keeps the capacity of the fragment list, the
+ * store and the iovec array, so a steady connection stops allocating after
+ * its first requests. Not thread safe
+ */
+class ResponseBuffer {
+    public:
+        /** @brief Position in the buffer, see mark() */
+        struct Mark {
+            std::size_t fragments = 0;
+            std::size_t stored = 0;
+            std::size_t bytes = 0;
+        };
+
+        /**
+         * @brief Appends text without copying it, it must stay valid until
+         * flush() or clear() (string literals, static strings)
+         */
+        void append(std::string_view fragment);
+
+        /** @brief Appends a copy of text */
+        void appendCopy(std::string_view text);
+
+        /** @brief Appends the decimal digits of value */
+        void appendNumber(long long value);
+
+        /** @brief Appends value like std::ostream with its default precision (%g) */
+        void appendNumber(double value);
+
+        /** @brief Bytes in the buffer */
+        std::size_t size() const { return bytes; }
+
+        bool empty() const { return bytes == 0; }
+
+        /**
+         * @brief Current end of the buffer, for rewind() and startsWith()
+         *
+         * Valid until the buffer is rewound before it or cleared
+         */
+        Mark mark();
+
+        /** @brief Drops everything appended since mark */
+        void rewind(const Mark& mark);
+
+        /** @brief true if the bytes appended since mark start with prefix */
+        bool startsWith(const Mark& mark, std::string_view prefix) const;
+
+        /** @brief Empties the buffer, capacity is kept */
+        void clear();
+
+        /**
+         * @brief Sends everything with sendmsg(), then clears the buffer
+         *
+         * Short writes resume where the kernel stopped, EINTR retries and
+         * EAGAIN waits for the socket to be writable, so blocking and
+         * non-blocking sockets both work
+         *
+         * @param timeout longest wait for the socket to be writable again,
+         * negative waits forever. With a timeout the sends never block, even
+         * on a blocking socket, and a client that reads nothing for that long
+         * fails the flush with errno ETIMEDOUT
+         * @return false if the connection failed, the buffer is cleared anyway
+         */
+        bool flush(int socket, std::chrono::milliseconds timeout = std::chrono::milliseconds(-1));
+
+        /** @brief Copy of the content (tests, logs) */
+        std::string str() const;
+
+        friend std::ostream& operator<<(std::ostream& out, const ResponseBuffer& buffer);
+
+    private:
+        /**
+         * @brief A slice of the response: external text when data is set,
+         * otherwise bytes [offset, offset + size) of store
+         */
+        struct Fragment {
+            const char* data;
+            std::size_t offset;
+            std::size_t size;
+        };
+
+        /** @brief Start of a fragment, store pointers are only stable once appends are done */
+        const char* begin(const Fragment& fragment) const;
+
+        std::vector<Fragment> fragments;
+        std::string           store;
+        std::size_t           bytes = 0;
+
+        /** @brief Fragments before this index belong to a mark, copies are not merged into them */
+        std::size_t sealed = 0;
+
+        /** @brief Scratch iovec array of flush() */
+        std::vector<iovec> iov;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/* Compile time mapping of result rows onto structs, fields read by position */
+#ifndef ROW_MAPPER_HPP
+#define ROW_MAPPER_HPP
+
+#include "request_arena.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Column name usable as a template argument: Column<"account_id", ...>
+ */
+template <std::size_t N>
+struct ColumnName {
+    constexpr ColumnName(const char (&text)[N]) { std::copy_n(text, N, name); }
+
+    constexpr std::string_view view() const { return std::string_view(name, N - 1); }
+
+    char name[N];
+};
+
+/**
+ * @brief Decodes the text of a field into T, the default decoder of a Column
+ *
+ * Integers and doubles go through std::from_chars, strings are copied
+ * (std::pmr::string into RequestArena::resource()). Throws
+ * std::invalid_argument if the text is not a valid T
+ */
+template <typename T>
+T decodeText(std::string_view text) {
+    if constexpr (std::is_same_v<T, std::pmr::string>) {
+        return std::pmr::string(text, RequestArena::resource());
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        return std::string(text);
+    } else if constexpr (std::is_same_v<T, bool>) {
+        if (text != "t" && text != "f") {
+            throw std::invalid_argument("Invalid boolean value: " + std::string(text));
+        }
+        return text == "t";
+    } else {
+        static_assert(std::is_arithmetic_v<T>, "no text decoder for this member type");
+        T value{};
+        auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || parsed.ec != std::errc() || parsed.ptr != text.data() + text.size()) {
+            throw std::invalid_argument("Invalid numeric value: " + std::string(text));
+        }
+        return value;
+    }
+}
+
+/**
+ * @brief One column of a RowMapper: its name in the query and the struct
+ * member it fills
+ *
+ * Decode turns the field text into the member type, decodeText<T> unless a
+ * function is given (parseCents for a NUMERIC read into int64 cents). A
+ * std::optional member takes NULL as std::nullopt, any other member throws
+ * on NULL
+ */
+template <ColumnName Name, auto Member, auto Decode = nullptr>
+struct Column {
+    static constexpr std::string_view NAME = Name.view();
+    static constexpr auto MEMBER = Member;
+};
+
+namespace rowmapper_detail {
+    template <typename M>
+    struct MemberOf;
+
+    template <typename S, typename T>
+    struct MemberOf<T S::*> {
+        using Struct = S;
+        using Type = T;
+    };
+
+    template <typename T>
+    struct IsOptional : std::false_type {};
+
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    template <typename C>
+    struct ColumnTraits;
+
+    template <ColumnName Name, auto Member, auto Decode>
+    struct ColumnTraits<Column<Name, Member, Decode>> {
+        using Type = typename MemberOf<decltype(Member)>::Type;
+
+        template <typename Value>
+        static Value decodeValue(std::string_view text) {
+            if constexpr (std::is_same_v<decltype(Decode), std::nullptr_t>) {
+                return decodeText<Value>(text);
+            } else {
+                return Decode(text);
+            }
+        }
+
+        template <typename Field>
+        static Type decode(const Field& field) {
+            if constexpr (IsOptional<Type>::value) {
+                if (field.is_null()) {
+                    return std::nullopt;
+                }
+                return decodeValue<typename Type::value_type>(field.view());
+            } else {
+                if (field.is_null()) {
+                    throw std::invalid_argument("NULL in column " + std::string(Name.view()));
+                }
+                return decodeValue<Type>(field.view());
+            }
+        }
+    };
+}
+
+/**
+ * @class RowMapper
+ *
+ * @brief Builds a Struct from a result row, declared once as a column list
+ *
+ *     using AccountRow = RowMapper<Account,
+ *         Column<"account_id", &Account::accountID>,
+ *         Column<"balance",    &Account::balance>, ...>;
+ *
+ *     Account acc = AccountRow::map(res[0]);
+ *
+ * Field i of the row goes to the member of the i-th Column, the decoders are
+ * chosen at compile time and no field is looked up by name. The query must
+ * select the columns in that order: the first row mapped is checked once
+ * (column count, names, and that the members follow the struct's declaration
+ * order) and a mismatch throws std::runtime_error.
+ *
+ * Struct is built by aggregate initialization, so every member is listed,
+ * in declaration order, and std::pmr::string members keep the arena they
+ * were decoded into. Row is pqxx::row or anything with size(), operator[]
+ * and fields with view(), is_null() and name()
+ */
+template <typename Struct, typename... Columns>
+class RowMapper {
+    public:
+        static constexpr std::size_t COLUMNS = sizeof...(Columns);
+
+        static_assert(COLUMNS > 0, "a RowMapper needs at least one Column");
+
+        static_assert((std::is_same_v<typename rowmapper_detail::MemberOf<std::remove_cv_t<decltype(Columns::MEMBER)>>::Struct,
+                                      Struct> && ...),
+                      "every Column must name a member of the mapped struct");
+
+        /** @brief Column names in query order ("account_id", ...) */
+        static constexpr std::string_view NAMES[COLUMNS] = {Columns::NAME...};
+
+        /** @brief Decodes row into a Struct, checks the row shape on first use */
+        template <typename Row>
+        static Struct map(const Row& row) {
+            if (!checked.load(std::memory_order_acquire)) {
+                check(row);
+            }
+            return build(row, std::index_sequence_for<Columns...>{});
+        }
+
+        /**
+         * @brief Throws std::runtime_error unless row has the mapped columns
+         * in order, and the member list follows Struct's declaration order
+         */
+        template <typename Row>
+        static void check(const Row& row) {
+            if (static_cast<std::size_t>(row.size()) != COLUMNS) {
+                throw std::runtime_error("Row mapping expects " + std::to_string(COLUMNS) +
+                                         " columns, the result has " + std::to_string(row.size()));
+            }
+            for (std::size_t i = 0; i < COLUMNS; ++i) {
+                std::string_view name = row[static_cast<int>(i)].name();
+                if (name != NAMES[i]) {
+                    throw std::runtime_error("Row mapping expects column " + std::string(NAMES[i]) +
+                                             " at position " + std::to_string(i) + ", the result has " +
+                                             std::string(name));
+                }
+            }
+
+            /* aggregate initialization fills members by declaration order */
+            static const Struct sample{};
+            const std::uintptr_t offsets[] = {
+                reinterpret_cast<std::uintptr_t>(&(sample.*Columns::MEMBER))...
+            };
+            for (std::size_t i = 1; i < COLUMNS; ++i) {
+                if (offsets[i] <= offsets[i - 1]) {
+                    throw std::runtime_error("Row mapping member of column " + std::string(NAMES[i]) +
+                                             " is not in declaration order");
+                }
+            }
+
+            checked.store(true, std::memory_order_release);
+        }
+
+    private:
+        template <typename Row, std::size_t... I>
+        static Struct build(const Row& row, std::index_sequence<I...>) {
+            return Struct{rowmapper_detail::ColumnTraits<Columns>::decode(row[static_cast<int>(I)])...};
+        }
+
+        static inline std::atomic<bool> checked{false};
+};
+
+#endif
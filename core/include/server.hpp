@@ -3,9 +3,163 @@
 #define SERVER_HPP
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "task.hpp"
+#include "rate_limiter.hpp"
+#include "connection_tracker.hpp"
+#include "audit_log.hpp"
+#include "transfer_feed.hpp"
+
+class AccountService;
+class TransactionService;
+class AsyncDBConnection;
+class ClientStream;
+class ResponseBuffer;
+
+/**
+ * @brief How Server serves its client connections
+ */
+enum class IOBackend {
+    /** @brief One blocking worker thread per connection */
+    Threads,
+    /**
+     * @brief One EventLoop per acceptor serving all of its clients and its
+     * own AsyncDBConnections, no thread ever waits on a query
+     */
+    Epoll,
+    /**
+     * @brief Like Epoll, but client sockets are driven by an io_uring per
+     * acceptor: multishot accept, multishot recv into a provided buffer ring
+     * and send linked to a timeout. Needs a build with IO_URING=1 and a
+     * kernel >= 6.0, otherwise the server falls back to Epoll at start()
+     */
+    IoUring
+};
+
+/**
+ * @brief Tunables of the listening side of Server
+ *
+ * Defaults keep the original behaviour (one listening socket, one accept
+ * thread). Can be loaded from config/server.json with fromFile()
+ */
+struct ServerConfig {
+    /**
+     * @brief Number of listening sockets, each with its own accept thread
+     *
+     * With more than one, every socket is bound to the same port with
+     * SO_REUSEPORT and the kernel spreads new connections between them,
+     * so accept() is no longer a single serialization point
+     */
+    int acceptors = 1;
+
+    /** @brief listen() backlog of each socket */
+    int backlog = 128;
+
+    /** @brief Pin accept thread i to CPU core i (modulo the number of cores) */
+    bool pinAcceptors = false;
+
+    /**
+     * @brief TCP_DEFER_ACCEPT timeout in seconds (0 disables it)
+     *
+     * accept() only returns once the client sent its first bytes, so idle
+     * connections never wake up an accept thread
+     */
+    int deferAcceptSeconds = 1;
+
+    /** @brief Set TCP_NODELAY on accepted sockets, replies are tiny */
+    bool noDelay = true;
+
+    /**
+     * @brief TCP keepalive of accepted sockets ("tcp_keepalive_idle_s",
+     * "tcp_keepalive_interval_s", "tcp_keepalive_probes"), off when idle is 0
+     *
+     * Finds half-open connections (peer gone without a FIN) that no command
+     * will ever arrive on, the kernel resets them after the failed probes
+     */
+    int keepAliveIdleSeconds = 0;
+    int keepAliveIntervalSeconds = 10;
+    int keepAliveProbes = 3;
+
+    /**
+     * @brief Connection cap, idle and read timeouts ("max_connections",
+     * "idle_timeout_ms", "read_timeout_ms", "evict_idle_after_ms"), all off by default
+     */
+    ConnectionLimits connections;
+
+    /**
+     * @brief Max time stop() waits for in-flight requests before closing
+     * the client sockets
+     */
+    std::chrono::milliseconds drainTimeout{5000};
+
+    /** @brief Connection handling model ("io_backend": "threads", "epoll" or "io_uring") */
+    IOBackend backend = IOBackend::Threads;
+
+    /**
+     * @brief Non-blocking database connections opened by each event loop
+     * (epoll backend), each one keeps many pipelined queries in flight
+     */
+    int dbConnectionsPerLoop = 2;
+
+    /**
+     * @brief Commands per second and burst of one connection
+     * ("rate_limit_per_connection", "rate_burst_per_connection"), unlimited by default
+     */
+    RateLimit connectionLimit;
+
+    /**
+     * @brief Commands per second and burst of all the connections of one
+     * client address ("rate_limit_per_address", "rate_burst_per_address")
+     */
+    RateLimit addressLimit;
+
+    /**
+     * @brief Shares of the DB lock of interactive and bulk requests
+     * ("interactive_weight", "bulk_weight"), threads backend
+     */
+    unsigned interactiveWeight = 4;
+    unsigned bulkWeight = 1;
+
+    /**
+     * @brief Commands received in one read from which the read is a bulk
+     * request ("bulk_batch_commands")
+     */
+    std::size_t bulkBatchCommands = 8;
+
+    /**
+     * @brief Audit pipeline ("audit_queue_capacity", "audit_flush_interval_ms",
+     * "audit_batch_size", "audit_overflow", "audit_spill_path"), see AuditLog
+     */
+    AuditSettings audit;
+
+    /**
+     * @brief Committed transfers stream of SUBSCRIBE ("transfer_feed",
+     * "transfer_feed_poll_ms", "transfer_feed_replay", "transfer_feed_buffer"),
+     * see TransferFeed
+     */
+    TransferFeedSettings feed;
+
+    /**
+     * @brief Load the configuration from a JSON file, missing keys keep
+     * their default value
+     *
+     * Throws std::runtime_error if the file cannot be opened or names an
+     * unknown io_backend or audit_overflow
+     */
+    static ServerConfig fromFile(const std::string& path);
+};
 
 /**
  * @class TransactionServer
@@ -19,12 +173,26 @@
  *   - PING
  *   - BALANCE <accountID>
  *   - TRANSFER <fromID> <toID> <amount> <description>
+ *   - RELOAD (config reload, see setReloadHandler())
+ *   - STATS (live connection counts)
+ *   - SUBSCRIBE [<streamID> <sequence>] (committed transfers pushed as
+ *     "EVENT ..." lines from then on, see TransferFeed)
+ *
+ * Any command can be prefixed by "DEADLINE <ms> ": past ms after it was
+ * received the server stops working on it (see RequestDeadline) and answers
+ * "ERROR Deadline exceeded ..."
  *
  * For each connected client, the server spawns a worker thread that reads
  * commands, delegates to the Data Access Layer and returns responses. 
  * Using DB Connection and relying on concurrency primitives (threads,
  * atomic flags and mutexes inside DBConnection) to remain safe when multiple
  * clients are active at the same time
+ *
+ * With the epoll backend (ServerConfig::backend) there is no thread per client:
+ * each acceptor thread runs an EventLoop that owns its clients and a few
+ * AsyncDBConnections. Each client is served by a coroutine (serveClient())
+ * that reads like handleClient() but suspends on socket and query I/O instead
+ * of blocking, so a handful of threads keep hundreds of queries in flight
  */
 class Server {
     public:
@@ -40,6 +208,15 @@ class Server {
          */
         Server(const std::string& host, int port);
 
+        /**
+         * @brief Constructs a new Server instance with explicit listening options
+         *
+         * @param host Hostname or IP address to bind to
+         * @param port TCP port number on which the server will listen for clients
+         * @param config acceptors, backlog and socket options
+         */
+        Server(const std::string& host, int port, const ServerConfig& config);
+
         /**
          * @brief Destructor for Server
          *
@@ -57,25 +234,328 @@ class Server {
         void start();
 
         /**
-         * @brief Stops the server and clean resources
+         * @brief Stops the server and clean resources, drains for at most
+         * config.drainTimeout
          * 
          */
         void stop();
+
+        /**
+         * @brief Orderly shutdown with an explicit drain deadline
+         *
+         *   1. stops accepting (listening sockets closed, accept threads joined)
+         *   2. new commands on open connections get "ERROR RETRY ..." so clients
+         *      can resend them to another instance
+         *   3. waits until in-flight requests finish or drainTimeout expires.
+         *      Past the deadline the commands left in a batch get "ERROR RETRY
+         *      ...", threads waiting for the DB lock are sent away with the same
+         *      error and the running query is cancelled
+         *   4. closes every client socket and joins every worker thread
+         *
+         * Drain time and counters are published in Metrics ("server.drain_*")
+         *
+         * @param drainTimeout max time to wait for in-flight requests
+         */
+        void stop(std::chrono::milliseconds drainTimeout);
+
+        /**
+         * @brief Called by the RELOAD command, which answers "OK RELOADING"
+         * right away (the reload records its outcome in the audit log).
+         * Without a handler RELOAD is an error. Set before start()
+         */
+        void setReloadHandler(std::function<void()> handler);
+
+        /**
+         * @brief Moves the event loops to the primary of the reloaded config
+         * (DBConnection::getConnectionString()), no-op with the threads backend
+         *
+         * openDatabase() then the hand over it returns. Must not run
+         * concurrently with start() or stop()
+         */
+        void reloadDatabase();
+
+        /**
+         * @brief Opens the event loops' async connections to conninfo on the
+         * calling thread, without swapping anything yet
+         *
+         * Throws std::runtime_error, with every connection opened so far
+         * closed, if one fails. ConfigReloader runs it before
+         * DBConnection::reload() swaps the threads' connection, so both
+         * backends move or none does
+         *
+         * @return the hand over: each loop swaps the new connections in
+         * between two events, queries in flight finish on the old ones,
+         * closed once idle. Empty with the threads backend
+         */
+        std::function<void()> openDatabase(const std::string& conninfo);
     private:
+        /** @brief Complete command lines of one read, see takeLines() */
+        using CommandLines = std::pmr::vector<std::pmr::string>;
 
         /**
          * @brief Main loop that waits for incoming client connections
          * 
          * Loops continue until running flag is cleared and the stop() method is called
+         *
+         * @param index position of the listening socket in listenSockets
+         */
+        void acceptLoop(std::size_t index);
+
+        /**
+         * @brief Creates, binds and starts listening on one socket
+         *
+         * Throwns an error if the socket cannot be created or put into listening mode
+         *
+         * @return File descriptor of the listening socket
          */
-        void acceptLoop();
+        int openListenSocket();
 
         /**
          * @brief Handles a single connection
          * 
          * @param clientSocket File descriptor for the accepted client socket
+         * @param connection id of the client in connectionTracker
+         */
+        void handleClient(int clientSocket, ConnectionTracker::ConnectionID connection);
+
+        /**
+         * @brief Executes one protocol command and appends its response line(s)
+         *
+         * @param line command without the trailing newline
+         * @param out response of the connection, always terminated by a newline
+         * @param received when the command was read, start of its DEADLINE
+         */
+        void dispatchCommand(std::string_view line,
+                             AccountService& accountService,
+                             TransactionService& txService,
+                             ResponseBuffer& out,
+                             std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Executes every complete command received in one read
+         *
+         * Consecutive BALANCE commands sent back to back by a pipelining client
+         * are answered with a single AccountService::getBalances() call, so all
+         * their queries share one round trip to the database. Responses keep
+         * the order of the commands. Once the drain deadline of stop() passed,
+         * the commands not started yet get "ERROR RETRY Server is shutting down"
+         */
+        void dispatchBatch(const CommandLines& lines,
+                           AccountService& accountService,
+                           TransactionService& txService,
+                           ResponseBuffer& out,
+                           std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Executes one protocol command without blocking (epoll backend)
+         *
+         * Same commands and responses as dispatchCommand(), written as straight
+         * line code: the coroutine suspends on the database query and resumes
+         * on the loop thread when its result arrives
+         *
+         * @param db connection of the calling loop, nullptr if none is up
+         * @param received when the command was read, start of its DEADLINE
+         * @param deadline of an enclosing DEADLINE, its queries carry the
+         * time left as statement_timeout
+         */
+        Task<std::string> handleCommand(std::string_view line, AsyncDBConnection* db,
+                                        std::chrono::steady_clock::time_point received,
+                                        std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt);
+
+        /**
+         * @brief Splits "DEADLINE <ms> <command>" into its deadline and command
+         *
+         * @return false if line has no valid DEADLINE prefix
+         */
+        static bool parseDeadline(std::string_view line, std::chrono::steady_clock::time_point received,
+                                  std::chrono::steady_clock::time_point& deadline, std::string_view& command);
+
+        /**
+         * @brief Responses of count commands refused by the rate limiter,
+         * "ERROR RETRY Rate limited, retry in <ms> ms" each
+         */
+        static std::string rateLimitedResponses(std::size_t count, std::chrono::milliseconds retryAfter);
+
+        /**
+         * @brief Applies TCP_NODELAY and keepalive to an accepted socket
+         */
+        void configureClientSocket(int clientSocket) const;
+
+        /**
+         * @brief Tracks an accepted socket in connectionTracker
+         *
+         * Over max_connections, with no idle connection to evict, the client
+         * gets "ERROR RETRY Too many connections" and the socket is closed
+         *
+         * @param close wakes the server of the connection up, see ConnectionTracker::open()
+         * @return id of the connection, 0 if it was refused (socket closed)
          */
-        void handleClient(int clientSocket);
+        ConnectionTracker::ConnectionID trackConnection(int clientSocket, ConnectionTracker::CloseHandler close);
+
+        /**
+         * @brief Cuts the first SUBSCRIBE command of a read out of lines,
+         * the commands after it are moved to trailing
+         *
+         * The caller runs trailing once SUBSCRIBE was refused, or answers
+         * them with subscribedResponses() when the connection streams
+         *
+         * @return the SUBSCRIBE line, empty if lines have none
+         */
+        static std::string takeSubscribe(CommandLines& lines, CommandLines& trailing);
+
+        /**
+         * @brief Responses of count commands sent after a SUBSCRIBE that
+         * opened, "ERROR Connection is subscribed" each
+         */
+        static std::string subscribedResponses(std::size_t count);
+
+        /**
+         * @brief Runs "SUBSCRIBE [<streamID> <sequence>]"
+         *
+         * @param reply "SUBSCRIBED <streamID> <sequence>" (events follow from
+         * sequence + 1) or the error line
+         * @return the subscription, nullptr if refused
+         */
+        std::shared_ptr<TransferSubscription> openSubscription(std::string_view line, std::string& reply);
+
+        /**
+         * @brief Sends the events of subscription until the client leaves,
+         * falls behind or the server stops (threads backend)
+         *
+         * A client that reads nothing for SUBSCRIBER_SEND_TIMEOUT is dropped,
+         * so it cannot pin the worker thread
+         */
+        void streamTransfers(int clientSocket, const std::shared_ptr<TransferSubscription>& subscription);
+
+        /** @brief Response of STATS: "STATS connections_active=3 ..." */
+        std::string statsResponse() const;
+
+        /** @brief How often a streaming worker thread looks for its client leaving */
+        static constexpr std::chrono::milliseconds SUBSCRIBER_POLL{200};
+
+        /** @brief A subscriber's socket full for this long drops it, like the io_uring SEND_TIMEOUT_SECONDS */
+        static constexpr std::chrono::milliseconds SUBSCRIBER_SEND_TIMEOUT{30000};
+
+        /** @brief A client that never sends a newline must not grow its buffer forever */
+        static constexpr std::size_t MAX_PENDING_BYTES = 64 * 1024;
+
+        /**
+         * @brief Cuts every complete line out of pending (CR/LF stripped,
+         * empty lines skipped), the unterminated tail stays in pending
+         *
+         * @param resource where the lines are allocated, the request arena
+         * with the threads backend
+         */
+        static CommandLines takeLines(std::string& pending,
+                                      std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Marks the end of a request, wakes stop() up when it was the
+         * last one in flight
+         */
+        void finishRequest();
+
+        /* --- epoll backend, implemented in server_epoll.cpp --- */
+
+        /** @brief An event loop thread with its listening socket, clients and DB connections */
+        struct EventWorker;
+
+        /** @brief Starts one EventWorker per listening socket */
+        void startEventWorkers();
+
+        /** @brief Stops accepting on every EventWorker (listening sockets closed) */
+        void stopEventAccept();
+
+        /**
+         * @brief Cancels the queries still running on the workers' connections
+         * (drain deadline reached)
+         */
+        void cancelEventQueries();
+
+        /**
+         * @brief Closes every client, stops the loops and joins their threads
+         *
+         * @return number of client connections closed
+         */
+        std::size_t stopEventWorkers();
+
+        /** @brief Body of an event loop thread */
+        void runEventWorker(EventWorker& worker);
+
+        /** @brief Accepts every pending connection of the worker's listening socket */
+        void acceptReady(EventWorker& worker);
+
+        /**
+         * @brief Serves one client until it disconnects, coroutine running on
+         * the worker's loop (the epoll/io_uring counterpart of handleClient())
+         */
+        Task<void> serveClient(EventWorker& worker, std::unique_ptr<ClientStream> stream,
+                               RateLimiter::Client limits, ConnectionTracker::ConnectionID connection);
+
+        /**
+         * @brief Runs the commands of one read on the worker's loop and
+         * appends their responses to out, in order (the per read part of
+         * serveClient(), dispatchBatch() of the event loops)
+         */
+        Task<void> runCommands(EventWorker& worker, const CommandLines& lines, std::string& out,
+                               std::chrono::steady_clock::time_point received);
+
+        /**
+         * @brief streamTransfers() of the event loops: the coroutine writes
+         * the events while a second one reads, to see the client leave
+         */
+        Task<void> streamTransfers(EventWorker& worker, ClientStream& socket,
+                                   std::shared_ptr<TransferSubscription> subscription);
+
+        /**
+         * @brief Tracks a socket accepted by an event worker, closed by
+         * shutting its stream down on the worker's loop
+         *
+         * @return id of the connection, 0 if it was refused (socket closed)
+         */
+        ConnectionTracker::ConnectionID trackEventConnection(EventWorker& worker, int clientSocket);
+
+        /* --- io_uring backend, implemented in server_uring.cpp --- */
+
+        /**
+         * @brief Checks that io_uring can be used (build flag, kernel support)
+         *
+         * @param reason why it cannot, when returning false
+         */
+        static bool ioUringAvailable(std::string& reason);
+
+        /**
+         * @brief Body of an event loop thread with the io_uring backend: the
+         * ring waits for client I/O and for the loop's epoll descriptor
+         * (database sockets, posted tasks) at the same time
+         */
+        void runUringWorker(EventWorker& worker);
+
+        /** @brief Next async connection of the worker that is still up, or nullptr */
+        AsyncDBConnection* pickConnection(EventWorker& worker);
+
+        /**
+         * @brief A connection and the thread serving it
+         *
+         * The socket is closed by the worker itself when it finishes, under
+         * workersMutex, so stop() never touches a descriptor that was reused
+         */
+        struct ClientWorker {
+            int               socket = -1;
+            ConnectionTracker::ConnectionID connection = 0;
+            std::thread       thread;
+            std::atomic<bool> finished{false};
+        };
+
+        /**
+         * @brief Spawns the worker thread of an accepted socket
+         */
+        void spawnWorker(int clientSocket, ConnectionTracker::ConnectionID connection);
+
+        /**
+         * @brief Joins and forgets workers whose client already disconnected
+         */
+        void reapWorkers();
 
         /**
          * @brief  Host and IP address the server will bind to
@@ -89,27 +569,62 @@ class Server {
          */
         int portBind;
 
+        /** @brief Listening options */
+        ServerConfig config;
+
+        /** @brief Per connection and per address command limits */
+        RateLimiter rateLimiter;
+
+        /** @brief Connection cap and timeouts of every backend */
+        ConnectionTracker connectionTracker;
+
         /**
-         * @brief File descriptor for the listening socket
-         * 
+         * @brief File descriptors of the listening sockets
+         * (config.acceptors of them, sharing the port with SO_REUSEPORT)
          */
-        int listenSocket = -1;
+        std::vector<int> listenSockets;
 
         /** Flag to indicate if the server is running or not */
         std::atomic<bool> running{false};
 
         /**
-         * @brief Accept loop thread
+         * @brief Accept loop threads, one per listening socket
          *
-         * This thread runs acceptLoop() while the server is running
+         * Each thread runs acceptLoop() while the server is running
          */
-        std::thread acceptThread;
+        std::vector<std::thread> acceptThreads;
 
         /**
-         * @brief Optional container to track worker threads
-         * 
+         * @brief Every live client worker, replaces detached threads so that
+         * stop() can wait for them
+         */
+        std::list<ClientWorker> workers;
+
+        /** @brief Protects workers and the sockets they own */
+        std::mutex workersMutex;
+
+        /** @brief Set by stop(), new commands are answered with a retryable error */
+        std::atomic<bool> draining{false};
+
+        /** @brief Set by stop() past the drain deadline, see dispatchBatch() */
+        std::atomic<bool> drainExpired{false};
+
+        /** @brief Commands currently being processed */
+        std::atomic<int> inFlight{0};
+
+        /** @brief Signalled when inFlight drops to 0 while draining */
+        std::mutex drainMutex;
+        std::condition_variable drained;
+
+        /** @brief Run by the RELOAD command, may be empty */
+        std::function<void()> reloadHandler;
+
+        /**
+         * @brief Event loop threads of the epoll/io_uring backends, one per listening socket
+         *
+         * shared_ptr because EventWorker is only complete in server_event_worker.hpp
          */
-        std::vector<std::thread> workerThread;
+        std::vector<std::shared_ptr<EventWorker>> eventWorkers;
 };
 
 
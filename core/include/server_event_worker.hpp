@@ -0,0 +1,48 @@
+/* Internal to Server: state of an event loop thread, shared by the epoll
+ * (server_epoll.cpp) and io_uring (server_uring.cpp) backends */
+#ifndef SERVER_EVENT_WORKER_HPP
+#define SERVER_EVENT_WORKER_HPP
+
+#include "server.hpp"
+#include "event_loop.hpp"
+#include "async_db.hpp"
+#include "client_stream.hpp"
+
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct Server::EventWorker {
+    EventLoop loop;
+    int listenSocket = -1;
+    std::thread thread;
+
+    std::vector<std::unique_ptr<AsyncDBConnection>> connections;
+    std::size_t nextConnection = 0;
+
+    /* Replaced by a config reload, closed once their last query completed */
+    std::vector<std::unique_ptr<AsyncDBConnection>> retiredConnections;
+    bool sweepPosted = false;
+
+    /* Closes the retired connections with nothing in flight. Only from a
+     * posted task: never while a callback of one of them is on the stack */
+    void sweepRetired() {
+        sweepPosted = false;
+        std::erase_if(retiredConnections, [](const std::unique_ptr<AsyncDBConnection>& db) {
+            return db->inFlight() == 0;
+        });
+    }
+
+    /* Streams of the clients being served by connection id, each owned by
+     * its serveClient() frame */
+    std::unordered_map<ConnectionTracker::ConnectionID, ClientStream*> clients;
+
+    /* Set on the loop thread by stopEventWorkers(), the last client leaving stops the loop */
+    bool stopping = false;
+
+    /* Written by the loop thread before it exits, read after join() */
+    std::size_t closedSessions = 0;
+};
+
+#endif
@@ -0,0 +1,146 @@
+/* Places accounts on shards and runs transfers across them */
+#ifndef SHARD_COORDINATOR_HPP
+#define SHARD_COORDINATOR_HPP
+
+#include "database_connection.hpp"
+#include "replica_router.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class ShardCoordinator
+ *
+ * @brief Spreads accounts over the shards of the DB config ("shards") and
+ * keeps transfers atomic across them
+ *
+ * A transfer between two accounts of the same shard calls transferMoney() on
+ * that shard, exactly like the unsharded path. A transfer between shards is a
+ * two phase commit driven from here:
+ *
+ *   1. "BEGIN gid" is appended to the recovery log
+ *   2. debitTransferLeg() runs on the source shard, creditTransferLeg() on the
+ *      destination shard, each in its own transaction ended by
+ *      PREPARE TRANSACTION gid (rows stay locked, the outcome survives crashes)
+ *   3. any failure rolls both back and logs "ABORT gid"
+ *   4. otherwise "COMMIT gid" is logged and fsync'ed, this is the decision
+ *   5. COMMIT PREPARED gid on both shards, then "DONE gid"
+ *
+ * recover() settles what a crash or a lost shard left prepared: COMMIT
+ * PREPARED when the log holds the COMMIT decision, ROLLBACK PREPARED
+ * otherwise (presumed abort). Only the gids of this node ("bank_<node>_",
+ * ShardSettings::nodeID) are settled, its log knows nothing of the
+ * others. Shards need max_prepared_transactions > 0
+ */
+class ShardCoordinator {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the coordinator
+         */
+        static ShardCoordinator& getInstance();
+
+        ~ShardCoordinator();
+
+        /**
+         * @brief Replaces the shard list and closes the current connections,
+         * called with DBConnection::getShardSettings() by start()
+         *
+         * Throws std::runtime_error if the recovery log cannot be opened
+         */
+        void configure(const ShardSettings& settings);
+
+        /**
+         * @brief Configures the coordinator from DBConnection, connects every
+         * shard and runs recover(). No-op when no shard is configured
+         *
+         * Throws std::runtime_error if a shard cannot be reached
+         */
+        void start();
+
+        /** @brief true when the database is sharded */
+        bool enabled() const;
+
+        /** @brief Number of configured shards */
+        std::size_t shardCount() const;
+
+        /** @brief Shard holding accountID */
+        std::size_t shardOf(int accountID) const;
+
+        /**
+         * @brief Moves amount between two accounts, wherever they live
+         *
+         * Throws std::runtime_error("Transfer failed: ...") like
+         * TransactionService::transfer(), in which case no balance changed
+         */
+        void transfer(int fromAccountID, int toAccountID, double amount, const std::string& description);
+
+        /**
+         * @brief Connection of the shard holding accountID, for reads
+         */
+        ReadLease acquireRead(int accountID);
+
+        /**
+         * @brief Connection of one shard, for reads spanning several accounts
+         */
+        ReadLease acquireShard(std::size_t shard);
+
+        /**
+         * @brief Settles the prepared transactions of this node still
+         * pending on the shards, see the class description
+         *
+         * @return number of prepared transactions committed or rolled back
+         */
+        std::size_t recover();
+
+    private:
+        ShardCoordinator() = default;
+        ShardCoordinator(const ShardCoordinator&) = delete;
+        ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+        /** @brief One shard and its connection */
+        struct Shard {
+            std::string connectionString;
+
+            /** @brief Held for the length of a transfer leg or a read */
+            std::mutex mutex;
+            std::unique_ptr<pqxx::connection> conn;
+
+            /** @brief Open connection, reconnects after a failure (mutex held) */
+            pqxx::connection& connection();
+        };
+
+        void transferLocal(Shard& shard, int fromAccountID, int toAccountID,
+                           double amount, const std::string& description);
+
+        void transferCrossShard(Shard& debit, Shard& credit, int fromAccountID, int toAccountID,
+                                double amount, const std::string& description);
+
+        /** @brief Unique global transaction id, starting with nodePrefix */
+        std::string nextTransactionID();
+
+        /** @brief Appends one line to the recovery log and syncs it */
+        void logRecord(const std::string& record);
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        ShardSettings settings;
+
+        /** @brief Recovery log, append only */
+        int logFd = -1;
+        std::mutex logMutex;
+
+        /** @brief Part of every gid, distinguishes restarts */
+        std::string instanceTag;
+
+        /** @brief "bank_<node>_", the gids recover() may settle */
+        std::string nodePrefix;
+        std::atomic<std::uint64_t> sequence{0};
+
+        /** @brief Set when a COMMIT PREPARED failed, the next transfer retries recover() */
+        std::atomic<bool> recoveryNeeded{false};
+};
+
+#endif
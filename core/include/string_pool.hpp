@@ -0,0 +1,72 @@
+/* Interned, append only storage for the cold strings of in-memory tables */
+#ifndef STRING_POOL_HPP
+#define STRING_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class StringPool
+ *
+ * @brief Stores each distinct string once and hands out 32-bit handles
+ *
+ * The characters of every string sit back to back in one buffer, a handle is
+ * the index of the string's start offset. intern() of a string already in
+ * the pool returns its existing handle, so the name shared by the accounts
+ * of one customer (or by thousands of customers) costs its bytes once and
+ * 4 bytes per reference, instead of a std::string (32 bytes plus a heap
+ * block past 15 characters) per row.
+ *
+ * Lookups go through an open addressing table of handles (linear probing,
+ * at most half full). Views returned by view() stay valid until the next
+ * intern() or clear(). Not thread safe
+ */
+class StringPool {
+    public:
+        using Handle = std::uint32_t;
+
+        /** @brief Handle of the empty string, valid in every pool */
+        static constexpr Handle EMPTY = 0;
+
+        StringPool();
+
+        /**
+         * @brief Handle of text, added to the pool when not there yet
+         *
+         * Throws std::length_error past 4 GiB of characters or 2^32 strings
+         */
+        Handle intern(std::string_view text);
+
+        /** @brief The string behind handle */
+        std::string_view view(Handle handle) const {
+            return std::string_view(chars.data() + offsets[handle], offsets[handle + 1] - offsets[handle]);
+        }
+
+        /** @brief Number of distinct strings, the empty one included */
+        std::size_t size() const { return offsets.size() - 1; }
+
+        /** @brief Reserves room for strings distinct strings of characters bytes in total */
+        void reserve(std::size_t strings, std::size_t characters);
+
+        /** @brief Drops every string but the empty one */
+        void clear();
+
+        /** @brief Heap bytes held by the pool (characters, offsets, lookup table) */
+        std::size_t memoryUsage() const;
+
+    private:
+        /** @brief Grows the lookup table to slots entries and reinserts every handle */
+        void rehash(std::size_t slots);
+
+        /** @brief characters of string i are chars[offsets[i], offsets[i + 1]) */
+        std::string                chars;
+        std::vector<std::uint32_t> offsets;
+
+        /** @brief handle + 1 of the string hashed there, 0 for a free slot */
+        std::vector<std::uint32_t> table;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/* Periodic folding of hot account stripes into their account row */
+#ifndef STRIPE_FOLDER_HPP
+#define STRIPE_FOLDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class StripeFolder
+ *
+ * @brief Background thread calling foldAllAccountStripes() every interval
+ *
+ * Credits into a striped account pile up in its stripes (see
+ * database/procedures/accountStripes.sql). Folding them back into the account
+ * row keeps debits from having to fold them inline. Runs on the primary, or
+ * on every shard when the database is sharded
+ */
+class StripeFolder {
+    public:
+        explicit StripeFolder(std::chrono::milliseconds interval);
+
+        /** @brief Stops the background thread if it is still running */
+        ~StripeFolder();
+
+        /** @brief Starts the background thread, no-op if already running */
+        void start();
+
+        /** @brief Wakes the thread up and waits for it to finish */
+        void stop();
+
+        /**
+         * @brief One fold round, run by the background thread
+         *
+         * @return number of accounts whose stripes were folded
+         */
+        int fold();
+
+    private:
+        /** @brief Loop run by the background thread */
+        void run();
+
+        std::chrono::milliseconds interval;
+
+        std::atomic<bool>       running{false};
+        std::mutex              waitMutex;
+        std::condition_variable wakeUp;
+        std::thread             folderThread;
+};
+
+#endif
@@ -0,0 +1,168 @@
+/* C++20 coroutine task type used by the event loop based request handlers */
+#ifndef TASK_HPP
+#define TASK_HPP
+
+#include <coroutine>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+template <typename T>
+class Task;
+
+namespace detail {
+    /**
+     * @brief Part of the promise shared by every Task<T>
+     *
+     * Keeps the awaiting coroutine (continuation) and resumes it when the task
+     * finishes, by symmetric transfer, so long chains of co_await never grow
+     * the stack
+     */
+    struct TaskPromiseBase {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        std::exception_ptr exception;
+
+        /* Tasks are lazy, they start when awaited (or spawned) */
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> done) noexcept {
+                return done.promise().continuation;
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+
+        void return_value(T result) { value.emplace(std::move(result)); }
+
+        T take() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase {
+        Task<void> get_return_object();
+
+        void return_void() {}
+
+        void take() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+}
+
+/**
+ * @class Task
+ *
+ * @brief Lazily started coroutine producing a T
+ *
+ * A Task runs when it is co_awaited, the awaiting coroutine is resumed with
+ * its result (or its exception) when it completes. Nothing here knows about
+ * threads: a task suspended on I/O is resumed by the EventLoop that owns that
+ * I/O, so tasks always run on the loop thread, the server executor.
+ */
+template <typename T = void>
+class Task {
+    public:
+        using promise_type = detail::TaskPromise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        explicit Task(Handle handle) : handle(handle) {}
+
+        Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                if (handle) {
+                    handle.destroy();
+                }
+                handle = std::exchange(other.handle, {});
+            }
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() { return handle.promise().take(); }
+
+    private:
+        Handle handle;
+};
+
+namespace detail {
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    /* Self destroying coroutine that owns a spawned task */
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() {}
+        };
+    };
+
+    inline Detached runDetached(Task<void> task) {
+        try {
+            co_await std::move(task);
+        }
+        catch (const std::exception& e) {
+            std::cout << "[Task] Unhandled exception: " << e.what() << "\n";
+        }
+    }
+}
+
+/**
+ * @brief Starts a task on the calling thread without waiting for it
+ *
+ * The task runs until its first suspension before spawn() returns, its frame
+ * is released when it completes. Exceptions escaping the task are logged
+ */
+inline void spawn(Task<void> task) {
+    detail::runDetached(std::move(task));
+}
+
+#endif
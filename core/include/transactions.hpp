@@ -36,11 +36,16 @@ public:
      * @param amount double qnt of money to be sent
      * @param description optional string, describes transfer
      *
+     * Every attempt, committed or not, is queued to the AuditLog
      */
     void transfer(int fromAccountID,
          int toAccountID,
          double amount,
          const std::string& description = "Transfer description...");
+
+private:
+    /** @brief The transfer itself, transfer() adds its audit event */
+    void execute(int fromAccountID, int toAccountID, double amount, const std::string& description);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,281 @@
+/* Stream of committed transfers pushed to SUBSCRIBE clients, fed by one reader per database */
+#ifndef TRANSFER_FEED_HPP
+#define TRANSFER_FEED_HPP
+
+/* libpqxx */
+#include <pqxx/pqxx>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Transfer feed settings, the "transfer_feed_*" keys of config/server.json
+ */
+struct TransferFeedSettings {
+    /** @brief Read the committed transfers at all ("transfer_feed") */
+    bool enabled = true;
+
+    /**
+     * @brief Pause of a reader between two reads of the transactions table
+     * of its database, the latency of the events ("transfer_feed_poll_ms")
+     */
+    std::chrono::milliseconds pollInterval{50};
+
+    /** @brief Last events kept for subscribers resuming ("transfer_feed_replay") */
+    std::size_t replayCapacity = 65536;
+
+    /**
+     * @brief Events queued for one subscriber before it is cut off as too
+     * slow ("transfer_feed_buffer")
+     */
+    std::size_t subscriberBuffer = 4096;
+};
+
+/**
+ * @brief One committed transfer, as published to the subscribers
+ */
+struct TransferEvent {
+    std::uint64_t sequence = 0;     // given by TransferFeed, 1, 2, 3... within a stream
+    long long     transactionID = 0;
+    int           fromAccountID = 0;
+    int           toAccountID = 0;
+    std::int64_t  cents = 0;
+    std::size_t   source = 0;       // database of the row: 0 the primary, then the shards
+
+    /**
+     * @brief Reads a payload "<transaction_id> <from> <to> <amount>"
+     * (sequence is left to the feed)
+     *
+     * @return false if payload is not in that form
+     */
+    static bool parse(std::string_view payload, TransferEvent& event);
+
+    /** @brief "EVENT <sequence> <transaction_id> <from> <to> <amount>\n" */
+    std::string line() const;
+};
+
+/**
+ * @class TransferSubscription
+ *
+ * @brief Bounded queue of EVENT lines of one subscriber, filled by the feed
+ * and drained by the thread or coroutine serving the client
+ *
+ * When the subscriber falls subscriberBuffer events behind, the feed closes
+ * the subscription with a last line "ERROR Subscriber too slow, resume after
+ * <sequence>" instead of queueing more or slowing the other subscribers down
+ */
+class TransferSubscription {
+    public:
+        explicit TransferSubscription(std::size_t capacity);
+
+        /**
+         * @brief Appends the queued lines to out without waiting
+         *
+         * @return false once the subscription is closed and every line taken
+         */
+        bool take(std::string& out);
+
+        /**
+         * @brief Like take(), waiting up to timeout for a line or the close
+         * (threads backend)
+         */
+        bool waitAndTake(std::string& out, std::chrono::milliseconds timeout);
+
+        /**
+         * @brief Calls wake once, from any thread, as soon as lines are queued
+         * or the subscription is closed (right away if that is already the
+         * case). For the event loops, which post the resume of their coroutine
+         */
+        void onReady(std::function<void()> wake);
+
+        /** @brief Ends the subscription, finalLine (if any) is the last line taken */
+        void close(std::string finalLine = {});
+
+        /** @brief Sequence of the last event queued */
+        std::uint64_t lastSequence() const;
+
+        /**
+         * @brief Sequence of the last event taken, the resume position of a
+         * client that got every line taken so far
+         */
+        std::uint64_t takenSequence() const;
+
+    private:
+        friend class TransferFeed;
+
+        /**
+         * @brief Queues the line of event
+         *
+         * @param bounded closes the subscription instead when it is full
+         * (live events, the replay of a resume is queued whole)
+         * @return false once the subscription is closed
+         */
+        bool push(const TransferEvent& event, bool bounded = true);
+
+        const std::size_t capacity;
+
+        mutable std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::string> lines;
+        std::function<void()> wake;
+        std::uint64_t queuedSequence = 0;
+        std::uint64_t takenUpTo = 0;
+        bool closed = false;
+};
+
+/**
+ * @class TransferFeed
+ *
+ * @brief Publishes the committed transfers to the SUBSCRIBE clients of the
+ * server, so downstream services stop polling the transactions table
+ *
+ * A reader thread per database (the primary, then every shard) reads the
+ * rows committed since its last read every pollInterval, on one dedicated
+ * connection: transfers, netted records and the debit legs of cross shard
+ * transfers. Every row becomes a TransferEvent with the next sequence
+ * number, is kept in a replay ring of replayCapacity events and is queued to
+ * every subscription. The writers publish nothing themselves, a NOTIFY per
+ * transfer would serialize their commits on Postgres's notify queue lock.
+ *
+ * Sequence numbers restart with the process. The stream id (start time in
+ * ms) tells a client whether its last sequence belongs to this stream: a
+ * resume within the replay ring gets every event it missed, anything else
+ * is refused and the client backfills from the transactions table.
+ *
+ * A read asks for the transaction_ids above the last one seen and for the
+ * lower ids skipped so far (SERIAL ids do not commit in order, like
+ * AccountTable's pending ids). The first read of a reader starts at the
+ * newest row, a reader that lost its connection goes on where it stopped.
+ * Events are unique per database and transaction_id within the replay ring
+ */
+class TransferFeed {
+    public:
+        /**
+         * @brief Retrieve the unique (global) singleton instance of the feed
+         */
+        static TransferFeed& getInstance();
+
+        /** @brief Stops the reader threads */
+        ~TransferFeed();
+
+        /**
+         * @brief Starts the reader threads, no-op if running or disabled
+         *
+         * The replay ring and subscriber buffer sizes keep their first values,
+         * so do the shards read (DBConnection::getShardSettings())
+         */
+        void start(const TransferFeedSettings& settings);
+
+        /** @brief Stops the readers and closes every subscription */
+        void stop();
+
+        /**
+         * @brief Subscribes to the events after a position of the stream
+         *
+         * @param streamID stream of the resume position, 0 for live events only
+         * @param after last sequence the client received, set to the last one
+         * published for a live subscription
+         * @param error why the resume was refused, when returning nullptr
+         * @return the subscription, with the missed events already queued
+         */
+        std::shared_ptr<TransferSubscription> subscribe(std::uint64_t streamID, std::uint64_t& after,
+                                                        std::string& error);
+
+        /** @brief Forgets a subscription, the client is gone */
+        void unsubscribe(const std::shared_ptr<TransferSubscription>& subscription);
+
+        /**
+         * @brief Publishes one "<transaction_id> <from> <to> <amount>" payload
+         *
+         * @param source database of the transaction, see TransferEvent
+         * @return false if the payload is invalid or its transaction was
+         * already published
+         */
+        bool publish(std::string_view payload, std::size_t source = 0);
+
+        /** @brief Identifies this run of the stream, see class description */
+        std::uint64_t streamID() const;
+
+        /** @brief Sequence of the last event published, 0 if none */
+        std::uint64_t lastSequence() const;
+
+        /** @brief Live subscriptions */
+        std::size_t subscribers() const;
+
+    private:
+        TransferFeed();
+        TransferFeed(const TransferFeed&) = delete;
+        TransferFeed& operator=(const TransferFeed&) = delete;
+
+        /**
+         * @brief One database read, its transaction ids are its own
+         */
+        struct Source {
+            /** @brief libpq connection string, empty for the primary */
+            std::string connectionString;
+            std::string name;
+            std::thread reader;
+
+            /** @brief Highest transaction_id read */
+            long long lastTransactionID = 0;
+
+            /** @brief Ids below lastTransactionID without a row yet, still in flight */
+            std::unordered_set<long long> pending;
+
+            /** @brief The first read took the newest row as the start */
+            bool positioned = false;
+
+            /** @brief Ids of the events of this source in the replay ring */
+            std::unordered_set<long long> replayed;
+        };
+
+        void run(std::size_t source);
+
+        /**
+         * @brief Starts source at its newest transaction_id, the ids missing
+         * within PENDING_WINDOW below it are pending
+         */
+        void position(pqxx::connection& conn, std::size_t source);
+
+        /**
+         * @brief Publishes the rows of source committed since the last read,
+         * page by page until the backlog is read
+         */
+        void readCommitted(pqxx::connection& conn, std::size_t source);
+
+        /** @brief Moves the last id and the pending ids of source past id (mutex held) */
+        void track(Source& source, long long id);
+
+        bool publishEvent(TransferEvent event);
+
+        TransferFeedSettings settings;
+        const std::uint64_t stream;
+
+        std::atomic<bool> running{false};
+        std::mutex readerMutex;
+        std::condition_variable stopRequested;
+
+        /**
+         * @brief The primary first, then the shards added by start(). Only
+         * grows while no reader runs
+         */
+        std::vector<std::unique_ptr<Source>> sources;
+
+        mutable std::mutex mutex;
+        std::uint64_t sequence = 0;
+        std::deque<TransferEvent> replay;
+        std::vector<std::shared_ptr<TransferSubscription>> subscriptions;
+};
+
+#endif
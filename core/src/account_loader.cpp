@@ -0,0 +1,183 @@
+#include "account_loader.hpp"
+#include "database_connection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <string_view>
+
+namespace {
+    using SnapshotTransaction = pqxx::transaction<pqxx::isolation_level::repeatable_read,
+                                                  pqxx::write_policy::read_only>;
+}
+
+void AccountColumns::push(std::int32_t accountID, std::int32_t customerID, std::int64_t cents,
+                          std::string_view currency, AccountType type,
+                          std::string_view customerName, std::string_view customerEmail) {
+    CurrencyCode code{};
+    std::memcpy(code.data(), currency.data(), std::min(currency.size(), code.size()));
+
+    accountIDs.push_back(accountID);
+    balanceCents.push_back(cents);
+    currencies.push_back(code);
+    accountTypes.push_back(type);
+
+    customerIDs.push_back(customerID);
+    customerNames.push_back(strings.intern(customerName));
+    customerEmails.push_back(strings.intern(customerEmail));
+}
+
+void AccountColumns::reserve(std::size_t rows) {
+    accountIDs.reserve(rows);
+    balanceCents.reserve(rows);
+    currencies.reserve(rows);
+    accountTypes.reserve(rows);
+    customerIDs.reserve(rows);
+    customerNames.reserve(rows);
+    customerEmails.reserve(rows);
+}
+
+void AccountColumns::append(AccountColumns&& other) {
+    auto move = [](auto& to, auto& from) {
+        to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+        from.clear();
+    };
+
+    move(accountIDs, other.accountIDs);
+    move(balanceCents, other.balanceCents);
+    move(currencies, other.currencies);
+    move(accountTypes, other.accountTypes);
+    move(customerIDs, other.customerIDs);
+
+    /* every distinct string of other is interned once, its rows are remapped */
+    std::vector<StringPool::Handle> remap(other.strings.size());
+    for (StringPool::Handle handle = 0; handle < remap.size(); ++handle) {
+        remap[handle] = strings.intern(other.strings.view(handle));
+    }
+    for (StringPool::Handle handle : other.customerNames) {
+        customerNames.push_back(remap[handle]);
+    }
+    for (StringPool::Handle handle : other.customerEmails) {
+        customerEmails.push_back(remap[handle]);
+    }
+    other.customerNames.clear();
+    other.customerEmails.clear();
+    other.strings.clear();
+}
+
+std::vector<AccountRecord> AccountColumns::toRecords() const {
+    std::vector<AccountRecord> records(size());
+
+    for (std::size_t i = 0; i < size(); ++i) {
+        AccountRecord& rec = records[i];
+        rec.accountID    = accountIDs[i];
+        rec.customerID   = customerIDs[i];
+        rec.balanceCents = balanceCents[i];
+        std::memcpy(rec.currency, currencies[i].data(), currencies[i].size());
+        rec.accountType  = accountTypes[i];
+    }
+    return records;
+}
+
+std::size_t AccountColumns::memoryUsage() const {
+    return accountIDs.capacity() * sizeof(std::int32_t) +
+           balanceCents.capacity() * sizeof(std::int64_t) +
+           currencies.capacity() * sizeof(CurrencyCode) +
+           accountTypes.capacity() * sizeof(AccountType) +
+           customerIDs.capacity() * sizeof(std::int32_t) +
+           (customerNames.capacity() + customerEmails.capacity()) * sizeof(StringPool::Handle) +
+           strings.memoryUsage();
+}
+
+AccountLoader::AccountLoader(int workers) : workers(std::max(1, workers)) {
+}
+
+AccountColumns AccountLoader::load(const std::function<void(pqxx::transaction_base&)>& onSnapshot) {
+    auto started = std::chrono::steady_clock::now();
+
+    /* The leader keeps its transaction open until every worker finished,
+     * an exported snapshot is only importable while its exporter is alive */
+    auto conn = DBConnection::getInstance().openDedicatedConnection();
+    SnapshotTransaction leader(*conn);
+
+    auto snapshotID = leader.query_value<std::string>("SELECT pg_export_snapshot()");
+    auto bounds = leader.exec("SELECT COALESCE(MIN(account_id), 0), COALESCE(MAX(account_id), -1) FROM accounts")[0];
+    std::int64_t minID = bounds[0].as<std::int64_t>();
+    std::int64_t maxID = bounds[1].as<std::int64_t>();
+
+    if (onSnapshot) {
+        onSnapshot(leader);
+    }
+
+    /* Equal width account_id ranges, ids come from a SERIAL so they are dense */
+    std::int64_t span = maxID - minID + 1;
+    int rangeCount = static_cast<int>(std::min<std::int64_t>(workers, std::max<std::int64_t>(span, 1)));
+    std::int64_t width = (span + rangeCount - 1) / rangeCount;
+
+    std::vector<std::future<AccountColumns>> parts;
+    for (int i = 0; i < rangeCount && span > 0; ++i) {
+        std::int64_t lo = minID + i * width;
+        std::int64_t hi = std::min(maxID, lo + width - 1);
+        parts.push_back(std::async(std::launch::async, &AccountLoader::loadRange, snapshotID, lo, hi));
+    }
+
+    AccountColumns columns;
+    std::vector<AccountColumns> loaded;
+    std::size_t total = 0;
+    for (auto& part : parts) {
+        loaded.push_back(part.get());
+        total += loaded.back().size();
+    }
+
+    columns.reserve(total);
+    for (auto& part : loaded) {
+        columns.append(std::move(part));
+    }
+
+    leader.commit();
+
+    stats.rows = columns.size();
+    stats.workers = rangeCount;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    std::cout << "[AccountLoader] Loaded " << stats.rows << " accounts with " << stats.workers
+              << " workers in " << stats.seconds << "s (" << static_cast<long long>(stats.rowsPerSecond())
+              << " rows/s)\n";
+
+    return columns;
+}
+
+AccountColumns AccountLoader::loadRange(const std::string& snapshotID,
+                                        std::int64_t lo, std::int64_t hi) {
+    auto conn = DBConnection::getInstance().openDedicatedConnection();
+    SnapshotTransaction tx(*conn);
+
+    /* Must be the first statement of the transaction */
+    tx.exec("SET TRANSACTION SNAPSHOT " + tx.quote(snapshotID));
+
+    AccountColumns columns;
+    columns.reserve(static_cast<std::size_t>(hi - lo + 1));
+
+    /* COPY cannot take bind parameters, lo/hi are integers so inlining is safe */
+    const std::string query =
+        "SELECT a.account_id, a.customer_id,"
+        " a.balance + COALESCE((SELECT SUM(s.balance) FROM account_stripes s"
+        " WHERE s.account_id = a.account_id), 0), a.currency, a.account_type,"
+        " c.full_name, c.email "
+        "FROM accounts a JOIN customers c ON a.customer_id = c.customer_id "
+        "WHERE a.account_id BETWEEN " + std::to_string(lo) + " AND " + std::to_string(hi) +
+        " ORDER BY a.account_id";
+
+    for (auto [accountID, customerID, balance, currency, type, name, email] :
+         tx.stream<std::int32_t, std::int32_t, std::string_view, std::optional<std::string_view>,
+                   std::string_view, std::string_view, std::string_view>(query)) {
+        /* string_views point into the COPY line buffer, decode before the next row */
+        columns.push(accountID, customerID, parseCents(balance), currency.value_or("USD"),
+                     parseAccountType(type), name, email);
+    }
+
+    tx.commit();
+    return columns;
+}
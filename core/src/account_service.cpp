@@ -1,18 +1,36 @@
 #include "account_service.hpp"
 #include "database_connection.hpp"
+#include "shard_coordinator.hpp"
+#include "request_arena.hpp"
 
-std::optional<Account> AccountService::getAccount(int accountID) {
+#include <unordered_map>
+
+namespace {
+    /* row balance plus the stripes of a striped (hot) account, id appended */
+    constexpr const char* BALANCE_QUERY =
+        "SELECT a.balance + COALESCE((SELECT SUM(s.balance) FROM account_stripes s"
+        " WHERE s.account_id = a.account_id), 0) FROM accounts a WHERE a.account_id = ";
+}
+
+std::optional<Account> AccountService::getAccount(int accountID, ReadConsistency consistency) {
     std::cout << "[AccountService] getAccount(" << accountID << ") start\n";
 
-    auto& db = DBConnection::getInstance();
-    auto guard = db.lock();
-    auto tx = db.createReadTransaction();
+    /* the shard holding the account, else the primary (under its lock) or a
+     * replica, see ReplicaRouter */
+    auto& shards = ShardCoordinator::getInstance();
+    auto lease = shards.enabled() ? shards.acquireRead(accountID)
+                                  : ReplicaRouter::getInstance().acquireRead(consistency);
+    /* a single SELECT is atomic by itself, skipping BEGIN/COMMIT saves two round trips */
+    auto tx = lease.createAutocommitTransaction();
 
     std::cout << "[AccountService] getAccount(" << accountID << ") before exec\n";
 
     pqxx::result res = tx->exec(
         "SELECT a.account_id, a.customer_id, c.full_name AS customer_name,"
-        " c.email AS customer_email, a.account_type, a.balance, a.currency "
+        " c.email AS customer_email, a.account_type,"
+        /* a striped (hot) account also holds the credits of its stripes */
+        " a.balance + COALESCE((SELECT SUM(s.balance) FROM account_stripes s"
+        " WHERE s.account_id = a.account_id), 0) AS balance, a.currency "
         "FROM accounts a JOIN customers c ON a.customer_id = c.customer_id "
         "WHERE a.account_id = $1", accountID
     );
@@ -20,23 +38,14 @@ std::optional<Account> AccountService::getAccount(int accountID) {
     tx->commit();
 
     std::cout << "[AccountService] getAccount(" << accountID << ") after exec, rows = "
-              << res.size() << "\n";
+              << res.size() << (lease.onReplica() ? " (replica)" : "") << "\n";
 
     if (res.empty()) {
         return std::nullopt;
     }
 
-    const auto& row = res[0];
-
-    Account acc{
-        row["account_id"].as<int>(),
-        row["customer_id"].as<int>(),
-        row["customer_name"].as<std::string>(),
-        row["customer_email"].as<std::string>(),
-        row["account_type"].as<std::string>(),
-        row["balance"].as<double>(),
-        row["currency"].as<std::string>()
-    };
+    /* fields read by position, strings copied straight into the request arena */
+    Account acc = AccountRow::map(res[0]);
 
     std::cout << "[AccountService] getAccount(" << accountID << ") built Account\n";
 
@@ -52,7 +61,7 @@ bool AccountService::accountExist(int accountID) {
 double AccountService::getBalance(int accountId) {
     std::cout << "[AccountService] getBalance(" << accountId << ") called\n";
 
-    auto account = getAccount(accountId);
+    auto account = getAccount(accountId, ReplicaRouter::getInstance().balanceConsistency());
 
     std::cout << "[AccountService] getBalance(" << accountId << ") after getAccount\n";
 
@@ -67,6 +76,86 @@ double AccountService::getBalance(int accountId) {
     return account->balance;
 }
 
+std::vector<std::optional<double>> AccountService::getBalances(const std::vector<int>& accountIDs) {
+    std::cout << "[AccountService] getBalances(" << accountIDs.size() << " accounts) start\n";
+
+    std::vector<std::optional<double>> balances(accountIDs.size());
+    if (accountIDs.empty()) {
+        return balances;
+    }
+
+    if (ShardCoordinator::getInstance().enabled()) {
+        getShardedBalances(accountIDs, balances);
+        std::cout << "[AccountService] getBalances(" << accountIDs.size() << " accounts) done\n";
+        return balances;
+    }
+
+    auto lease = ReplicaRouter::getInstance().acquireRead(ReplicaRouter::getInstance().balanceConsistency());
+    auto tx = lease.createAutocommitTransaction();
+
+    pqxx::pipeline pipe(*tx);
+    /* hold the queries back until all of them are queued, then send them at once */
+    pipe.retain(static_cast<int>(accountIDs.size()));
+
+    std::vector<pqxx::pipeline::query_id> queries;
+    queries.reserve(accountIDs.size());
+    for (int id : accountIDs) {
+        /* pipeline queries take no parameters, ids are plain integers */
+        queries.push_back(pipe.insert(
+            std::string(BALANCE_QUERY) + std::to_string(id)));
+    }
+
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        pqxx::result res = pipe.retrieve(queries[i]);
+        if (!res.empty()) {
+            balances[i] = res[0][0].as<double>();
+        }
+    }
+    pipe.complete();
+
+    std::cout << "[AccountService] getBalances(" << accountIDs.size() << " accounts) done\n";
+
+    return balances;
+}
+
+void AccountService::getShardedBalances(const std::vector<int>& accountIDs,
+                                        std::vector<std::optional<double>>& balances) {
+    auto& shards = ShardCoordinator::getInstance();
+
+    /* one query per shard holding some of the ids: {id,...} array literal */
+    std::vector<std::string> idLists(shards.shardCount());
+    std::unordered_map<int, std::vector<std::size_t>> positions;
+    for (std::size_t i = 0; i < accountIDs.size(); ++i) {
+        auto& slots = positions[accountIDs[i]];
+        if (slots.empty()) {
+            std::string& list = idLists[shards.shardOf(accountIDs[i])];
+            list += (list.empty() ? "{" : ",") + std::to_string(accountIDs[i]);
+        }
+        slots.push_back(i);
+    }
+
+    for (std::size_t shard = 0; shard < idLists.size(); ++shard) {
+        if (idLists[shard].empty()) {
+            continue;
+        }
+
+        auto lease = shards.acquireShard(shard);
+        auto tx = lease.createAutocommitTransaction();
+        pqxx::result res = tx->exec(
+            "SELECT a.account_id, a.balance + COALESCE((SELECT SUM(s.balance) FROM account_stripes s"
+            " WHERE s.account_id = a.account_id), 0) FROM accounts a WHERE a.account_id = ANY($1::int[])",
+            pqxx::params{idLists[shard] + "}"});
+
+        for (const auto& row : res) {
+            double balance = row[1].as<double>();
+            /* the same id may be asked for several times */
+            for (std::size_t i : positions[row[0].as<int>()]) {
+                balances[i] = balance;
+            }
+        }
+    }
+}
+
 void AccountService::printAccount(int accountID) {
     auto openAccount = getAccount(accountID);
 
@@ -0,0 +1,346 @@
+#include "account_snapshot.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+    constexpr char MAGIC[8] = {'C', 'B', 'I', 'S', 'N', 'A', 'P', '1'};
+    constexpr std::uint64_t ALIGNMENT = 64;
+
+    std::uint64_t alignUp(std::uint64_t value) {
+        return (value + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+
+    /* Lookup table for the reflected IEEE polynomial 0xEDB88320 */
+    std::array<std::uint32_t, 256> makeCrcTable() {
+        std::array<std::uint32_t, 256> table{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+
+    /* write() until every byte is out, retrying on short writes and EINTR */
+    void writeAll(int fd, const void* data, std::size_t size, const std::string& path) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to write snapshot " + path + ": " + std::strerror(errno));
+            }
+            p += n;
+            size -= static_cast<std::size_t>(n);
+        }
+    }
+
+    /* Closes the descriptor when leaving scope */
+    struct FileGuard {
+        int fd;
+        ~FileGuard() { if (fd >= 0) ::close(fd); }
+    };
+
+    /* Unmaps the file when leaving scope */
+    struct MapGuard {
+        void* addr;
+        std::size_t size;
+        ~MapGuard() { if (addr != MAP_FAILED) ::munmap(addr, size); }
+    };
+}
+
+std::uint32_t AccountSnapshot::crc32(const void* data, std::size_t size, std::uint32_t crc) {
+    static const std::array<std::uint32_t, 256> table = makeCrcTable();
+
+    const auto* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void AccountSnapshot::write(const std::string& path,
+                            const std::vector<AccountRecord>& records,
+                            std::int64_t lastTransactionID,
+                            const std::vector<std::int64_t>& pending) {
+    /* Build the section table first, payload offsets depend on its size */
+    std::vector<SnapshotSection> sections;
+    std::vector<const void*> payloads;
+
+    for (std::uint64_t first = 0; first < records.size(); first += RECORDS_PER_SECTION) {
+        std::uint64_t count = std::min<std::uint64_t>(RECORDS_PER_SECTION, records.size() - first);
+        SnapshotSection s{};
+        s.type = SECTION_ACCOUNTS;
+        s.recordSize = sizeof(AccountRecord);
+        s.recordCount = count;
+        s.checksum = crc32(&records[first], count * sizeof(AccountRecord));
+        sections.push_back(s);
+        payloads.push_back(&records[first]);
+    }
+
+    SnapshotSection pendingSection{};
+    pendingSection.type = SECTION_PENDING;
+    pendingSection.recordSize = sizeof(std::int64_t);
+    pendingSection.recordCount = pending.size();
+    pendingSection.checksum = crc32(pending.data(), pending.size() * sizeof(std::int64_t));
+    sections.push_back(pendingSection);
+    payloads.push_back(pending.data());
+
+    std::uint64_t offset = alignUp(sizeof(SnapshotHeader) + sections.size() * sizeof(SnapshotSection));
+    for (auto& s : sections) {
+        s.offset = offset;
+        offset = alignUp(offset + s.recordCount * s.recordSize);
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sectionCount = static_cast<std::uint32_t>(sections.size());
+    header.lastTransactionID = lastTransactionID;
+    header.createdAt = static_cast<std::int64_t>(std::time(nullptr));
+    header.headerChecksum = crc32(sections.data(), sections.size() * sizeof(SnapshotSection),
+                                  crc32(&header, sizeof(header)));
+
+    /* Written next to the final file then renamed, so a crash never leaves
+     * a half written snapshot under the real name */
+    const std::string tmpPath = path + ".tmp";
+    FileGuard file{::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    if (file.fd < 0) {
+        throw std::runtime_error("Failed to open snapshot " + tmpPath + ": " + std::strerror(errno));
+    }
+
+    static const char zeros[ALIGNMENT] = {};
+    std::uint64_t written = 0;
+
+    writeAll(file.fd, &header, sizeof(header), tmpPath);
+    writeAll(file.fd, sections.data(), sections.size() * sizeof(SnapshotSection), tmpPath);
+    written = sizeof(header) + sections.size() * sizeof(SnapshotSection);
+
+    for (std::size_t i = 0; i < sections.size(); ++i) {
+        writeAll(file.fd, zeros, sections[i].offset - written, tmpPath);
+        std::uint64_t bytes = sections[i].recordCount * sections[i].recordSize;
+        writeAll(file.fd, payloads[i], bytes, tmpPath);
+        written = sections[i].offset + bytes;
+    }
+
+    if (::fsync(file.fd) != 0) {
+        throw std::runtime_error("Failed to sync snapshot " + tmpPath + ": " + std::strerror(errno));
+    }
+
+    if (::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to rename snapshot " + tmpPath + ": " + std::strerror(errno));
+    }
+
+    /* The rename itself only survives a crash once the directory is synced */
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    if (directory.empty()) {
+        directory = ".";
+    }
+    FileGuard dir{::open(directory.c_str(), O_RDONLY | O_DIRECTORY)};
+    if (dir.fd < 0 || ::fsync(dir.fd) != 0) {
+        throw std::runtime_error("Failed to sync snapshot directory " + directory + ": " + std::strerror(errno));
+    }
+}
+
+void AccountSnapshot::write(const std::string& path, const AccountTable& table) {
+    std::vector<AccountRecord> records;
+    std::vector<std::int64_t> pending;
+    std::int64_t lastTransactionID = 0;
+
+    table.copyTo(records, lastTransactionID, pending);
+    write(path, records, lastTransactionID, pending);
+}
+
+bool AccountSnapshot::load(const std::string& path, AccountTable& table) {
+    FileGuard file{::open(path.c_str(), O_RDONLY)};
+    if (file.fd < 0) {
+        std::cout << "[AccountSnapshot] No snapshot at " << path << "\n";
+        return false;
+    }
+
+    struct stat st{};
+    if (::fstat(file.fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        std::cout << "[AccountSnapshot] Snapshot " << path << " is truncated\n";
+        return false;
+    }
+
+    const std::size_t fileSize = static_cast<std::size_t>(st.st_size);
+    MapGuard map{::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, file.fd, 0), fileSize};
+    if (map.addr == MAP_FAILED) {
+        std::cout << "[AccountSnapshot] mmap failed for " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    ::madvise(map.addr, fileSize, MADV_SEQUENTIAL);
+
+    const auto* base = static_cast<const char*>(map.addr);
+    SnapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        std::cout << "[AccountSnapshot] " << path << " is not a version " << VERSION << " snapshot\n";
+        return false;
+    }
+
+    const std::size_t tableBytes = header.sectionCount * sizeof(SnapshotSection);
+    if (sizeof(SnapshotHeader) + tableBytes > fileSize) {
+        std::cout << "[AccountSnapshot] Snapshot " << path << " is truncated\n";
+        return false;
+    }
+
+    const auto* sections = reinterpret_cast<const SnapshotSection*>(base + sizeof(SnapshotHeader));
+
+    std::uint32_t expected = header.headerChecksum;
+    header.headerChecksum = 0;
+    if (crc32(sections, tableBytes, crc32(&header, sizeof(header))) != expected) {
+        std::cout << "[AccountSnapshot] Header checksum mismatch in " << path << "\n";
+        return false;
+    }
+
+    /* Bounds first, then every section checksum in parallel */
+    std::uint64_t accountCount = 0;
+    std::vector<std::future<bool>> checks;
+    for (std::uint32_t i = 0; i < header.sectionCount; ++i) {
+        const SnapshotSection& s = sections[i];
+        if (s.offset + s.recordCount * s.recordSize > fileSize) {
+            std::cout << "[AccountSnapshot] Section " << i << " out of bounds in " << path << "\n";
+            return false;
+        }
+        if (s.type == SECTION_ACCOUNTS) {
+            if (s.recordSize != sizeof(AccountRecord)) {
+                std::cout << "[AccountSnapshot] Unexpected record size in " << path << "\n";
+                return false;
+            }
+            accountCount += s.recordCount;
+        }
+        checks.push_back(std::async(std::launch::async, [base, s]() {
+            return crc32(base + s.offset, s.recordCount * s.recordSize) == s.checksum;
+        }));
+    }
+
+    bool valid = true;
+    for (std::size_t i = 0; i < checks.size(); ++i) {
+        if (!checks[i].get()) {
+            std::cout << "[AccountSnapshot] Checksum mismatch in section " << i << " of " << path << "\n";
+            valid = false;
+        }
+    }
+    if (!valid) {
+        return false;
+    }
+
+    std::vector<AccountRecord> records(accountCount);
+    std::vector<std::int64_t> pending;
+    std::size_t next = 0;
+
+    for (std::uint32_t i = 0; i < header.sectionCount; ++i) {
+        const SnapshotSection& s = sections[i];
+        if (s.type == SECTION_ACCOUNTS) {
+            std::memcpy(&records[next], base + s.offset, s.recordCount * sizeof(AccountRecord));
+            next += s.recordCount;
+        } else if (s.type == SECTION_PENDING && s.recordSize == sizeof(std::int64_t)) {
+            pending.resize(s.recordCount);
+            std::memcpy(pending.data(), base + s.offset, s.recordCount * sizeof(std::int64_t));
+        }
+    }
+
+    std::cout << "[AccountSnapshot] Loaded " << accountCount << " accounts from " << path
+              << ", watermark " << header.lastTransactionID << "\n";
+
+    table.reset(std::move(records), header.lastTransactionID, std::move(pending));
+    return true;
+}
+
+void AccountSnapshot::warmStart(const std::string& path, AccountTable& table) {
+    if (load(path, table)) {
+        table.replayTransactions();
+        return;
+    }
+
+    std::cout << "[AccountSnapshot] Falling back to full scan\n";
+    table.loadFromDatabase();
+}
+
+SnapshotWriter::SnapshotWriter(AccountTable& table, std::string path, std::chrono::seconds interval)
+    : table(table), snapshotPath(std::move(path)), interval(interval) {
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+void SnapshotWriter::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    writerThread = std::thread(&SnapshotWriter::run, this);
+}
+
+void SnapshotWriter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(waitMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+}
+
+void SnapshotWriter::run() {
+    bool warm = false;
+
+    while (true) {
+        if (!warm) {
+            try {
+                AccountSnapshot::warmStart(snapshotPath, table);
+                warm = true;
+            }
+            catch (const std::exception& e) {
+                /* retried from the snapshot on the next tick, reset() replaces what was loaded */
+                std::cout << "[SnapshotWriter] Warm start failed, retrying: " << e.what() << "\n";
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(waitMutex);
+            wakeUp.wait_for(guard, interval, [this]() { return !running; });
+            if (!running) {
+                return;
+            }
+        }
+
+        if (!warm) {
+            continue;
+        }
+
+        try {
+            table.replayTransactions();
+            AccountSnapshot::write(snapshotPath, table);
+            std::cout << "[SnapshotWriter] Wrote " << snapshotPath << "\n";
+        }
+        catch (const std::exception& e) {
+            /* keep the previous snapshot and retry on the next tick */
+            std::cout << "[SnapshotWriter] Snapshot failed: " << e.what() << "\n";
+        }
+    }
+}
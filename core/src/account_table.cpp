@@ -0,0 +1,313 @@
+#include "account_table.hpp"
+#include "database_connection.hpp"
+#include "account_loader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace {
+    /* Transaction ids are SERIAL, so a lower id can commit after a higher one.
+     * Gaps inside this window below the watermark are remembered as pending,
+     * older gaps are assumed to be rolled back transactions */
+    constexpr std::int64_t PENDING_WINDOW = 10000;
+
+    /* Builds a Postgres array literal like {1,2,3} */
+    std::string toArrayLiteral(const std::unordered_set<std::int64_t>& ids) {
+        std::string out = "{";
+        for (auto id : ids) {
+            if (out.size() > 1) {
+                out += ',';
+            }
+            out += std::to_string(id);
+        }
+        out += '}';
+        return out;
+    }
+}
+
+std::int64_t parseCents(std::string_view text) {
+    if (text.empty()) {
+        throw std::invalid_argument("Empty numeric value");
+    }
+
+    bool negative = false;
+    std::size_t pos = 0;
+    if (text[0] == '-' || text[0] == '+') {
+        negative = text[0] == '-';
+        ++pos;
+    }
+
+    std::int64_t units = 0;
+    std::int64_t cents = 0;
+    int fractionDigits = 0;
+    bool seenDigit = false;
+    bool inFraction = false;
+
+    for (; pos < text.size(); ++pos) {
+        char c = text[pos];
+        if (c == '.' && !inFraction) {
+            inFraction = true;
+            continue;
+        }
+        if (c < '0' || c > '9') {
+            throw std::invalid_argument("Invalid numeric value: " + std::string(text));
+        }
+        seenDigit = true;
+        if (!inFraction) {
+            units = units * 10 + (c - '0');
+        } else if (fractionDigits < 2) {
+            cents = cents * 10 + (c - '0');
+            ++fractionDigits;
+        }
+        /* digits beyond the second decimal are dropped, NUMERIC(14,2) never has them */
+    }
+
+    if (!seenDigit) {
+        throw std::invalid_argument("Invalid numeric value: " + std::string(text));
+    }
+
+    while (fractionDigits < 2) {
+        cents *= 10;
+        ++fractionDigits;
+    }
+
+    std::int64_t total = units * 100 + cents;
+    return negative ? -total : total;
+}
+
+std::string formatCents(std::int64_t cents) {
+    std::string sign = cents < 0 ? "-" : "";
+    std::uint64_t abs = cents < 0 ? static_cast<std::uint64_t>(-(cents + 1)) + 1
+                                  : static_cast<std::uint64_t>(cents);
+    std::string frac = std::to_string(abs % 100);
+    if (frac.size() < 2) {
+        frac.insert(frac.begin(), '0');
+    }
+    return sign + std::to_string(abs / 100) + "." + frac;
+}
+
+AccountType parseAccountType(std::string_view text) {
+    if (text == "checking") return AccountType::Checking;
+    if (text == "savings")  return AccountType::Savings;
+    if (text == "credit")   return AccountType::Credit;
+    throw std::invalid_argument("Unknown account type: " + std::string(text));
+}
+
+const char* accountTypeName(AccountType type) {
+    switch (type) {
+        case AccountType::Checking: return "checking";
+        case AccountType::Savings:  return "savings";
+        case AccountType::Credit:   return "credit";
+    }
+    return "unknown";
+}
+
+void AccountTable::reset(std::vector<AccountRecord> newRecords,
+                         std::int64_t lastTransactionID,
+                         std::vector<std::int64_t> pending) {
+    std::unique_lock<std::shared_mutex> guard(tableMutex);
+
+    records = std::move(newRecords);
+    lastTxID = lastTransactionID;
+    pendingTx.clear();
+    pendingTx.insert(pending.begin(), pending.end());
+    rebuildIndex();
+}
+
+void AccountTable::rebuildIndex() {
+    index.clear();
+    index.reserve(records.size());
+    maxAccountID = 0;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        index[records[i].accountID] = i;
+        maxAccountID = std::max(maxAccountID, records[i].accountID);
+    }
+}
+
+void AccountTable::loadFromDatabase() {
+    std::cout << "[AccountTable] Full scan of accounts start\n";
+
+    std::int64_t watermark = 0;
+    std::vector<std::int64_t> pending;
+
+    /* The watermark is read inside the loader's leader transaction, so it
+     * describes exactly the snapshot the workers stream the accounts from */
+    AccountLoader loader;
+    AccountColumns columns = loader.load([&](pqxx::transaction_base& tx) {
+        watermark = tx.query_value<std::int64_t>(
+            "SELECT COALESCE(MAX(transaction_id), 0) FROM transactions");
+
+        pqxx::result gaps = tx.exec(
+            "SELECT g FROM generate_series(GREATEST($1::bigint - $2, 0) + 1, $1::bigint) g "
+            "WHERE NOT EXISTS (SELECT 1 FROM transactions t WHERE t.transaction_id = g)",
+            pqxx::params{watermark, PENDING_WINDOW});
+
+        pending.reserve(gaps.size());
+        for (const auto& row : gaps) {
+            pending.push_back(row[0].as<std::int64_t>());
+        }
+    });
+
+    std::cout << "[AccountTable] Full scan loaded " << columns.size()
+              << " accounts, watermark " << watermark << "\n";
+
+    reset(columns.toRecords(), watermark, std::move(pending));
+}
+
+std::size_t AccountTable::replayTransactions() {
+    std::int64_t watermark;
+    std::int32_t knownAccounts;
+    std::string pendingArray;
+    {
+        std::shared_lock<std::shared_mutex> guard(tableMutex);
+        watermark = lastTxID;
+        knownAccounts = maxAccountID;
+        pendingArray = toArrayLiteral(pendingTx);
+    }
+
+    /* Both reads see the same snapshot: the balances of the new accounts
+     * include exactly the transactions replayed here */
+    auto conn = DBConnection::getInstance().openDedicatedConnection();
+    pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> tx(*conn);
+
+    pqxx::result res = tx.exec(
+        "SELECT transaction_id, from_account, to_account, amount FROM transactions "
+        "WHERE transaction_id > $1 OR transaction_id = ANY($2::bigint[]) "
+        "ORDER BY transaction_id",
+        pqxx::params{watermark, pendingArray});
+
+    pqxx::result created = tx.exec(
+        "SELECT account_id, customer_id, balance, COALESCE(currency, 'USD'), account_type FROM accounts "
+        "WHERE account_id > $1 ORDER BY account_id",
+        pqxx::params{knownAccounts});
+    tx.commit();
+
+    std::size_t applied = 0;
+    std::int64_t highest = watermark;
+    std::unordered_set<std::int64_t> seen;
+
+    for (const auto& row : res) {
+        std::int64_t id = row[0].as<std::int64_t>();
+        std::int32_t from = row[1].is_null() ? 0 : row[1].as<std::int32_t>();
+        std::int32_t to   = row[2].is_null() ? 0 : row[2].as<std::int32_t>();
+
+        if (applyTransaction(id, from, to, parseCents(row[3].view()))) {
+            ++applied;
+        }
+        seen.insert(id);
+        highest = std::max(highest, id);
+    }
+
+    /* Added after the replay, their balances already hold its deltas */
+    std::vector<AccountRecord> newRecords;
+    newRecords.reserve(created.size());
+    for (const auto& row : created) {
+        AccountRecord record{};
+        record.accountID = row[0].as<std::int32_t>();
+        record.customerID = row[1].as<std::int32_t>();
+        record.balanceCents = parseCents(row[2].view());
+        std::string_view currency = row[3].view();
+        std::memcpy(record.currency, currency.data(), std::min<std::size_t>(currency.size(), 3));
+        record.accountType = parseAccountType(row[4].view());
+        newRecords.push_back(record);
+    }
+    std::size_t added = addAccounts(newRecords);
+
+    /* Ids skipped between the old and the new watermark are still in flight */
+    std::unique_lock<std::shared_mutex> guard(tableMutex);
+    for (std::int64_t id = std::max(watermark, highest - PENDING_WINDOW) + 1; id < highest; ++id) {
+        if (!seen.count(id)) {
+            pendingTx.insert(id);
+        }
+    }
+    for (auto it = pendingTx.begin(); it != pendingTx.end();) {
+        if (*it <= lastTxID - PENDING_WINDOW) {
+            it = pendingTx.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::cout << "[AccountTable] Replayed " << applied << " transactions, watermark "
+              << lastTxID << ", " << added << " new accounts\n";
+    return applied;
+}
+
+bool AccountTable::applyTransaction(std::int64_t transactionID,
+                                    std::int32_t fromAccount,
+                                    std::int32_t toAccount,
+                                    std::int64_t amountCents) {
+    std::unique_lock<std::shared_mutex> guard(tableMutex);
+
+    if (transactionID <= lastTxID) {
+        /* below the watermark only pending ids still have to be applied */
+        if (pendingTx.erase(transactionID) == 0) {
+            return false;
+        }
+    } else {
+        lastTxID = transactionID;
+    }
+
+    auto from = index.find(fromAccount);
+    if (from != index.end()) {
+        records[from->second].balanceCents -= amountCents;
+    }
+
+    auto to = index.find(toAccount);
+    if (to != index.end()) {
+        records[to->second].balanceCents += amountCents;
+    }
+
+    return true;
+}
+
+std::size_t AccountTable::addAccounts(const std::vector<AccountRecord>& newRecords) {
+    std::unique_lock<std::shared_mutex> guard(tableMutex);
+
+    std::size_t added = 0;
+    for (const auto& record : newRecords) {
+        if (!index.emplace(record.accountID, records.size()).second) {
+            continue;
+        }
+        records.push_back(record);
+        maxAccountID = std::max(maxAccountID, record.accountID);
+        ++added;
+    }
+    return added;
+}
+
+std::optional<AccountRecord> AccountTable::find(std::int32_t accountID) const {
+    std::shared_lock<std::shared_mutex> guard(tableMutex);
+
+    auto it = index.find(accountID);
+    if (it == index.end()) {
+        return std::nullopt;
+    }
+    return records[it->second];
+}
+
+void AccountTable::copyTo(std::vector<AccountRecord>& out,
+                          std::int64_t& lastTransactionID,
+                          std::vector<std::int64_t>& pending) const {
+    std::shared_lock<std::shared_mutex> guard(tableMutex);
+
+    out.assign(records.begin(), records.end());
+    lastTransactionID = lastTxID;
+    pending.assign(pendingTx.begin(), pendingTx.end());
+}
+
+std::size_t AccountTable::size() const {
+    std::shared_lock<std::shared_mutex> guard(tableMutex);
+    return records.size();
+}
+
+std::int64_t AccountTable::lastTransactionID() const {
+    std::shared_lock<std::shared_mutex> guard(tableMutex);
+    return lastTxID;
+}
+
+std::int32_t AccountTable::highestAccountID() const {
+    std::shared_lock<std::shared_mutex> guard(tableMutex);
+    return maxAccountID;
+}
@@ -0,0 +1,336 @@
+#include "async_db.hpp"
+#include "account_table.hpp"
+#include "pg_binary.hpp"
+
+#include <sys/epoll.h>
+
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    /* same limits as RequestDeadline::applyTo(), local to the implicit transaction of the query */
+    constexpr const char* TIMEOUT_STATEMENT =
+        "SELECT set_config('statement_timeout', $1, true), set_config('lock_timeout', $1, true)";
+
+    /* libpq messages end with a newline, responses are single lines */
+    std::string trimMessage(const char* text) {
+        std::string message = text ? text : "";
+        while (!message.empty() && (message.back() == '\n' || message.back() == ' ')) {
+            message.pop_back();
+        }
+        return message;
+    }
+}
+
+AsyncResult::AsyncResult(PGresult* result, std::string error)
+    : result(result), message(std::move(error)) {
+}
+
+bool AsyncResult::ok() const {
+    return message.empty() && result != nullptr;
+}
+
+const std::string& AsyncResult::error() const {
+    return message;
+}
+
+int AsyncResult::rows() const {
+    return ok() ? PQntuples(result.get()) : 0;
+}
+
+bool AsyncResult::isNull(int row, int column) const {
+    return PQgetisnull(result.get(), row, column) != 0;
+}
+
+std::string_view AsyncResult::value(int row, int column) const {
+    return std::string_view(PQgetvalue(result.get(), row, column),
+                            static_cast<std::size_t>(PQgetlength(result.get(), row, column)));
+}
+
+std::int64_t AsyncResult::integer(int row, int column) const {
+    std::string_view field = value(row, column);
+
+    if (PQfformat(result.get(), column) == 1) {
+        switch (PQftype(result.get(), column)) {
+            case INT4_OID: return decodeInt4(field);
+            case INT8_OID: return decodeInt8(field);
+            default: throw std::invalid_argument("Column is not an integer");
+        }
+    }
+
+    std::int64_t number = 0;
+    auto parsed = std::from_chars(field.data(), field.data() + field.size(), number);
+    if (field.empty() || parsed.ec != std::errc() || parsed.ptr != field.data() + field.size()) {
+        throw std::invalid_argument("Invalid integer value: " + std::string(field));
+    }
+    return number;
+}
+
+std::int64_t AsyncResult::cents(int row, int column) const {
+    if (PQfformat(result.get(), column) == 1) {
+        if (PQftype(result.get(), column) != NUMERIC_OID) {
+            throw std::invalid_argument("Column is not numeric");
+        }
+        return decodeNumericCents(value(row, column));
+    }
+    return parseCents(value(row, column));
+}
+
+PGconn* AsyncDBConnection::open(const std::string& conninfo) {
+    PGconn* conn = PQconnectdb(conninfo.c_str());
+
+    if (PQstatus(conn) != CONNECTION_OK) {
+        std::string message = trimMessage(PQerrorMessage(conn));
+        PQfinish(conn);
+        throw std::runtime_error("Connection error: " + message);
+    }
+    return conn;
+}
+
+AsyncDBConnection::AsyncDBConnection(EventLoop& loop, const std::string& conninfo)
+    : AsyncDBConnection(loop, open(conninfo)) {
+}
+
+AsyncDBConnection::AsyncDBConnection(EventLoop& loop, PGconn* connected) : loop(loop), conn(connected) {
+    if (PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1) {
+        std::string message = trimMessage(PQerrorMessage(conn));
+        PQfinish(conn);
+        throw std::runtime_error("Failed to enter pipeline mode: " + message);
+    }
+
+    socket = PQsocket(conn);
+    loop.add(socket, EPOLLIN, [this](std::uint32_t events) { onEvents(events); });
+}
+
+AsyncDBConnection::~AsyncDBConnection() {
+    if (socket >= 0) {
+        loop.remove(socket);
+    }
+    broken = true;
+    failPending("Database connection closed");
+    PQfinish(conn);
+}
+
+void AsyncDBConnection::prepare(const std::string& name, const std::string& sql, ResultFormat results) {
+    resultFormats[name] = results;
+
+    if (broken || !PQsendPrepare(conn, name.c_str(), sql.c_str(), 0, nullptr)) {
+        std::cout << "[AsyncDB] prepare(" << name << ") failed: "
+                  << trimMessage(PQerrorMessage(conn)) << "\n";
+        return;
+    }
+
+    endQuery([name](AsyncResult result) {
+        if (!result.ok()) {
+            std::cout << "[AsyncDB] prepare(" << name << ") failed: " << result.error() << "\n";
+        }
+    });
+}
+
+void AsyncDBConnection::queryPrepared(const std::string& name,
+                                      const std::vector<std::string>& params,
+                                      Callback callback,
+                                      std::optional<std::chrono::milliseconds> timeout) {
+    if (broken) {
+        callback(AsyncResult(nullptr, "Database connection lost"));
+        return;
+    }
+
+    /* statements up to the next sync share an implicit transaction, so the
+     * local settings only last for the query sent right after them */
+    int skipResults = 0;
+    if (timeout) {
+        /* 0 would mean "no timeout" to Postgres */
+        const std::string ms = std::to_string(std::max<long long>(1, timeout->count()));
+        const char* value = ms.c_str();
+        if (!PQsendQueryParams(conn, TIMEOUT_STATEMENT, 1, nullptr, &value, nullptr, nullptr, 0)) {
+            callback(AsyncResult(nullptr, trimMessage(PQerrorMessage(conn))));
+            return;
+        }
+        skipResults = 1;
+    }
+
+    std::vector<const char*> values;
+    values.reserve(params.size());
+    for (const auto& param : params) {
+        values.push_back(param.c_str());
+    }
+
+    auto format = resultFormats.find(name);
+    int resultFormat = format == resultFormats.end() ? 0 : static_cast<int>(format->second);
+
+    if (!PQsendQueryPrepared(conn, name.c_str(), static_cast<int>(values.size()),
+                             values.data(), nullptr, nullptr, resultFormat)) {
+        callback(AsyncResult(nullptr, trimMessage(PQerrorMessage(conn))));
+        return;
+    }
+
+    endQuery(std::move(callback), skipResults);
+}
+
+AsyncDBConnection::Query AsyncDBConnection::query(const std::string& name,
+                                                  const std::vector<std::string>& params,
+                                                  std::optional<std::chrono::milliseconds> timeout) {
+    Query pendingQuery;
+
+    queryPrepared(name, params, [state = pendingQuery.state](AsyncResult result) {
+        state->result.emplace(std::move(result));
+        if (state->waiting) {
+            std::exchange(state->waiting, {}).resume();
+        }
+    }, timeout);
+
+    return pendingQuery;
+}
+
+void AsyncDBConnection::endQuery(Callback callback, int skipResults) {
+    pending.push_back(Pending{std::move(callback), nullptr, {}, skipResults});
+
+    /* One sync per query: isolates failures and ends its implicit transaction */
+    if (!PQpipelineSync(conn)) {
+        failAll(trimMessage(PQerrorMessage(conn)));
+        return;
+    }
+
+    flushOutput();
+}
+
+void AsyncDBConnection::cancel() {
+    if (broken || pending.empty()) {
+        return;
+    }
+
+    /* the cancel request travels on a separate short lived connection */
+    char message[256];
+    PGcancel* request = PQgetCancel(conn);
+    if (request && !PQcancel(request, message, sizeof(message))) {
+        std::cout << "[AsyncDB] cancel() failed: " << message << "\n";
+    }
+    PQfreeCancel(request);
+}
+
+std::size_t AsyncDBConnection::inFlight() const {
+    return pending.size();
+}
+
+bool AsyncDBConnection::isConnected() const {
+    return !broken;
+}
+
+void AsyncDBConnection::onEvents(std::uint32_t events) {
+    if (events & EPOLLOUT) {
+        flushOutput();
+    }
+
+    if (broken) {
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+        if (!PQconsumeInput(conn)) {
+            failAll(trimMessage(PQerrorMessage(conn)));
+            return;
+        }
+        readResults();
+    }
+}
+
+void AsyncDBConnection::readResults() {
+    while (!broken && !pending.empty() && !PQisBusy(conn)) {
+        PGresult* result = PQgetResult(conn);
+
+        if (result == nullptr) {
+            /* end of the results of the current query, its sync point follows */
+            continue;
+        }
+
+        ExecStatusType status = PQresultStatus(result);
+
+        if (status == PGRES_PIPELINE_SYNC) {
+            PQclear(result);
+
+            Pending done = std::move(pending.front());
+            pending.pop_front();
+
+            /* the callback may send new queries, pending is already consistent */
+            try {
+                done.callback(AsyncResult(done.result, std::move(done.error)));
+            }
+            catch (const std::exception& e) {
+                std::cout << "[AsyncDB] Callback exception: " << e.what() << "\n";
+            }
+            continue;
+        }
+
+        Pending& current = pending.front();
+
+        if (status == PGRES_FATAL_ERROR || status == PGRES_PIPELINE_ABORTED) {
+            if (current.error.empty()) {
+                current.error = status == PGRES_FATAL_ERROR
+                    ? trimMessage(PQresultErrorMessage(result))
+                    : "Pipeline aborted";
+            }
+            PQclear(result);
+        } else if (current.skipResults > 0) {
+            /* set_config() ahead of the query */
+            --current.skipResults;
+            PQclear(result);
+        } else if (current.result == nullptr) {
+            current.result = result;
+        } else {
+            /* single statement queries only produce one result */
+            PQclear(result);
+        }
+    }
+
+    if (!broken && PQstatus(conn) == CONNECTION_BAD) {
+        failAll(trimMessage(PQerrorMessage(conn)));
+    }
+}
+
+void AsyncDBConnection::flushOutput() {
+    if (broken) {
+        return;
+    }
+
+    int left = PQflush(conn);
+    if (left < 0) {
+        failAll(trimMessage(PQerrorMessage(conn)));
+        return;
+    }
+
+    /* 1 means the socket buffer is full, resume when it becomes writable */
+    bool wantWrite = left == 1;
+    if (wantWrite != watchingWrite) {
+        loop.modify(socket, wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+        watchingWrite = wantWrite;
+    }
+}
+
+void AsyncDBConnection::failAll(const std::string& message) {
+    std::cout << "[AsyncDB] Connection lost: " << message << "\n";
+
+    broken = true;
+    loop.remove(socket);
+    socket = -1;
+
+    failPending(message.empty() ? "Database connection lost" : message);
+}
+
+void AsyncDBConnection::failPending(const std::string& message) {
+    std::deque<Pending> failed;
+    failed.swap(pending);
+
+    for (auto& query : failed) {
+        PQclear(query.result);
+        try {
+            query.callback(AsyncResult(nullptr, message));
+        }
+        catch (const std::exception& e) {
+            std::cout << "[AsyncDB] Callback exception: " << e.what() << "\n";
+        }
+    }
+}
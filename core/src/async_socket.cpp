@@ -0,0 +1,116 @@
+#include "async_socket.hpp"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <utility>
+
+AsyncSocket::AsyncSocket(EventLoop& loop, int fd) : loop(loop), fd(fd) {
+    loop.add(fd, EPOLLIN, [this](std::uint32_t events) { onEvents(events); });
+}
+
+AsyncSocket::~AsyncSocket() {
+    loop.remove(fd);
+    ::close(fd);
+}
+
+void AsyncSocket::Readiness::await_suspend(std::coroutine_handle<> handle) {
+    if (writing) {
+        socket.writer = handle;
+        socket.watchWrite(true);
+    } else {
+        socket.reader = handle;
+    }
+}
+
+Task<ssize_t> AsyncSocket::read(char* buffer, std::size_t size) {
+    while (!closed) {
+        ssize_t n = ::recv(fd, buffer, size, 0);
+        if (n >= 0) {
+            co_return n;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            closed = true;
+            co_return n;
+        }
+        co_await Readiness{*this, false};
+    }
+    co_return 0;
+}
+
+Task<bool> AsyncSocket::write(std::string_view data) {
+    while (!data.empty() && !closed) {
+        ssize_t n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            data.remove_prefix(static_cast<std::size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            co_await Readiness{*this, true};
+            continue;
+        }
+        closed = true;
+    }
+
+    if (watchingWrite && !closed) {
+        watchWrite(false);
+    }
+    co_return data.empty();
+}
+
+void AsyncSocket::shutdown() {
+    if (closed) {
+        return;
+    }
+    closed = true;
+    ::shutdown(fd, SHUT_RDWR);
+
+    /* resumed coroutines see closed and return, they may destroy this socket */
+    auto waitingReader = std::exchange(reader, {});
+    auto waitingWriter = std::exchange(writer, {});
+    if (waitingReader) {
+        waitingReader.resume();
+    }
+    if (waitingWriter) {
+        waitingWriter.resume();
+    }
+}
+
+bool AsyncSocket::isOpen() const {
+    return !closed;
+}
+
+void AsyncSocket::onEvents(std::uint32_t events) {
+    std::coroutine_handle<> waitingReader;
+    std::coroutine_handle<> waitingWriter;
+
+    if (reader && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        waitingReader = std::exchange(reader, {});
+    }
+    if (writer && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        waitingWriter = std::exchange(writer, {});
+    }
+
+    /* do not touch members after resuming, the coroutine may own this socket */
+    if (waitingReader) {
+        waitingReader.resume();
+    }
+    if (waitingWriter) {
+        waitingWriter.resume();
+    }
+}
+
+void AsyncSocket::watchWrite(bool enable) {
+    if (enable != watchingWrite) {
+        loop.modify(fd, enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+        watchingWrite = enable;
+    }
+}
@@ -0,0 +1,361 @@
+#include "audit_log.hpp"
+#include "database_connection.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+
+namespace {
+    /* audit_logs.operation is VARCHAR(100) */
+    constexpr std::size_t MAX_OPERATION = 100;
+
+    /* a blocked record() looks for room this often */
+    constexpr std::chrono::microseconds BLOCK_RETRY{200};
+
+    /* COPY text format: backslash, tab and line breaks are escaped */
+    void appendEscaped(std::string& out, std::string_view text) {
+        for (char c : text) {
+            switch (c) {
+                case '\\': out += "\\\\"; break;
+                case '\t': out += "\\t";  break;
+                case '\n': out += "\\n";  break;
+                case '\r': out += "\\r";  break;
+                default:   out += c;
+            }
+        }
+    }
+
+    /* "2026-01-31 12:00:00.123456" */
+    void appendTimestamp(std::string& out, std::chrono::system_clock::time_point time) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+        std::time_t seconds = static_cast<std::time_t>(micros / 1000000);
+        std::tm utc{};
+        gmtime_r(&seconds, &utc);
+
+        char text[40];
+        std::size_t n = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+        n += static_cast<std::size_t>(std::snprintf(text + n, sizeof(text) - n, ".%06lld",
+                                                    static_cast<long long>(micros % 1000000)));
+        out.append(text, n);
+    }
+}
+
+AuditEvent AuditEvent::transfer(int fromAccountID, int toAccountID, double amount,
+                                std::string outcome, std::string detail) {
+    AuditEvent event;
+    event.operation = "transfer";
+    event.outcome = std::move(outcome);
+    event.fromAccountID = fromAccountID;
+    event.toAccountID = toAccountID;
+    event.amount = amount;
+    event.detail = std::move(detail);
+    return event;
+}
+
+AuditEvent AuditEvent::reload(std::string outcome) {
+    AuditEvent event;
+    event.operation = "reload";
+    event.outcome = std::move(outcome);
+    return event;
+}
+
+std::string auditCopyLine(const AuditEvent& event) {
+    std::string details;
+    auto field = [&details](const char* name) -> std::string& {
+        if (!details.empty()) {
+            details += ' ';
+        }
+        return details.append(name).append("=");
+    };
+
+    if (!event.outcome.empty()) {
+        field("outcome") += event.outcome;
+    }
+    if (event.fromAccountID != 0) {
+        field("from") += std::to_string(event.fromAccountID);
+    }
+    if (event.toAccountID != 0) {
+        field("to") += std::to_string(event.toAccountID);
+    }
+    if (event.amount != 0.0) {
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), event.amount);
+        field("amount").append(digits, result.ptr);
+    }
+    if (!event.detail.empty()) {
+        field("detail") += event.detail;
+    }
+
+    std::string line;
+    line.reserve(32 + event.operation.size() + details.size());
+    appendTimestamp(line, event.time);
+    line += '\t';
+    appendEscaped(line, std::string_view(event.operation).substr(0, MAX_OPERATION));
+    line += '\t';
+    appendEscaped(line, details);
+    return line;
+}
+
+AuditLog& AuditLog::getInstance() {
+    static AuditLog instance;
+    return instance;
+}
+
+AuditLog::~AuditLog() {
+    stop();
+}
+
+void AuditLog::start(const AuditSettings& newSettings) {
+    std::lock_guard<std::mutex> guard(writerMutex);
+    if (running) {
+        return;
+    }
+
+    settings = newSettings;
+    settings.batchSize = std::max<std::size_t>(settings.batchSize, 1);
+    settings.flushInterval = std::max(settings.flushInterval, std::chrono::milliseconds(1));
+    if (!queue) {
+        queue = std::make_unique<BoundedQueue<AuditEvent>>(settings.queueCapacity);
+    }
+
+    /* events spilled by a previous run are written once the queue is empty */
+    std::error_code ignored;
+    spilled = std::filesystem::exists(settings.spillPath, ignored) ||
+              std::filesystem::exists(settings.spillPath + ".replay", ignored);
+
+    running = true;
+    writer = std::thread(&AuditLog::run, this);
+
+    std::cout << "[AuditLog] Writer started: queue " << queue->capacity() << " events, flush every "
+              << settings.flushInterval.count() << " ms\n";
+}
+
+void AuditLog::stop() {
+    {
+        std::lock_guard<std::mutex> guard(writerMutex);
+        running = false;
+    }
+    wakeWriter.notify_all();
+
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+void AuditLog::record(AuditEvent event) {
+    if (!running.load(std::memory_order_acquire)) {
+        return;
+    }
+    if (queue->tryPush(event)) {
+        return;
+    }
+
+    switch (settings.overflow) {
+        case AuditOverflow::Block:
+            while (running.load(std::memory_order_acquire)) {
+                flushRequested = true;
+                wakeWriter.notify_one();
+                std::this_thread::sleep_for(BLOCK_RETRY);
+                if (queue->tryPush(event)) {
+                    return;
+                }
+            }
+            Metrics::getInstance().increment("audit.events_dropped");
+            return;
+
+        case AuditOverflow::Drop:
+            Metrics::getInstance().increment("audit.events_dropped");
+            return;
+
+        case AuditOverflow::Spill:
+            if (!spill(auditCopyLine(event))) {
+                Metrics::getInstance().increment("audit.events_dropped");
+            }
+            return;
+    }
+}
+
+void AuditLog::run() {
+    std::unique_lock<std::mutex> guard(writerMutex);
+    while (running) {
+        wakeWriter.wait_for(guard, settings.flushInterval, [this]() { return !running || flushRequested; });
+        flushRequested = false;
+        guard.unlock();
+
+        /* a full batch means more may be waiting */
+        while (flush() == settings.batchSize) {
+        }
+        if (spilled && batch.empty() && queue->sizeApprox() == 0) {
+            replaySpill();
+        }
+
+        guard.lock();
+    }
+    guard.unlock();
+
+    /* last attempt, what the database does not take is spilled or lost */
+    while (flush() > 0) {
+    }
+    if (spilled) {
+        replaySpill();
+    }
+
+    std::size_t lost = 0;
+    AuditEvent event;
+    while (queue->tryPop(event)) {
+        batch.push_back(auditCopyLine(event));
+    }
+    for (const auto& line : batch) {
+        if (settings.overflow != AuditOverflow::Spill || !spill(line)) {
+            ++lost;
+        }
+    }
+    batch.clear();
+    {
+        std::lock_guard<std::mutex> spillGuard(spillMutex);
+        spillFile.close();
+    }
+
+    if (lost > 0) {
+        Metrics::getInstance().increment("audit.events_dropped", static_cast<std::int64_t>(lost));
+        std::cout << "[AuditLog] " << lost << " event(s) not written at shutdown\n";
+    }
+    std::cout << "[AuditLog] Writer stopped\n";
+}
+
+std::size_t AuditLog::flush() {
+    if (!queue) {
+        return 0;
+    }
+
+    /* a batch that failed is retried as is, before anything newer */
+    if (batch.empty()) {
+        AuditEvent event;
+        while (batch.size() < settings.batchSize && queue->tryPop(event)) {
+            batch.push_back(auditCopyLine(event));
+        }
+    }
+    if (batch.empty()) {
+        return 0;
+    }
+
+    std::size_t next = 0;
+    if (!copyLines([&](std::string& line) {
+            if (next == batch.size()) {
+                return false;
+            }
+            line = batch[next++];
+            return true;
+        })) {
+        return 0;
+    }
+
+    std::size_t written = batch.size();
+    batch.clear();
+    Metrics::getInstance().increment("audit.events_written", static_cast<std::int64_t>(written));
+    return written;
+}
+
+std::size_t AuditLog::queued() const {
+    return queue ? queue->sizeApprox() : 0;
+}
+
+bool AuditLog::spill(const std::string& line) {
+    std::lock_guard<std::mutex> guard(spillMutex);
+
+    if (!spillFile.is_open()) {
+        auto directory = std::filesystem::path(settings.spillPath).parent_path();
+        std::error_code ignored;
+        if (!directory.empty()) {
+            std::filesystem::create_directories(directory, ignored);
+        }
+        spillFile.clear();
+        spillFile.open(settings.spillPath, std::ios::app);
+    }
+
+    if (!(spillFile << line << '\n')) {
+        return false;
+    }
+    spilled = true;
+    Metrics::getInstance().increment("audit.events_spilled");
+    return true;
+}
+
+bool AuditLog::replaySpill() {
+    /* the spill file is renamed so record() can go on spilling meanwhile, a
+     * replay file left by a failed attempt is retried before a new one is taken */
+    const std::string replayPath = settings.spillPath + ".replay";
+    std::error_code ignored;
+    {
+        std::lock_guard<std::mutex> guard(spillMutex);
+        if (spillFile.is_open()) {
+            spillFile.close();
+        }
+        spilled = false;
+        if (!std::filesystem::exists(replayPath, ignored)) {
+            if (!std::filesystem::exists(settings.spillPath, ignored)) {
+                return true;
+            }
+            std::filesystem::rename(settings.spillPath, replayPath, ignored);
+        }
+    }
+
+    std::ifstream file(replayPath);
+    std::size_t lines = 0;
+    bool copied = copyLines([&](std::string& line) {
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                ++lines;
+                return true;
+            }
+        }
+        return false;
+    });
+
+    if (!copied) {
+        spilled = true;
+        return false;
+    }
+
+    std::filesystem::remove(replayPath, ignored);
+    std::cout << "[AuditLog] " << lines << " spilled event(s) written\n";
+    Metrics::getInstance().increment("audit.events_written", static_cast<std::int64_t>(lines));
+    return true;
+}
+
+bool AuditLog::copyLines(const std::function<bool(std::string&)>& next) {
+    try {
+        if (!conn || !conn->is_open()) {
+            conn = DBConnection::getInstance().openDedicatedConnection();
+        }
+
+        pqxx::work tx(*conn);
+        auto stream = pqxx::stream_to::table(tx, {"audit_logs"}, {"log_timestamp", "operation", "details"});
+        std::string line;
+        while (next(line)) {
+            stream.write_raw_line(line);
+        }
+        stream.complete();
+        tx.commit();
+
+        if (failing) {
+            std::cout << "[AuditLog] Writing to audit_logs again\n";
+            failing = false;
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        /* logged once per outage, the writer retries every cycle */
+        if (!failing) {
+            std::cout << "[AuditLog] Write to audit_logs failed, retrying: " << e.what() << "\n";
+            failing = true;
+        }
+        Metrics::getInstance().increment("audit.write_failures");
+        conn.reset();
+        return false;
+    }
+}
@@ -0,0 +1,104 @@
+#include "circuit_breaker.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    const char* stateName(CircuitBreaker::State state) {
+        switch (state) {
+            case CircuitBreaker::State::Closed: return "closed";
+            case CircuitBreaker::State::Open:   return "open";
+            default:                            return "half_open";
+        }
+    }
+}
+
+CircuitBreaker::CircuitBreaker(std::string name, BreakerSettings settings)
+    : name(std::move(name)), settings(settings) {
+}
+
+void CircuitBreaker::configure(const BreakerSettings& newSettings) {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+    settings = newSettings;
+}
+
+bool CircuitBreaker::allowAttempt() {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+
+    bool allowed = false;
+    switch (current) {
+        case State::Closed:
+            allowed = true;
+            break;
+        case State::Open:
+            /* the first caller after the backoff is the probe */
+            if (Clock::now() >= retryAt) {
+                transition(State::HalfOpen);
+                allowed = true;
+            }
+            break;
+        case State::HalfOpen:
+            /* a probe is already running */
+            break;
+    }
+
+    if (!allowed) {
+        Metrics::getInstance().increment(name + ".circuit.rejected");
+    }
+    return allowed;
+}
+
+void CircuitBreaker::recordSuccess() {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+
+    consecutiveFailures = 0;
+    backoff = std::chrono::milliseconds(0);
+    if (current != State::Closed) {
+        transition(State::Closed);
+    }
+}
+
+void CircuitBreaker::recordFailure() {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+
+    ++consecutiveFailures;
+    if (current == State::Closed && consecutiveFailures < settings.failureThreshold) {
+        return;
+    }
+
+    /* 100 ms, 200 ms, 400 ms ... up to maxBackoff */
+    backoff = backoff.count() == 0 ? settings.initialBackoff
+                                   : std::min(backoff * 2, settings.maxBackoff);
+    retryAt = Clock::now() + backoff;
+    transition(State::Open);
+}
+
+CircuitBreaker::State CircuitBreaker::state() const {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+    return current;
+}
+
+std::chrono::milliseconds CircuitBreaker::retryIn() const {
+    std::lock_guard<std::mutex> guard(breakerMutex);
+
+    if (current != State::Open) {
+        return std::chrono::milliseconds(0);
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(retryAt - Clock::now());
+    return std::max(left, std::chrono::milliseconds(0));
+}
+
+void CircuitBreaker::transition(State next) {
+    current = next;
+
+    auto& metrics = Metrics::getInstance();
+    metrics.increment(name + ".circuit." + stateName(next));
+    metrics.set(name + ".circuit.state", static_cast<std::int64_t>(next));
+
+    std::cout << "[CircuitBreaker] " << name << " circuit " << stateName(next);
+    if (next == State::Open) {
+        std::cout << " for " << backoff.count() << " ms";
+    }
+    std::cout << "\n";
+}
@@ -0,0 +1,106 @@
+#include "config_reloader.hpp"
+#include "audit_log.hpp"
+#include "database_connection.hpp"
+#include "replica_router.hpp"
+#include "server.hpp"
+#include "metrics.hpp"
+
+#include <signal.h>
+#include <pthread.h>
+#include <cerrno>
+#include <ctime>
+#include <functional>
+#include <iostream>
+
+namespace {
+    /* how often the thread looks at requestReload() and stop() between signals */
+    constexpr long WAIT_NANOSECONDS = 200L * 1000 * 1000;
+}
+
+ConfigReloader::ConfigReloader(std::string path, Server& server)
+    : configPath(std::move(path)), server(server) {
+}
+
+ConfigReloader::~ConfigReloader() {
+    stop();
+}
+
+void ConfigReloader::blockReloadSignal() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+void ConfigReloader::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    reloaderThread = std::thread(&ConfigReloader::run, this);
+}
+
+void ConfigReloader::stop() {
+    running = false;
+
+    if (reloaderThread.joinable()) {
+        reloaderThread.join();
+    }
+}
+
+void ConfigReloader::requestReload() {
+    reloadRequested = true;
+}
+
+bool ConfigReloader::reload() {
+    std::cout << "[ConfigReloader] Reloading " << configPath << "\n";
+
+    try {
+        auto& db = DBConnection::getInstance();
+
+        /* the event loops' handshakes run before DBConnection swaps: one that
+         * fails leaves both backends on the current primary */
+        std::function<void()> moveEventLoops;
+        bool primaryChanged = db.reload(configPath, [&](const std::string& conninfo) {
+            moveEventLoops = server.openDatabase(conninfo);
+        });
+        if (moveEventLoops) {
+            moveEventLoops();
+        }
+
+        ReplicaRouter::getInstance().reload(db.getReplicaSettings());
+
+        Metrics::getInstance().increment("config.reloads");
+        AuditLog::getInstance().record(AuditEvent::reload("ok"));
+        std::cout << "[ConfigReloader] Reload done"
+                  << (primaryChanged ? ", primary connection replaced" : "") << "\n";
+        return true;
+    }
+    catch (const std::exception& e) {
+        Metrics::getInstance().increment("config.reload_failures");
+        AuditLog::getInstance().record(AuditEvent::reload("failed"));
+        std::cout << "[ConfigReloader] Reload failed, keeping the current config: " << e.what() << "\n";
+        return false;
+    }
+}
+
+void ConfigReloader::run() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+
+    const timespec wait{0, WAIT_NANOSECONDS};
+
+    while (running) {
+        /* SIGHUP is blocked everywhere (blockReloadSignal()), it waits here */
+        if (::sigtimedwait(&signals, nullptr, &wait) == SIGHUP) {
+            std::cout << "[ConfigReloader] SIGHUP received\n";
+            reloadRequested = true;
+        }
+
+        if (reloadRequested.exchange(false)) {
+            reload();
+        }
+    }
+}
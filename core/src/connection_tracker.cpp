@@ -0,0 +1,227 @@
+#include "connection_tracker.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, std::size_t slots, Clock::time_point now)
+    : tick(std::max(tick, std::chrono::milliseconds(1))), origin(now), slots(std::max<std::size_t>(slots, 1)) {
+
+}
+
+std::uint64_t TimerWheel::tickOf(Clock::time_point when) const {
+    if (when <= origin) {
+        return 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(when - origin);
+    return static_cast<std::uint64_t>((elapsed.count() + tick.count() - 1) / tick.count());
+}
+
+TimerWheel::TimerID TimerWheel::schedule(Clock::time_point when, Callback callback) {
+    /* a timer due now still waits for the next advance() */
+    std::uint64_t due = std::max(tickOf(when), currentTick + 1);
+    std::size_t slot = due % slots.size();
+
+    TimerID id = nextID++;
+    slots[slot].push_back(Timer{id, due, std::move(callback)});
+    timers.emplace(id, std::make_pair(slot, std::prev(slots[slot].end())));
+    return id;
+}
+
+bool TimerWheel::cancel(TimerID id) {
+    auto it = timers.find(id);
+    if (it == timers.end()) {
+        return false;
+    }
+    slots[it->second.first].erase(it->second.second);
+    timers.erase(it);
+    return true;
+}
+
+std::size_t TimerWheel::advance(Clock::time_point now) {
+    if (now < origin) {
+        return 0;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - origin);
+    std::uint64_t target = static_cast<std::uint64_t>(elapsed.count() / tick.count());
+    if (target <= currentTick) {
+        return 0;
+    }
+
+    /* past one revolution every slot is looked at once */
+    std::uint64_t steps = std::min<std::uint64_t>(target - currentTick, slots.size());
+
+    std::vector<Callback> due;
+    for (std::uint64_t step = 1; step <= steps; ++step) {
+        Slot& slot = slots[(currentTick + step) % slots.size()];
+        for (auto it = slot.begin(); it != slot.end();) {
+            if (it->dueTick <= target) {
+                due.push_back(std::move(it->callback));
+                timers.erase(it->id);
+                it = slot.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    currentTick = target;
+
+    for (auto& callback : due) {
+        callback();
+    }
+    return due.size();
+}
+
+ConnectionTracker::ConnectionTracker(ConnectionLimits limits) : settings(limits), wheel(TICK) {
+
+}
+
+ConnectionTracker::~ConnectionTracker() {
+    stop();
+}
+
+void ConnectionTracker::start() {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    if (running || !settings.timeouts()) {
+        return;
+    }
+    running = true;
+    timerThread = std::thread(&ConnectionTracker::run, this);
+}
+
+void ConnectionTracker::stop() {
+    {
+        std::lock_guard<std::mutex> guard(trackerMutex);
+        running = false;
+    }
+    stopRequested.notify_all();
+
+    if (timerThread.joinable()) {
+        timerThread.join();
+    }
+}
+
+void ConnectionTracker::run() {
+    std::unique_lock<std::mutex> guard(trackerMutex);
+    while (running) {
+        stopRequested.wait_for(guard, TICK, [this]() { return !running; });
+
+        guard.unlock();
+        expire();
+        guard.lock();
+    }
+}
+
+ConnectionTracker::ConnectionID ConnectionTracker::open(CloseHandler close) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    auto now = Clock::now();
+
+    if (settings.maxConnections > 0 && connections.size() - closing >= settings.maxConnections) {
+        /* under pressure the client quiet for the longest makes room */
+        if (idleOrder.empty() || now - connections.at(idleOrder.front()).idleSince < settings.evictIdleAfter) {
+            Metrics::getInstance().increment("server.connections_rejected");
+            return 0;
+        }
+        shut(idleOrder.front(), "server.connections_evicted");
+    }
+
+    ConnectionID id = nextID++;
+    connections[id].close = std::move(close);
+    connections[id].idlePosition = idleOrder.end();
+    enter(id, State::Idle, now);
+    return id;
+}
+
+void ConnectionTracker::close(ConnectionID id) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    auto it = connections.find(id);
+    if (it == connections.end()) {
+        return;
+    }
+
+    Connection& connection = it->second;
+    if (connection.state == State::Closing) {
+        --closing;
+    } else {
+        enter(id, State::Busy, Clock::now());
+    }
+    connections.erase(it);
+}
+
+void ConnectionTracker::idle(ConnectionID id) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    enter(id, State::Idle, Clock::now());
+}
+
+void ConnectionTracker::reading(ConnectionID id) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    enter(id, State::Reading, Clock::now());
+}
+
+void ConnectionTracker::busy(ConnectionID id) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    enter(id, State::Busy, Clock::now());
+}
+
+void ConnectionTracker::enter(ConnectionID id, State state, Clock::time_point now) {
+    auto it = connections.find(id);
+    if (it == connections.end() || it->second.state == State::Closing) {
+        return;
+    }
+
+    Connection& connection = it->second;
+
+    if (connection.timer != 0) {
+        wheel.cancel(connection.timer);
+        connection.timer = 0;
+    }
+    if (connection.idlePosition != idleOrder.end()) {
+        idleOrder.erase(connection.idlePosition);
+        connection.idlePosition = idleOrder.end();
+    }
+
+    connection.state = state;
+
+    if (state == State::Idle) {
+        connection.idleSince = now;
+        connection.idlePosition = idleOrder.insert(idleOrder.end(), id);
+        if (settings.idleTimeout.count() > 0) {
+            connection.timer = wheel.schedule(now + settings.idleTimeout, [this, id]() {
+                shut(id, "server.idle_timeouts");
+            });
+        }
+    } else if (state == State::Reading && settings.readTimeout.count() > 0) {
+        connection.timer = wheel.schedule(now + settings.readTimeout, [this, id]() {
+            shut(id, "server.read_timeouts");
+        });
+    }
+}
+
+void ConnectionTracker::shut(ConnectionID id, const char* metric) {
+    auto it = connections.find(id);
+    if (it == connections.end() || it->second.state == State::Closing) {
+        return;
+    }
+
+    /* no timer, out of the idle list: a Busy connection */
+    enter(id, State::Busy, Clock::now());
+    it->second.state = State::Closing;
+    ++closing;
+
+    Metrics::getInstance().increment(metric);
+    it->second.close(id);
+}
+
+std::size_t ConnectionTracker::expire(Clock::time_point now) {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    return wheel.advance(now);
+}
+
+std::size_t ConnectionTracker::active() const {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    return connections.size() - closing;
+}
+
+std::size_t ConnectionTracker::idleCount() const {
+    std::lock_guard<std::mutex> guard(trackerMutex);
+    return idleOrder.size();
+}
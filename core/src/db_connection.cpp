@@ -1,6 +1,10 @@
 /* Develop our functions and class implementation */
 #include "database_connection.hpp"
 #include "json.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cctype>
 
 using json = nlohmann::json;
 
@@ -13,6 +17,78 @@ DBConnection& DBConnection::getInstance() {
 }
 
 void DBConnection::loadConfig(const std::string& path) {
+    parse(path);
+    breaker.configure(breakerSettings);
+}
+
+bool DBConnection::reload(const std::string& path,
+                          const std::function<void(const std::string& conninfo)>& beforeSwap) {
+    /* parsed aside: a bad file leaves the running configuration alone */
+    DBConnection staged;
+    staged.parse(path);
+
+    bool primaryChanged = staged.connectionString != getConnectionString();
+
+    /* conn may be replaced by reconnect() meanwhile, read like the swaps do */
+    bool connected;
+    {
+        std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+        connected = conn && conn->is_open();
+    }
+
+    /* the handshakes happen before the swap, requests keep the old connection meanwhile */
+    std::unique_ptr<pqxx::connection> fresh;
+    if (primaryChanged && connected) {
+        fresh = staged.openDedicatedConnection();
+    }
+    if (primaryChanged && beforeSwap) {
+        beforeSwap(staged.connectionString);
+    }
+
+    std::unique_ptr<pqxx::connection> retired;
+    {
+        /* waits for the query running on the old connection, if any */
+        auto guard = lock();
+        std::lock_guard<std::mutex> configGuard(configMutex);
+
+        if (fresh) {
+            std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+            retired = std::move(conn);
+            conn = std::move(fresh);
+            broken = false;
+        }
+
+        host = staged.host;
+        port = staged.port;
+        dbname = staged.dbname;
+        user = staged.user;
+        password = staged.password;
+        sslmode = staged.sslmode;
+        connect_timeout = staged.connect_timeout;
+        connectionString = staged.connectionString;
+        replicaSettings = staged.replicaSettings;
+        breakerSettings = staged.breakerSettings;
+
+        /* moving accounts between shards is not something a reload can do */
+        if (staged.shardSettings.connectionStrings != shardSettings.connectionStrings
+            || staged.shardSettings.placement != shardSettings.placement
+            || staged.shardSettings.rangeBounds != shardSettings.rangeBounds) {
+            std::cout << "[DBConnection] Shard layout changed, restart to apply it\n";
+        }
+    }
+
+    breaker.configure(breakerSettings);
+
+    /* closed outside the lock, the new connection is already serving */
+    if (retired) {
+        retired.reset();
+        breaker.recordSuccess();
+    }
+
+    return primaryChanged;
+}
+
+void DBConnection::parse(const std::string& path) {
     std::ifstream file(path);
 
     /* Check if config file is accessible */
@@ -43,6 +119,69 @@ void DBConnection::loadConfig(const std::string& path) {
        << " connect_timeout=" << connect_timeout;
 
     connectionString = ss.str();
+
+    /* Replicas and shards: every field missing from an entry is the primary's */
+    auto entryConnectionString = [&](const json& entry) {
+        std::ostringstream es;
+        es << "host=" << entry.value("host", host)
+           << " port=" << entry.value("port", port)
+           << " dbname=" << entry.value("dbname", dbname)
+           << " user=" << entry.value("user", user)
+           << " password=" << entry.value("password", password)
+           << " sslmode=" << entry.value("sslmode", sslmode)
+           << " connect_timeout=" << entry.value("connect_timeout", connect_timeout);
+        return es.str();
+    };
+
+    /* Optional read replicas */
+    replicaSettings = ReplicaSettings{};
+    for (const auto& replica : cfg.value("read_replicas", json::array())) {
+        replicaSettings.connectionStrings.push_back(entryConnectionString(replica));
+    }
+    replicaSettings.maxLag = std::chrono::milliseconds(
+        cfg.value("replica_max_lag_ms", replicaSettings.maxLag.count()));
+    replicaSettings.checkInterval = std::chrono::milliseconds(
+        cfg.value("replica_check_interval_ms", replicaSettings.checkInterval.count()));
+    replicaSettings.balanceOnReplica = cfg.value("balance_on_replica", replicaSettings.balanceOnReplica);
+
+    /* Optional shards, accounts are spread between them by account_id */
+    shardSettings = ShardSettings{};
+    for (const auto& shard : cfg.value("shards", json::array())) {
+        shardSettings.connectionStrings.push_back(entryConnectionString(shard));
+    }
+
+    std::string placement = cfg.value("shard_placement", "hash");
+    if (placement == "hash") {
+        shardSettings.placement = ShardPlacement::Hash;
+    } else if (placement == "range") {
+        shardSettings.placement = ShardPlacement::Range;
+        shardSettings.rangeBounds = cfg.value("shard_ranges", std::vector<int>{});
+
+        if (!shardSettings.connectionStrings.empty()
+            && shardSettings.rangeBounds.size() + 1 != shardSettings.connectionStrings.size()) {
+            throw std::runtime_error("shard_ranges needs one bound less than the number of shards");
+        }
+        if (!std::is_sorted(shardSettings.rangeBounds.begin(), shardSettings.rangeBounds.end())) {
+            throw std::runtime_error("shard_ranges must be in ascending order");
+        }
+    } else {
+        throw std::runtime_error("Unknown shard_placement: " + placement);
+    }
+    shardSettings.recoveryLogPath = cfg.value("shard_recovery_log", shardSettings.recoveryLogPath);
+    shardSettings.nodeID = cfg.value("shard_node_id", shardSettings.nodeID);
+    if (shardSettings.nodeID.empty() || shardSettings.nodeID.size() > 32
+        || !std::all_of(shardSettings.nodeID.begin(), shardSettings.nodeID.end(),
+                        [](unsigned char c) { return std::isalnum(c); })) {
+        throw std::runtime_error("shard_node_id must be 1 to 32 letters or digits");
+    }
+
+    /* Optional reconnect tuning of the primary */
+    breakerSettings = BreakerSettings{};
+    breakerSettings.failureThreshold = cfg.value("reconnect_failure_threshold", breakerSettings.failureThreshold);
+    breakerSettings.initialBackoff = std::chrono::milliseconds(
+        cfg.value("reconnect_initial_backoff_ms", breakerSettings.initialBackoff.count()));
+    breakerSettings.maxBackoff = std::chrono::milliseconds(
+        cfg.value("reconnect_max_backoff_ms", breakerSettings.maxBackoff.count()));
 }
 
 void DBConnection::connect() {
@@ -70,22 +209,225 @@ bool DBConnection::isConnected() const {
 }
 
 pqxx::connection& DBConnection::getConnection() {
-    /* If not connect, throw a runtime_error */
-    if (!isConnected())
+    /* If connect() never succeeded, throw a runtime_error */
+    if (!conn)
         throw std::runtime_error("Database not connected!");
+
+    /* a restart since the last request left an EOF on the socket, reading it
+     * (get_notifs() consumes input, sends nothing) tells before any statement */
+    if (!broken && conn->is_open()) {
+        try {
+            conn->get_notifs();
+        }
+        catch (const pqxx::broken_connection&) {
+            broken = true;
+        }
+    }
+
+    /* broken since the last request, reopened before handing it out */
+    if (broken || !conn->is_open())
+        reconnect();
+
     return *conn;
 }
 
+void DBConnection::reconnect() {
+    broken = true;
+    auto fresh = probe();
+
+    {
+        std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+        conn = std::move(fresh);
+    }
+    broken = false;
+    probing = false;
+
+    breaker.recordSuccess();
+    Metrics::getInstance().increment("db.reconnects");
+    std::cout << "[DBConnection] Reconnected\n";
+}
+
+std::unique_ptr<pqxx::connection> DBConnection::probe() {
+    if (probing.exchange(true)) {
+        throw DatabaseUnavailable("Database unavailable, reconnecting");
+    }
+
+    if (!breaker.allowAttempt()) {
+        probing = false;
+        throw DatabaseUnavailable("Database unavailable, retry in "
+                                  + std::to_string(breaker.retryIn().count()) + " ms");
+    }
+
+    /* the threads queued for the lock would wait out the connect: they are
+     * sent away, and lock() refuses newcomers while probing is set */
+    lockQueue.dismissWaiters();
+    std::cout << "[DBConnection] Connection lost, reconnecting\n";
+
+    try {
+        return openDedicatedConnection();
+    }
+    catch (const std::exception& e) {
+        breaker.recordFailure();
+        probing = false;
+        throw DatabaseUnavailable(std::string("Database unavailable: ") + e.what());
+    }
+}
+
+template <typename Transaction>
+std::unique_ptr<Transaction> DBConnection::beginTransaction() {
+    try {
+        return std::make_unique<Transaction>(getConnection());
+    }
+    catch (const pqxx::broken_connection&) {
+        /* the BEGIN is all that was sent, nothing of the caller ran yet */
+        std::cout << "[DBConnection] Connection broke before BEGIN, retrying once\n";
+        broken = true;
+        return std::make_unique<Transaction>(getConnection());
+    }
+}
+
+CircuitBreaker::State DBConnection::circuitState() const {
+    return breaker.state();
+}
+
 std::unique_ptr<pqxx::work> DBConnection::createWriteTransaction() {
     /* a unique pointer to a newly created pqxx::work transaction */
-    return std::make_unique<pqxx::work>(getConnection());
+    auto tx = beginTransaction<pqxx::work>();
+    RequestDeadline::applyTo(*tx);
+    return tx;
 }
 
 std::unique_ptr<pqxx::read_transaction> DBConnection::createReadTransaction() {
     /* a unique pointer to a newly created pqxx::read_transaction query*/
-    return std::make_unique<pqxx::read_transaction>(getConnection());
+    auto tx = beginTransaction<pqxx::read_transaction>();
+    RequestDeadline::applyTo(*tx);
+    return tx;
+}
+
+std::unique_ptr<pqxx::transaction_base> DBConnection::createAutocommitTransaction() {
+    if (RequestDeadline::current()) {
+        return createWriteTransaction();
+    }
+
+    /* a unique pointer to a newly created pqxx::nontransaction */
+    return std::make_unique<pqxx::nontransaction>(getConnection());
+}
+
+std::unique_ptr<pqxx::connection> DBConnection::openDedicatedConnection() const {
+    try {
+        auto dedicated = std::make_unique<pqxx::connection>(getConnectionString());
+
+        if (!dedicated->is_open()) {
+            throw std::runtime_error("Database connection failed.");
+        }
+        return dedicated;
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Connection error: ") + e.what());
+    }
+}
+
+std::string DBConnection::getConnectionString() const {
+    std::lock_guard<std::mutex> guard(configMutex);
+    return connectionString;
+}
+
+ReplicaSettings DBConnection::getReplicaSettings() const {
+    std::lock_guard<std::mutex> guard(configMutex);
+    return replicaSettings;
+}
+
+ShardSettings DBConnection::getShardSettings() const {
+    std::lock_guard<std::mutex> guard(configMutex);
+    return shardSettings;
+}
+
+void DBConnection::cancelQuery() {
+    std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+    cancelRunningQuery();
+}
+
+bool DBConnection::cancelQueryOf(std::uint64_t generation) {
+    std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+
+    /* someone took the lock since, the query running now is theirs */
+    if (generation != lockGeneration || !isConnected())
+        return false;
+
+    cancelRunningQuery();
+    return true;
+}
+
+void DBConnection::cancelRunningQuery() {
+    if (!isConnected())
+        return;
+
+    try {
+        /* libpq sends the cancel request on a separate socket (PQcancel) */
+        conn->cancel_query();
+    }
+    catch (const std::exception& e) {
+        std::cout << "[DBConnection] cancelQuery() failed: " << e.what() << "\n";
+    }
 }
 
 std::unique_lock<std::mutex> DBConnection::lock() {
-    return std::unique_lock<std::mutex>(dbMutex);
+    /* lost connection with a reconnect under way or the circuit open:
+     * refused right away rather than after queueing for the lock */
+    if (broken) {
+        auto retryIn = breaker.retryIn();
+        if (probing || retryIn.count() > 0) {
+            Metrics::getInstance().increment("db.circuit.rejected");
+            throw DatabaseUnavailable(probing ? std::string("Database unavailable, reconnecting")
+                                              : "Database unavailable, retry in "
+                                                + std::to_string(retryIn.count()) + " ms");
+        }
+    }
+
+    auto deadline = RequestDeadline::current();
+    if (!lockQueue.enter(RequestClassScope::current(), deadline)) {
+        if (lockQueue.isClosed()) {
+            throw DatabaseUnavailable("Server is shutting down");
+        }
+        if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+            throw DeadlineExceeded("Deadline exceeded waiting for the database");
+        }
+        /* sent away by a reconnect, see probe() */
+        throw DatabaseUnavailable("Database unavailable, reconnecting");
+    }
+
+    /* the thread holding the turn is the only one blocked on dbMutex, so the
+     * mutex is handed over in the order chosen by the fair queue */
+    std::unique_lock<std::mutex> guard(dbMutex);
+    lockQueue.leave();
+
+    /* had the turn when closeLock() came, waited for the cancelled query */
+    if (lockQueue.isClosed()) {
+        throw DatabaseUnavailable("Server is shutting down");
+    }
+
+    std::uint64_t generation;
+    {
+        std::lock_guard<std::mutex> cancelGuard(cancelMutex);
+        generation = ++lockGeneration;
+    }
+
+    if (deadline) {
+        /* unlocked by the unwinding if it already passed */
+        RequestDeadline::check("waiting for the database");
+        RequestDeadline::watchPrimary(generation);
+    }
+    return guard;
+}
+
+void DBConnection::closeLock() {
+    lockQueue.close();
+}
+
+void DBConnection::reopenLock() {
+    lockQueue.reopen();
+}
+
+void DBConnection::setLockWeights(unsigned interactive, unsigned bulk) {
+    lockQueue.setWeights(interactive, bulk);
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "event_loop.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    constexpr int MAX_EVENTS = 256;
+}
+
+EventLoop::EventLoop() {
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw std::runtime_error(std::string("Failed to create epoll instance: ") + std::strerror(errno));
+    }
+
+    wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        ::close(epollFd);
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + std::strerror(errno));
+    }
+
+    add(wakeFd, EPOLLIN, [this](std::uint32_t) {
+        std::uint64_t value;
+        while (::read(wakeFd, &value, sizeof(value)) > 0) {
+        }
+    });
+}
+
+EventLoop::~EventLoop() {
+    ::close(wakeFd);
+    ::close(epollFd);
+}
+
+void EventLoop::add(int fd, std::uint32_t events, Handler handler) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl(ADD) failed: ") + std::strerror(errno));
+    }
+    handlers[fd] = std::make_shared<Handler>(std::move(handler));
+}
+
+void EventLoop::modify(int fd, std::uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (::epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl(MOD) failed: ") + std::strerror(errno));
+    }
+}
+
+void EventLoop::remove(int fd) {
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+void EventLoop::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(tasksMutex);
+        tasks.push_back(std::move(task));
+    }
+
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(wakeFd, &one, sizeof(one));
+}
+
+void EventLoop::stop() {
+    stopRequested = true;
+
+    std::uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = ::write(wakeFd, &one, sizeof(one));
+}
+
+bool EventLoop::inLoopThread() const {
+    return loopThread.load() == std::this_thread::get_id();
+}
+
+void EventLoop::runPostedTasks() {
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> guard(tasksMutex);
+        ready.swap(tasks);
+    }
+
+    for (auto& task : ready) {
+        task();
+    }
+}
+
+void EventLoop::poll(int timeoutMs) {
+    epoll_event events[MAX_EVENTS];
+
+    int n = ::epoll_wait(epollFd, events, MAX_EVENTS, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::runtime_error(std::string("epoll_wait failed: ") + std::strerror(errno));
+    }
+
+    for (int i = 0; i < n; ++i) {
+        auto it = handlers.find(events[i].data.fd);
+        if (it == handlers.end()) {
+            /* removed by an earlier handler of this same batch */
+            continue;
+        }
+
+        /* keep the handler alive even if it removes itself */
+        std::shared_ptr<Handler> handler = it->second;
+        (*handler)(events[i].events);
+    }
+
+    runPostedTasks();
+}
+
+void EventLoop::run() {
+    loopThread = std::this_thread::get_id();
+
+    while (!stopRequested) {
+        poll(-1);
+    }
+
+    /* tasks posted right before stop() still run, they may release resources */
+    runPostedTasks();
+    loopThread = std::thread::id{};
+}
+
+bool EventLoop::isStopped() const {
+    return stopRequested;
+}
+
+int EventLoop::fd() const {
+    return epollFd;
+}
@@ -0,0 +1,109 @@
+#include "fair_queue.hpp"
+
+#include <algorithm>
+
+namespace {
+    thread_local RequestClass currentClass = RequestClass::Interactive;
+}
+
+RequestClassScope::RequestClassScope(RequestClass requestClass) : previous(currentClass) {
+    currentClass = requestClass;
+}
+
+RequestClassScope::~RequestClassScope() {
+    currentClass = previous;
+}
+
+RequestClass RequestClassScope::current() {
+    return currentClass;
+}
+
+void FairQueue::setWeights(unsigned interactive, unsigned bulk) {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    weights[static_cast<int>(RequestClass::Interactive)] = std::max(1u, interactive);
+    weights[static_cast<int>(RequestClass::Bulk)] = std::max(1u, bulk);
+}
+
+bool FairQueue::enter(RequestClass requestClass,
+                      std::optional<std::chrono::steady_clock::time_point> deadline) {
+    std::unique_lock<std::mutex> guard(queueMutex);
+    if (closed) {
+        return false;
+    }
+
+    const int index = static_cast<int>(requestClass);
+    double start = std::max(virtualTime, lastFinish[index]);
+    lastFinish[index] = start + 1.0 / weights[index];
+
+    /* nobody to be fair to: take the turn right away */
+    if (!busy && waiting.empty()) {
+        busy = true;
+        virtualTime = start;
+        return true;
+    }
+
+    Waiter self;
+    auto key = std::make_pair(start, arrivals++);
+    waiting.emplace(key, &self);
+
+    auto done = [this, &self]() { return self.admitted || self.dismissed || closed; };
+    if (!deadline) {
+        self.wakeUp.wait(guard, done);
+    } else {
+        self.wakeUp.wait_until(guard, *deadline, done);
+    }
+    if (self.admitted) {
+        return true;
+    }
+
+    /* timed out or sent away and still queued, nobody refers to self any more */
+    waiting.erase(key);
+    return false;
+}
+
+void FairQueue::leave() {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    busy = false;
+    admitNext();
+}
+
+void FairQueue::close() {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    closed = true;
+    for (auto& [key, waiter] : waiting) {
+        waiter->wakeUp.notify_one();
+    }
+}
+
+void FairQueue::dismissWaiters() {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    for (auto& [key, waiter] : waiting) {
+        waiter->dismissed = true;
+        waiter->wakeUp.notify_one();
+    }
+}
+
+void FairQueue::reopen() {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    closed = false;
+}
+
+bool FairQueue::isClosed() const {
+    std::lock_guard<std::mutex> guard(queueMutex);
+    return closed;
+}
+
+void FairQueue::admitNext() {
+    if (busy || closed || waiting.empty()) {
+        return;
+    }
+
+    auto next = waiting.begin();
+    virtualTime = next->first.first;
+    Waiter* waiter = next->second;
+    waiting.erase(next);
+
+    busy = true;
+    waiter->admitted = true;
+    waiter->wakeUp.notify_one();
+}
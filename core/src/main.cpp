@@ -1,9 +1,36 @@
 /* Main file for the running transaction Server */
 #include "database_connection.hpp"
+#include "replica_router.hpp"
+#include "shard_coordinator.hpp"
 #include "server.hpp"
+#include "account_snapshot.hpp"
+#include "stripe_folder.hpp"
+#include "netting_service.hpp"
+#include "config_reloader.hpp"
+#include "request_deadline.hpp"
+#include "audit_log.hpp"
+#include "transfer_feed.hpp"
 #include <iostream>
 #include <string>
 #include <cstdlib>
+#include <chrono>
+#include <filesystem>
+
+/* DB credentials, re-read on SIGHUP or RELOAD */
+static const std::string DB_CONFIG_PATH = "config/db_credential.json";
+
+/* Optional listening options (acceptors, backlog, socket flags) */
+static const std::string SERVER_CONFIG_PATH = "config/server.json";
+
+/* Snapshot of the in-process account table, rewritten every SNAPSHOT_INTERVAL */
+static const std::string SNAPSHOT_PATH = "data/accounts.snap";
+static constexpr std::chrono::seconds SNAPSHOT_INTERVAL{60};
+
+/* Stripes of hot accounts are folded into their account row this often */
+static constexpr std::chrono::milliseconds STRIPE_FOLD_INTERVAL{5000};
+
+/* Transfers between internal accounts accumulate this long before being netted */
+static constexpr std::chrono::milliseconds NETTING_WINDOW{5};
 
 /**
  * @brief Simple helper to parse host/port from argv.
@@ -31,6 +58,9 @@ static void parseArgs(int argc, char* argv[],
 
 int main(int argc, char* argv[]) {
     try {
+        /* before any thread exists: they all inherit the blocked SIGHUP */
+        ConfigReloader::blockReloadSignal();
+
         std::string host;
         int port;
         parseArgs(argc, argv, host, port);
@@ -41,7 +71,7 @@ int main(int argc, char* argv[]) {
 
         /* Init and connect the DB */
         auto& db = DBConnection::getInstance();
-        db.loadConfig("config/db_credential.json");
+        db.loadConfig(DB_CONFIG_PATH);
         db.connect();
 
         if (!db.isConnected()) {
@@ -51,9 +81,49 @@ int main(int argc, char* argv[]) {
 
         std::cout << "[Main] Connected to database successfully.\n";
 
+        /* Read replicas of db_credential.json ("read_replicas"), if any */
+        ReplicaRouter::getInstance().start();
+
+        /* Shards of db_credential.json ("shards"), if any: settles what a
+         * previous run left prepared before serving transfers */
+        ShardCoordinator::getInstance().start();
+
+        /* The in-process account table is rebuilt in the background (snapshot +
+         * transactions tail, or a full scan when there is no valid snapshot yet) */
+        std::filesystem::create_directories(std::filesystem::path(SNAPSHOT_PATH).parent_path());
+        AccountTable accountTable;
+
+        SnapshotWriter snapshotWriter(accountTable, SNAPSHOT_PATH, SNAPSHOT_INTERVAL);
+        snapshotWriter.start();
+
+        StripeFolder stripeFolder(STRIPE_FOLD_INTERVAL);
+        stripeFolder.start();
+
+        /* Cancels the queries of "DEADLINE" requests that outlive it */
+        DeadlineWatchdog::getInstance().start();
+
+        /* Internal accounts (table internal_accounts), if any */
+        NettingService::getInstance().start(NETTING_WINDOW);
+
         /* Starts the TCP server on host,port */
-        Server server(host, port);
+        ServerConfig serverConfig;
+        if (std::filesystem::exists(SERVER_CONFIG_PATH)) {
+            serverConfig = ServerConfig::fromFile(SERVER_CONFIG_PATH);
+        }
+
+        /* audit events of transfers and commands, written to audit_logs in the background */
+        AuditLog::getInstance().start(serverConfig.audit);
+
+        /* committed transfers for SUBSCRIBE clients, one LISTEN for all of them */
+        TransferFeed::getInstance().start(serverConfig.feed);
+
+        Server server(host, port, serverConfig);
+
+        ConfigReloader configReloader(DB_CONFIG_PATH, server);
+        server.setReloadHandler([&configReloader]() { configReloader.requestReload(); });
+
         server.start();
+        configReloader.start();
 
         std::cout << "[Main] Server running on " << host << ":" << port
                   << ". Press Enter to stop...\n";
@@ -63,7 +133,15 @@ int main(int argc, char* argv[]) {
         std::cin.get();
 
         std::cout << "[Main] Shutting down server...\n";
+        configReloader.stop();
         server.stop();
+        TransferFeed::getInstance().stop();
+        NettingService::getInstance().stop();
+        AuditLog::getInstance().stop();
+        snapshotWriter.stop();
+        stripeFolder.stop();
+        DeadlineWatchdog::getInstance().stop();
+        ReplicaRouter::getInstance().stop();
         std::cout << "[Main] Server stopped cleanly.\n";
     }
     catch (const std::exception& e) {
@@ -0,0 +1,30 @@
+#include "metrics.hpp"
+
+Metrics& Metrics::getInstance() {
+    static Metrics instance;
+    return instance;
+}
+
+std::atomic<std::int64_t>& Metrics::get(const std::string& name) {
+    std::lock_guard<std::mutex> guard(metricsMutex);
+    /* try_emplace value initializes the atomic to 0 on first use */
+    return values.try_emplace(name, 0).first->second;
+}
+
+void Metrics::increment(const std::string& name, std::int64_t delta) {
+    get(name).fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::set(const std::string& name, std::int64_t value) {
+    get(name).store(value, std::memory_order_relaxed);
+}
+
+std::map<std::string, std::int64_t> Metrics::snapshot() const {
+    std::lock_guard<std::mutex> guard(metricsMutex);
+
+    std::map<std::string, std::int64_t> out;
+    for (const auto& [name, value] : values) {
+        out[name] = value.load(std::memory_order_relaxed);
+    }
+    return out;
+}
@@ -0,0 +1,285 @@
+#include "netting_service.hpp"
+#include "database_connection.hpp"
+#include "shard_coordinator.hpp"
+#include "metrics.hpp"
+#include "request_deadline.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+namespace {
+    /* NUMERIC literal of an amount in cents: 1234 -> "12.34" */
+    std::string centsToString(std::int64_t cents) {
+        std::string sign = cents < 0 ? "-" : "";
+        std::int64_t absolute = std::llabs(cents);
+        std::string fraction = std::to_string(absolute % 100);
+        if (fraction.size() < 2) {
+            fraction.insert(0, "0");
+        }
+        return sign + std::to_string(absolute / 100) + "." + fraction;
+    }
+
+    /* The transfers of one account pair in a flush, low < high */
+    struct NettedPair {
+        /* positive: low pays high */
+        std::int64_t             netCents = 0;
+        std::vector<std::size_t> members;
+        std::string              error;
+    };
+}
+
+NettingService& NettingService::getInstance() {
+    static NettingService instance;
+    return instance;
+}
+
+NettingService::~NettingService() {
+    stop();
+}
+
+void NettingService::start(std::chrono::milliseconds newWindow, std::size_t newMaxBatch) {
+    if (running) {
+        return;
+    }
+
+    if (ShardCoordinator::getInstance().enabled()) {
+        std::cout << "[NettingService] Sharded database, netting disabled\n";
+        return;
+    }
+
+    internalAccounts.clear();
+    {
+        auto& db = DBConnection::getInstance();
+        auto guard = db.lock();
+        auto tx = db.createReadTransaction();
+        pqxx::result res = tx->exec(
+            "SELECT i.account_id, a.currency "
+            "FROM internal_accounts i JOIN accounts a ON a.account_id = i.account_id");
+        tx->commit();
+
+        for (const auto& row : res) {
+            internalAccounts.emplace(row[0].as<int>(), row[1].as<std::string>());
+        }
+    }
+
+    if (internalAccounts.empty()) {
+        return;
+    }
+
+    window = newWindow;
+    maxBatch = newMaxBatch;
+
+    std::cout << "[NettingService] Netting transfers between " << internalAccounts.size()
+              << " internal account(s), window " << window.count() << " ms\n";
+
+    running = true;
+    flusherThread = std::thread(&NettingService::run, this);
+}
+
+void NettingService::stop() {
+    {
+        std::lock_guard<std::mutex> guard(pendingMutex);
+        running = false;
+    }
+    pendingChanged.notify_all();
+
+    if (flusherThread.joinable()) {
+        flusherThread.join();
+    }
+}
+
+bool NettingService::eligible(int fromAccountID, int toAccountID) const {
+    return running && fromAccountID != toAccountID
+        && internalAccounts.count(fromAccountID) > 0
+        && internalAccounts.count(toAccountID) > 0;
+}
+
+void NettingService::transfer(int fromAccountID, int toAccountID, double amount,
+                              const std::string& description) {
+    std::int64_t cents = std::llround(amount * 100.0);
+    if (cents <= 0) {
+        throw std::runtime_error("Transfer failed: Transfer amount must be positive");
+    }
+
+    /* the same checks as transferMoney(), a net transfer would not see them */
+    const std::string& fromCurrency = internalAccounts.at(fromAccountID);
+    const std::string& toCurrency = internalAccounts.at(toAccountID);
+    if (fromCurrency != toCurrency) {
+        throw std::runtime_error("Transfer failed: Currency mismatch: " + fromCurrency + " vs " + toCurrency);
+    }
+
+    auto claim = std::make_shared<std::atomic<Claim>>(Claim::Queued);
+    std::future<void> done;
+    bool queued;
+    {
+        std::lock_guard<std::mutex> guard(pendingMutex);
+        pending.push_back(PendingTransfer{fromAccountID, toAccountID, cents, description, {}, claim});
+        done = pending.back().done.get_future();
+        queued = running;
+    }
+
+    if (queued) {
+        pendingChanged.notify_one();
+    } else {
+        /* stopped between eligible() and here, nobody else will flush it */
+        flush();
+    }
+
+    auto deadline = RequestDeadline::current();
+    if (deadline && done.wait_until(*deadline) == std::future_status::timeout) {
+        /* not taken yet: the flush will skip it, nothing gets recorded */
+        Claim expected = Claim::Queued;
+        if (claim->compare_exchange_strong(expected, Claim::Withdrawn)) {
+            Metrics::getInstance().increment("netting.withdrawn");
+            throw DeadlineExceeded("Deadline exceeded waiting for the netting flush");
+        }
+    }
+
+    done.get();
+}
+
+std::size_t NettingService::flush() {
+    std::lock_guard<std::mutex> flushGuard(flushMutex);
+
+    std::vector<PendingTransfer> batch;
+    {
+        std::lock_guard<std::mutex> guard(pendingMutex);
+        batch.swap(pending);
+    }
+
+    if (batch.empty()) {
+        return 0;
+    }
+
+    std::map<std::pair<int, int>, NettedPair> pairs;
+    std::size_t taken = 0;
+    std::size_t committed = 0;
+    std::size_t netTransfers = 0;
+
+    try {
+        auto& db = DBConnection::getInstance();
+        auto guard = db.lock();
+
+        /* holding the database: the transfers still wanted are taken, the
+         * ones whose caller's deadline passed meanwhile are left out */
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            const auto& request = batch[i];
+            Claim expected = Claim::Queued;
+            if (!request.claim->compare_exchange_strong(expected, Claim::Taken)) {
+                continue;
+            }
+            ++taken;
+
+            /* ordered by pair: rows are locked in account order, flush after flush */
+            bool lowPays = request.fromAccountID < request.toAccountID;
+            auto key = lowPays ? std::make_pair(request.fromAccountID, request.toAccountID)
+                               : std::make_pair(request.toAccountID, request.fromAccountID);
+
+            NettedPair& pair = pairs[key];
+            pair.netCents += lowPays ? request.cents : -request.cents;
+            pair.members.push_back(i);
+        }
+
+        if (pairs.empty()) {
+            return 0;
+        }
+
+        auto tx = db.createWriteTransaction();
+
+        for (auto& [key, pair] : pairs) {
+            if (pair.netCents == 0) {
+                continue;
+            }
+
+            int from = pair.netCents > 0 ? key.first : key.second;
+            int to   = pair.netCents > 0 ? key.second : key.first;
+
+            try {
+                pqxx::subtransaction savepoint(*tx, "netted_pair");
+                savepoint.exec("SELECT applyTransferBalances($1, $2, $3::numeric)",
+                               pqxx::params{from, to, centsToString(std::llabs(pair.netCents))});
+                savepoint.commit();
+                ++netTransfers;
+            }
+            catch (const pqxx::sql_error& e) {
+                /* rolled back to the savepoint, the other pairs go on */
+                pair.error = e.what();
+            }
+        }
+
+        /* every individual transfer of the accepted pairs, in one COPY */
+        auto stream = pqxx::stream_to::table(*tx, {"transactions"},
+                                             {"from_account", "to_account", "amount", "description", "status"});
+        for (const auto& [key, pair] : pairs) {
+            if (!pair.error.empty()) {
+                continue;
+            }
+            for (std::size_t i : pair.members) {
+                const auto& request = batch[i];
+                stream.write_values(request.fromAccountID, request.toAccountID,
+                                    centsToString(request.cents), request.description, "netted");
+                ++committed;
+            }
+        }
+        stream.complete();
+
+        tx->commit();
+    }
+    catch (const std::exception& e) {
+        std::cout << "[NettingService] Flush of " << batch.size() << " transfer(s) failed: " << e.what() << "\n";
+
+        /* refused before anything was sent (circuit open, closeLock()):
+         * retryable, like the transfers that are not netted */
+        auto failure = dynamic_cast<const DatabaseUnavailable*>(&e)
+                           ? std::current_exception()
+                           : std::make_exception_ptr(std::runtime_error(std::string("Transfer failed: ") + e.what()));
+        for (auto& request : batch) {
+            request.done.set_exception(failure);
+        }
+        return 0;
+    }
+
+    for (const auto& [key, pair] : pairs) {
+        for (std::size_t i : pair.members) {
+            if (pair.error.empty()) {
+                batch[i].done.set_value();
+            } else {
+                batch[i].done.set_exception(std::make_exception_ptr(
+                    std::runtime_error("Transfer failed: " + pair.error)));
+            }
+        }
+    }
+
+    auto& metrics = Metrics::getInstance();
+    metrics.increment("netting.flushes");
+    metrics.increment("netting.transfers", static_cast<std::int64_t>(committed));
+    metrics.increment("netting.net_transfers", static_cast<std::int64_t>(netTransfers));
+    metrics.increment("netting.rejected", static_cast<std::int64_t>(taken - committed));
+
+    return committed;
+}
+
+void NettingService::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(pendingMutex);
+            pendingChanged.wait(guard, [this]() { return !running || !pending.empty(); });
+
+            /* the window opens with the first queued transfer */
+            pendingChanged.wait_for(guard, window, [this]() {
+                return !running || pending.size() >= maxBatch;
+            });
+        }
+
+        flush();
+
+        if (!running) {
+            /* transfer() flushes by itself from now on */
+            flush();
+            return;
+        }
+    }
+}
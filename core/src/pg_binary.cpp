@@ -0,0 +1,74 @@
+#include "pg_binary.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr std::uint16_t NUMERIC_NEG = 0x4000;
+    constexpr std::uint16_t NUMERIC_POS = 0x0000;
+
+    /* network byte order, whatever the host's */
+    std::uint64_t readBigEndian(const char* data, int bytes) {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = (value << 8) | static_cast<unsigned char>(data[i]);
+        }
+        return value;
+    }
+
+    std::uint16_t readUInt16(const char* data) {
+        return static_cast<std::uint16_t>(readBigEndian(data, 2));
+    }
+}
+
+std::int32_t decodeInt4(std::string_view field) {
+    if (field.size() != 4) {
+        throw std::invalid_argument("Invalid binary int4 field");
+    }
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(readBigEndian(field.data(), 4)));
+}
+
+std::int64_t decodeInt8(std::string_view field) {
+    if (field.size() != 8) {
+        throw std::invalid_argument("Invalid binary int8 field");
+    }
+    return static_cast<std::int64_t>(readBigEndian(field.data(), 8));
+}
+
+std::int64_t decodeNumericCents(std::string_view field) {
+    if (field.size() < 8) {
+        throw std::invalid_argument("Invalid binary numeric field");
+    }
+
+    int ndigits = readUInt16(field.data());
+    int weight = static_cast<std::int16_t>(readUInt16(field.data() + 2));
+    std::uint16_t sign = readUInt16(field.data() + 4);
+
+    if (field.size() != 8 + 2 * static_cast<std::size_t>(ndigits)) {
+        throw std::invalid_argument("Invalid binary numeric field");
+    }
+    if (sign != NUMERIC_POS && sign != NUMERIC_NEG) {
+        throw std::invalid_argument("Numeric value is NaN or infinite");
+    }
+
+    auto digit = [&](int i) -> std::int64_t {
+        return i < ndigits ? readUInt16(field.data() + 8 + 2 * i) : 0;
+    };
+
+    /* digits 0..weight are the integer part, trailing zero digits are not sent */
+    constexpr std::int64_t MAX_UNITS = std::numeric_limits<std::int64_t>::max() / 100;
+    std::int64_t units = 0;
+    for (int i = 0; i <= weight; ++i) {
+        if (units > (MAX_UNITS - digit(i)) / 10000) {
+            throw std::out_of_range("Numeric value does not fit in cents");
+        }
+        units = units * 10000 + digit(i);
+    }
+
+    /* the first fractional digit holds the cents in its two high decimal places */
+    int firstFraction = weight + 1;
+    std::int64_t cents = firstFraction >= 0 ? digit(firstFraction) / 100 : 0;
+
+    std::int64_t total = units * 100 + cents;
+    return sign == NUMERIC_NEG ? -total : total;
+}
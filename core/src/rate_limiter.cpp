@@ -0,0 +1,110 @@
+#include "rate_limiter.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cmath>
+
+TokenBucket::TokenBucket(RateLimit limit, Clock::time_point now)
+    : limit(limit), tokens(limit.burst), last(now) {
+}
+
+void TokenBucket::refill(Clock::time_point now) {
+    std::chrono::duration<double> elapsed = now - last;
+    if (elapsed.count() > 0) {
+        tokens = std::min(limit.burst, tokens + elapsed.count() * limit.perSecond);
+        last = now;
+    }
+}
+
+std::size_t TokenBucket::take(std::size_t wanted, Clock::time_point now) {
+    if (!limit.enabled()) {
+        return wanted;
+    }
+
+    refill(now);
+    std::size_t taken = std::min(wanted, static_cast<std::size_t>(tokens));
+    tokens -= static_cast<double>(taken);
+    return taken;
+}
+
+void TokenBucket::refund(std::size_t count) {
+    if (limit.enabled()) {
+        tokens = std::min(limit.burst, tokens + static_cast<double>(count));
+    }
+}
+
+std::chrono::milliseconds TokenBucket::waitTime(Clock::time_point now) {
+    if (!limit.enabled()) {
+        return std::chrono::milliseconds(0);
+    }
+
+    refill(now);
+    if (tokens >= 1.0) {
+        return std::chrono::milliseconds(0);
+    }
+    return std::chrono::milliseconds(
+        static_cast<long long>(std::ceil((1.0 - tokens) * 1000.0 / limit.perSecond)));
+}
+
+bool TokenBucket::full(Clock::time_point now) const {
+    std::chrono::duration<double> elapsed = now - last;
+    return tokens + elapsed.count() * limit.perSecond >= limit.burst;
+}
+
+RateLimiter::RateLimiter(RateLimit perConnection, RateLimit perAddress)
+    : perConnection(perConnection), perAddress(perAddress) {
+}
+
+RateLimiter::Client RateLimiter::client(int socket) const {
+    Client client;
+    client.bucket = TokenBucket(perConnection);
+
+    sockaddr_storage peer{};
+    socklen_t length = sizeof(peer);
+    char text[INET6_ADDRSTRLEN] = "";
+
+    if (::getpeername(socket, reinterpret_cast<sockaddr*>(&peer), &length) == 0) {
+        if (peer.ss_family == AF_INET) {
+            ::inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&peer)->sin_addr, text, sizeof(text));
+        } else if (peer.ss_family == AF_INET6) {
+            ::inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6*>(&peer)->sin6_addr, text, sizeof(text));
+        }
+    }
+    client.address = text;
+    return client;
+}
+
+RateLimiter::Admission RateLimiter::admit(Client& client, std::size_t count) {
+    const auto now = TokenBucket::Clock::now();
+
+    Admission admission;
+    admission.admitted = client.bucket.take(count, now);
+
+    if (perAddress.enabled() && admission.admitted > 0) {
+        std::lock_guard<std::mutex> guard(addressMutex);
+
+        if (addressBuckets.size() >= MAX_TRACKED_ADDRESSES) {
+            /* a full bucket is what a new one would be */
+            std::erase_if(addressBuckets, [now](auto& entry) { return entry.second.full(now); });
+        }
+
+        TokenBucket& shared = addressBuckets.try_emplace(client.address, perAddress, now).first->second;
+        std::size_t taken = shared.take(admission.admitted, now);
+        client.bucket.refund(admission.admitted - taken);
+        admission.admitted = taken;
+
+        if (admission.admitted < count) {
+            admission.retryAfter = shared.waitTime(now);
+        }
+    }
+
+    if (admission.admitted < count) {
+        admission.retryAfter = std::max(admission.retryAfter, client.bucket.waitTime(now));
+        /* at least 1 ms, "retry in 0 ms" reads like no limit */
+        admission.retryAfter = std::max(admission.retryAfter, std::chrono::milliseconds(1));
+    }
+    return admission;
+}
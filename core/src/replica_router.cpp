@@ -0,0 +1,315 @@
+#include "replica_router.hpp"
+#include "metrics.hpp"
+
+#include <iostream>
+#include <sstream>
+
+namespace {
+    /* Lag is 0 when everything received was replayed: replay_timestamp only
+     * moves on new writes, an idle primary must not look like a lagging replica.
+     * That only holds while WAL still arrives, a standby that lost its
+     * walreceiver stays "caught up" with what it last received, so the third
+     * column tells whether it is streaming. Roles without pg_read_all_stats
+     * only see the pid of the walreceiver, not its status */
+    constexpr const char* LAG_QUERY =
+        "SELECT pg_is_in_recovery(),"
+        " CASE WHEN pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0"
+        " ELSE COALESCE((EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp()) * 1000)::bigint, 0)"
+        " END,"
+        " EXISTS (SELECT 1 FROM pg_stat_wal_receiver WHERE COALESCE(status = 'streaming', pid IS NOT NULL))";
+
+    /* host=... port=... out of a libpq connection string, for the logs */
+    std::string replicaName(const std::string& connectionString) {
+        std::istringstream iss(connectionString);
+        std::string field, host, port;
+        while (iss >> field) {
+            if (field.rfind("host=", 0) == 0) {
+                host = field.substr(5);
+            } else if (field.rfind("port=", 0) == 0) {
+                port = field.substr(5);
+            }
+        }
+        return host + ":" + port;
+    }
+}
+
+ReadLease::ReadLease(std::unique_lock<std::mutex> guard, pqxx::connection& conn, bool replica,
+                     std::shared_ptr<void> owner)
+    : owner(std::move(owner)), guard(std::move(guard)), conn(&conn), replica(replica) {
+}
+
+pqxx::connection& ReadLease::getConnection() const {
+    return *conn;
+}
+
+std::unique_ptr<pqxx::read_transaction> ReadLease::createReadTransaction() const {
+    auto tx = std::make_unique<pqxx::read_transaction>(*conn);
+    RequestDeadline::applyTo(*tx);
+    return tx;
+}
+
+std::unique_ptr<pqxx::transaction_base> ReadLease::createAutocommitTransaction() const {
+    if (RequestDeadline::current()) {
+        return createReadTransaction();
+    }
+    return std::make_unique<pqxx::nontransaction>(*conn);
+}
+
+bool ReadLease::onReplica() const {
+    return replica;
+}
+
+ReplicaRouter& ReplicaRouter::getInstance() {
+    static ReplicaRouter instance;
+    return instance;
+}
+
+ReplicaRouter::~ReplicaRouter() {
+    stop();
+}
+
+void ReplicaRouter::configure(const ReplicaSettings& settings) {
+    /* the checker thread walks replicas, it must not run while they change */
+    stop();
+
+    auto list = std::make_shared<ReplicaList>();
+    for (const auto& connectionString : settings.connectionStrings) {
+        auto replica = std::make_shared<Replica>();
+        replica->connectionString = connectionString;
+        replica->name = replicaName(connectionString);
+        list->push_back(std::move(replica));
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(listMutex);
+        replicas = std::move(list);
+    }
+
+    maxLagMs = settings.maxLag.count();
+    checkInterval = settings.checkInterval;
+    balanceOnReplica = settings.balanceOnReplica;
+}
+
+void ReplicaRouter::reload(const ReplicaSettings& settings) {
+    auto current = currentReplicas();
+
+    auto list = std::make_shared<ReplicaList>();
+    std::vector<std::shared_ptr<Replica>> added;
+    for (const auto& connectionString : settings.connectionStrings) {
+        std::shared_ptr<Replica> replica;
+        for (const auto& existing : *current) {
+            if (existing->connectionString == connectionString) {
+                replica = existing;
+                break;
+            }
+        }
+
+        if (!replica) {
+            replica = std::make_shared<Replica>();
+            replica->connectionString = connectionString;
+            replica->name = replicaName(connectionString);
+            added.push_back(replica);
+        }
+        list->push_back(std::move(replica));
+    }
+
+    /* connected before the swap, reads never wait for a handshake */
+    for (auto& replica : added) {
+        checkReplica(*replica);
+    }
+
+    maxLagMs = settings.maxLag.count();
+    balanceOnReplica = settings.balanceOnReplica;
+    {
+        std::lock_guard<std::mutex> guard(waitMutex);
+        checkInterval = settings.checkInterval;
+    }
+    {
+        std::lock_guard<std::mutex> guard(listMutex);
+        replicas = list;
+    }
+
+    std::cout << "[ReplicaRouter] Reloaded: " << list->size() << " replica(s), "
+              << added.size() << " new\n";
+
+    if (list->empty()) {
+        stop();
+    } else if (!running) {
+        startThread();
+    } else {
+        /* the new interval applies right away */
+        wakeUp.notify_all();
+    }
+}
+
+void ReplicaRouter::start() {
+    if (running) {
+        return;
+    }
+
+    configure(DBConnection::getInstance().getReplicaSettings());
+    auto list = currentReplicas();
+    if (list->empty()) {
+        return;
+    }
+
+    std::cout << "[ReplicaRouter] Routing reads to " << list->size()
+              << " replica(s), max lag " << maxLagMs << " ms\n";
+
+    /* first round before any read, so replicas are usable right away */
+    checkReplicas();
+
+    startThread();
+}
+
+void ReplicaRouter::startThread() {
+    running = true;
+    checkerThread = std::thread(&ReplicaRouter::run, this);
+}
+
+void ReplicaRouter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(waitMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+
+    if (checkerThread.joinable()) {
+        checkerThread.join();
+    }
+}
+
+ReadLease ReplicaRouter::acquireRead(ReadConsistency consistency) {
+    auto list = currentReplicas();
+    if (consistency == ReadConsistency::BoundedStaleness && !list->empty()) {
+        for (std::size_t tries = 0; tries < list->size(); ++tries) {
+            const auto& candidate = (*list)[nextReplica++ % list->size()];
+            Replica& replica = *candidate;
+            if (!usable(replica)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(replica.mutex);
+            /* the checker may have dropped it while we waited for the lock */
+            if (usable(replica) && replica.conn && replica.conn->is_open()) {
+                Metrics::getInstance().increment("db.reads_replica");
+                return ReadLease(std::move(guard), *replica.conn, true, candidate);
+            }
+        }
+
+        /* every replica is down or too far behind */
+        Metrics::getInstance().increment("db.reads_replica_fallback");
+    }
+
+    auto& db = DBConnection::getInstance();
+    auto guard = db.lock();
+    Metrics::getInstance().increment("db.reads_primary");
+    return ReadLease(std::move(guard), db.getConnection(), false);
+}
+
+ReadConsistency ReplicaRouter::balanceConsistency() const {
+    return balanceOnReplica ? ReadConsistency::BoundedStaleness : ReadConsistency::Strong;
+}
+
+void ReplicaRouter::checkReplicas() {
+    std::size_t usableCount = 0;
+    for (auto& replica : *currentReplicas()) {
+        checkReplica(*replica);
+        if (usable(*replica)) {
+            ++usableCount;
+        }
+    }
+    Metrics::getInstance().set("db.replicas_usable", static_cast<std::int64_t>(usableCount));
+}
+
+std::size_t ReplicaRouter::usableReplicas() const {
+    std::size_t count = 0;
+    for (const auto& replica : *currentReplicas()) {
+        if (usable(*replica)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void ReplicaRouter::checkReplica(Replica& replica) {
+    bool wasUsable = usable(replica);
+
+    try {
+        /* connecting can take connect_timeout, reads must not wait behind it */
+        std::unique_ptr<pqxx::connection> fresh;
+        {
+            std::lock_guard<std::mutex> guard(replica.mutex);
+            if (!replica.conn || !replica.conn->is_open()) {
+                replica.healthy = false;
+                replica.conn.reset();
+            }
+        }
+        if (!replica.healthy) {
+            fresh = std::make_unique<pqxx::connection>(replica.connectionString);
+        }
+
+        std::lock_guard<std::mutex> guard(replica.mutex);
+        if (fresh) {
+            replica.conn = std::move(fresh);
+        }
+
+        pqxx::nontransaction tx(*replica.conn);
+        pqxx::row row = tx.exec(LAG_QUERY).one_row();
+
+        /* a promoted standby is no longer fed by the primary */
+        if (!row[0].as<bool>()) {
+            throw std::runtime_error("not in recovery (promoted or not a standby)");
+        }
+
+        replica.lagMs = row[1].as<std::int64_t>();
+        replica.streaming = row[2].as<bool>();
+        replica.healthy = true;
+        replica.downLogged = false;
+    }
+    catch (const std::exception& e) {
+        std::lock_guard<std::mutex> guard(replica.mutex);
+        if (!replica.downLogged) {
+            std::cout << "[ReplicaRouter] Replica " << replica.name << " down: " << e.what() << "\n";
+            replica.downLogged = true;
+        }
+        replica.healthy = false;
+        replica.conn.reset();
+        return;
+    }
+
+    bool nowUsable = usable(replica);
+    if (nowUsable && !wasUsable) {
+        std::cout << "[ReplicaRouter] Replica " << replica.name << " up, lag "
+                  << replica.lagMs << " ms\n";
+    } else if (!nowUsable && wasUsable && !replica.streaming) {
+        std::cout << "[ReplicaRouter] Replica " << replica.name
+                  << " is not streaming from the primary, reads go elsewhere\n";
+    } else if (!nowUsable && wasUsable) {
+        std::cout << "[ReplicaRouter] Replica " << replica.name << " lags "
+                  << replica.lagMs << " ms, reads go elsewhere\n";
+    }
+}
+
+std::shared_ptr<const ReplicaRouter::ReplicaList> ReplicaRouter::currentReplicas() const {
+    std::lock_guard<std::mutex> guard(listMutex);
+    return replicas;
+}
+
+bool ReplicaRouter::usable(const Replica& replica) const {
+    return replica.healthy && replica.streaming && replica.lagMs <= maxLagMs;
+}
+
+void ReplicaRouter::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(waitMutex);
+            wakeUp.wait_for(guard, checkInterval, [this]() { return !running; });
+            if (!running) {
+                return;
+            }
+        }
+
+        checkReplicas();
+    }
+}
@@ -0,0 +1,93 @@
+#include "request_arena.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+namespace {
+    struct ThreadArena {
+        std::unique_ptr<std::byte[]> buffer = std::make_unique<std::byte[]>(RequestArena::INITIAL_BYTES);
+
+        /* past the buffer, blocks come from the heap until release() */
+        std::pmr::monotonic_buffer_resource arena{buffer.get(), RequestArena::INITIAL_BYTES,
+                                                  std::pmr::new_delete_resource()};
+
+        /* open Scopes, nested ones share the outermost request */
+        int depth = 0;
+    };
+
+    ThreadArena& threadArena() {
+        thread_local ThreadArena arena;
+        return arena;
+    }
+
+    /* plain integer: read and written by its own thread only */
+    thread_local std::uint64_t allocations = 0;
+}
+
+RequestArena::Scope::Scope() {
+    ++threadArena().depth;
+}
+
+RequestArena::Scope::~Scope() {
+    ThreadArena& state = threadArena();
+    if (--state.depth == 0) {
+        /* back to the start of the buffer, the heap blocks are freed */
+        state.arena.release();
+    }
+}
+
+std::pmr::memory_resource* RequestArena::resource() {
+    ThreadArena& state = threadArena();
+    return state.depth > 0 ? &state.arena : std::pmr::get_default_resource();
+}
+
+bool AllocationCounter::enabled() {
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::uint64_t AllocationCounter::threadAllocations() {
+    return allocations;
+}
+
+#ifdef COUNT_ALLOCATIONS
+/* Every other form of new and delete (arrays, nothrow) forwards to these */
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    ++allocations;
+    auto align = static_cast<std::size_t>(alignment);
+    std::size_t rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    if (void* block = std::aligned_alloc(align, rounded)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept {
+    std::free(block);
+}
+#endif
@@ -0,0 +1,150 @@
+#include "request_deadline.hpp"
+#include "database_connection.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+namespace {
+    thread_local RequestDeadline::Scope* currentScope = nullptr;
+}
+
+RequestDeadline::Scope::Scope(Clock::time_point deadline)
+    : deadline(deadline), previous(currentScope) {
+    currentScope = this;
+}
+
+RequestDeadline::Scope::~Scope() {
+    currentScope = previous;
+
+    for (auto& watch : watches) {
+        DeadlineWatchdog::getInstance().finish(*watch);
+    }
+}
+
+std::optional<RequestDeadline::Clock::time_point> RequestDeadline::current() {
+    if (!currentScope) {
+        return std::nullopt;
+    }
+    return currentScope->deadline;
+}
+
+bool RequestDeadline::expired() {
+    return currentScope && Clock::now() >= currentScope->deadline;
+}
+
+void RequestDeadline::check(const char* where) {
+    if (expired()) {
+        throw DeadlineExceeded(std::string("Deadline exceeded ") + where);
+    }
+}
+
+void RequestDeadline::applyTo(pqxx::transaction_base& tx) {
+    if (!currentScope) {
+        return;
+    }
+
+    check("before the query");
+
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(currentScope->deadline - Clock::now());
+    /* 0 would mean "no timeout" to Postgres */
+    const std::string ms = std::to_string(std::max<long long>(1, left.count()));
+    tx.exec("SET LOCAL statement_timeout = " + ms + "; SET LOCAL lock_timeout = " + ms);
+}
+
+void RequestDeadline::watchPrimary(std::uint64_t generation) {
+    if (!currentScope) {
+        return;
+    }
+
+    auto watch = std::make_shared<DeadlineWatch>();
+    watch->deadline = currentScope->deadline;
+    watch->generation = generation;
+
+    currentScope->watches.push_back(watch);
+    DeadlineWatchdog::getInstance().watch(std::move(watch));
+}
+
+DeadlineWatchdog& DeadlineWatchdog::getInstance() {
+    static DeadlineWatchdog instance;
+    return instance;
+}
+
+DeadlineWatchdog::~DeadlineWatchdog() {
+    stop();
+}
+
+void DeadlineWatchdog::start() {
+    std::lock_guard<std::mutex> guard(watchMutex);
+    if (running) {
+        return;
+    }
+
+    running = true;
+    watchdogThread = std::thread(&DeadlineWatchdog::run, this);
+}
+
+void DeadlineWatchdog::stop() {
+    {
+        std::lock_guard<std::mutex> guard(watchMutex);
+        running = false;
+        watches = {};
+    }
+    wakeUp.notify_all();
+
+    if (watchdogThread.joinable()) {
+        watchdogThread.join();
+    }
+}
+
+void DeadlineWatchdog::watch(std::shared_ptr<DeadlineWatch> watch) {
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> guard(watchMutex);
+        if (!running) {
+            return;
+        }
+        earliest = watches.empty() || watch->deadline < watches.top()->deadline;
+        watches.push(std::move(watch));
+    }
+
+    if (earliest) {
+        wakeUp.notify_one();
+    }
+}
+
+void DeadlineWatchdog::finish(DeadlineWatch& watch) {
+    std::lock_guard<std::mutex> guard(watchMutex);
+    watch.finished = true;
+}
+
+void DeadlineWatchdog::run() {
+    std::unique_lock<std::mutex> guard(watchMutex);
+
+    while (running) {
+        if (watches.empty()) {
+            wakeUp.wait(guard);
+            continue;
+        }
+
+        auto next = watches.top();
+        if (RequestDeadline::Clock::now() < next->deadline) {
+            wakeUp.wait_until(guard, next->deadline);
+            continue;
+        }
+
+        watches.pop();
+        if (next->finished) {
+            continue;
+        }
+
+        /* PQcancel talks to the server, not under watchMutex */
+        guard.unlock();
+        if (DBConnection::getInstance().cancelQueryOf(next->generation)) {
+            std::cout << "[DeadlineWatchdog] Request past its deadline, query cancelled\n";
+            Metrics::getInstance().increment("db.deadline_cancels");
+        }
+        guard.lock();
+    }
+}
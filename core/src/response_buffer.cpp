@@ -0,0 +1,151 @@
+#include "response_buffer.hpp"
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <climits>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+
+void ResponseBuffer::append(std::string_view fragment) {
+    if (fragment.empty()) {
+        return;
+    }
+    fragments.push_back(Fragment{fragment.data(), 0, fragment.size()});
+    bytes += fragment.size();
+}
+
+void ResponseBuffer::appendCopy(std::string_view text) {
+    if (text.empty()) {
+        return;
+    }
+
+    /* consecutive copies share one fragment, unless a mark lies between them */
+    if (fragments.size() > sealed && fragments.back().data == nullptr) {
+        fragments.back().size += text.size();
+    } else {
+        fragments.push_back(Fragment{nullptr, store.size(), text.size()});
+    }
+    store.append(text);
+    bytes += text.size();
+}
+
+void ResponseBuffer::appendNumber(long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    appendCopy(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+}
+
+void ResponseBuffer::appendNumber(double value) {
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+    appendCopy(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+}
+
+ResponseBuffer::Mark ResponseBuffer::mark() {
+    sealed = fragments.size();
+    return Mark{fragments.size(), store.size(), bytes};
+}
+
+void ResponseBuffer::rewind(const Mark& mark) {
+    fragments.resize(mark.fragments);
+    store.resize(mark.stored);
+    bytes = mark.bytes;
+    sealed = mark.fragments;
+}
+
+bool ResponseBuffer::startsWith(const Mark& mark, std::string_view prefix) const {
+    if (bytes - mark.bytes < prefix.size()) {
+        return false;
+    }
+
+    std::size_t checked = 0;
+    for (std::size_t i = mark.fragments; i < fragments.size() && checked < prefix.size(); ++i) {
+        const char* data = begin(fragments[i]);
+        std::size_t n = std::min(fragments[i].size, prefix.size() - checked);
+        if (std::string_view(data, n) != prefix.substr(checked, n)) {
+            return false;
+        }
+        checked += n;
+    }
+    return checked == prefix.size();
+}
+
+void ResponseBuffer::clear() {
+    fragments.clear();
+    store.clear();
+    bytes = 0;
+    sealed = 0;
+}
+
+const char* ResponseBuffer::begin(const Fragment& fragment) const {
+    return fragment.data ? fragment.data : store.data() + fragment.offset;
+}
+
+bool ResponseBuffer::flush(int socket, std::chrono::milliseconds timeout) {
+    iov.clear();
+    for (const auto& fragment : fragments) {
+        iov.push_back(iovec{const_cast<char*>(begin(fragment)), fragment.size});
+    }
+
+    std::size_t first = 0;
+    bool ok = true;
+
+    /* a bounded flush waits in poll() only, never in sendmsg() */
+    const int flags = timeout.count() < 0 ? MSG_NOSIGNAL : MSG_NOSIGNAL | MSG_DONTWAIT;
+
+    while (first < iov.size()) {
+        msghdr message{};
+        message.msg_iov = iov.data() + first;
+        message.msg_iovlen = std::min<std::size_t>(iov.size() - first, IOV_MAX);
+
+        ssize_t sent = ::sendmsg(socket, &message, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                pollfd writable{socket, POLLOUT, 0};
+                int ready = ::poll(&writable, 1, timeout.count() < 0 ? -1 : static_cast<int>(timeout.count()));
+                if (ready > 0 || (ready < 0 && errno == EINTR)) {
+                    continue;
+                }
+                if (ready == 0) {
+                    errno = ETIMEDOUT;
+                }
+            }
+            ok = false;
+            break;
+        }
+
+        /* skips what went out, a partly sent iovec resumes mid way */
+        auto remaining = static_cast<std::size_t>(sent);
+        while (first < iov.size() && remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            ++first;
+        }
+        if (remaining > 0) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+            iov[first].iov_len -= remaining;
+        }
+    }
+
+    clear();
+    return ok;
+}
+
+std::string ResponseBuffer::str() const {
+    std::string out;
+    out.reserve(bytes);
+    for (const auto& fragment : fragments) {
+        out.append(begin(fragment), fragment.size);
+    }
+    return out;
+}
+
+std::ostream& operator<<(std::ostream& out, const ResponseBuffer& buffer) {
+    for (const auto& fragment : buffer.fragments) {
+        out.write(buffer.begin(fragment), static_cast<std::streamsize>(fragment.size));
+    }
+    return out;
+}
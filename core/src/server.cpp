@@ -3,32 +3,131 @@
 #include "database_connection.hpp"
 #include "account_service.hpp"
 #include "transactions.hpp"
+#include "metrics.hpp"
+#include "shard_coordinator.hpp"
+#include "request_deadline.hpp"
+#include "response_buffer.hpp"
+#include "command_parser.hpp"
+#include "request_arena.hpp"
+
+#include "json.hpp"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <cstring>
 
+using json = nlohmann::json;
+
+
+ServerConfig ServerConfig::fromFile(const std::string& path) {
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open server config file: " + path);
+
+    json cfg;
+    file >> cfg;
+
+    ServerConfig config;
+    config.acceptors          = cfg.value("acceptors", config.acceptors);
+    config.backlog            = cfg.value("backlog", config.backlog);
+    config.pinAcceptors       = cfg.value("pin_acceptors", config.pinAcceptors);
+    config.deferAcceptSeconds = cfg.value("defer_accept_seconds", config.deferAcceptSeconds);
+    config.noDelay            = cfg.value("tcp_nodelay", config.noDelay);
+    config.keepAliveIdleSeconds     = cfg.value("tcp_keepalive_idle_s", config.keepAliveIdleSeconds);
+    config.keepAliveIntervalSeconds = cfg.value("tcp_keepalive_interval_s", config.keepAliveIntervalSeconds);
+    config.keepAliveProbes          = cfg.value("tcp_keepalive_probes", config.keepAliveProbes);
+    config.drainTimeout       = std::chrono::milliseconds(
+        cfg.value("drain_timeout_ms", static_cast<long long>(config.drainTimeout.count())));
+    config.dbConnectionsPerLoop = cfg.value("db_connections_per_loop", config.dbConnectionsPerLoop);
+
+    /* a limit without a burst lets one second worth of commands through at once */
+    config.connectionLimit.perSecond = cfg.value("rate_limit_per_connection", config.connectionLimit.perSecond);
+    config.connectionLimit.burst     = cfg.value("rate_burst_per_connection", config.connectionLimit.perSecond);
+    config.addressLimit.perSecond    = cfg.value("rate_limit_per_address", config.addressLimit.perSecond);
+    config.addressLimit.burst        = cfg.value("rate_burst_per_address", config.addressLimit.perSecond);
+    config.interactiveWeight         = cfg.value("interactive_weight", config.interactiveWeight);
+    config.bulkWeight                = cfg.value("bulk_weight", config.bulkWeight);
+    config.bulkBatchCommands         = cfg.value("bulk_batch_commands", config.bulkBatchCommands);
+
+    auto& connections = config.connections;
+    connections.maxConnections = cfg.value("max_connections", connections.maxConnections);
+    connections.idleTimeout    = std::chrono::milliseconds(
+        cfg.value("idle_timeout_ms", static_cast<long long>(connections.idleTimeout.count())));
+    connections.readTimeout    = std::chrono::milliseconds(
+        cfg.value("read_timeout_ms", static_cast<long long>(connections.readTimeout.count())));
+    connections.evictIdleAfter = std::chrono::milliseconds(
+        cfg.value("evict_idle_after_ms", static_cast<long long>(connections.evictIdleAfter.count())));
+
+    auto& audit = config.audit;
+    audit.queueCapacity = cfg.value("audit_queue_capacity", audit.queueCapacity);
+    audit.flushInterval = std::chrono::milliseconds(
+        cfg.value("audit_flush_interval_ms", static_cast<long long>(audit.flushInterval.count())));
+    audit.batchSize     = cfg.value("audit_batch_size", audit.batchSize);
+    audit.spillPath     = cfg.value("audit_spill_path", audit.spillPath);
+
+    std::string overflow = cfg.value("audit_overflow", std::string("drop"));
+    if (overflow == "block") {
+        audit.overflow = AuditOverflow::Block;
+    } else if (overflow == "drop") {
+        audit.overflow = AuditOverflow::Drop;
+    } else if (overflow == "spill") {
+        audit.overflow = AuditOverflow::Spill;
+    } else {
+        throw std::runtime_error("Unknown audit_overflow in " + path + ": " + overflow);
+    }
+
+    auto& feed = config.feed;
+    feed.enabled          = cfg.value("transfer_feed", feed.enabled);
+    feed.pollInterval     = std::chrono::milliseconds(
+        cfg.value("transfer_feed_poll_ms", static_cast<long long>(feed.pollInterval.count())));
+    feed.replayCapacity   = cfg.value("transfer_feed_replay", feed.replayCapacity);
+    feed.subscriberBuffer = cfg.value("transfer_feed_buffer", feed.subscriberBuffer);
+
+    std::string backend = cfg.value("io_backend", std::string("threads"));
+    if (backend == "threads") {
+        config.backend = IOBackend::Threads;
+    } else if (backend == "epoll") {
+        config.backend = IOBackend::Epoll;
+    } else if (backend == "io_uring") {
+        config.backend = IOBackend::IoUring;
+    } else {
+        throw std::runtime_error("Unknown io_backend in " + path + ": " + backend);
+    }
+    return config;
+}
+
+Server::Server(const std::string& host, int port) : Server(host, port, ServerConfig{}) {
 
-Server::Server(const std::string& host, int port) : hostBind(host), portBind(port) {
+}
 
+Server::Server(const std::string& host, int port, const ServerConfig& config)
+    : hostBind(host), portBind(port), config(config),
+      rateLimiter(config.connectionLimit, config.addressLimit), connectionTracker(config.connections) {
+    if (this->config.acceptors < 1) {
+        this->config.acceptors = 1;
+    }
+    if (this->config.dbConnectionsPerLoop < 1) {
+        this->config.dbConnectionsPerLoop = 1;
+    }
 }
 
 Server::~Server() {
     stop();
 }
 
-void Server::start() {
-    /* If server is currently running, returns immediately */
-    if (running) {
-        return;
-    }
-
-    listenSocket = ::socket(AF_INET, SOCK_STREAM,0);
-    running = true;
+int Server::openListenSocket() {
+    int listenSocket = ::socket(AF_INET, SOCK_STREAM, 0);
 
     if (listenSocket < 0) {
         throw std::runtime_error("Failed to create socket!");
@@ -38,6 +137,18 @@ void Server::start() {
 
     setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
 
+    /* Several sockets on the same port, the kernel balances connections between them */
+    if (config.acceptors > 1 &&
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &option, sizeof(option)) < 0) {
+        ::close(listenSocket);
+        throw std::runtime_error("Failed to set SO_REUSEPORT");
+    }
+
+    if (config.deferAcceptSeconds > 0) {
+        setsockopt(listenSocket, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                   &config.deferAcceptSeconds, sizeof(config.deferAcceptSeconds));
+    }
+
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY); // binds to all interfaces
@@ -48,37 +159,220 @@ void Server::start() {
         throw std::runtime_error("Failed to bind socket");
     }
 
-    if (listen(listenSocket, 8) < 0) {
+    if (listen(listenSocket, config.backlog) < 0) {
         ::close(listenSocket);
         throw std::runtime_error("Failed to listen on socket");
     }
 
-    std::cout << "[Server] Listening on port " << portBind << std::endl;
+    return listenSocket;
+}
+
+void Server::start() {
+    /* If server is currently running, returns immediately */
+    if (running) {
+        return;
+    }
+
+    std::string reason;
+    if (config.backend == IOBackend::IoUring && !ioUringAvailable(reason)) {
+        std::cout << "[Server] io_uring unavailable (" << reason << "), falling back to epoll\n";
+        config.backend = IOBackend::Epoll;
+    }
+
+    /* the async DB connections all point at the primary, they know nothing of shards */
+    if (config.backend != IOBackend::Threads && ShardCoordinator::getInstance().enabled()) {
+        std::cout << "[Server] Sharded database, falling back to the threads backend\n";
+        config.backend = IOBackend::Threads;
+    }
+
+    try {
+        for (int i = 0; i < config.acceptors; ++i) {
+            listenSockets.push_back(openListenSocket());
+        }
+    }
+    catch (...) {
+        for (int fd : listenSockets) {
+            ::close(fd);
+        }
+        listenSockets.clear();
+        throw;
+    }
+
+    running = true;
 
-    /* Accept loop in its own thread */
-    acceptThread = std::thread(&Server::acceptLoop, this);
+    connectionTracker.start();
+    DBConnection::getInstance().setLockWeights(config.interactiveWeight, config.bulkWeight);
+
+    std::cout << "[Server] Listening on port " << portBind << " with "
+              << config.acceptors << " acceptor(s), backlog " << config.backlog << std::endl;
+
+    if (config.backend != IOBackend::Threads) {
+        startEventWorkers();
+        return;
+    }
+
+    /* Each accept loop in its own thread */
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t i = 0; i < listenSockets.size(); ++i) {
+        acceptThreads.emplace_back(&Server::acceptLoop, this, i);
+
+        if (config.pinAcceptors) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(acceptThreads.back().native_handle(), sizeof(cpus), &cpus);
+        }
+    }
 
 }
 
 void Server::stop() {
+    stop(config.drainTimeout);
+}
+
+void Server::stop(std::chrono::milliseconds drainTimeout) {
     if (!running) {
         return;
     }
 
+    auto& metrics = Metrics::getInstance();
+    auto started = std::chrono::steady_clock::now();
+
+    /* 1. Stop accepting new connections */
     running = false;
 
-    if (listenSocket >= 0) {
+    if (config.backend != IOBackend::Threads) {
+        stopEventAccept();
+    }
+
+    for (int& listenSocket : listenSockets) {
         ::shutdown(listenSocket, SHUT_RDWR);
         ::close(listenSocket);
         listenSocket = -1;
     }
 
-    if (acceptThread.joinable()) {
-        acceptThread.join();
+    for (auto& acceptThread : acceptThreads) {
+        if (acceptThread.joinable()) {
+            acceptThread.join();
+        }
     }
+
+    acceptThreads.clear();
+    listenSockets.clear();
+
+    /* 2. From now on new commands are refused with a retryable error */
+    draining = true;
+
+    /* 3. Let the requests already running finish, up to the deadline */
+    bool completed;
+    {
+        std::unique_lock<std::mutex> guard(drainMutex);
+        completed = drained.wait_for(guard, drainTimeout, [this]() { return inFlight == 0; });
+    }
+
+    if (!completed) {
+        std::cout << "[Server] Drain deadline reached with " << inFlight
+                  << " request(s) in flight, cancelling\n";
+        metrics.increment("server.drain_timeouts");
+        metrics.increment("server.drain_cancelled_requests", inFlight);
+        if (config.backend != IOBackend::Threads) {
+            cancelEventQueries();
+        } else {
+            /* batches stop at their next command and waiters for the lock
+             * give up, so only the running query is left to cancel */
+            drainExpired = true;
+            auto& db = DBConnection::getInstance();
+            db.closeLock();
+            db.cancelQuery();
+        }
+    }
+
+    /* 4. Close every connection, recv() returns and the workers exit */
+    std::size_t closedSessions = 0;
+    if (config.backend != IOBackend::Threads) {
+        closedSessions = stopEventWorkers();
+    }
+
+    std::list<ClientWorker> remaining;
+    {
+        std::lock_guard<std::mutex> guard(workersMutex);
+        for (auto& worker : workers) {
+            if (worker.socket >= 0) {
+                ::shutdown(worker.socket, SHUT_RDWR);
+            }
+        }
+        remaining.splice(remaining.end(), workers);
+    }
+
+    for (auto& worker : remaining) {
+        if (worker.thread.joinable()) {
+            worker.thread.join();
+        }
+    }
+
+    if (drainExpired) {
+        drainExpired = false;
+        DBConnection::getInstance().reopenLock();
+    }
+    draining = false;
+    connectionTracker.stop();
+
+    auto drainMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    metrics.set("server.drain_ms", drainMs);
+    metrics.increment("server.drains");
+
+    std::cout << "[Server] Stopped after draining " << remaining.size() + closedSessions
+              << " connection(s) in " << drainMs << " ms\n";
 }
 
-void Server::acceptLoop() {
+void Server::spawnWorker(int clientSocket, ConnectionTracker::ConnectionID connection) {
+    std::lock_guard<std::mutex> guard(workersMutex);
+
+    ClientWorker& worker = workers.emplace_back();
+    worker.socket = clientSocket;
+    worker.connection = connection;
+    worker.thread = std::thread([this, &worker]() {
+        handleClient(worker.socket, worker.connection);
+
+        /* untracked first: a timeout firing now must not shut a reused descriptor */
+        connectionTracker.close(worker.connection);
+
+        std::lock_guard<std::mutex> guard(workersMutex);
+        ::close(worker.socket);
+        worker.socket = -1;
+        worker.finished = true;
+        Metrics::getInstance().increment("server.connections_active", -1);
+    });
+
+    Metrics::getInstance().increment("server.connections_active");
+    Metrics::getInstance().increment("server.connections_accepted");
+}
+
+void Server::reapWorkers() {
+    std::list<ClientWorker> done;
+    {
+        std::lock_guard<std::mutex> guard(workersMutex);
+        for (auto it = workers.begin(); it != workers.end();) {
+            auto next = std::next(it);
+            if (it->finished) {
+                done.splice(done.end(), workers, it);
+            }
+            it = next;
+        }
+    }
+
+    /* joined outside the lock, the threads already returned or are about to */
+    for (auto& worker : done) {
+        if (worker.thread.joinable()) {
+            worker.thread.join();
+        }
+    }
+}
+
+void Server::acceptLoop(std::size_t index) {
+    const int listenSocket = listenSockets[index];
+
     while (running) {
         int clientSocket = ::accept(listenSocket, nullptr, nullptr);
 
@@ -89,103 +383,543 @@ void Server::acceptLoop() {
             continue;
         }
 
-        std::thread t(&Server::handleClient, this, clientSocket);
-        /* each client is handled in its own thread */
-        t.detach();
+        configureClientSocket(clientSocket);
+
+        /* a timeout or an eviction wakes the worker up from its recv() */
+        auto connection = trackConnection(clientSocket, [clientSocket](ConnectionTracker::ConnectionID) {
+            ::shutdown(clientSocket, SHUT_RDWR);
+        });
+        if (connection == 0) {
+            continue;
+        }
+
+        /* each client is handled in its own (tracked) thread */
+        reapWorkers();
+        spawnWorker(clientSocket, connection);
     }
 }
 
-void Server::handleClient(int clientSocket) {
-    AccountService accountService;
-    TransactionService txService;
+void Server::configureClientSocket(int clientSocket) const {
+    int option = 1;
 
-    char buffer[1024];
+    if (config.noDelay) {
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+    }
 
-    while (true) {
-        std::memset(buffer, 0, sizeof(buffer));
-        ssize_t n = ::recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-        if (n <= 0) {
-            /* When  client is closed or error */
-            std::cout << "[Server] recv returned " << n << ", closing client\n";
-            break;
+    if (config.keepAliveIdleSeconds > 0) {
+        setsockopt(clientSocket, SOL_SOCKET, SO_KEEPALIVE, &option, sizeof(option));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPIDLE,
+                   &config.keepAliveIdleSeconds, sizeof(config.keepAliveIdleSeconds));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPINTVL,
+                   &config.keepAliveIntervalSeconds, sizeof(config.keepAliveIntervalSeconds));
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_KEEPCNT,
+                   &config.keepAliveProbes, sizeof(config.keepAliveProbes));
+    }
+}
+
+ConnectionTracker::ConnectionID Server::trackConnection(int clientSocket, ConnectionTracker::CloseHandler close) {
+    auto connection = connectionTracker.open(std::move(close));
+    if (connection != 0) {
+        return connection;
+    }
+
+    std::cout << "[Server] Connection limit reached, refusing client\n";
+    static const std::string refused = "ERROR RETRY Too many connections\n";
+    ::send(clientSocket, refused.c_str(), refused.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    ::close(clientSocket);
+    return 0;
+}
+
+std::string Server::statsResponse() const {
+    auto& metrics = Metrics::getInstance();
+    std::ostringstream response;
+    response << "STATS connections_active=" << connectionTracker.active()
+             << " connections_idle=" << connectionTracker.idleCount()
+             << " connections_max=" << config.connections.maxConnections
+             << " connections_accepted=" << metrics.get("server.connections_accepted")
+             << " connections_rejected=" << metrics.get("server.connections_rejected")
+             << " connections_evicted=" << metrics.get("server.connections_evicted")
+             << " idle_timeouts=" << metrics.get("server.idle_timeouts")
+             << " read_timeouts=" << metrics.get("server.read_timeouts") << "\n";
+    return response.str();
+}
+
+std::string Server::takeSubscribe(CommandLines& lines, CommandLines& trailing) {
+    auto found = std::find_if(lines.begin(), lines.end(), [](const std::pmr::string& line) {
+        return CommandParser(line).word() == "SUBSCRIBE";
+    });
+    if (found == lines.end()) {
+        return {};
+    }
+
+    std::string line(*found);
+    trailing.assign(std::make_move_iterator(found + 1), std::make_move_iterator(lines.end()));
+    lines.erase(found, lines.end());
+    return line;
+}
+
+std::string Server::subscribedResponses(std::size_t count) {
+    std::string out;
+    for (std::size_t i = 0; i < count; ++i) {
+        out += "ERROR Connection is subscribed\n";
+    }
+    return out;
+}
+
+std::shared_ptr<TransferSubscription> Server::openSubscription(std::string_view line, std::string& reply) {
+    CommandParser parser(line);
+    parser.word();
+
+    /* no argument: live events only */
+    long long streamID = 0;
+    long long after = 0;
+    if (!parser.remainder().empty()) {
+        parser >> streamID >> after;
+        if (!parser || streamID <= 0 || after < 0 || !parser.remainder().empty()) {
+            std::cout << "[Server] SUBSCRIBE: invalid arguments\n";
+            reply = "ERROR Invalid SUBSCRIBE arguments\n";
+            return nullptr;
         }
+    }
 
-        /* Builds string from the exact number of bytes received */
-        std::string line(buffer, n);
+    if (draining) {
+        reply = "ERROR RETRY Server is shutting down\n";
+        return nullptr;
+    }
 
-        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
-            line.pop_back();
+    auto& feed = TransferFeed::getInstance();
+    std::uint64_t position = static_cast<std::uint64_t>(after);
+    std::string error;
+    auto subscription = feed.subscribe(static_cast<std::uint64_t>(streamID), position, error);
+    if (!subscription) {
+        std::cout << "[Server] SUBSCRIBE refused: " << error << "\n";
+        reply = "ERROR " + error + "\n";
+        return nullptr;
+    }
+
+    std::cout << "[Server] Subscriber streaming from sequence " << position + 1 << "\n";
+    reply = "SUBSCRIBED " + std::to_string(feed.streamID()) + " " + std::to_string(position) + "\n";
+    return subscription;
+}
+
+void Server::streamTransfers(int clientSocket, const std::shared_ptr<TransferSubscription>& subscription) {
+    std::string lines;
+    ResponseBuffer out;
+    char ignored[256];
+    std::uint64_t delivered = subscription->takenSequence();
+
+    bool open = true;
+    while (open) {
+        lines.clear();
+        open = subscription->waitAndTake(lines, SUBSCRIBER_POLL);
+        if (!lines.empty()) {
+            out.append(lines);
+            if (!out.flush(clientSocket, SUBSCRIBER_SEND_TIMEOUT)) {
+                if (errno == ETIMEDOUT) {
+                    /* its socket is full, no ERROR line fits: the client
+                     * resumes after the last EVENT it read */
+                    std::cout << "[Server] Subscriber stopped reading, dropping it, resume after "
+                              << delivered << "\n";
+                    Metrics::getInstance().increment("feed.subscribers_dropped");
+                }
+                break;
+            }
         }
+        delivered = subscription->takenSequence();
 
-        if (line.empty()) {
-            std::cout << "[Server] Received empty line, ignoring\n";
-            continue;
+        /* the client leaving, or stop() shutting the socket down, ends the
+         * stream; anything it sends meanwhile is ignored */
+        ssize_t n = ::recv(clientSocket, ignored, sizeof(ignored), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            break;
         }
+    }
 
-        std::cout << "[Server] Received: \"" << line << "\"\n";
+    TransferFeed::getInstance().unsubscribe(subscription);
+    std::cout << "[Server] Subscriber gone\n";
+}
 
-        std::istringstream iss(line);
-        std::string cmd;
-        iss >> cmd;
+void Server::finishRequest() {
+    if (--inFlight == 0 && draining) {
+        std::lock_guard<std::mutex> guard(drainMutex);
+        drained.notify_all();
+    }
+}
 
-        std::ostringstream response;
+namespace {
+    /* Parses "BALANCE <id>", returns false for anything else */
+    bool parseBalance(std::string_view line, int& accountID) {
+        CommandParser parser(line);
+        std::string_view cmd;
+        parser >> cmd >> accountID;
+        return cmd == "BALANCE" && parser;
+    }
+}
 
-        try {
-            if (cmd == "PING") {
-                std::cout << "[Server] Handling PING\n";
-                response << "PONG\n";
-            } else if (cmd == "BALANCE") {
-                int accId;
-                iss >> accId;
-                if (!iss) {
-                    std::cout << "[Server] BALANCE: invalid arguments\n";
-                    response << "ERROR Invalid BALANCE arguments\n";
-                } else {
-                    std::cout << "[Server] BALANCE for account " << accId << "\n";
+void Server::setReloadHandler(std::function<void()> handler) {
+    reloadHandler = std::move(handler);
+}
 
-                    double bal = accountService.getBalance(accId);
-                    response << "BALANCE " << accId << " " << bal << "\n";
-                }
-            } else if (cmd == "TRANSFER") {
-                int fromId, toId;
-                double amount;
-                iss >> fromId >> toId >> amount;
-                if (!iss) {
-                    std::cout << "[Server] TRANSFER: invalid arguments\n";
-                    response << "ERROR Invalid TRANSFER arguments\n";
+bool Server::parseDeadline(std::string_view line, std::chrono::steady_clock::time_point received,
+                           std::chrono::steady_clock::time_point& deadline, std::string_view& command) {
+    CommandParser parser(line);
+    std::string_view cmd;
+    long long ms;
+    parser >> cmd >> ms;
+    if (cmd != "DEADLINE" || !parser || ms <= 0) {
+        return false;
+    }
+
+    command = parser.remainder();
+    deadline = received + std::chrono::milliseconds(ms);
+    return !command.empty();
+}
+
+void Server::dispatchCommand(std::string_view line,
+                             AccountService& accountService,
+                             TransactionService& txService,
+                             ResponseBuffer& out,
+                             std::chrono::steady_clock::time_point received) {
+    CommandParser iss(line);
+    std::string_view cmd = iss.word();
+
+    /* a command that throws half way leaves nothing but its error line */
+    const auto start = out.mark();
+
+    try {
+        if (cmd == "DEADLINE") {
+            std::chrono::steady_clock::time_point deadline;
+            std::string_view command;
+            if (!parseDeadline(line, received, deadline, command)) {
+                std::cout << "[Server] DEADLINE: invalid arguments\n";
+                out.append("ERROR Invalid DEADLINE arguments\n");
+            } else {
+                /* everything below, down to the queries, sees the deadline */
+                RequestDeadline::Scope scope(deadline);
+
+                if (RequestDeadline::expired()) {
+                    out.append("ERROR Deadline exceeded before it started\n");
                 } else {
+                    dispatchCommand(command, accountService, txService, out, received);
+                }
 
-                    std::cout << "[Server] TRANSFER reqyest " << amount
-                              << " from " << fromId << " to " << toId << "\n";
-                    
-                    try {
-                        txService.transfer(fromId, toId, amount, "Server transfer");
-                        std::cout << "[Server] TRANSFER succeeded\n";
-                        response << "OK\n";
-                    } catch (const std::exception& e) {
-                        std::cout << "[Server] TRANSFER exception: " << e.what() << "\n";
-                        response << "ERROR " << e.what() << "\n";
+                if (out.startsWith(start, "ERROR") && RequestDeadline::expired()) {
+                    Metrics::getInstance().increment("server.deadline_exceeded");
+                    /* a query cancelled at the deadline reports a cancel, say why */
+                    if (!out.startsWith(start, "ERROR Deadline exceeded")) {
+                        out.rewind(start);
+                        out.append("ERROR Deadline exceeded\n");
                     }
                 }
+            }
+        } else if (cmd == "PING") {
+            std::cout << "[Server] Handling PING\n";
+            out.append("PONG\n");
+        } else if (cmd == "BALANCE") {
+            int accId;
+            iss >> accId;
+            if (!iss) {
+                std::cout << "[Server] BALANCE: invalid arguments\n";
+                out.append("ERROR Invalid BALANCE arguments\n");
             } else {
-                std::cout << "[Server] Unknown command: " << cmd << "\n";
-                response << "ERROR Unknown command\n";
+                std::cout << "[Server] BALANCE for account " << accId << "\n";
+
+                double bal = accountService.getBalance(accId);
+                out.append("BALANCE ");
+                out.appendNumber(static_cast<long long>(accId));
+                out.append(" ");
+                out.appendNumber(bal);
+                out.append("\n");
+            }
+        } else if (cmd == "TRANSFER") {
+            int fromId, toId;
+            double amount;
+            iss >> fromId >> toId >> amount;
+            if (!iss) {
+                std::cout << "[Server] TRANSFER: invalid arguments\n";
+                out.append("ERROR Invalid TRANSFER arguments\n");
+            } else {
+
+                std::cout << "[Server] TRANSFER reqyest " << amount
+                          << " from " << fromId << " to " << toId << "\n";
+                
+                try {
+                    txService.transfer(fromId, toId, amount, "Server transfer");
+                    std::cout << "[Server] TRANSFER succeeded\n";
+                    out.append("OK\n");
+                } catch (const DatabaseUnavailable& e) {
+                    std::cout << "[Server] TRANSFER refused: " << e.what() << "\n";
+                    out.append("ERROR RETRY ");
+                    out.appendCopy(e.what());
+                    out.append("\n");
+                } catch (const std::exception& e) {
+                    std::cout << "[Server] TRANSFER exception: " << e.what() << "\n";
+                    out.append("ERROR ");
+                    out.appendCopy(e.what());
+                    out.append("\n");
+                }
+            }
+        } else if (cmd == "STATS") {
+            std::cout << "[Server] Handling STATS\n";
+            out.appendCopy(statsResponse());
+        } else if (cmd == "SUBSCRIBE") {
+            /* handleClient() takes SUBSCRIBE itself, only a DEADLINE prefix gets here */
+            out.append("ERROR SUBSCRIBE takes no DEADLINE\n");
+        } else if (cmd == "RELOAD") {
+            std::cout << "[Server] Handling RELOAD\n";
+            /* the reload itself records its outcome */
+            if (reloadHandler) {
+                reloadHandler();
+                out.append("OK RELOADING\n");
+            } else {
+                out.append("ERROR Reload not available\n");
+                AuditLog::getInstance().record(AuditEvent::reload("refused"));
+            }
+        } else {
+            std::cout << "[Server] Unknown command: " << cmd << "\n";
+            out.append("ERROR Unknown command\n");
+        }
+    }
+    catch (const DatabaseUnavailable& e) {
+        /* circuit open: nothing was sent to the database, safe to retry */
+        std::cout << "[Server] Refused: " << e.what() << "\n";
+        out.rewind(start);
+        out.append("ERROR RETRY ");
+        out.appendCopy(e.what());
+        out.append("\n");
+    }
+    catch (const std::exception& e) {
+        std::cout << "[Server] Exception: " << e.what() << "\n";
+        out.rewind(start);
+        out.append("ERROR ");
+        out.appendCopy(e.what());
+        out.append("\n");
+    }
+}
+
+void Server::dispatchBatch(const CommandLines& lines,
+                           AccountService& accountService,
+                           TransactionService& txService,
+                           ResponseBuffer& out,
+                           std::chrono::steady_clock::time_point received) {
+    for (std::size_t i = 0; i < lines.size();) {
+        /* past the drain deadline nothing new is sent to the database */
+        if (drainExpired) {
+            out.append("ERROR RETRY Server is shutting down\n");
+            Metrics::getInstance().increment("server.drain_rejected");
+            ++i;
+            continue;
+        }
+
+        /* Runs of consecutive BALANCE commands go out in a single pipeline */
+        std::vector<int> ids;
+        std::size_t end = i;
+        int accId;
+        while (end < lines.size() && parseBalance(lines[end], accId)) {
+            ids.push_back(accId);
+            ++end;
+        }
+
+        if (ids.size() < 2) {
+            dispatchCommand(lines[i], accountService, txService, out, received);
+            ++i;
+            continue;
+        }
+
+        std::cout << "[Server] Pipelining " << ids.size() << " BALANCE commands\n";
+
+        try {
+            auto balances = accountService.getBalances(ids);
+            for (std::size_t k = 0; k < ids.size(); ++k) {
+                if (balances[k]) {
+                    out.append("BALANCE ");
+                    out.appendNumber(static_cast<long long>(ids[k]));
+                    out.append(" ");
+                    out.appendNumber(*balances[k]);
+                } else {
+                    out.append("ERROR Account not found: ");
+                    out.appendNumber(static_cast<long long>(ids[k]));
+                }
+                out.append("\n");
             }
         }
         catch (const std::exception& e) {
             std::cout << "[Server] Exception: " << e.what() << "\n";
-            response << "ERROR " << e.what() << "\n";
+            const char* prefix = dynamic_cast<const DatabaseUnavailable*>(&e) ? "ERROR RETRY " : "ERROR ";
+            for (std::size_t k = 0; k < ids.size(); ++k) {
+                out.append(prefix);
+                out.appendCopy(e.what());
+                out.append("\n");
+            }
+        }
+
+        i = end;
+    }
+}
+
+std::string Server::rateLimitedResponses(std::size_t count, std::chrono::milliseconds retryAfter) {
+    Metrics::getInstance().increment("server.rate_limited", static_cast<std::int64_t>(count));
+
+    std::string line = "ERROR RETRY Rate limited, retry in " + std::to_string(retryAfter.count()) + " ms\n";
+    std::string out;
+    for (std::size_t i = 0; i < count; ++i) {
+        out += line;
+    }
+    return out;
+}
+
+Server::CommandLines Server::takeLines(std::string& pending, std::pmr::memory_resource* resource) {
+    CommandLines lines(resource);
+    std::size_t start = 0;
+    for (std::size_t nl; (nl = pending.find('\n', start)) != std::string::npos; start = nl + 1) {
+        std::string_view line(pending.data() + start, nl - start);
+
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.remove_suffix(1);
+        }
+
+        if (line.empty()) {
+            std::cout << "[Server] Received empty line, ignoring\n";
+            continue;
         }
 
-        const std::string out = response.str();
+        std::cout << "[Server] Received: \"" << line << "\"\n";
+        lines.emplace_back(line);
+    }
+    pending.erase(0, start);
+    return lines;
+}
+
+void Server::handleClient(int clientSocket, ConnectionTracker::ConnectionID connection) {
+    AccountService accountService;
+    TransactionService txService;
+    RateLimiter::Client limits = rateLimiter.client(clientSocket);
+
+    char buffer[4096];
+
+    /* Bytes received but not yet terminated by a newline */
+    std::string pending;
+
+    /* Responses of one read, reused from read to read */
+    ResponseBuffer out;
+
+    /* allocations per request, builds with COUNT_ALLOCATIONS only */
+    auto& metrics = Metrics::getInstance();
+    static auto& requests = metrics.get("server.requests");
+    static auto& requestAllocations = metrics.get("server.request_allocations");
+
+    while (true) {
+        ssize_t n = ::recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            /* When  client is closed or error */
+            std::cout << "[Server] recv returned " << n << ", closing client\n";
+            break;
+        }
+
+        pending.append(buffer, static_cast<std::size_t>(n));
+        const auto received = std::chrono::steady_clock::now();
+        const auto allocationsBefore = AllocationCounter::threadAllocations();
+
+        /* lines, parsed accounts and the like, all released at the end of the read */
+        RequestArena::Scope arena;
+
+        /* One recv() can hold several pipelined commands, or half of one */
+        CommandLines lines = takeLines(pending, RequestArena::resource());
+
+        if (pending.size() > MAX_PENDING_BYTES) {
+            out.append("ERROR Line too long\n");
+            out.flush(clientSocket);
+            break;
+        }
+
+        if (lines.empty()) {
+            /* half a command: the rest has read_timeout to arrive */
+            connectionTracker.reading(connection);
+            continue;
+        }
+
+        connectionTracker.busy(connection);
+
+        /* Counted before checking draining: stop() sets draining then waits
+         * for inFlight == 0, so a request is either refused or waited for */
+        ++inFlight;
+        if (draining) {
+            for (std::size_t i = 0; i < lines.size(); ++i) {
+                out.append("ERROR RETRY Server is shutting down\n");
+            }
+            out.flush(clientSocket);
+            Metrics::getInstance().increment("server.drain_rejected", lines.size());
+            finishRequest();
+            connectionTracker.idle(connection);
+            continue;
+        }
+
+        /* commands past the limits are refused, the ones before them run */
+        auto admission = rateLimiter.admit(limits, lines.size());
+        std::string refused;
+        if (admission.admitted < lines.size()) {
+            refused = rateLimitedResponses(lines.size() - admission.admitted, admission.retryAfter);
+            lines.resize(admission.admitted);
+        }
+
+        /* the connection only carries events once SUBSCRIBE opened, every
+         * command after it still gets its one response, in order */
+        CommandLines trailing(RequestArena::resource());
+        std::string subscribe = takeSubscribe(lines, trailing);
+        std::shared_ptr<TransferSubscription> subscription;
+
+        /* a big pipelined read is a batch job, it yields the DB lock to interactive clients */
+        RequestClassScope requestClass(lines.size() + trailing.size() >= config.bulkBatchCommands
+                                           ? RequestClass::Bulk
+                                           : RequestClass::Interactive);
+
+        dispatchBatch(lines, accountService, txService, out, received);
+        if (!subscribe.empty()) {
+            std::string reply;
+            subscription = openSubscription(subscribe, reply);
+            out.appendCopy(reply);
+            if (subscription) {
+                out.appendCopy(subscribedResponses(trailing.size()));
+            } else {
+                dispatchBatch(trailing, accountService, txService, out, received);
+            }
+        }
+        out.appendCopy(refused);
+
+        /* every response of the read in one sendmsg(), short writes resumed */
+        bool sent = true;
         if (!out.empty()) {
-            ::send(clientSocket, out.c_str(), out.size(), 0);
             std::cout << "[Server] Sent: \"" << out << "\"\n";
+            sent = out.flush(clientSocket);
+        }
+
+        finishRequest();
+
+        if (AllocationCounter::enabled()) {
+            requestAllocations += static_cast<std::int64_t>(AllocationCounter::threadAllocations() - allocationsBefore);
+            ++requests;
+        }
+
+        if (!sent) {
+            std::cout << "[Server] send failed, closing client\n";
+            if (subscription) {
+                TransferFeed::getInstance().unsubscribe(subscription);
+            }
+            break;
+        }
+
+        if (subscription) {
+            /* busy from here on: a subscriber sends nothing and must not time out */
+            streamTransfers(clientSocket, subscription);
+            break;
+        }
+
+        if (pending.empty()) {
+            connectionTracker.idle(connection);
         } else {
-            std::cout << "[Server] No response generated for: \"" << line << "\"\n";
+            connectionTracker.reading(connection);
         }
     }
 
-    ::close(clientSocket);
     std::cout << "[Server] Client disconnected\n";
 }
@@ -0,0 +1,664 @@
+/* epoll backend of Server: event loops running one coroutine per client
+ * (also the base of the io_uring backend, see server_uring.cpp) */
+#include "server.hpp"
+#include "server_event_worker.hpp"
+#include "database_connection.hpp"
+#include "async_socket.hpp"
+#include "metrics.hpp"
+#include "command_parser.hpp"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+#include <iostream>
+
+namespace {
+    /* Statements prepared on every AsyncDBConnection of the server */
+    constexpr const char* BALANCE_STATEMENT  = "server_balance";
+    constexpr const char* TRANSFER_STATEMENT = "server_transfer";
+
+    /* Parses "BALANCE <id>", returns false for anything else */
+    bool parseBalance(std::string_view line, int& accountID) {
+        CommandParser parser(line);
+        std::string_view cmd;
+        parser >> cmd >> accountID;
+        return cmd == "BALANCE" && parser;
+    }
+
+    /* Suspends a subscriber's writer until its subscription has lines or is
+     * closed, resumed on the loop (the feed wakes it from its own thread) */
+    struct SubscriptionReady {
+        EventLoop& loop;
+        TransferSubscription& subscription;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            EventLoop* target = &loop;
+            subscription.onReady([target, handle]() { target->post([handle]() { handle.resume(); }); });
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    /* Reading side of a subscribed client, its writer waits for it to return */
+    struct SubscriberReader {
+        bool done = false;
+        std::coroutine_handle<> waiting;
+    };
+
+    struct ReaderDone {
+        SubscriberReader& reader;
+
+        bool await_ready() const noexcept { return reader.done; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { reader.waiting = handle; }
+        void await_resume() const noexcept {}
+    };
+
+    /* Reads until the client leaves or the socket is shut down, then ends the
+     * subscription. What a subscriber sends is ignored */
+    Task<void> watchSubscriber(EventLoop& loop, ClientStream& socket,
+                               std::shared_ptr<TransferSubscription> subscription,
+                               std::shared_ptr<SubscriberReader> reader) {
+        char ignored[256];
+        while (co_await socket.read(ignored, sizeof(ignored)) > 0) {
+        }
+        subscription->close();
+
+        reader->done = true;
+        if (auto waiting = std::exchange(reader->waiting, {})) {
+            loop.post([waiting]() { waiting.resume(); });
+        }
+    }
+
+    /* Appends the digits of value, %g like std::ostream for a double */
+    template <typename Number>
+    void appendNumber(std::string& out, Number value) {
+        char digits[32];
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<Number>) {
+            result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6);
+        } else {
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        out.append(digits, result.ptr);
+    }
+
+    /* Appends the response line of a BALANCE query, formatted like the threaded backend */
+    void appendBalance(std::string& out, int accId, const AsyncResult& result) {
+        if (!result.ok()) {
+            out += "ERROR ";
+            out += result.error();
+        } else if (result.rows() == 0) {
+            out += "ERROR Account not found: ";
+            appendNumber(out, accId);
+        } else {
+            /* binary numeric, decoded to cents without going through text;
+             * cents / 100.0 is the double std::stod gave for the text form */
+            out += "BALANCE ";
+            appendNumber(out, accId);
+            out += ' ';
+            appendNumber(out, static_cast<double>(result.cents(0, 0)) / 100.0);
+        }
+        out += '\n';
+    }
+}
+
+void Server::startEventWorkers() {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+    /* The workers own the listening sockets from now on */
+    for (std::size_t i = 0; i < listenSockets.size(); ++i) {
+        auto worker = std::make_shared<EventWorker>();
+        worker->listenSocket = listenSockets[i];
+        worker->thread = std::thread(&Server::runEventWorker, this, std::ref(*worker));
+
+        if (config.pinAcceptors) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % cores, &cpus);
+            pthread_setaffinity_np(worker->thread.native_handle(), sizeof(cpus), &cpus);
+        }
+
+        eventWorkers.push_back(std::move(worker));
+    }
+    listenSockets.clear();
+
+    std::cout << "[Server] " << (config.backend == IOBackend::IoUring ? "io_uring" : "epoll")
+              << " backend: " << eventWorkers.size() << " event loop(s), "
+              << config.dbConnectionsPerLoop << " async DB connection(s) each\n";
+}
+
+namespace {
+    /* Statements every async connection prepares before serving */
+    void prepareStatements(AsyncDBConnection& db) {
+        /* row balance plus the stripes of a striped (hot) account */
+        db.prepare(BALANCE_STATEMENT,
+                   "SELECT a.balance + COALESCE((SELECT SUM(s.balance) FROM account_stripes s"
+                   " WHERE s.account_id = a.account_id), 0) FROM accounts a WHERE a.account_id = $1",
+                   ResultFormat::Binary);
+        db.prepare(TRANSFER_STATEMENT, "SELECT transferMoney($1, $2, $3, $4)");
+    }
+
+    struct PGconnClose {
+        void operator()(PGconn* conn) const { PQfinish(conn); }
+    };
+    using OpenedConnections = std::vector<std::unique_ptr<PGconn, PGconnClose>>;
+}
+
+void Server::runEventWorker(EventWorker& worker) {
+    const std::string conninfo = DBConnection::getInstance().getConnectionString();
+
+    /* Connections are created on the loop thread, they are used only there */
+    for (int i = 0; i < config.dbConnectionsPerLoop; ++i) {
+        try {
+            auto db = std::make_unique<AsyncDBConnection>(worker.loop, conninfo);
+            prepareStatements(*db);
+            worker.connections.push_back(std::move(db));
+        }
+        catch (const std::exception& e) {
+            std::cout << "[Server] Async DB connection failed: " << e.what() << "\n";
+        }
+    }
+
+    if (config.backend == IOBackend::IoUring) {
+        runUringWorker(worker);
+    } else {
+        ::fcntl(worker.listenSocket, F_SETFL, ::fcntl(worker.listenSocket, F_GETFL) | O_NONBLOCK);
+        worker.loop.add(worker.listenSocket, EPOLLIN, [this, &worker](std::uint32_t) {
+            acceptReady(worker);
+        });
+
+        worker.loop.run();
+    }
+
+    worker.connections.clear();
+    worker.retiredConnections.clear();
+
+    if (worker.listenSocket >= 0) {
+        worker.loop.remove(worker.listenSocket);
+        ::close(worker.listenSocket);
+        worker.listenSocket = -1;
+    }
+}
+
+void Server::stopEventAccept() {
+    for (auto& worker : eventWorkers) {
+        EventWorker* target = worker.get();
+        target->loop.post([target]() {
+            if (target->listenSocket >= 0) {
+                target->loop.remove(target->listenSocket);
+                ::close(target->listenSocket);
+                target->listenSocket = -1;
+            }
+        });
+    }
+}
+
+void Server::cancelEventQueries() {
+    for (auto& worker : eventWorkers) {
+        EventWorker* target = worker.get();
+        target->loop.post([target]() {
+            for (auto& db : target->connections) {
+                db->cancel();
+            }
+        });
+    }
+}
+
+std::size_t Server::stopEventWorkers() {
+    std::size_t closed = 0;
+
+    for (auto& worker : eventWorkers) {
+        EventWorker* target = worker.get();
+        target->loop.post([target]() {
+            target->stopping = true;
+            target->closedSessions = target->clients.size();
+
+            /* Wakes up every client coroutine: suspended reads and writes return
+             * "closed", queries still running fail when their connection closes */
+            std::vector<ClientStream*> open;
+            for (auto& [connection, client] : target->clients) {
+                open.push_back(client);
+            }
+            for (ClientStream* client : open) {
+                client->shutdown();
+            }
+            target->connections.clear();
+            target->retiredConnections.clear();
+
+            if (target->clients.empty()) {
+                target->loop.stop();
+            }
+        });
+    }
+
+    for (auto& worker : eventWorkers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        closed += worker->closedSessions;
+    }
+
+    eventWorkers.clear();
+    return closed;
+}
+
+void Server::acceptReady(EventWorker& worker) {
+    while (running) {
+        int clientSocket = ::accept4(worker.listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (clientSocket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::perror("[Server] accept");
+            }
+            return;
+        }
+
+        configureClientSocket(clientSocket);
+
+        auto connection = trackEventConnection(worker, clientSocket);
+        if (connection == 0) {
+            continue;
+        }
+
+        /* runs until its first read suspends, then the loop drives it */
+        spawn(serveClient(worker, std::make_unique<AsyncSocket>(worker.loop, clientSocket),
+                          rateLimiter.client(clientSocket), connection));
+    }
+}
+
+ConnectionTracker::ConnectionID Server::trackEventConnection(EventWorker& worker, int clientSocket) {
+    EventWorker* target = &worker;
+
+    /* the tracker runs on its own thread: the stream is shut down on the
+     * loop, if the client is still there by then */
+    return trackConnection(clientSocket, [target](ConnectionTracker::ConnectionID connection) {
+        target->loop.post([target, connection]() {
+            auto client = target->clients.find(connection);
+            if (client != target->clients.end()) {
+                client->second->shutdown();
+            }
+        });
+    });
+}
+
+void Server::reloadDatabase() {
+    if (auto handOver = openDatabase(DBConnection::getInstance().getConnectionString())) {
+        handOver();
+    }
+}
+
+std::function<void()> Server::openDatabase(const std::string& conninfo) {
+    if (eventWorkers.empty()) {
+        return {};
+    }
+
+    /* every handshake first, here: the loops keep serving meanwhile, and a
+     * failure leaves all of them on the old connections */
+    std::vector<std::shared_ptr<OpenedConnections>> opened;
+    for (std::size_t w = 0; w < eventWorkers.size(); ++w) {
+        auto connections = std::make_shared<OpenedConnections>();
+        for (int i = 0; i < config.dbConnectionsPerLoop; ++i) {
+            connections->emplace_back(AsyncDBConnection::open(conninfo));
+        }
+        opened.push_back(std::move(connections));
+    }
+
+    return [this, opened = std::move(opened)]() {
+        for (std::size_t w = 0; w < eventWorkers.size(); ++w) {
+            EventWorker* target = eventWorkers[w].get();
+            target->loop.post([target, connections = opened[w]]() {
+                if (target->stopping) {
+                    return;
+                }
+
+                std::vector<std::unique_ptr<AsyncDBConnection>> fresh;
+                for (auto& conn : *connections) {
+                    try {
+                        auto db = std::make_unique<AsyncDBConnection>(target->loop, conn.release());
+                        prepareStatements(*db);
+                        fresh.push_back(std::move(db));
+                    }
+                    catch (const std::exception& e) {
+                        std::cout << "[Server] Async DB connection failed: " << e.what() << "\n";
+                    }
+                }
+                if (fresh.empty()) {
+                    return;
+                }
+
+                for (auto& old : target->connections) {
+                    target->retiredConnections.push_back(std::move(old));
+                }
+                target->connections = std::move(fresh);
+                target->nextConnection = 0;
+                target->sweepRetired();
+            });
+        }
+
+        std::cout << "[Server] Event loops moving to the reloaded database config\n";
+    };
+}
+
+AsyncDBConnection* Server::pickConnection(EventWorker& worker) {
+    if (worker.stopping) {
+        return nullptr;
+    }
+
+    /* old connections of a reload, closed from a task once idle */
+    if (!worker.retiredConnections.empty() && !worker.sweepPosted) {
+        worker.sweepPosted = true;
+        EventWorker* target = &worker;
+        worker.loop.post([target]() { target->sweepRetired(); });
+    }
+
+    /* round robin between the connections that are still up */
+    for (std::size_t tries = 0; tries < worker.connections.size(); ++tries) {
+        auto& candidate = worker.connections[worker.nextConnection++ % worker.connections.size()];
+        if (candidate->isConnected()) {
+            return candidate.get();
+        }
+    }
+    return nullptr;
+}
+
+Task<void> Server::serveClient(EventWorker& worker, std::unique_ptr<ClientStream> stream,
+                               RateLimiter::Client limits, ConnectionTracker::ConnectionID connection) {
+    ClientStream& socket = *stream;
+    worker.clients.emplace(connection, &socket);
+
+    Metrics::getInstance().increment("server.connections_active");
+    Metrics::getInstance().increment("server.connections_accepted");
+
+    char buffer[4096];
+
+    /* Bytes received but not yet terminated by a newline */
+    std::string pending;
+
+    /* Responses of one read, its capacity is reused from read to read */
+    std::string out;
+
+    while (true) {
+        ssize_t n = co_await socket.read(buffer, sizeof(buffer));
+        if (n <= 0) {
+            std::cout << "[Server] recv returned " << n << ", closing client\n";
+            break;
+        }
+
+        pending.append(buffer, static_cast<std::size_t>(n));
+        const auto received = std::chrono::steady_clock::now();
+
+        /* One read can hold several pipelined commands, or half of one */
+        CommandLines lines = takeLines(pending);
+
+        if (pending.size() > MAX_PENDING_BYTES) {
+            co_await socket.write("ERROR Line too long\n");
+            break;
+        }
+
+        if (lines.empty()) {
+            /* half a command: the rest has read_timeout to arrive */
+            connectionTracker.reading(connection);
+            continue;
+        }
+        connectionTracker.busy(connection);
+
+        /* commands past the limits are refused, the ones before them run */
+        auto admission = rateLimiter.admit(limits, lines.size());
+        std::string refused;
+        if (admission.admitted < lines.size()) {
+            refused = rateLimitedResponses(lines.size() - admission.admitted, admission.retryAfter);
+            lines.resize(admission.admitted);
+        }
+
+        /* the connection only carries events once SUBSCRIBE opened, every
+         * command after it still gets its one response, in order */
+        CommandLines trailing;
+        std::string subscribe = takeSubscribe(lines, trailing);
+        std::shared_ptr<TransferSubscription> subscription;
+
+        out.clear();
+        co_await runCommands(worker, lines, out, received);
+        if (!subscribe.empty()) {
+            std::string reply;
+            subscription = openSubscription(subscribe, reply);
+            out += reply;
+            if (subscription) {
+                out += subscribedResponses(trailing.size());
+            } else {
+                co_await runCommands(worker, trailing, out, received);
+            }
+        }
+        out += refused;
+
+        if (!out.empty() && !co_await socket.write(out)) {
+            if (subscription) {
+                TransferFeed::getInstance().unsubscribe(subscription);
+            }
+            break;
+        }
+
+        if (subscription) {
+            /* busy from here on: a subscriber sends nothing and must not time out */
+            co_await streamTransfers(worker, socket, std::move(subscription));
+            break;
+        }
+
+        if (pending.empty()) {
+            connectionTracker.idle(connection);
+        } else {
+            connectionTracker.reading(connection);
+        }
+    }
+
+    connectionTracker.close(connection);
+    worker.clients.erase(connection);
+    Metrics::getInstance().increment("server.connections_active", -1);
+    std::cout << "[Server] Client disconnected\n";
+
+    if (worker.stopping && worker.clients.empty()) {
+        worker.loop.stop();
+    }
+}
+
+Task<void> Server::runCommands(EventWorker& worker, const CommandLines& lines, std::string& out,
+                               std::chrono::steady_clock::time_point received) {
+    for (std::size_t i = 0; i < lines.size();) {
+        /* Counted before checking draining, like handleClient() */
+        ++inFlight;
+        if (draining) {
+            out += "ERROR RETRY Server is shutting down\n";
+            Metrics::getInstance().increment("server.drain_rejected");
+            finishRequest();
+            ++i;
+            continue;
+        }
+
+        /* Runs of BALANCE commands: every query is sent before the first
+         * result is awaited, so they are pipelined on the connection */
+        AsyncDBConnection* db = pickConnection(worker);
+        std::vector<std::pair<int, AsyncDBConnection::Query>> balances;
+        int accId;
+        while (db && i < lines.size() && parseBalance(lines[i], accId)) {
+            balances.emplace_back(accId, db->query(BALANCE_STATEMENT, {std::to_string(accId)}));
+            ++i;
+        }
+
+        if (balances.empty()) {
+            out += co_await handleCommand(lines[i], db, received);
+            ++i;
+        } else {
+            std::cout << "[Server] Pipelining " << balances.size() << " BALANCE commands\n";
+            for (auto& [id, query] : balances) {
+                appendBalance(out, id, co_await query);
+            }
+        }
+
+        finishRequest();
+    }
+}
+
+Task<void> Server::streamTransfers(EventWorker& worker, ClientStream& socket,
+                                   std::shared_ptr<TransferSubscription> subscription) {
+    auto reader = std::make_shared<SubscriberReader>();
+    spawn(watchSubscriber(worker.loop, socket, subscription, reader));
+
+    std::string lines;
+    bool open = true;
+    while (open) {
+        lines.clear();
+        open = subscription->take(lines);
+        if (!lines.empty() && !co_await socket.write(lines)) {
+            break;
+        }
+        if (open) {
+            co_await SubscriptionReady{worker.loop, *subscription};
+        }
+    }
+
+    TransferFeed::getInstance().unsubscribe(subscription);
+    std::cout << "[Server] Subscriber gone\n";
+
+    /* the reader holds the socket, serveClient() frees it once the reader returned */
+    socket.shutdown();
+    if (!reader->done) {
+        co_await ReaderDone{*reader};
+    }
+}
+
+Task<std::string> Server::handleCommand(std::string_view line, AsyncDBConnection* db,
+                                        std::chrono::steady_clock::time_point received,
+                                        std::optional<std::chrono::steady_clock::time_point> deadline) {
+    CommandParser iss(line);
+    std::string_view cmd = iss.word();
+
+    /* time left for the query of a DEADLINE request, the server cancels it then */
+    auto timeout = [&deadline]() -> std::optional<std::chrono::milliseconds> {
+        if (!deadline) {
+            return std::nullopt;
+        }
+        return std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now());
+    };
+
+    if (cmd == "DEADLINE") {
+        std::chrono::steady_clock::time_point until;
+        std::string_view command;
+        if (!parseDeadline(line, received, until, command)) {
+            std::cout << "[Server] DEADLINE: invalid arguments\n";
+            co_return "ERROR Invalid DEADLINE arguments\n";
+        }
+        if (deadline) {
+            until = std::min(until, *deadline);
+        }
+
+        /* nothing blocks a loop: the deadline is checked before the query goes
+         * out, then enforced by Postgres through the query's statement_timeout */
+        std::string inner;
+        if (std::chrono::steady_clock::now() >= until) {
+            inner = "ERROR Deadline exceeded before it started\n";
+        } else {
+            inner = co_await handleCommand(command, db, received, until);
+        }
+
+        /* same replies as dispatchCommand(): a query cancelled by its
+         * statement_timeout reports a cancel, say why */
+        if (inner.rfind("ERROR", 0) == 0 && std::chrono::steady_clock::now() >= until) {
+            Metrics::getInstance().increment("server.deadline_exceeded");
+            if (inner.rfind("ERROR Deadline exceeded", 0) != 0) {
+                inner = "ERROR Deadline exceeded\n";
+            }
+        }
+        co_return inner;
+    }
+
+    if (cmd == "PING") {
+        std::cout << "[Server] Handling PING\n";
+        co_return "PONG\n";
+    }
+
+    if (cmd == "SUBSCRIBE") {
+        /* serveClient() takes SUBSCRIBE itself, only a DEADLINE prefix gets here */
+        co_return "ERROR SUBSCRIBE takes no DEADLINE\n";
+    }
+
+    if (cmd == "BALANCE") {
+        int accId;
+        iss >> accId;
+        if (!iss) {
+            std::cout << "[Server] BALANCE: invalid arguments\n";
+            co_return "ERROR Invalid BALANCE arguments\n";
+        }
+        if (!db) {
+            co_return "ERROR Database not connected!\n";
+        }
+
+        std::cout << "[Server] BALANCE for account " << accId << "\n";
+
+        std::vector<std::string> params{std::to_string(accId)};
+        AsyncResult result = co_await db->query(BALANCE_STATEMENT, params, timeout());
+        std::string response;
+        appendBalance(response, accId, result);
+        co_return response;
+    }
+
+    if (cmd == "TRANSFER") {
+        int fromId, toId;
+        double amount;
+        iss >> fromId >> toId >> amount;
+        if (!iss) {
+            std::cout << "[Server] TRANSFER: invalid arguments\n";
+            co_return "ERROR Invalid TRANSFER arguments\n";
+        }
+        if (!db) {
+            co_return "ERROR Database not connected!\n";
+        }
+
+        std::cout << "[Server] TRANSFER request " << amount
+                  << " from " << fromId << " to " << toId << "\n";
+
+        /* A single statement between two sync points runs in its own
+         * implicit transaction, transferMoney() is atomic on its own */
+        std::vector<std::string> params{std::to_string(fromId), std::to_string(toId),
+                                        std::to_string(amount), "Server transfer"};
+        AsyncResult result = co_await db->query(TRANSFER_STATEMENT, params, timeout());
+        if (!result.ok()) {
+            std::cout << "[Server] TRANSFER exception: " << result.error() << "\n";
+            AuditLog::getInstance().record(AuditEvent::transfer(fromId, toId, amount, "failed", result.error()));
+            co_return "ERROR Transfer failed: " + result.error() + "\n";
+        }
+
+        /* this backend calls transferMoney() itself, TransactionService does not see it */
+        AuditLog::getInstance().record(AuditEvent::transfer(fromId, toId, amount, "ok", "Server transfer"));
+        std::cout << "[Server] TRANSFER succeeded\n";
+        co_return "OK\n";
+    }
+
+    if (cmd == "STATS") {
+        std::cout << "[Server] Handling STATS\n";
+        co_return statsResponse();
+    }
+
+    if (cmd == "RELOAD") {
+        std::cout << "[Server] Handling RELOAD\n";
+        if (!reloadHandler) {
+            AuditLog::getInstance().record(AuditEvent::reload("refused"));
+            co_return "ERROR Reload not available\n";
+        }
+        /* the reload itself records its outcome */
+        reloadHandler();
+        co_return "OK RELOADING\n";
+    }
+
+    std::cout << "[Server] Unknown command: " << cmd << "\n";
+    co_return "ERROR Unknown command\n";
+}
@@ -0,0 +1,472 @@
+/* io_uring backend of Server: same workers, coroutines and command dispatch
+ * as the epoll backend (server_epoll.cpp), client sockets driven by a ring */
+#include "server.hpp"
+#include "server_event_worker.hpp"
+
+#include <iostream>
+#include <string>
+
+#ifdef HAVE_IO_URING
+
+#include <liburing.h>
+
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <coroutine>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+    constexpr unsigned RING_ENTRIES = 1024;
+
+    /* Provided buffer ring shared by every multishot recv of a worker,
+     * the count must be a power of two */
+    constexpr unsigned BUFFER_COUNT = 1024;
+    constexpr unsigned BUFFER_SIZE  = 4096;
+    constexpr int      BUFFER_GROUP = 0;
+
+    /* A send still pending after this long is cancelled and the client dropped */
+    constexpr long long SEND_TIMEOUT_SECONDS = 30;
+
+    /**
+     * @brief An operation in flight on the ring, its address is the user_data
+     * of the SQE. Completions with user_data 0 (link timeouts, cancels) are ignored
+     */
+    struct UringOp {
+        virtual ~UringOp() = default;
+
+        /** @return true once no more completions will come for this operation */
+        virtual bool complete(const io_uring_cqe& cqe) = 0;
+    };
+
+    /**
+     * @brief The ring of one worker with its provided buffers
+     *
+     * Owns every UringOp submitted through it: an operation is deleted after
+     * its last completion, or with the ring when the worker exits
+     */
+    class UringDriver {
+        public:
+            UringDriver() {
+                int rc = io_uring_queue_init(RING_ENTRIES, &ring, 0);
+                if (rc < 0) {
+                    throw std::runtime_error(std::string("io_uring_queue_init failed: ") + std::strerror(-rc));
+                }
+
+                int err = 0;
+                bufferRing = io_uring_setup_buf_ring(&ring, BUFFER_COUNT, BUFFER_GROUP, 0, &err);
+                if (!bufferRing) {
+                    io_uring_queue_exit(&ring);
+                    throw std::runtime_error(std::string("io_uring_setup_buf_ring failed: ") + std::strerror(-err));
+                }
+
+                buffers.resize(static_cast<std::size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+                for (unsigned id = 0; id < BUFFER_COUNT; ++id) {
+                    io_uring_buf_ring_add(bufferRing, buffer(id), BUFFER_SIZE, id,
+                                          io_uring_buf_ring_mask(BUFFER_COUNT), id);
+                }
+                io_uring_buf_ring_advance(bufferRing, BUFFER_COUNT);
+            }
+
+            ~UringDriver() {
+                /* cancels whatever is still in flight */
+                io_uring_free_buf_ring(&ring, bufferRing, BUFFER_COUNT, BUFFER_GROUP);
+                io_uring_queue_exit(&ring);
+
+                for (UringOp* op : ops) {
+                    delete op;
+                }
+            }
+
+            UringDriver(const UringDriver&) = delete;
+            UringDriver& operator=(const UringDriver&) = delete;
+
+            /**
+             * @brief Next free SQE, submitting the queued ones first when fewer
+             * than needed are left (linked SQEs must go in the same submit)
+             */
+            io_uring_sqe* sqe(unsigned needed = 1) {
+                if (io_uring_sq_space_left(&ring) < needed) {
+                    io_uring_submit(&ring);
+                }
+                io_uring_sqe* entry = io_uring_get_sqe(&ring);
+                if (!entry) {
+                    throw std::runtime_error("io_uring submission queue full");
+                }
+                return entry;
+            }
+
+            /** @brief Makes op the owner of entry's completions */
+            void track(UringOp* op, io_uring_sqe* entry) {
+                io_uring_sqe_set_data(entry, op);
+                ops.insert(op);
+            }
+
+            /** @brief Asks the kernel to cancel op, it still gets its final completion */
+            void cancel(UringOp* op) {
+                io_uring_sqe* entry = sqe();
+                io_uring_prep_cancel(entry, op, 0);
+                io_uring_sqe_set_data(entry, nullptr);
+            }
+
+            char* buffer(unsigned id) {
+                return buffers.data() + static_cast<std::size_t>(id) * BUFFER_SIZE;
+            }
+
+            /** @brief Gives a provided buffer back to the kernel */
+            void recycle(unsigned id) {
+                io_uring_buf_ring_add(bufferRing, buffer(id), BUFFER_SIZE, id,
+                                      io_uring_buf_ring_mask(BUFFER_COUNT), 0);
+                io_uring_buf_ring_advance(bufferRing, 1);
+            }
+
+            /**
+             * @brief Submits the queued SQEs, waits for at least one completion
+             * and dispatches every completion available
+             */
+            void waitAndDispatch() {
+                int rc = io_uring_submit_and_wait(&ring, 1);
+                if (rc < 0 && rc != -EINTR) {
+                    throw std::runtime_error(std::string("io_uring_submit_and_wait failed: ") + std::strerror(-rc));
+                }
+
+                /* The CQE is consumed before dispatching: a completion may
+                 * resume a coroutine that queues new operations */
+                io_uring_cqe* cqe;
+                while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+                    io_uring_cqe completion = *cqe;
+                    io_uring_cqe_seen(&ring, cqe);
+
+                    auto* op = static_cast<UringOp*>(io_uring_cqe_get_data(&completion));
+                    if (op && op->complete(completion)) {
+                        ops.erase(op);
+                        delete op;
+                    }
+                }
+            }
+
+        private:
+            io_uring ring{};
+            io_uring_buf_ring* bufferRing = nullptr;
+            std::vector<char> buffers;
+            std::unordered_set<UringOp*> ops;
+    };
+
+    /** @brief Awaitable that parks a coroutine in a handle slot until it is resumed */
+    struct Park {
+        std::coroutine_handle<>& slot;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> waiting) noexcept { slot = waiting; }
+        void await_resume() const noexcept {}
+    };
+
+    void resume(std::coroutine_handle<>& slot) {
+        if (auto waiting = std::exchange(slot, {})) {
+            waiting.resume();
+        }
+    }
+
+    /**
+     * @brief Client socket of the io_uring backend
+     *
+     * A multishot recv keeps the socket readable for its whole life: received
+     * bytes are copied out of the provided buffer into inbox and the buffer is
+     * recycled at once, so a slow client never holds ring buffers. The state is
+     * shared with the operations in flight, which may outlive the socket
+     */
+    class UringSocket : public ClientStream {
+        public:
+            UringSocket(UringDriver& driver, int fd)
+                : driver(driver), state(std::make_shared<State>()) {
+                state->fd = fd;
+                armRecv(driver, state, new RecvOp(driver, state));
+            }
+
+            ~UringSocket() override {
+                /* ends the multishot recv, its last completion drops the state */
+                shutdown();
+                ::close(state->fd);
+            }
+
+            Task<ssize_t> read(char* data, std::size_t size) override {
+                while (state->inbox.empty() && !state->eof && !state->closed) {
+                    co_await Park{state->reader};
+                }
+
+                if (state->inbox.empty()) {
+                    co_return state->closed ? -1 : state->readError;
+                }
+
+                std::size_t n = std::min(size, state->inbox.size());
+                std::memcpy(data, state->inbox.data(), n);
+                state->inbox.erase(0, n);
+                co_return static_cast<ssize_t>(n);
+            }
+
+            Task<bool> write(std::string_view data) override {
+                while (!data.empty()) {
+                    if (state->closed) {
+                        co_return false;
+                    }
+
+                    /* send linked to a timeout, the operation keeps its own
+                     * copy of the bytes in case the socket goes first */
+                    auto* op = new SendOp(state, std::string(data));
+                    io_uring_sqe* send = driver.sqe(2);
+                    io_uring_prep_send(send, state->fd, op->data.data(), op->data.size(), MSG_NOSIGNAL);
+                    send->flags |= IOSQE_IO_LINK;
+                    driver.track(op, send);
+
+                    io_uring_sqe* timeout = driver.sqe();
+                    io_uring_prep_link_timeout(timeout, &op->timeout, 0);
+                    io_uring_sqe_set_data(timeout, nullptr);
+
+                    co_await Park{state->writer};
+
+                    if (state->sendResult <= 0) {
+                        co_return false;
+                    }
+                    /* partial send, the rest goes in a new one */
+                    data.remove_prefix(static_cast<std::size_t>(state->sendResult));
+                }
+                co_return true;
+            }
+
+            void shutdown() override {
+                if (state->closed) {
+                    return;
+                }
+                state->closed = true;
+                ::shutdown(state->fd, SHUT_RDWR);
+
+                /* a pending send completes with an error on its own */
+                resume(state->reader);
+            }
+
+        private:
+            struct State {
+                int fd = -1;
+                std::string inbox;
+                bool eof = false;
+                bool closed = false;
+                ssize_t readError = 0;
+                int sendResult = 0;
+                std::coroutine_handle<> reader;
+                std::coroutine_handle<> writer;
+            };
+
+            struct RecvOp : UringOp {
+                UringDriver& driver;
+                std::shared_ptr<State> state;
+
+                RecvOp(UringDriver& driver, std::shared_ptr<State> state)
+                    : driver(driver), state(std::move(state)) {}
+
+                bool complete(const io_uring_cqe& cqe) override {
+                    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                        unsigned id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                        state->inbox.append(driver.buffer(id), static_cast<std::size_t>(cqe.res));
+                        driver.recycle(id);
+                    } else if (cqe.res == 0) {
+                        state->eof = true;
+                    } else if (cqe.res < 0 && cqe.res != -ENOBUFS) {
+                        state->eof = true;
+                        state->readError = -1;
+                    }
+
+                    bool finished = false;
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                        /* multishot ended (out of buffers, or on its own) */
+                        if (state->eof || state->closed) {
+                            finished = true;
+                        } else {
+                            armRecv(driver, state, this);
+                        }
+                    }
+
+                    resume(state->reader);
+                    return finished;
+                }
+            };
+
+            struct SendOp : UringOp {
+                std::shared_ptr<State> state;
+                std::string data;
+                __kernel_timespec timeout{SEND_TIMEOUT_SECONDS, 0};
+
+                SendOp(std::shared_ptr<State> state, std::string data)
+                    : state(std::move(state)), data(std::move(data)) {}
+
+                bool complete(const io_uring_cqe& cqe) override {
+                    /* -ECANCELED when the linked timeout fired first */
+                    state->sendResult = cqe.res;
+                    if (cqe.res == -ECANCELED) {
+                        std::cout << "[Server] Send timed out, dropping client\n";
+                    }
+                    resume(state->writer);
+                    return true;
+                }
+            };
+
+            static void armRecv(UringDriver& driver, const std::shared_ptr<State>& state, RecvOp* op) {
+                io_uring_sqe* entry = driver.sqe();
+                io_uring_prep_recv_multishot(entry, state->fd, nullptr, 0, 0);
+                entry->flags |= IOSQE_BUFFER_SELECT;
+                entry->buf_group = BUFFER_GROUP;
+                driver.track(op, entry);
+            }
+
+            UringDriver& driver;
+            std::shared_ptr<State> state;
+    };
+
+    /**
+     * @brief One shot poll of the EventLoop's epoll descriptor: database
+     * sockets and posted tasks are served by EventLoop::poll(0) when it fires
+     */
+    struct LoopPollOp : UringOp {
+        UringDriver& driver;
+        EventLoop& loop;
+
+        LoopPollOp(UringDriver& driver, EventLoop& loop) : driver(driver), loop(loop) {}
+
+        void arm() {
+            io_uring_sqe* entry = driver.sqe();
+            io_uring_prep_poll_add(entry, loop.fd(), POLLIN);
+            driver.track(this, entry);
+        }
+
+        bool complete(const io_uring_cqe&) override {
+            loop.poll(0);
+            arm();
+            return false;
+        }
+    };
+}
+
+bool Server::ioUringAvailable(std::string& reason) {
+    /* multishot recv with provided buffer rings needs 6.0 */
+    utsname kernel{};
+    int major = 0, minor = 0;
+    if (::uname(&kernel) == 0 && std::sscanf(kernel.release, "%d.%d", &major, &minor) == 2 && major < 6) {
+        reason = std::string("kernel ") + kernel.release + " is older than 6.0";
+        return false;
+    }
+
+    io_uring ring{};
+    int rc = io_uring_queue_init(8, &ring, 0);
+    if (rc < 0) {
+        /* ENOSYS on old kernels, EPERM when disabled by sysctl or seccomp */
+        reason = std::string("io_uring_setup: ") + std::strerror(-rc);
+        return false;
+    }
+
+    bool supported = false;
+    if (io_uring_probe* probe = io_uring_get_probe_ring(&ring)) {
+        supported = true;
+        for (int opcode : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD,
+                           IORING_OP_LINK_TIMEOUT, IORING_OP_ASYNC_CANCEL}) {
+            supported = supported && io_uring_opcode_supported(probe, opcode);
+        }
+        io_uring_free_probe(probe);
+    }
+    io_uring_queue_exit(&ring);
+
+    if (!supported) {
+        reason = "io_uring opcodes missing";
+    }
+    return supported;
+}
+
+void Server::runUringWorker(EventWorker& worker) {
+    UringDriver driver;
+
+    /* Multishot accept: one SQE, one completion per connection */
+    struct AcceptOp : UringOp {
+        Server& server;
+        EventWorker& worker;
+        UringDriver& driver;
+        AcceptOp*& self;
+
+        AcceptOp(Server& server, EventWorker& worker, UringDriver& driver, AcceptOp*& self)
+            : server(server), worker(worker), driver(driver), self(self) {}
+
+        void arm() {
+            io_uring_sqe* entry = driver.sqe();
+            io_uring_prep_multishot_accept(entry, worker.listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+            driver.track(this, entry);
+        }
+
+        bool complete(const io_uring_cqe& cqe) override {
+            if (cqe.res >= 0) {
+                int clientSocket = cqe.res;
+                server.configureClientSocket(clientSocket);
+
+                auto connection = server.trackEventConnection(worker, clientSocket);
+                if (connection != 0) {
+                    spawn(server.serveClient(worker, std::make_unique<UringSocket>(driver, clientSocket),
+                                             server.rateLimiter.client(clientSocket), connection));
+                }
+            } else if (cqe.res != -ECANCELED) {
+                std::cout << "[Server] accept: " << std::strerror(-cqe.res) << "\n";
+            }
+
+            if (cqe.flags & IORING_CQE_F_MORE) {
+                return false;
+            }
+            if (worker.listenSocket >= 0 && server.running) {
+                arm();
+                return false;
+            }
+            self = nullptr;
+            return true;
+        }
+    };
+
+    AcceptOp* accept = new AcceptOp(*this, worker, driver, accept);
+    accept->arm();
+
+    (new LoopPollOp(driver, worker.loop))->arm();
+
+    std::cout << "[Server] io_uring worker ready\n";
+
+    while (!worker.loop.isStopped()) {
+        driver.waitAndDispatch();
+
+        /* stopEventAccept() closed the listening socket, the ring still holds
+         * a reference to it until the multishot accept is cancelled */
+        if (accept && worker.listenSocket < 0) {
+            driver.cancel(accept);
+            accept = nullptr;
+        }
+    }
+
+    /* tasks posted right before stop() still run, like EventLoop::run() */
+    worker.loop.poll(0);
+}
+
+#else
+
+bool Server::ioUringAvailable(std::string& reason) {
+    reason = "built without io_uring support (make IO_URING=1)";
+    return false;
+}
+
+void Server::runUringWorker(EventWorker& worker) {
+    /* start() never selects the backend in this build */
+    std::cout << "[Server] io_uring backend not built in\n";
+    worker.loop.run();
+}
+
+#endif
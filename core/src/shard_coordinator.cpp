@@ -0,0 +1,394 @@
+#include "shard_coordinator.hpp"
+#include "metrics.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+namespace {
+    /* Prepared transactions of the coordinators, "bank_<node>_...". recover()
+     * only settles its own node's, anything else on the shards (other
+     * servers, other applications, manual PREPAREs) is left alone */
+    constexpr const char* GID_PREFIX = "bank_";
+
+    /* Stable across builds and platforms (std::hash<int> is the identity on
+     * libstdc++ and unspecified elsewhere): placement must never change */
+    std::uint32_t mixAccountID(int accountID) {
+        std::uint32_t h = static_cast<std::uint32_t>(accountID);
+        h ^= h >> 16;
+        h *= 0x85ebca6bu;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35u;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /* host:port out of a libpq connection string, for the logs */
+    std::string shardName(const std::string& connectionString) {
+        std::istringstream iss(connectionString);
+        std::string field, host, port, dbname;
+        while (iss >> field) {
+            if (field.rfind("host=", 0) == 0) {
+                host = field.substr(5);
+            } else if (field.rfind("port=", 0) == 0) {
+                port = field.substr(5);
+            } else if (field.rfind("dbname=", 0) == 0) {
+                dbname = field.substr(7);
+            }
+        }
+        return host + ":" + port + "/" + dbname;
+    }
+}
+
+pqxx::connection& ShardCoordinator::Shard::connection() {
+    if (!conn || !conn->is_open()) {
+        conn = std::make_unique<pqxx::connection>(connectionString);
+    }
+    return *conn;
+}
+
+ShardCoordinator& ShardCoordinator::getInstance() {
+    static ShardCoordinator instance;
+    return instance;
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    if (logFd >= 0) {
+        ::close(logFd);
+    }
+}
+
+void ShardCoordinator::configure(const ShardSettings& newSettings) {
+    shards.clear();
+    if (logFd >= 0) {
+        ::close(logFd);
+        logFd = -1;
+    }
+
+    settings = newSettings;
+    for (const auto& connectionString : settings.connectionStrings) {
+        auto shard = std::make_unique<Shard>();
+        shard->connectionString = connectionString;
+        shards.push_back(std::move(shard));
+    }
+
+    if (shards.empty()) {
+        return;
+    }
+
+    std::filesystem::path logPath(settings.recoveryLogPath);
+    if (logPath.has_parent_path()) {
+        std::filesystem::create_directories(logPath.parent_path());
+    }
+
+    logFd = ::open(settings.recoveryLogPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd < 0) {
+        throw std::runtime_error("Failed to open shard recovery log " + settings.recoveryLogPath
+                                 + ": " + std::strerror(errno));
+    }
+
+    /* gids must never repeat, not even across restarts */
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    std::ostringstream tag;
+    tag << std::hex << std::chrono::duration_cast<std::chrono::microseconds>(now).count()
+        << "_" << ::getpid();
+    instanceTag = tag.str();
+    nodePrefix = GID_PREFIX + settings.nodeID + "_";
+}
+
+void ShardCoordinator::start() {
+    configure(DBConnection::getInstance().getShardSettings());
+    if (shards.empty()) {
+        return;
+    }
+
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->mutex);
+        try {
+            shard->connection();
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("Shard " + shardName(shard->connectionString)
+                                     + " unreachable: " + e.what());
+        }
+    }
+
+    std::cout << "[ShardCoordinator] " << shards.size() << " shard(s), "
+              << (settings.placement == ShardPlacement::Hash ? "hash" : "range")
+              << " placement\n";
+
+    std::size_t settled = recover();
+    if (settled > 0) {
+        std::cout << "[ShardCoordinator] Settled " << settled << " prepared transaction(s) on start\n";
+    }
+}
+
+bool ShardCoordinator::enabled() const {
+    return !shards.empty();
+}
+
+std::size_t ShardCoordinator::shardCount() const {
+    return shards.size();
+}
+
+std::size_t ShardCoordinator::shardOf(int accountID) const {
+    if (shards.empty()) {
+        return 0;
+    }
+
+    if (settings.placement == ShardPlacement::Range) {
+        auto bound = std::upper_bound(settings.rangeBounds.begin(), settings.rangeBounds.end(), accountID);
+        return static_cast<std::size_t>(bound - settings.rangeBounds.begin());
+    }
+
+    return mixAccountID(accountID) % shards.size();
+}
+
+void ShardCoordinator::transfer(int fromAccountID, int toAccountID, double amount,
+                                const std::string& description) {
+    if (shards.empty()) {
+        throw std::runtime_error("Transfer failed: no shard configured");
+    }
+
+    /* in doubt transactions keep their rows locked, settle them first */
+    if (recoveryNeeded.exchange(false)) {
+        try {
+            recover();
+        }
+        catch (const std::exception& e) {
+            std::cout << "[ShardCoordinator] recover() failed: " << e.what() << "\n";
+            recoveryNeeded = true;
+        }
+    }
+
+    Shard& debit  = *shards[shardOf(fromAccountID)];
+    Shard& credit = *shards[shardOf(toAccountID)];
+
+    if (&debit == &credit) {
+        transferLocal(debit, fromAccountID, toAccountID, amount, description);
+    } else {
+        transferCrossShard(debit, credit, fromAccountID, toAccountID, amount, description);
+    }
+}
+
+void ShardCoordinator::transferLocal(Shard& shard, int fromAccountID, int toAccountID,
+                                     double amount, const std::string& description) {
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    try {
+        pqxx::work tx(shard.connection());
+        tx.exec("SELECT transferMoney($1, $2, $3, $4);",
+                pqxx::params{fromAccountID, toAccountID, amount, description});
+        tx.commit();
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Transfer failed: ") + e.what());
+    }
+
+    Metrics::getInstance().increment("shard.transfers_local");
+}
+
+void ShardCoordinator::transferCrossShard(Shard& debit, Shard& credit, int fromAccountID, int toAccountID,
+                                          double amount, const std::string& description) {
+    const std::string gid = nextTransactionID();
+
+    /* std::scoped_lock never deadlocks with another transfer locking the
+     * same two shards the other way around */
+    std::scoped_lock guard(debit.mutex, credit.mutex);
+
+    bool debitOpen = false, debitPrepared = false;
+    bool creditOpen = false, creditPrepared = false;
+
+    try {
+        logRecord("BEGIN " + gid);
+
+        /* explicit BEGIN: PREPARE TRANSACTION must end the transaction, not COMMIT */
+        std::string currency;
+        {
+            pqxx::nontransaction tx(debit.connection());
+            tx.exec("BEGIN");
+            debitOpen = true;
+            currency = tx.exec("SELECT debitTransferLeg($1, $2, $3, $4)",
+                               pqxx::params{fromAccountID, toAccountID, amount, description})
+                           .one_field().as<std::string>();
+            tx.exec("PREPARE TRANSACTION " + debit.connection().quote(gid));
+            debitPrepared = true;
+        }
+        {
+            pqxx::nontransaction tx(credit.connection());
+            tx.exec("BEGIN");
+            creditOpen = true;
+            tx.exec("SELECT creditTransferLeg($1, $2, $3, $4, $5)",
+                    pqxx::params{fromAccountID, toAccountID, amount, currency, description});
+            tx.exec("PREPARE TRANSACTION " + credit.connection().quote(gid));
+            creditPrepared = true;
+        }
+
+        /* the decision: from here on the transfer happened, whatever fails next */
+        logRecord("COMMIT " + gid);
+    }
+    catch (const std::exception& e) {
+        auto rollback = [&gid](Shard& shard, bool open, bool prepared) {
+            if (!open) {
+                return;
+            }
+            try {
+                pqxx::nontransaction tx(shard.connection());
+                tx.exec(prepared ? "ROLLBACK PREPARED " + shard.connection().quote(gid) : std::string("ROLLBACK"));
+            }
+            catch (const std::exception& rollbackError) {
+                /* still prepared: presumed abort, recover() rolls it back */
+                std::cout << "[ShardCoordinator] Rollback of " << gid << " on "
+                          << shardName(shard.connectionString) << " failed: " << rollbackError.what() << "\n";
+            }
+        };
+        rollback(debit, debitOpen, debitPrepared);
+        rollback(credit, creditOpen, creditPrepared);
+
+        try {
+            logRecord("ABORT " + gid);
+        }
+        catch (const std::exception&) {
+            /* no COMMIT record either, recovery presumes abort */
+        }
+
+        Metrics::getInstance().increment("shard.transfers_aborted");
+        throw std::runtime_error(std::string("Transfer failed: ") + e.what());
+    }
+
+    bool settled = true;
+    for (Shard* shard : {&debit, &credit}) {
+        try {
+            pqxx::nontransaction tx(shard->connection());
+            tx.exec("COMMIT PREPARED " + shard->connection().quote(gid));
+        }
+        catch (const std::exception& e) {
+            std::cout << "[ShardCoordinator] COMMIT PREPARED " << gid << " on "
+                      << shardName(shard->connectionString) << " failed, left to recovery: "
+                      << e.what() << "\n";
+            settled = false;
+        }
+    }
+
+    if (settled) {
+        try {
+            logRecord("DONE " + gid);
+        }
+        catch (const std::exception& e) {
+            std::cout << "[ShardCoordinator] " << e.what() << "\n";
+        }
+    } else {
+        Metrics::getInstance().increment("shard.in_doubt");
+        recoveryNeeded = true;
+    }
+
+    Metrics::getInstance().increment("shard.transfers_cross");
+}
+
+ReadLease ShardCoordinator::acquireRead(int accountID) {
+    return acquireShard(shardOf(accountID));
+}
+
+ReadLease ShardCoordinator::acquireShard(std::size_t index) {
+    Shard& shard = *shards.at(index);
+    std::unique_lock<std::mutex> guard(shard.mutex);
+    pqxx::connection& conn = shard.connection();
+    return ReadLease(std::move(guard), conn, false);
+}
+
+std::size_t ShardCoordinator::recover() {
+    /* every shard locked: no transfer sits between BEGIN and its decision */
+    std::vector<std::unique_lock<std::mutex>> guards;
+    for (auto& shard : shards) {
+        guards.emplace_back(shard->mutex);
+    }
+    std::lock_guard<std::mutex> logGuard(logMutex);
+
+    std::unordered_set<std::string> committed;
+    {
+        std::ifstream log(settings.recoveryLogPath);
+        std::string record, gid;
+        while (log >> record >> gid) {
+            if (record == "COMMIT") {
+                committed.insert(gid);
+            }
+        }
+    }
+
+    std::size_t settled = 0;
+    bool complete = true;
+
+    for (auto& shard : shards) {
+        try {
+            pqxx::nontransaction tx(shard->connection());
+            /* left() rather than LIKE: '_' is a wildcard there */
+            pqxx::result pending = tx.exec(
+                "SELECT gid FROM pg_prepared_xacts "
+                "WHERE left(gid, length($1)) = $1 AND database = current_database()",
+                pqxx::params{nodePrefix});
+
+            for (const auto& row : pending) {
+                std::string gid = row[0].as<std::string>();
+                bool commit = committed.count(gid) > 0;
+
+                tx.exec((commit ? "COMMIT PREPARED " : "ROLLBACK PREPARED ") + shard->connection().quote(gid));
+                std::cout << "[ShardCoordinator] " << (commit ? "Committed " : "Rolled back ")
+                          << gid << " on " << shardName(shard->connectionString) << "\n";
+                ++settled;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "[ShardCoordinator] Recovery on " << shardName(shard->connectionString)
+                      << " failed: " << e.what() << "\n";
+            complete = false;
+        }
+    }
+
+    /* nothing of this node is in doubt anymore, the log (its own) can start over */
+    if (complete && logFd >= 0) {
+        if (::ftruncate(logFd, 0) != 0) {
+            std::cout << "[ShardCoordinator] Failed to truncate " << settings.recoveryLogPath
+                      << ": " << std::strerror(errno) << "\n";
+        }
+    } else if (!complete) {
+        recoveryNeeded = true;
+    }
+
+    return settled;
+}
+
+std::string ShardCoordinator::nextTransactionID() {
+    return nodePrefix + instanceTag + "_" + std::to_string(++sequence);
+}
+
+void ShardCoordinator::logRecord(const std::string& record) {
+    std::lock_guard<std::mutex> guard(logMutex);
+
+    std::string line = record + "\n";
+    const char* data = line.data();
+    std::size_t left = line.size();
+
+    while (left > 0) {
+        ssize_t n = ::write(logFd, data, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Failed to write shard recovery log: " + std::string(std::strerror(errno)));
+        }
+        data += n;
+        left -= static_cast<std::size_t>(n);
+    }
+
+    if (::fdatasync(logFd) != 0) {
+        throw std::runtime_error("Failed to sync shard recovery log: " + std::string(std::strerror(errno)));
+    }
+}
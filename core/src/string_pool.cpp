@@ -0,0 +1,80 @@
+#include "string_pool.hpp"
+
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    constexpr std::size_t INITIAL_SLOTS = 64;
+}
+
+StringPool::StringPool() : offsets{0, 0}, table(INITIAL_SLOTS, 0) {
+
+}
+
+StringPool::Handle StringPool::intern(std::string_view text) {
+    if (text.empty()) {
+        return EMPTY;
+    }
+
+    std::size_t mask = table.size() - 1;
+    std::size_t slot = std::hash<std::string_view>{}(text) & mask;
+    for (; table[slot] != 0; slot = (slot + 1) & mask) {
+        if (view(table[slot] - 1) == text) {
+            return table[slot] - 1;
+        }
+    }
+
+    if (chars.size() + text.size() > std::numeric_limits<std::uint32_t>::max() ||
+        offsets.size() >= std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error("StringPool is full");
+    }
+
+    auto handle = static_cast<Handle>(size());
+    chars.append(text);
+    offsets.push_back(static_cast<std::uint32_t>(chars.size()));
+    table[slot] = handle + 1;
+
+    /* at most half full keeps the probe sequences short */
+    if (size() * 2 > table.size()) {
+        rehash(table.size() * 2);
+    }
+    return handle;
+}
+
+void StringPool::rehash(std::size_t slots) {
+    table.assign(slots, 0);
+    std::size_t mask = slots - 1;
+
+    for (Handle handle = 1; handle < size(); ++handle) {
+        std::size_t slot = std::hash<std::string_view>{}(view(handle)) & mask;
+        while (table[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = handle + 1;
+    }
+}
+
+void StringPool::reserve(std::size_t strings, std::size_t characters) {
+    chars.reserve(characters);
+    offsets.reserve(strings + 2);
+
+    std::size_t slots = table.size();
+    while (slots < strings * 2) {
+        slots *= 2;
+    }
+    if (slots != table.size()) {
+        rehash(slots);
+    }
+}
+
+void StringPool::clear() {
+    chars.clear();
+    offsets.assign({0, 0});
+    table.assign(INITIAL_SLOTS, 0);
+}
+
+std::size_t StringPool::memoryUsage() const {
+    return chars.capacity() + offsets.capacity() * sizeof(std::uint32_t) +
+           table.capacity() * sizeof(std::uint32_t);
+}
@@ -0,0 +1,89 @@
+#include "stripe_folder.hpp"
+#include "database_connection.hpp"
+#include "shard_coordinator.hpp"
+#include "metrics.hpp"
+
+#include <iostream>
+
+namespace {
+    /* accounts being debited are skipped (SKIP LOCKED), never waited for */
+    constexpr const char* FOLD_QUERY = "SELECT foldAllAccountStripes()";
+}
+
+StripeFolder::StripeFolder(std::chrono::milliseconds interval)
+    : interval(interval) {
+}
+
+StripeFolder::~StripeFolder() {
+    stop();
+}
+
+void StripeFolder::start() {
+    if (running) {
+        return;
+    }
+
+    running = true;
+    folderThread = std::thread(&StripeFolder::run, this);
+}
+
+void StripeFolder::stop() {
+    {
+        std::lock_guard<std::mutex> guard(waitMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+
+    if (folderThread.joinable()) {
+        folderThread.join();
+    }
+}
+
+int StripeFolder::fold() {
+    int folded = 0;
+
+    auto& shards = ShardCoordinator::getInstance();
+    if (shards.enabled()) {
+        for (std::size_t shard = 0; shard < shards.shardCount(); ++shard) {
+            auto lease = shards.acquireShard(shard);
+            /* one statement, its own transaction */
+            auto tx = lease.createAutocommitTransaction();
+            folded += tx->query_value<int>(FOLD_QUERY);
+        }
+    } else {
+        /* housekeeping, requests go first */
+        RequestClassScope bulk(RequestClass::Bulk);
+
+        auto& db = DBConnection::getInstance();
+        auto guard = db.lock();
+        auto tx = db.createWriteTransaction();
+        folded = tx->query_value<int>(FOLD_QUERY);
+        tx->commit();
+    }
+
+    Metrics::getInstance().increment("db.stripe_folds", folded);
+    return folded;
+}
+
+void StripeFolder::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(waitMutex);
+            wakeUp.wait_for(guard, interval, [this]() { return !running; });
+            if (!running) {
+                return;
+            }
+        }
+
+        try {
+            int folded = fold();
+            if (folded > 0) {
+                std::cout << "[StripeFolder] Folded the stripes of " << folded << " account(s)\n";
+            }
+        }
+        catch (const std::exception& e) {
+            /* the stripes keep their credits, debits fold them if needed */
+            std::cout << "[StripeFolder] Fold failed: " << e.what() << "\n";
+        }
+    }
+}
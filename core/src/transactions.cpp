@@ -1,16 +1,50 @@
 #include "transactions.hpp"
 #include "database_connection.hpp"
+#include "shard_coordinator.hpp"
+#include "netting_service.hpp"
+#include "audit_log.hpp"
 
 void TransactionService::transfer(int fromAccountID,
                                   int toAccountID,
                                   double amount,
                                   const std::string& description) {
-    
+    /* queued only, audit_logs is written by the AuditLog writer thread */
+    try {
+        execute(fromAccountID, toAccountID, amount, description);
+    }
+    catch (const std::exception& e) {
+        AuditLog::getInstance().record(AuditEvent::transfer(fromAccountID, toAccountID, amount, "failed", e.what()));
+        throw;
+    }
+    AuditLog::getInstance().record(AuditEvent::transfer(fromAccountID, toAccountID, amount, "ok", description));
+}
+
+void TransactionService::execute(int fromAccountID,
+                                 int toAccountID,
+                                 double amount,
+                                 const std::string& description) {
 
     std::cout << "[TransactionService] transfer("
               << fromAccountID << " -> " << toAccountID
               << ", " << amount << ", \"" << description << "\") start\n";
 
+    /* between internal accounts: netted with the other transfers of the window */
+    auto& netting = NettingService::getInstance();
+    if (netting.eligible(fromAccountID, toAccountID)) {
+        netting.transfer(fromAccountID, toAccountID, amount, description);
+        std::cout << "[TransactionService] transfer() committed by a netting flush\n";
+        return;
+    }
+
+    /* sharded database: the accounts may live on two different shards */
+    auto& shards = ShardCoordinator::getInstance();
+    if (shards.enabled()) {
+        shards.transfer(fromAccountID, toAccountID, amount, description);
+        std::cout << "[TransactionService] transfer() committed on shard(s) "
+                  << shards.shardOf(fromAccountID) << "/" << shards.shardOf(toAccountID) << "\n";
+        return;
+    }
+
     /* Get the instance using DBConnection and store in db */
     auto& db = DBConnection::getInstance();
     
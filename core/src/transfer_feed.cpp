@@ -0,0 +1,489 @@
+#include "transfer_feed.hpp"
+#include "account_table.hpp"
+#include "command_parser.hpp"
+#include "database_connection.hpp"
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    /* pause before connecting again after the reader connection failed */
+    constexpr std::chrono::seconds RECONNECT_DELAY{1};
+
+    /* Transaction ids are SERIAL, so a lower id can commit after a higher one.
+     * Skipped ids inside this window below the last one read are asked for
+     * again by every read, older ones are assumed rolled back (see
+     * AccountTable's PENDING_WINDOW) */
+    constexpr long long PENDING_WINDOW = 10000;
+
+    /* Rows of one database committed since the last read. Transfers, netted
+     * records and the debit legs of cross shard transfers, whose destination
+     * only lives in the description (see shardTransfer.sql), are published.
+     * The other rows (credit legs, deposits...) only settle their id */
+    constexpr const char* READ_QUERY =
+        "SELECT transaction_id, from_account, "
+        "COALESCE(to_account, substring(description FROM '\\(to account ([0-9]+)\\)$')::int), amount, "
+        "COALESCE(from_account IS NOT NULL "
+        "AND (status IN ('completed', 'netted') AND to_account IS NOT NULL "
+        "OR status = 'cross_shard' AND to_account IS NULL AND description ~ '\\(to account [0-9]+\\)$'), false) "
+        "FROM transactions "
+        "WHERE transaction_id > $1 OR transaction_id = ANY($2::bigint[]) "
+        "ORDER BY transaction_id LIMIT $3";
+
+    /* rows per read query, a backlog is read page after page */
+    constexpr long long READ_PAGE = 10000;
+
+    /* Builds a Postgres array literal like {1,2,3} */
+    std::string toArrayLiteral(const std::unordered_set<long long>& ids) {
+        std::string out = "{";
+        for (auto id : ids) {
+            if (out.size() > 1) {
+                out += ',';
+            }
+            out += std::to_string(id);
+        }
+        out += '}';
+        return out;
+    }
+}
+
+bool TransferEvent::parse(std::string_view payload, TransferEvent& event) {
+    CommandParser parser(payload);
+    std::string_view amount;
+    parser >> event.transactionID >> event.fromAccountID >> event.toAccountID >> amount;
+    if (!parser || !parser.remainder().empty()) {
+        return false;
+    }
+
+    try {
+        event.cents = parseCents(amount);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+std::string TransferEvent::line() const {
+    std::string out = "EVENT ";
+    out += std::to_string(sequence);
+    out += ' ';
+    out += std::to_string(transactionID);
+    out += ' ';
+    out += std::to_string(fromAccountID);
+    out += ' ';
+    out += std::to_string(toAccountID);
+    out += ' ';
+    out += formatCents(cents);
+    out += '\n';
+    return out;
+}
+
+TransferSubscription::TransferSubscription(std::size_t capacity) : capacity(std::max<std::size_t>(capacity, 1)) {
+
+}
+
+bool TransferSubscription::take(std::string& out) {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (const auto& line : lines) {
+        out += line;
+    }
+    lines.clear();
+    takenUpTo = queuedSequence;
+    return !closed;
+}
+
+bool TransferSubscription::waitAndTake(std::string& out, std::chrono::milliseconds timeout) {
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        ready.wait_for(guard, timeout, [this]() { return closed || !lines.empty(); });
+    }
+    return take(out);
+}
+
+void TransferSubscription::onReady(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!closed && lines.empty()) {
+            wake = std::move(callback);
+            return;
+        }
+    }
+    callback();
+}
+
+void TransferSubscription::close(std::string finalLine) {
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (closed) {
+            return;
+        }
+        closed = true;
+        if (!finalLine.empty()) {
+            lines.push_back(std::move(finalLine));
+        }
+        callback = std::exchange(wake, {});
+    }
+    ready.notify_all();
+    if (callback) {
+        callback();
+    }
+}
+
+std::uint64_t TransferSubscription::lastSequence() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return queuedSequence;
+}
+
+std::uint64_t TransferSubscription::takenSequence() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return takenUpTo;
+}
+
+bool TransferSubscription::push(const TransferEvent& event, bool bounded) {
+    std::function<void()> callback;
+    bool open;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (closed) {
+            return false;
+        }
+
+        if (bounded && lines.size() >= capacity) {
+            /* the client gets what is queued, then where to resume from */
+            closed = true;
+            lines.push_back("ERROR Subscriber too slow, resume after " + std::to_string(queuedSequence) + "\n");
+        } else {
+            lines.push_back(event.line());
+            queuedSequence = event.sequence;
+        }
+        open = !closed;
+        callback = std::exchange(wake, {});
+    }
+    ready.notify_all();
+    if (callback) {
+        callback();
+    }
+    return open;
+}
+
+TransferFeed& TransferFeed::getInstance() {
+    static TransferFeed instance;
+    return instance;
+}
+
+TransferFeed::TransferFeed()
+    : stream(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count())) {
+    auto primary = std::make_unique<Source>();
+    primary->name = "primary";
+    sources.push_back(std::move(primary));
+}
+
+TransferFeed::~TransferFeed() {
+    stop();
+}
+
+void TransferFeed::start(const TransferFeedSettings& newSettings) {
+    std::lock_guard<std::mutex> guard(readerMutex);
+    if (running || !newSettings.enabled) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> feedGuard(mutex);
+        /* the ring and the buffers keep the sizes they were created with */
+        if (sequence == 0 && subscriptions.empty()) {
+            settings = newSettings;
+        } else {
+            settings.pollInterval = newSettings.pollInterval;
+        }
+        settings.replayCapacity = std::max<std::size_t>(settings.replayCapacity, 1);
+
+        /* transfers between accounts of one shard are recorded on that shard */
+        if (sources.size() == 1) {
+            auto& db = DBConnection::getInstance();
+            const std::string primary = db.getConnectionString();
+            for (const auto& connectionString : db.getShardSettings().connectionStrings) {
+                if (connectionString == primary) {
+                    continue;
+                }
+                auto shard = std::make_unique<Source>();
+                shard->connectionString = connectionString;
+                shard->name = "shard " + std::to_string(sources.size() - 1);
+                sources.push_back(std::move(shard));
+            }
+        }
+    }
+
+    running = true;
+    for (std::size_t i = 0; i < sources.size(); ++i) {
+        sources[i]->reader = std::thread(&TransferFeed::run, this, i);
+    }
+
+    std::cout << "[TransferFeed] Reading " << sources.size() << " database(s) every "
+              << settings.pollInterval.count() << " ms, stream " << stream << "\n";
+}
+
+void TransferFeed::stop() {
+    {
+        std::lock_guard<std::mutex> guard(readerMutex);
+        running = false;
+    }
+    stopRequested.notify_all();
+
+    for (auto& source : sources) {
+        if (source->reader.joinable()) {
+            source->reader.join();
+        }
+    }
+
+    std::vector<std::shared_ptr<TransferSubscription>> closing;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        closing.swap(subscriptions);
+    }
+    for (auto& subscription : closing) {
+        subscription->close("ERROR Server is shutting down, resume after " +
+                            std::to_string(subscription->lastSequence()) + "\n");
+        Metrics::getInstance().increment("feed.subscribers", -1);
+    }
+}
+
+std::shared_ptr<TransferSubscription> TransferFeed::subscribe(std::uint64_t streamID, std::uint64_t& after,
+                                                              std::string& error) {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    auto subscription = std::make_shared<TransferSubscription>(settings.subscriberBuffer);
+    if (streamID == 0) {
+        after = sequence;
+    } else if (streamID != stream) {
+        error = "Stream " + std::to_string(streamID) + " has ended, current stream is " + std::to_string(stream);
+        return nullptr;
+    } else if (after > sequence) {
+        error = "Unknown sequence " + std::to_string(after) + ", last is " + std::to_string(sequence);
+        return nullptr;
+    } else {
+        /* every event after the resume point must still be in the ring */
+        std::uint64_t oldest = replay.empty() ? sequence + 1 : replay.front().sequence;
+        if (after + 1 < oldest) {
+            error = "Events after " + std::to_string(after) + " are no longer kept, oldest is " +
+                    std::to_string(oldest);
+            return nullptr;
+        }
+        for (const auto& event : replay) {
+            if (event.sequence > after) {
+                subscription->push(event, false);
+            }
+        }
+    }
+
+    subscription->queuedSequence = std::max(subscription->queuedSequence, after);
+    subscription->takenUpTo = after;
+    subscriptions.push_back(subscription);
+    Metrics::getInstance().increment("feed.subscribers");
+    return subscription;
+}
+
+void TransferFeed::unsubscribe(const std::shared_ptr<TransferSubscription>& subscription) {
+    subscription->close();
+
+    std::lock_guard<std::mutex> guard(mutex);
+    auto found = std::find(subscriptions.begin(), subscriptions.end(), subscription);
+    if (found != subscriptions.end()) {
+        subscriptions.erase(found);
+        Metrics::getInstance().increment("feed.subscribers", -1);
+    }
+}
+
+bool TransferFeed::publish(std::string_view payload, std::size_t source) {
+    TransferEvent event;
+    if (!TransferEvent::parse(payload, event)) {
+        std::cout << "[TransferFeed] Ignoring invalid payload: \"" << payload << "\"\n";
+        return false;
+    }
+    event.source = source;
+    return publishEvent(event);
+}
+
+bool TransferFeed::publishEvent(TransferEvent event) {
+    std::lock_guard<std::mutex> guard(mutex);
+    Source& source = *sources.at(event.source);
+
+    /* a row read again after a lost connection is published once */
+    if (source.replayed.count(event.transactionID) > 0) {
+        return false;
+    }
+
+    const long long id = event.transactionID;
+    track(source, id);
+
+    event.sequence = ++sequence;
+
+    replay.push_back(event);
+    source.replayed.insert(id);
+    if (replay.size() > settings.replayCapacity) {
+        sources[replay.front().source]->replayed.erase(replay.front().transactionID);
+        replay.pop_front();
+    }
+
+    /* a subscription too slow for this event is closed by push() and dropped here */
+    std::size_t dropped = 0;
+    std::erase_if(subscriptions, [&](const std::shared_ptr<TransferSubscription>& subscription) {
+        if (subscription->push(event)) {
+            return false;
+        }
+        ++dropped;
+        return true;
+    });
+
+    auto& metrics = Metrics::getInstance();
+    metrics.increment("feed.events_published");
+    if (dropped > 0) {
+        metrics.increment("feed.subscribers", -static_cast<std::int64_t>(dropped));
+        metrics.increment("feed.subscribers_dropped", static_cast<std::int64_t>(dropped));
+    }
+    return true;
+}
+
+std::uint64_t TransferFeed::streamID() const {
+    return stream;
+}
+
+std::uint64_t TransferFeed::lastSequence() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return sequence;
+}
+
+std::size_t TransferFeed::subscribers() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return subscriptions.size();
+}
+
+void TransferFeed::track(Source& source, long long id) {
+    /* ids skipped up to this one may still commit, the next reads ask for them */
+    if (id > source.lastTransactionID) {
+        for (long long gap = std::max(source.lastTransactionID, id - PENDING_WINDOW) + 1; gap < id; ++gap) {
+            source.pending.insert(gap);
+        }
+        source.lastTransactionID = id;
+        if (source.pending.size() > static_cast<std::size_t>(2 * PENDING_WINDOW)) {
+            std::erase_if(source.pending, [id](long long gap) { return gap <= id - PENDING_WINDOW; });
+        }
+    } else {
+        source.pending.erase(id);
+    }
+}
+
+void TransferFeed::run(std::size_t index) {
+    const Source& source = *sources[index];
+    bool failing = false;
+
+    while (running) {
+        try {
+            auto conn = source.connectionString.empty()
+                            ? DBConnection::getInstance().openDedicatedConnection()
+                            : std::make_unique<pqxx::connection>(source.connectionString);
+
+            if (failing) {
+                std::cout << "[TransferFeed] Reading again from " << source.name << "\n";
+                failing = false;
+            }
+
+            /* one query per pollInterval per database, however many subscribe */
+            while (running) {
+                readCommitted(*conn, index);
+
+                std::unique_lock<std::mutex> guard(readerMutex);
+                stopRequested.wait_for(guard, settings.pollInterval, [this]() { return !running; });
+            }
+        }
+        catch (const std::exception& e) {
+            /* logged once per outage, retried every RECONNECT_DELAY */
+            if (!failing) {
+                std::cout << "[TransferFeed] Reading from " << source.name << " failed, retrying: "
+                          << e.what() << "\n";
+                failing = true;
+            }
+            Metrics::getInstance().increment("feed.read_failures");
+
+            std::unique_lock<std::mutex> guard(readerMutex);
+            stopRequested.wait_for(guard, RECONNECT_DELAY, [this]() { return !running; });
+        }
+    }
+
+    std::cout << "[TransferFeed] Reader of " << source.name << " stopped\n";
+}
+
+void TransferFeed::position(pqxx::connection& conn, std::size_t index) {
+    /* one snapshot, so the gaps are those below the newest id it saw */
+    pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> tx(conn);
+    auto newest = tx.query_value<long long>("SELECT COALESCE(MAX(transaction_id), 0) FROM transactions");
+    auto gaps = tx.exec(
+        "SELECT g FROM generate_series(GREATEST($1::bigint - $2, 0) + 1, $1::bigint) g "
+        "WHERE NOT EXISTS (SELECT 1 FROM transactions t WHERE t.transaction_id = g)",
+        pqxx::params{newest, PENDING_WINDOW});
+    tx.commit();
+
+    std::lock_guard<std::mutex> guard(mutex);
+    Source& source = *sources[index];
+    for (const auto& row : gaps) {
+        long long gap = row[0].as<long long>();
+        if (gap > source.lastTransactionID) {
+            source.pending.insert(gap);
+        }
+    }
+    source.lastTransactionID = std::max(source.lastTransactionID, newest);
+    source.positioned = true;
+}
+
+void TransferFeed::readCommitted(pqxx::connection& conn, std::size_t index) {
+    /* the stream starts with the first read, the history is the table's */
+    if (!sources[index]->positioned) {
+        position(conn, index);
+        return;
+    }
+
+    long long after = 0;
+    std::size_t rows = 0;
+
+    /* every page also asks for the skipped ids, the ones the previous
+     * pages left behind included, until a short page ends the backlog */
+    do {
+        std::string pending;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            Source& source = *sources[index];
+            after = std::max(after, source.lastTransactionID);
+            std::erase_if(source.pending, [after](long long gap) { return gap <= after - PENDING_WINDOW; });
+            pending = toArrayLiteral(source.pending);
+        }
+
+        pqxx::read_transaction tx(conn);
+        auto page = tx.exec(READ_QUERY, pqxx::params{after, pending, READ_PAGE});
+        tx.commit();
+
+        rows = page.size();
+        for (const auto& row : page) {
+            long long id = row[0].as<long long>();
+            after = std::max(after, id);
+
+            if (!row[4].as<bool>()) {
+                /* committed, but no transfer to publish */
+                std::lock_guard<std::mutex> guard(mutex);
+                track(*sources[index], id);
+                continue;
+            }
+
+            TransferEvent event;
+            event.transactionID = id;
+            event.fromAccountID = row[1].as<int>();
+            event.toAccountID = row[2].as<int>();
+            event.cents = parseCents(row[3].view());
+            event.source = index;
+            publishEvent(event);
+        }
+    } while (rows == static_cast<std::size_t>(READ_PAGE) && running);
+}
@@ -123,3 +123,21 @@ TEST_F(AccountServiceTest, PrintAccount_ThrowsForNonExistingAccount) {
         std::runtime_error
     );
 }
+
+
+/**
+ * @brief getBalances() must answer every id in order and match getBalance()
+ *
+ * Missing accounts come back as std::nullopt instead of throwing
+ */
+TEST_F(AccountServiceTest, GetBalances_MatchesGetBalanceAndKeepsOrder) {
+    auto balances = service.getBalances({EXISTING_ACCOUNT_ID, NON_EXISTING_ACCOUNT_ID, EXISTING_ACCOUNT_ID});
+
+    ASSERT_EQ(balances.size(), 3u);
+    ASSERT_TRUE(balances[0].has_value());
+    EXPECT_FALSE(balances[1].has_value());
+    ASSERT_TRUE(balances[2].has_value());
+
+    EXPECT_DOUBLE_EQ(*balances[0], service.getBalance(EXISTING_ACCOUNT_ID));
+    EXPECT_DOUBLE_EQ(*balances[0], *balances[2]);
+}
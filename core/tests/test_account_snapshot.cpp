@@ -0,0 +1,149 @@
+/* Unit tests for the account snapshot format and the in-process AccountTable
+ * These tests do not need the database, they only use a temporary file */
+#include <gtest/gtest.h>
+#include "account_snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+    /**
+     * @brief Builds a record with the given id and balance in cents
+     */
+    AccountRecord makeRecord(std::int32_t id, std::int64_t cents) {
+        AccountRecord rec{};
+        rec.accountID = id;
+        rec.customerID = id * 10;
+        rec.balanceCents = cents;
+        std::memcpy(rec.currency, "USD", 3);
+        rec.accountType = AccountType::Checking;
+        return rec;
+    }
+}
+
+/**
+ * @class AccountSnapshotTest
+ *
+ * @brief GoogleTest tool that gives each test its own snapshot path and
+ * removes it afterwards
+ */
+class AccountSnapshotTest : public ::testing::Test {
+    protected:
+        void TearDown() override {
+            std::remove(path.c_str());
+            std::remove((path + ".tmp").c_str());
+        }
+
+        std::string path = "build/test_accounts.snap";
+};
+
+/**
+ * @test NUMERIC text must convert to cents without going thru double
+ */
+TEST(AccountTableTest, ParseCentsHandlesNumericText) {
+    EXPECT_EQ(parseCents("1500.00"), 150000);
+    EXPECT_EQ(parseCents("4200.25"), 420025);
+    EXPECT_EQ(parseCents("-12.5"), -1250);
+    EXPECT_EQ(parseCents("7"), 700);
+    EXPECT_EQ(formatCents(420025), "4200.25");
+    EXPECT_EQ(formatCents(-5), "-0.05");
+    EXPECT_THROW(parseCents("abc"), std::invalid_argument);
+}
+
+/**
+ * @test Replaying a transfer moves money once, a second apply is ignored
+ */
+TEST(AccountTableTest, ApplyTransactionIsIdempotent) {
+    AccountTable table;
+    table.reset({makeRecord(1, 10000), makeRecord(2, 0)}, 5);
+
+    EXPECT_TRUE(table.applyTransaction(6, 1, 2, 2500));
+    EXPECT_FALSE(table.applyTransaction(6, 1, 2, 2500));
+
+    EXPECT_EQ(table.find(1)->balanceCents, 7500);
+    EXPECT_EQ(table.find(2)->balanceCents, 2500);
+    EXPECT_EQ(table.lastTransactionID(), 6);
+}
+
+/**
+ * @test Pending ids below the watermark are still applied exactly once
+ */
+TEST(AccountTableTest, PendingTransactionBelowWatermarkIsApplied) {
+    AccountTable table;
+    table.reset({makeRecord(1, 10000), makeRecord(2, 0)}, 10, {8});
+
+    EXPECT_TRUE(table.applyTransaction(8, 1, 2, 100));
+    EXPECT_FALSE(table.applyTransaction(8, 1, 2, 100));
+    EXPECT_FALSE(table.applyTransaction(9, 1, 2, 100));
+
+    EXPECT_EQ(table.find(2)->balanceCents, 100);
+}
+
+/**
+ * @test Accounts created after the load are added once and take later transfers
+ */
+TEST(AccountTableTest, AddAccountsKeepsKnownOnesAndTakesLaterTransfers) {
+    AccountTable table;
+    table.reset({makeRecord(1, 10000), makeRecord(2, 0)}, 5);
+    EXPECT_EQ(table.highestAccountID(), 2);
+
+    EXPECT_EQ(table.addAccounts({makeRecord(2, 999), makeRecord(7, 500)}), 1u);
+    EXPECT_EQ(table.size(), 3u);
+    EXPECT_EQ(table.highestAccountID(), 7);
+    EXPECT_EQ(table.find(2)->balanceCents, 0);
+
+    EXPECT_TRUE(table.applyTransaction(6, 1, 7, 250));
+    EXPECT_EQ(table.find(7)->balanceCents, 750);
+}
+
+/**
+ * @test A written snapshot loads back with the same records and watermark
+ */
+TEST_F(AccountSnapshotTest, RoundTripKeepsRecordsAndWatermark) {
+    std::vector<AccountRecord> records;
+    for (int i = 1; i <= 1000; ++i) {
+        records.push_back(makeRecord(i, i * 100));
+    }
+
+    ASSERT_NO_THROW(AccountSnapshot::write(path, records, 42, {40, 41}));
+
+    AccountTable table;
+    ASSERT_TRUE(AccountSnapshot::load(path, table));
+
+    EXPECT_EQ(table.size(), 1000u);
+    EXPECT_EQ(table.lastTransactionID(), 42);
+    EXPECT_EQ(table.find(500)->balanceCents, 50000);
+    EXPECT_EQ(std::string(table.find(500)->currency), "USD");
+
+    /* pending id 41 is below the watermark but must still apply */
+    EXPECT_TRUE(table.applyTransaction(41, 1, 2, 1));
+}
+
+/**
+ * @test A flipped byte inside a section must be detected by its checksum
+ */
+TEST_F(AccountSnapshotTest, CorruptedSectionIsRejected) {
+    std::vector<AccountRecord> records = {makeRecord(1, 100), makeRecord(2, 200)};
+    ASSERT_NO_THROW(AccountSnapshot::write(path, records, 1, {}));
+
+    /* First payload starts at the first 64 byte boundary after the section table */
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(128 + 8);
+    file.put('\x7f');
+    file.close();
+
+    AccountTable table;
+    EXPECT_FALSE(AccountSnapshot::load(path, table));
+    EXPECT_EQ(table.size(), 0u);
+}
+
+/**
+ * @test Loading a missing file returns false instead of throwing
+ */
+TEST_F(AccountSnapshotTest, MissingFileReturnsFalse) {
+    AccountTable table;
+    EXPECT_FALSE(AccountSnapshot::load("build/does_not_exist.snap", table));
+}
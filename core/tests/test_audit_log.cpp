@@ -0,0 +1,167 @@
+/* Unit tests for BoundedQueue and the AuditLog overflow policies
+ * No DB needed: the writer is kept asleep, or its writes fail */
+
+#include <gtest/gtest.h>
+#include "audit_log.hpp"
+#include "bounded_queue.hpp"
+#include "database_connection.hpp"
+#include "metrics.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    /** @brief Settings whose writer does not wake up during a test */
+    AuditSettings quietSettings(AuditOverflow overflow) {
+        AuditSettings settings;
+        settings.queueCapacity = 4;
+        settings.flushInterval = std::chrono::hours(1);
+        settings.overflow = overflow;
+        settings.spillPath = "build/test_audit_spill.log";
+        return settings;
+    }
+
+    std::size_t countLines(const std::string& path) {
+        std::ifstream file(path);
+        std::size_t lines = 0;
+        for (std::string line; std::getline(file, line);) {
+            ++lines;
+        }
+        return lines;
+    }
+}
+
+TEST(BoundedQueueTest, Fifo_AndFullIsReported) {
+    BoundedQueue<std::string> queue(3);
+    EXPECT_EQ(queue.capacity(), 4u);
+
+    for (int i = 0; i < 4; ++i) {
+        std::string value = "event" + std::to_string(i);
+        EXPECT_TRUE(queue.tryPush(value));
+    }
+    std::string extra = "extra";
+    EXPECT_FALSE(queue.tryPush(extra));
+    EXPECT_EQ(extra, "extra");
+    EXPECT_EQ(queue.sizeApprox(), 4u);
+
+    std::string value;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(queue.tryPop(value));
+        EXPECT_EQ(value, "event" + std::to_string(i));
+    }
+    EXPECT_FALSE(queue.tryPop(value));
+}
+
+TEST(BoundedQueueTest, ManyProducers_LoseNothing) {
+    BoundedQueue<long> queue(64);
+    constexpr int PRODUCERS = 4;
+    constexpr long PER_PRODUCER = 5000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&queue, p]() {
+            for (long i = 1; i <= PER_PRODUCER; ++i) {
+                long value = p * PER_PRODUCER + i;
+                while (!queue.tryPush(value)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    long sum = 0;
+    long popped = 0;
+    long value;
+    while (popped < PRODUCERS * PER_PRODUCER) {
+        if (queue.tryPop(value)) {
+            sum += value;
+            ++popped;
+        }
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    long total = PRODUCERS * PER_PRODUCER;
+    EXPECT_EQ(sum, total * (total + 1) / 2);
+}
+
+TEST(AuditLogTest, CopyLine_EscapesAndSkipsUnsetFields) {
+    AuditEvent event = AuditEvent::transfer(1, 2, 10.5, "failed", "Insufficient\tfunds\non 1");
+    event.time = std::chrono::system_clock::time_point(std::chrono::microseconds(1700000000123456LL));
+
+    EXPECT_EQ(auditCopyLine(event),
+              "2023-11-14 22:13:20.123456\ttransfer\t"
+              "outcome=failed from=1 to=2 amount=10.5 detail=Insufficient\\tfunds\\non 1");
+
+    AuditEvent reload = AuditEvent::reload("ok");
+    reload.time = event.time;
+    EXPECT_EQ(auditCopyLine(reload), "2023-11-14 22:13:20.123456\treload\toutcome=ok");
+}
+
+TEST(AuditLogTest, Drop_CountsWhatDoesNotFit) {
+    auto& audit = AuditLog::getInstance();
+    auto& dropped = Metrics::getInstance().get("audit.events_dropped");
+
+    audit.start(quietSettings(AuditOverflow::Drop));
+    std::int64_t before = dropped.load();
+    for (int i = 0; i < 10; ++i) {
+        audit.record(AuditEvent::transfer(1, 2, i + 1, "ok", ""));
+    }
+
+    EXPECT_EQ(audit.queued(), 4u);
+    EXPECT_EQ(dropped.load() - before, 6);
+    audit.stop();
+    EXPECT_EQ(audit.queued(), 0u);
+}
+
+TEST(AuditLogTest, Spill_WritesTheOverflowToAFile) {
+    auto& audit = AuditLog::getInstance();
+    const auto settings = quietSettings(AuditOverflow::Spill);
+    std::remove(settings.spillPath.c_str());
+
+    audit.start(settings);
+    for (int i = 0; i < 7; ++i) {
+        audit.record(AuditEvent::transfer(1, 2, i + 1, "ok", "Spill test"));
+    }
+
+    EXPECT_EQ(audit.queued(), 4u);
+    audit.stop();
+
+    /* at stop the writer copies the file to audit_logs, or keeps every event in it */
+    std::size_t left = countLines(settings.spillPath) + countLines(settings.spillPath + ".replay");
+    EXPECT_TRUE(left == 0 || left == 7) << left << " events left in the spill files";
+
+    std::remove(settings.spillPath.c_str());
+    std::remove((settings.spillPath + ".replay").c_str());
+}
+
+TEST(AuditLogTest, Block_WaitsForRoom) {
+    if (DBConnection::getInstance().isConnected()) {
+        GTEST_SKIP() << "needs audit_logs to be unreachable, the writer would make room";
+    }
+
+    auto& audit = AuditLog::getInstance();
+    audit.start(quietSettings(AuditOverflow::Block));
+
+    /* the first full queue is moved into the writer's (failing) batch, the second one stays */
+    std::atomic<int> recorded{0};
+    std::thread producer([&]() {
+        for (int i = 0; i < 9; ++i) {
+            audit.record(AuditEvent::transfer(1, 2, i + 1, "ok", ""));
+            ++recorded;
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_EQ(recorded.load(), 8);
+
+    /* stop() releases the blocked producer */
+    audit.stop();
+    producer.join();
+    EXPECT_EQ(recorded.load(), 9);
+}
@@ -0,0 +1,80 @@
+/* Unit tests for CircuitBreaker, no DB needed */
+
+#include <gtest/gtest.h>
+#include "circuit_breaker.hpp"
+#include "metrics.hpp"
+
+#include <thread>
+
+namespace {
+    BreakerSettings fastSettings() {
+        BreakerSettings settings;
+        settings.failureThreshold = 2;
+        settings.initialBackoff = std::chrono::milliseconds(20);
+        settings.maxBackoff = std::chrono::milliseconds(40);
+        return settings;
+    }
+}
+
+TEST(CircuitBreakerTest, OpensAfterThreshold_AndFailsFast) {
+    CircuitBreaker breaker("test_open", fastSettings());
+
+    ASSERT_TRUE(breaker.allowAttempt());
+    breaker.recordFailure();
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::Closed);
+
+    /* under the threshold the next attempt goes through right away */
+    ASSERT_TRUE(breaker.allowAttempt());
+    breaker.recordFailure();
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::Open);
+
+    EXPECT_FALSE(breaker.allowAttempt());
+    EXPECT_GT(breaker.retryIn().count(), 0);
+
+    auto metrics = Metrics::getInstance().snapshot();
+    EXPECT_EQ(metrics["test_open.circuit.open"], 1);
+    EXPECT_EQ(metrics["test_open.circuit.rejected"], 1);
+    EXPECT_EQ(metrics["test_open.circuit.state"], 1);
+}
+
+TEST(CircuitBreakerTest, HalfOpen_LetsOneProbeThrough) {
+    CircuitBreaker breaker("test_probe", fastSettings());
+    breaker.recordFailure();
+    breaker.recordFailure();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+    EXPECT_TRUE(breaker.allowAttempt());
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::HalfOpen);
+    EXPECT_FALSE(breaker.allowAttempt());
+
+    breaker.recordSuccess();
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::Closed);
+    EXPECT_TRUE(breaker.allowAttempt());
+
+    auto metrics = Metrics::getInstance().snapshot();
+    EXPECT_EQ(metrics["test_probe.circuit.half_open"], 1);
+    EXPECT_EQ(metrics["test_probe.circuit.closed"], 1);
+    EXPECT_EQ(metrics["test_probe.circuit.state"], 0);
+}
+
+TEST(CircuitBreakerTest, FailedProbe_DoublesBackoffUpToMax) {
+    CircuitBreaker breaker("test_backoff", fastSettings());
+    breaker.recordFailure();
+    breaker.recordFailure();
+    EXPECT_LE(breaker.retryIn().count(), 20);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    ASSERT_TRUE(breaker.allowAttempt());
+    breaker.recordFailure();
+
+    EXPECT_EQ(breaker.state(), CircuitBreaker::State::Open);
+    EXPECT_GT(breaker.retryIn().count(), 20);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_TRUE(breaker.allowAttempt());
+    breaker.recordFailure();
+
+    /* capped by maxBackoff */
+    EXPECT_LE(breaker.retryIn().count(), 40);
+}
@@ -0,0 +1,125 @@
+/* Unit tests for TimerWheel and ConnectionTracker, no DB needed */
+
+#include <gtest/gtest.h>
+#include "connection_tracker.hpp"
+
+#include <vector>
+
+namespace {
+    using Clock = TimerWheel::Clock;
+    using std::chrono::milliseconds;
+}
+
+TEST(TimerWheelTest, FiresDueTimers_InTheirTick) {
+    auto start = Clock::now();
+    TimerWheel wheel(milliseconds(10), 8, start);
+
+    std::vector<int> fired;
+    wheel.schedule(start + milliseconds(25), [&fired]() { fired.push_back(1); });
+    wheel.schedule(start + milliseconds(50), [&fired]() { fired.push_back(2); });
+
+    EXPECT_EQ(wheel.advance(start + milliseconds(20)), 0u);
+    EXPECT_EQ(wheel.advance(start + milliseconds(30)), 1u);
+    EXPECT_EQ(wheel.advance(start + milliseconds(60)), 1u);
+    EXPECT_EQ(fired, (std::vector<int>{1, 2}));
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheelTest, TimerBeyondOneRevolution_WaitsForItsRound) {
+    auto start = Clock::now();
+    TimerWheel wheel(milliseconds(10), 4, start);
+
+    /* 4 slots of 10 ms: 100 ms is two and a half revolutions away */
+    bool fired = false;
+    wheel.schedule(start + milliseconds(100), [&fired]() { fired = true; });
+
+    for (int ms = 10; ms < 100; ms += 10) {
+        wheel.advance(start + milliseconds(ms));
+    }
+    EXPECT_FALSE(fired);
+
+    wheel.advance(start + milliseconds(100));
+    EXPECT_TRUE(fired);
+}
+
+TEST(TimerWheelTest, Cancelled_NeverFires) {
+    auto start = Clock::now();
+    TimerWheel wheel(milliseconds(10), 8, start);
+
+    bool fired = false;
+    auto id = wheel.schedule(start + milliseconds(10), [&fired]() { fired = true; });
+    EXPECT_TRUE(wheel.cancel(id));
+    EXPECT_FALSE(wheel.cancel(id));
+
+    /* a long jump looks at every slot once */
+    wheel.advance(start + milliseconds(1000));
+    EXPECT_FALSE(fired);
+}
+
+TEST(ConnectionTrackerTest, IdleAndReadTimeouts_CloseTheConnection) {
+    ConnectionLimits limits;
+    limits.idleTimeout = milliseconds(500);
+    limits.readTimeout = milliseconds(200);
+    ConnectionTracker tracker(limits);
+
+    std::vector<ConnectionTracker::ConnectionID> closed;
+    auto close = [&closed](ConnectionTracker::ConnectionID id) { closed.push_back(id); };
+
+    auto quiet = tracker.open(close);
+    auto slow = tracker.open(close);
+    auto working = tracker.open(close);
+    tracker.reading(slow);
+    tracker.busy(working);
+
+    auto now = Clock::now();
+    tracker.expire(now + milliseconds(400));
+    EXPECT_EQ(closed, (std::vector<ConnectionTracker::ConnectionID>{slow}));
+
+    tracker.expire(now + milliseconds(800));
+    EXPECT_EQ(closed, (std::vector<ConnectionTracker::ConnectionID>{slow, quiet}));
+
+    /* shut connections stop counting, the busy one stays */
+    EXPECT_EQ(tracker.active(), 1u);
+    tracker.close(slow);
+    tracker.close(quiet);
+    tracker.close(working);
+    EXPECT_EQ(tracker.active(), 0u);
+}
+
+TEST(ConnectionTrackerTest, AtTheCap_EvictsTheOldestIdle) {
+    ConnectionLimits limits;
+    limits.maxConnections = 2;
+    limits.evictIdleAfter = milliseconds(0);
+    ConnectionTracker tracker(limits);
+
+    std::vector<ConnectionTracker::ConnectionID> closed;
+    auto close = [&closed](ConnectionTracker::ConnectionID id) { closed.push_back(id); };
+
+    auto first = tracker.open(close);
+    auto second = tracker.open(close);
+    tracker.busy(first);
+    tracker.idle(first);
+
+    /* second has been idle the longest now */
+    auto third = tracker.open(close);
+    EXPECT_NE(third, 0u);
+    EXPECT_EQ(closed, (std::vector<ConnectionTracker::ConnectionID>{second}));
+    EXPECT_EQ(tracker.active(), 2u);
+}
+
+TEST(ConnectionTrackerTest, AtTheCap_RefusesWhenNobodyIsIdle) {
+    ConnectionLimits limits;
+    limits.maxConnections = 1;
+    ConnectionTracker tracker(limits);
+
+    auto first = tracker.open([](ConnectionTracker::ConnectionID) {});
+    tracker.busy(first);
+    EXPECT_EQ(tracker.open([](ConnectionTracker::ConnectionID) {}), 0u);
+
+    /* idle, but not for evictIdleAfter yet */
+    tracker.idle(first);
+    EXPECT_EQ(tracker.open([](ConnectionTracker::ConnectionID) {}), 0u);
+
+    tracker.close(first);
+    EXPECT_NE(tracker.open([](ConnectionTracker::ConnectionID) {}), 0u);
+}
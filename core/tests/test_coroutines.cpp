@@ -0,0 +1,100 @@
+/* Unit tests for the coroutine runtime of the epoll backend (Task, AsyncSocket)
+ * These tests do not need the database, they use a local socket pair */
+#include <gtest/gtest.h>
+#include "event_loop.hpp"
+#include "async_socket.hpp"
+#include "task.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+    Task<int> answer() {
+        co_return 42;
+    }
+
+    Task<int> addOne() {
+        int value = co_await answer();
+        co_return value + 1;
+    }
+
+    Task<int> fails() {
+        throw std::runtime_error("boom");
+        co_return 0;
+    }
+}
+
+/**
+ * @test Awaited tasks return their value to the awaiting coroutine
+ */
+TEST(CoroutineTest, Task_ReturnsValueThroughChain) {
+    int result = 0;
+
+    spawn([](int& out) -> Task<void> {
+        out = co_await addOne();
+    }(result));
+
+    EXPECT_EQ(result, 43);
+}
+
+/**
+ * @test An exception thrown inside a task is rethrown where it is awaited
+ */
+TEST(CoroutineTest, Task_PropagatesExceptions) {
+    std::string caught;
+
+    spawn([](std::string& out) -> Task<void> {
+        try {
+            co_await fails();
+        } catch (const std::exception& e) {
+            out = e.what();
+        }
+    }(caught));
+
+    EXPECT_EQ(caught, "boom");
+}
+
+/**
+ * @test read() suspends until the peer writes, write() sends everything,
+ * and the end of the stream resumes a suspended reader with 0
+ */
+TEST(CoroutineTest, AsyncSocket_ReadSuspendsUntilDataArrives) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+    EventLoop loop;
+    std::string received;
+    ssize_t lastRead = -1;
+
+    /* echo server: reads one chunk, answers it, then waits for the close */
+    spawn([](EventLoop& loop, int fd, std::string& received, ssize_t& lastRead) -> Task<void> {
+        AsyncSocket socket(loop, fd);
+        char buffer[64];
+
+        ssize_t n = co_await socket.read(buffer, sizeof(buffer));
+        received.assign(buffer, n > 0 ? n : 0);
+        co_await socket.write("echo " + received);
+
+        lastRead = co_await socket.read(buffer, sizeof(buffer));
+        loop.stop();
+    }(loop, fds[0], received, lastRead));
+
+    /* still suspended: nothing was written yet */
+    EXPECT_TRUE(received.empty());
+
+    ASSERT_EQ(::write(fds[1], "hello", 5), 5);
+    loop.post([fd = fds[1]]() { ::shutdown(fd, SHUT_WR); });
+    loop.run();
+
+    EXPECT_EQ(received, "hello");
+    EXPECT_EQ(lastRead, 0);
+
+    char reply[64] = {};
+    EXPECT_EQ(::read(fds[1], reply, sizeof(reply) - 1), 10);
+    EXPECT_EQ(std::string(reply), "echo hello");
+
+    ::close(fds[1]);
+}
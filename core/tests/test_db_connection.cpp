@@ -6,6 +6,7 @@ Google Test framework. Include tests like
     - Test a simple query like we did on demo */
 #include <gtest/gtest.h>
 #include "database_connection.hpp"
+#include "metrics.hpp"
 
 /**
  * @class DBConnectionTest
@@ -125,4 +126,85 @@ TEST_F(DBConnectionTest, CanFetchSpecificCustomerById) {
 
     EXPECT_FALSE(name.empty());
     EXPECT_FALSE(email.empty());
-}
\ No newline at end of file
+}
+/**
+ * @brief Reloading an unchanged config keeps the primary connection
+ */
+TEST_F(DBConnectionTest, ReloadSameConfig_KeepsConnection) {
+    auto& db = DBConnection::getInstance();
+    const std::string before = db.getConnectionString();
+
+    EXPECT_FALSE(db.reload("config/db_credential.json"));
+    EXPECT_TRUE(db.isConnected());
+    EXPECT_EQ(db.getConnectionString(), before);
+}
+
+/**
+ * @brief A reload that cannot parse its file changes nothing
+ */
+TEST_F(DBConnectionTest, ReloadInvalidPath_KeepsConnection) {
+    auto& db = DBConnection::getInstance();
+    const std::string before = db.getConnectionString();
+
+    EXPECT_THROW(db.reload("config/non_existing.json"), std::runtime_error);
+    EXPECT_TRUE(db.isConnected());
+    EXPECT_EQ(db.getConnectionString(), before);
+
+    auto tx = db.createReadTransaction();
+    EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+    tx->commit();
+}
+
+/**
+ * @brief A connection killed by the server is reopened by the next request
+ */
+TEST_F(DBConnectionTest, TerminatedConnection_IsReopened) {
+    auto& db = DBConnection::getInstance();
+
+    {
+        auto guard = db.lock();
+        auto tx = db.createAutocommitTransaction();
+        EXPECT_THROW(tx->exec("SELECT pg_terminate_backend(pg_backend_pid())"), pqxx::broken_connection);
+    }
+    EXPECT_FALSE(db.isConnected());
+
+    auto reconnectsBefore = Metrics::getInstance().get("db.reconnects").load();
+
+    auto guard = db.lock();
+    auto tx = db.createReadTransaction();
+    EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+    tx->commit();
+
+    EXPECT_TRUE(db.isConnected());
+    EXPECT_EQ(db.circuitState(), CircuitBreaker::State::Closed);
+    EXPECT_EQ(Metrics::getInstance().get("db.reconnects").load(), reconnectsBefore + 1);
+}
+
+/**
+ * @brief An idle connection killed by the server is reopened before the
+ * next statement, which does not see the failure
+ */
+TEST_F(DBConnectionTest, TerminatedIdleConnection_IsReopenedTransparently) {
+    auto& db = DBConnection::getInstance();
+
+    int backend;
+    {
+        auto guard = db.lock();
+        backend = db.getConnection().backendpid();
+    }
+
+    /* killed from another session, the shared one is idle meanwhile */
+    auto killer = db.openDedicatedConnection();
+    pqxx::nontransaction kill(*killer);
+    kill.exec("SELECT pg_terminate_backend($1)", pqxx::params{backend});
+
+    auto reconnectsBefore = Metrics::getInstance().get("db.reconnects").load();
+
+    auto guard = db.lock();
+    auto tx = db.createReadTransaction();
+    EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+    tx->commit();
+
+    EXPECT_NE(db.getConnection().backendpid(), backend);
+    EXPECT_EQ(Metrics::getInstance().get("db.reconnects").load(), reconnectsBefore + 1);
+}
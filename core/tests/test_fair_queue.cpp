@@ -0,0 +1,123 @@
+/* Unit tests for FairQueue, no DB needed */
+
+#include <gtest/gtest.h>
+#include "fair_queue.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(FairQueueTest, Uncontended_EntersRightAway) {
+    FairQueue queue;
+    queue.enter(RequestClass::Bulk);
+    queue.leave();
+    queue.enter(RequestClass::Interactive);
+    queue.leave();
+}
+
+TEST(FairQueueTest, InteractiveGoesAheadOfQueuedBulk) {
+    FairQueue queue;
+    queue.setWeights(4, 1);
+
+    std::mutex orderMutex;
+    std::string order;
+
+    /* hold the turn while the others queue up */
+    queue.enter(RequestClass::Interactive);
+
+    std::vector<std::thread> threads;
+    auto spawn = [&](RequestClass requestClass, char tag) {
+        threads.emplace_back([&, requestClass, tag]() {
+            queue.enter(requestClass);
+            {
+                std::lock_guard<std::mutex> guard(orderMutex);
+                order += tag;
+            }
+            queue.leave();
+        });
+        /* arrival order is part of the test */
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    };
+
+    spawn(RequestClass::Bulk, 'B');
+    spawn(RequestClass::Bulk, 'B');
+    spawn(RequestClass::Interactive, 'I');
+    spawn(RequestClass::Interactive, 'I');
+
+    queue.leave();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    /* the first bulk request started at the current virtual time, the
+     * interactive ones then fit before the second bulk one */
+    EXPECT_EQ(order, "BIIB");
+}
+
+TEST(FairQueueTest, RequestClassScope_RestoresPreviousClass) {
+    EXPECT_EQ(RequestClassScope::current(), RequestClass::Interactive);
+    {
+        RequestClassScope bulk(RequestClass::Bulk);
+        EXPECT_EQ(RequestClassScope::current(), RequestClass::Bulk);
+    }
+    EXPECT_EQ(RequestClassScope::current(), RequestClass::Interactive);
+}
+
+TEST(FairQueueTest, Deadline_GivesUpWithoutTheTurn) {
+    FairQueue queue;
+    queue.enter(RequestClass::Bulk);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(30);
+    EXPECT_FALSE(queue.enter(RequestClass::Interactive, deadline));
+
+    /* the expired waiter left the queue, the turn goes to the next one */
+    queue.leave();
+    EXPECT_TRUE(queue.enter(RequestClass::Interactive, std::chrono::steady_clock::now()
+                                                       + std::chrono::milliseconds(30)));
+    queue.leave();
+}
+
+TEST(FairQueueTest, Close_SendsWaitersAwayUntilReopened) {
+    FairQueue queue;
+    queue.enter(RequestClass::Bulk);
+
+    bool entered = true;
+    std::thread waiter([&]() { entered = queue.enter(RequestClass::Interactive); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    queue.close();
+    waiter.join();
+    EXPECT_FALSE(entered);
+    EXPECT_TRUE(queue.isClosed());
+
+    /* the holder keeps its turn, nobody new gets one */
+    EXPECT_FALSE(queue.enter(RequestClass::Interactive));
+    queue.leave();
+
+    queue.reopen();
+    EXPECT_TRUE(queue.enter(RequestClass::Interactive));
+    queue.leave();
+}
+
+TEST(FairQueueTest, DismissWaiters_OnlySendsCurrentWaitersAway) {
+    FairQueue queue;
+    queue.enter(RequestClass::Bulk);
+
+    bool entered = true;
+    std::thread waiter([&]() { entered = queue.enter(RequestClass::Interactive); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    queue.dismissWaiters();
+    waiter.join();
+    EXPECT_FALSE(entered);
+    EXPECT_FALSE(queue.isClosed());
+
+    /* a later arrival waits for the turn as usual */
+    std::thread later([&]() { entered = queue.enter(RequestClass::Interactive); queue.leave(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.leave();
+    later.join();
+    EXPECT_TRUE(entered);
+}
@@ -0,0 +1,122 @@
+/* Integration tests for NettingService, they assume:
+ *
+ *  - DB is running and json credential is valid
+ *  - accounts 1 and 2 exist, share a currency and hold at least 10.00 each
+ *  - internal_accounts table and applyTransferBalances() exist in db
+ *
+ * Accounts 1 and 2 are flagged internal for the length of each test */
+
+#include <gtest/gtest.h>
+#include "netting_service.hpp"
+#include "account_service.hpp"
+#include "database_connection.hpp"
+#include "request_deadline.hpp"
+
+#include <thread>
+
+namespace {
+    const int ACCOUNT_A = 1;
+    const int ACCOUNT_B = 2;
+
+    void execWrite(const std::string& query) {
+        auto& db = DBConnection::getInstance();
+        auto guard = db.lock();
+        auto tx = db.createWriteTransaction();
+        tx->exec(query);
+        tx->commit();
+    }
+
+    long countNetted(const std::string& description) {
+        auto& db = DBConnection::getInstance();
+        auto guard = db.lock();
+        auto tx = db.createReadTransaction();
+        return tx->query_value<long>(
+            "SELECT COUNT(*) FROM transactions WHERE status = 'netted' AND description = "
+            + tx->quote(description));
+    }
+}
+
+class NettingServiceTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            auto& db = DBConnection::getInstance();
+
+            if (!db.isConnected()) {
+                db.loadConfig("config/db_credential.json");
+                db.connect();
+            }
+
+            execWrite("INSERT INTO internal_accounts (account_id) VALUES (1), (2) ON CONFLICT DO NOTHING");
+
+            /* a long window: both transfers of a test land in the same flush */
+            NettingService::getInstance().start(std::chrono::milliseconds(200));
+        }
+
+        void TearDown() override {
+            NettingService::getInstance().stop();
+            execWrite("DELETE FROM internal_accounts WHERE account_id IN (1, 2)");
+        }
+
+        AccountService accountService;
+};
+
+TEST_F(NettingServiceTest, OppositeTransfers_AreNettedAndRecorded) {
+    auto& netting = NettingService::getInstance();
+    ASSERT_TRUE(netting.eligible(ACCOUNT_A, ACCOUNT_B));
+
+    double aBefore = accountService.getBalance(ACCOUNT_A);
+    double bBefore = accountService.getBalance(ACCOUNT_B);
+    long recordedBefore = countNetted("Netting test");
+
+    std::thread reverse([&netting]() {
+        EXPECT_NO_THROW(netting.transfer(ACCOUNT_B, ACCOUNT_A, 4.0, "Netting test"));
+    });
+    EXPECT_NO_THROW(netting.transfer(ACCOUNT_A, ACCOUNT_B, 10.0, "Netting test"));
+    reverse.join();
+
+    /* one net move of 6.00, two ledger rows */
+    EXPECT_NEAR(accountService.getBalance(ACCOUNT_A), aBefore - 6.0, 1e-6);
+    EXPECT_NEAR(accountService.getBalance(ACCOUNT_B), bBefore + 6.0, 1e-6);
+    EXPECT_EQ(countNetted("Netting test"), recordedBefore + 2);
+}
+
+TEST_F(NettingServiceTest, NetWithoutFunds_IsRejectedAndNotRecorded) {
+    auto& netting = NettingService::getInstance();
+
+    double aBefore = accountService.getBalance(ACCOUNT_A);
+    double bBefore = accountService.getBalance(ACCOUNT_B);
+    long recordedBefore = countNetted("Netting test - no funds");
+
+    EXPECT_THROW(netting.transfer(ACCOUNT_A, ACCOUNT_B, aBefore + 100.0, "Netting test - no funds"),
+                 std::runtime_error);
+
+    EXPECT_NEAR(accountService.getBalance(ACCOUNT_A), aBefore, 1e-6);
+    EXPECT_NEAR(accountService.getBalance(ACCOUNT_B), bBefore, 1e-6);
+    EXPECT_EQ(countNetted("Netting test - no funds"), recordedBefore);
+}
+
+TEST_F(NettingServiceTest, DeadlineBeforeTheFlush_WithdrawsTheTransfer) {
+    auto& netting = NettingService::getInstance();
+
+    double aBefore = accountService.getBalance(ACCOUNT_A);
+    long recordedBefore = countNetted("Netting test - deadline");
+
+    /* the 200 ms window outlasts the deadline */
+    {
+        RequestDeadline::Scope scope(std::chrono::steady_clock::now() + std::chrono::milliseconds(20));
+        EXPECT_THROW(netting.transfer(ACCOUNT_A, ACCOUNT_B, 1.0, "Netting test - deadline"), DeadlineExceeded);
+    }
+
+    /* the flush of the window skips it */
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_NEAR(accountService.getBalance(ACCOUNT_A), aBefore, 1e-6);
+    EXPECT_EQ(countNetted("Netting test - deadline"), recordedBefore);
+}
+
+TEST_F(NettingServiceTest, Stopped_NothingIsEligible) {
+    auto& netting = NettingService::getInstance();
+    netting.stop();
+
+    EXPECT_FALSE(netting.eligible(ACCOUNT_A, ACCOUNT_B));
+    EXPECT_FALSE(netting.eligible(ACCOUNT_A, ACCOUNT_A));
+}
@@ -0,0 +1,68 @@
+/* Unit tests for the binary result field decoders, no DB needed */
+
+#include <gtest/gtest.h>
+#include "pg_binary.hpp"
+
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    void put16(std::string& out, std::uint16_t value) {
+        out += static_cast<char>(value >> 8);
+        out += static_cast<char>(value & 0xFF);
+    }
+
+    /**
+     * @brief numeric field as the server sends it: ndigits, weight, sign,
+     * dscale, then the base 10000 digits
+     */
+    std::string numeric(std::int16_t weight, std::uint16_t sign, std::initializer_list<std::uint16_t> digits) {
+        std::string field;
+        put16(field, static_cast<std::uint16_t>(digits.size()));
+        put16(field, static_cast<std::uint16_t>(weight));
+        put16(field, sign);
+        put16(field, 2);
+        for (auto digit : digits) {
+            put16(field, digit);
+        }
+        return field;
+    }
+}
+
+TEST(PgBinaryTest, Integers_AreBigEndian) {
+    EXPECT_EQ(decodeInt4(std::string("\x00\x00\x04\xD2", 4)), 1234);
+    EXPECT_EQ(decodeInt4(std::string("\xFF\xFF\xFF\xFE", 4)), -2);
+    EXPECT_EQ(decodeInt8(std::string("\x00\x00\x00\x02\x54\x0B\xE3\xFF", 8)), 9999999999LL);
+    EXPECT_EQ(decodeInt8(std::string(8, '\xFF')), -1);
+
+    EXPECT_THROW(decodeInt4(std::string("\x00\x01", 2)), std::invalid_argument);
+    EXPECT_THROW(decodeInt8(std::string(4, '\0')), std::invalid_argument);
+}
+
+TEST(PgBinaryTest, Numeric_DecodesToCents) {
+    EXPECT_EQ(decodeNumericCents(numeric(0, 0x0000, {1584, 9800})), 158498);
+    EXPECT_EQ(decodeNumericCents(numeric(-1, 0x4000, {500})), -5);
+    EXPECT_EQ(decodeNumericCents(numeric(1, 0x0000, {1})), 1000000);
+    EXPECT_EQ(decodeNumericCents(numeric(2, 0x0000, {12, 3456, 7890, 1200})), 1234567890LL * 100 + 12);
+    EXPECT_EQ(decodeNumericCents(numeric(0, 0x0000, {})), 0);
+}
+
+TEST(PgBinaryTest, Numeric_DropsDigitsPastTheCents) {
+    /* like parseCents("0.001") and parseCents("12.3456") */
+    EXPECT_EQ(decodeNumericCents(numeric(-1, 0x0000, {10})), 0);
+    EXPECT_EQ(decodeNumericCents(numeric(-2, 0x0000, {100})), 0);
+    EXPECT_EQ(decodeNumericCents(numeric(0, 0x0000, {12, 3456})), 1234);
+}
+
+TEST(PgBinaryTest, Numeric_RejectsWhatCentsCannotHold) {
+    EXPECT_THROW(decodeNumericCents(numeric(0, 0xC000, {})), std::invalid_argument);
+    EXPECT_THROW(decodeNumericCents(numeric(0, 0xD000, {})), std::invalid_argument);
+    EXPECT_THROW(decodeNumericCents(numeric(5, 0x0000, {1})), std::out_of_range);
+    EXPECT_THROW(decodeNumericCents(std::string("\x00\x02\x00\x00", 4)), std::invalid_argument);
+
+    std::string truncated = numeric(0, 0x0000, {1584, 9800});
+    truncated.pop_back();
+    EXPECT_THROW(decodeNumericCents(truncated), std::invalid_argument);
+}
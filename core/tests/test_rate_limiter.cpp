@@ -0,0 +1,87 @@
+/* Unit tests for TokenBucket and RateLimiter, no DB needed */
+
+#include <gtest/gtest.h>
+#include "rate_limiter.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    using Clock = TokenBucket::Clock;
+
+    /* a connected socket for RateLimiter::client(), closed by the caller */
+    int connectedSocket(int& other) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return -1;
+        }
+        other = fds[1];
+        return fds[0];
+    }
+}
+
+TEST(TokenBucketTest, TakesUpToBurst_ThenRefills) {
+    auto now = Clock::now();
+    TokenBucket bucket(RateLimit{10, 5}, now);
+
+    EXPECT_EQ(bucket.take(8, now), 5u);
+    EXPECT_EQ(bucket.take(1, now), 0u);
+    EXPECT_EQ(bucket.waitTime(now).count(), 100);
+
+    /* 10 per second: one token every 100 ms */
+    now += std::chrono::milliseconds(250);
+    EXPECT_EQ(bucket.take(8, now), 2u);
+    EXPECT_EQ(bucket.waitTime(now).count(), 50);
+
+    now += std::chrono::seconds(10);
+    EXPECT_TRUE(bucket.full(now));
+}
+
+TEST(TokenBucketTest, Disabled_AdmitsEverything) {
+    auto now = Clock::now();
+    TokenBucket bucket(RateLimit{}, now);
+
+    EXPECT_EQ(bucket.take(1000000, now), 1000000u);
+    EXPECT_EQ(bucket.waitTime(now).count(), 0);
+}
+
+TEST(RateLimiterTest, ConnectionLimit_AdmitsInOrderWithRetryHint) {
+    RateLimiter limiter(RateLimit{1, 3}, RateLimit{});
+
+    int other = -1;
+    int socket = connectedSocket(other);
+    ASSERT_GE(socket, 0);
+    auto client = limiter.client(socket);
+
+    auto admission = limiter.admit(client, 5);
+    EXPECT_EQ(admission.admitted, 3u);
+    EXPECT_GT(admission.retryAfter.count(), 0);
+    EXPECT_LE(admission.retryAfter.count(), 1000);
+
+    /* another connection has its own bucket */
+    auto second = limiter.client(socket);
+    EXPECT_EQ(limiter.admit(second, 2).admitted, 2u);
+
+    ::close(socket);
+    ::close(other);
+}
+
+TEST(RateLimiterTest, AddressLimit_IsSharedByConnections) {
+    RateLimiter limiter(RateLimit{}, RateLimit{1, 4});
+
+    int other = -1;
+    int socket = connectedSocket(other);
+    ASSERT_GE(socket, 0);
+
+    auto first = limiter.client(socket);
+    auto second = limiter.client(socket);
+
+    EXPECT_EQ(limiter.admit(first, 3).admitted, 3u);
+
+    auto admission = limiter.admit(second, 3);
+    EXPECT_EQ(admission.admitted, 1u);
+    EXPECT_GT(admission.retryAfter.count(), 0);
+
+    ::close(socket);
+    ::close(other);
+}
@@ -0,0 +1,105 @@
+/* Integration tests for ReplicaRouter, they assume:
+ *
+ *  - DB is running and json credential is valid
+ *  - nothing listens on 127.0.0.1:1
+ *
+ * No streaming replica is needed: the tests check that reads never fail
+ * because of replicas, they fall back to the primary */
+
+#include <gtest/gtest.h>
+#include "replica_router.hpp"
+#include "account_service.hpp"
+#include "database_connection.hpp"
+
+class ReplicaRouterTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            auto& db = DBConnection::getInstance();
+
+            if (!db.isConnected()) {
+                db.loadConfig("config/db_credential.json");
+                db.connect();
+            }
+        }
+
+        void TearDown() override {
+            /* leave the singleton without replicas for the other suites */
+            ReplicaRouter::getInstance().configure(ReplicaSettings{});
+        }
+};
+
+TEST_F(ReplicaRouterTest, NoReplicas_ReadsGoToPrimary) {
+    auto& router = ReplicaRouter::getInstance();
+    router.configure(ReplicaSettings{});
+
+    auto lease = router.acquireRead();
+    EXPECT_FALSE(lease.onReplica());
+
+    auto tx = lease.createAutocommitTransaction();
+    EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+}
+
+TEST_F(ReplicaRouterTest, UnreachableReplica_FallsBackToPrimary) {
+    auto& router = ReplicaRouter::getInstance();
+
+    ReplicaSettings settings;
+    settings.connectionStrings.push_back("host=127.0.0.1 port=1 dbname=database1 connect_timeout=1");
+    router.configure(settings);
+    router.checkReplicas();
+
+    EXPECT_EQ(router.usableReplicas(), 0u);
+
+    auto lease = router.acquireRead(ReadConsistency::BoundedStaleness);
+    EXPECT_FALSE(lease.onReplica());
+}
+
+TEST_F(ReplicaRouterTest, PrimaryListedAsReplica_IsRejected) {
+    auto& router = ReplicaRouter::getInstance();
+
+    /* a server that is not in recovery is not a standby, never read from it
+     * as a replica (it could be a promoted one that split from the primary) */
+    ReplicaSettings settings;
+    settings.connectionStrings.push_back(DBConnection::getInstance().getConnectionString());
+    router.configure(settings);
+    router.checkReplicas();
+
+    EXPECT_EQ(router.usableReplicas(), 0u);
+}
+
+TEST_F(ReplicaRouterTest, Balance_StaysOnPrimaryByDefault) {
+    auto& router = ReplicaRouter::getInstance();
+    router.configure(ReplicaSettings{});
+
+    EXPECT_EQ(router.balanceConsistency(), ReadConsistency::Strong);
+
+    ReplicaSettings settings;
+    settings.balanceOnReplica = true;
+    router.configure(settings);
+    EXPECT_EQ(router.balanceConsistency(), ReadConsistency::BoundedStaleness);
+
+    /* still answered, by the primary, when no replica is configured */
+    AccountService service;
+    EXPECT_NO_THROW(service.getBalances({1, 2}));
+}
+
+TEST_F(ReplicaRouterTest, Reload_SwapsReplicasWhileReading) {
+    auto& router = ReplicaRouter::getInstance();
+    router.configure(ReplicaSettings{});
+
+    /* a lease taken before the reload stays valid after it */
+    auto lease = router.acquireRead(ReadConsistency::BoundedStaleness);
+
+    ReplicaSettings settings;
+    settings.connectionStrings.push_back("host=127.0.0.1 port=1 dbname=database1 connect_timeout=1");
+    router.reload(settings);
+
+    EXPECT_EQ(router.usableReplicas(), 0u);
+    EXPECT_FALSE(router.acquireRead(ReadConsistency::BoundedStaleness).onReplica());
+
+    auto tx = lease.createAutocommitTransaction();
+    EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+
+    /* back to no replica, the checker thread stops */
+    router.reload(ReplicaSettings{});
+    EXPECT_EQ(router.usableReplicas(), 0u);
+}
@@ -0,0 +1,95 @@
+/* Unit tests for RequestArena, AllocationCounter and CommandParser, no DB needed */
+
+#include <gtest/gtest.h>
+#include "request_arena.hpp"
+#include "command_parser.hpp"
+
+#include <string>
+#include <vector>
+
+TEST(RequestArenaTest, OutsideAScope_IsTheDefaultResource) {
+    EXPECT_EQ(RequestArena::resource(), std::pmr::get_default_resource());
+
+    {
+        RequestArena::Scope outer;
+        std::pmr::memory_resource* arena = RequestArena::resource();
+        EXPECT_NE(arena, std::pmr::get_default_resource());
+
+        /* a nested scope shares the request of the outer one */
+        {
+            RequestArena::Scope inner;
+            EXPECT_EQ(RequestArena::resource(), arena);
+        }
+        EXPECT_EQ(RequestArena::resource(), arena);
+    }
+
+    EXPECT_EQ(RequestArena::resource(), std::pmr::get_default_resource());
+}
+
+TEST(RequestArenaTest, Reset_ReusesTheSameMemory) {
+    const void* first;
+    {
+        RequestArena::Scope scope;
+        std::pmr::string line("BALANCE 1 with a line too long for the small string buffer",
+                              RequestArena::resource());
+        first = line.data();
+    }
+    {
+        RequestArena::Scope scope;
+        std::pmr::string line("BALANCE 2 with a line too long for the small string buffer",
+                              RequestArena::resource());
+        EXPECT_EQ(line.data(), first);
+    }
+}
+
+TEST(RequestArenaTest, ArenaStrings_DoNotHitTheHeap) {
+    if (!AllocationCounter::enabled()) {
+        GTEST_SKIP() << "built without COUNT_ALLOCATIONS";
+    }
+
+    /* first use of the thread's arena allocates its buffer */
+    { RequestArena::Scope warmUp; }
+
+    auto before = AllocationCounter::threadAllocations();
+    {
+        RequestArena::Scope scope;
+        std::pmr::vector<std::pmr::string> lines(RequestArena::resource());
+        for (int i = 0; i < 32; ++i) {
+            lines.emplace_back("TRANSFER 1 2 10.00 \"a description past the small string buffer\"");
+        }
+    }
+    EXPECT_EQ(AllocationCounter::threadAllocations(), before);
+
+    {
+        std::vector<std::string> lines;
+        lines.emplace_back("TRANSFER 1 2 10.00 \"a description past the small string buffer\"");
+    }
+    EXPECT_GT(AllocationCounter::threadAllocations(), before);
+}
+
+TEST(CommandParserTest, ReadsLikeAStringStream) {
+    CommandParser parser("  TRANSFER 12 +7 10.5abc   rest of  the line ");
+    std::string_view cmd;
+    int from, to;
+    double amount;
+    parser >> cmd >> from >> to >> amount;
+
+    ASSERT_TRUE(parser);
+    EXPECT_EQ(cmd, "TRANSFER");
+    EXPECT_EQ(from, 12);
+    EXPECT_EQ(to, 7);
+    EXPECT_DOUBLE_EQ(amount, 10.5);
+    EXPECT_EQ(parser.remainder(), "rest of  the line ");
+}
+
+TEST(CommandParserTest, FailureSticks) {
+    CommandParser parser("BALANCE abc 3");
+    std::string_view cmd;
+    int id = 0, other = 0;
+    parser >> cmd >> id >> other;
+    EXPECT_FALSE(parser);
+
+    CommandParser missing("BALANCE");
+    missing >> cmd >> id;
+    EXPECT_TRUE(!missing);
+}
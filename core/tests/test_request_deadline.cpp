@@ -0,0 +1,100 @@
+/* Tests for RequestDeadline and DeadlineWatchdog. The ones named *_OnPrimary
+ * assume the DB is running and json credential is valid */
+
+#include <gtest/gtest.h>
+#include "request_deadline.hpp"
+#include "database_connection.hpp"
+#include "metrics.hpp"
+
+#include <thread>
+
+namespace {
+    using Clock = RequestDeadline::Clock;
+
+    void connectPrimary() {
+        auto& db = DBConnection::getInstance();
+        if (!db.isConnected()) {
+            db.loadConfig("config/db_credential.json");
+            db.connect();
+        }
+    }
+}
+
+TEST(RequestDeadlineTest, Scope_SetsAndRestoresTheDeadline) {
+    EXPECT_FALSE(RequestDeadline::current().has_value());
+    EXPECT_FALSE(RequestDeadline::expired());
+    EXPECT_NO_THROW(RequestDeadline::check("here"));
+
+    {
+        RequestDeadline::Scope outer(Clock::now() + std::chrono::seconds(10));
+        EXPECT_FALSE(RequestDeadline::expired());
+
+        {
+            RequestDeadline::Scope inner(Clock::now() - std::chrono::milliseconds(1));
+            EXPECT_TRUE(RequestDeadline::expired());
+            EXPECT_THROW(RequestDeadline::check("here"), DeadlineExceeded);
+        }
+        EXPECT_FALSE(RequestDeadline::expired());
+    }
+
+    EXPECT_FALSE(RequestDeadline::current().has_value());
+}
+
+TEST(RequestDeadlineTest, StatementTimeout_StopsSlowQuery_OnPrimary) {
+    connectPrimary();
+    auto& db = DBConnection::getInstance();
+
+    RequestDeadline::Scope scope(Clock::now() + std::chrono::milliseconds(300));
+    auto started = Clock::now();
+
+    auto guard = db.lock();
+    auto tx = db.createReadTransaction();
+    EXPECT_THROW(tx->exec("SELECT pg_sleep(5)"), pqxx::sql_error);
+
+    EXPECT_LT(Clock::now() - started, std::chrono::seconds(2));
+}
+
+TEST(RequestDeadlineTest, Watchdog_CancelsRequestHoldingThePrimary_OnPrimary) {
+    connectPrimary();
+    auto& db = DBConnection::getInstance();
+    auto& watchdog = DeadlineWatchdog::getInstance();
+    watchdog.start();
+
+    auto cancelsBefore = Metrics::getInstance().get("db.deadline_cancels").load();
+    {
+        RequestDeadline::Scope scope(Clock::now() + std::chrono::milliseconds(300));
+        auto started = Clock::now();
+
+        auto guard = db.lock();
+        auto tx = db.createWriteTransaction();
+        /* lifts the statement timeout, only the watchdog can stop it now */
+        tx->exec("SET LOCAL statement_timeout = 0");
+        EXPECT_THROW(tx->exec("SELECT pg_sleep(5)"), pqxx::sql_error);
+
+        EXPECT_LT(Clock::now() - started, std::chrono::seconds(2));
+    }
+    EXPECT_EQ(Metrics::getInstance().get("db.deadline_cancels").load(), cancelsBefore + 1);
+
+    watchdog.stop();
+}
+
+TEST(RequestDeadlineTest, FinishedRequest_IsNotCancelled_OnPrimary) {
+    connectPrimary();
+    auto& db = DBConnection::getInstance();
+    auto& watchdog = DeadlineWatchdog::getInstance();
+    watchdog.start();
+
+    auto cancelsBefore = Metrics::getInstance().get("db.deadline_cancels").load();
+    {
+        RequestDeadline::Scope scope(Clock::now() + std::chrono::milliseconds(50));
+        auto guard = db.lock();
+        auto tx = db.createReadTransaction();
+        EXPECT_EQ(tx->query_value<int>("SELECT 1"), 1);
+        tx->commit();
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(Metrics::getInstance().get("db.deadline_cancels").load(), cancelsBefore);
+
+    watchdog.stop();
+}
@@ -0,0 +1,119 @@
+/* Unit tests for ResponseBuffer, no DB needed */
+
+#include <gtest/gtest.h>
+#include "response_buffer.hpp"
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <thread>
+
+TEST(ResponseBufferTest, Fragments_AreGatheredInOrder) {
+    ResponseBuffer out;
+    out.append("BALANCE ");
+    out.appendNumber(42LL);
+    out.append(" ");
+    out.appendNumber(1584.98);
+    out.append("\n");
+    out.appendNumber(-7LL);
+    out.appendNumber(0.1 + 0.2);
+
+    EXPECT_EQ(out.str(), "BALANCE 42 1584.98\n-70.3");
+    EXPECT_EQ(out.size(), out.str().size());
+}
+
+TEST(ResponseBufferTest, Rewind_DropsWhatFollowsTheMark) {
+    ResponseBuffer out;
+    out.append("PONG\n");
+    out.appendCopy("copied ");
+
+    auto mark = out.mark();
+    out.appendCopy("ERROR ");
+    out.appendCopy("canceling statement\n");
+    EXPECT_TRUE(out.startsWith(mark, "ERROR can"));
+    EXPECT_FALSE(out.startsWith(mark, "ERROR Deadline"));
+
+    out.rewind(mark);
+    out.append("ERROR Deadline exceeded\n");
+    EXPECT_EQ(out.str(), "PONG\ncopied ERROR Deadline exceeded\n");
+}
+
+TEST(ResponseBufferTest, Flush_ResumesShortWritesOnNonBlockingSocket) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    /* a small send buffer: the kernel takes the response in several pieces */
+    int size = 4096;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    ResponseBuffer out;
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) {
+        out.append("BALANCE ");
+        out.appendNumber(static_cast<long long>(i));
+        out.append("\n");
+        expected += "BALANCE " + std::to_string(i) + "\n";
+    }
+
+    std::string received;
+    std::thread reader([&received, &expected, fd = fds[1]]() {
+        char buffer[1024];
+        while (received.size() < expected.size()) {
+            ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            received.append(buffer, static_cast<std::size_t>(n));
+        }
+    });
+
+    EXPECT_TRUE(out.flush(fds[0]));
+    reader.join();
+
+    EXPECT_EQ(received, expected);
+    EXPECT_TRUE(out.empty());
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST(ResponseBufferTest, Flush_ReportsClosedPeer) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    ::close(fds[1]);
+
+    ResponseBuffer out;
+    out.append("PONG\n");
+    EXPECT_FALSE(out.flush(fds[0]));
+    EXPECT_TRUE(out.empty());
+
+    ::close(fds[0]);
+}
+
+TEST(ResponseBufferTest, Flush_TimesOutOnPeerNotReading) {
+    int fds[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    /* a blocking socket whose peer never reads */
+    int size = 4096;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    ResponseBuffer out;
+    for (int i = 0; i < 20000; ++i) {
+        out.append("EVENT 1 2 3 4 10.00\n");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(out.flush(fds[0], std::chrono::milliseconds(100)));
+    EXPECT_EQ(errno, ETIMEDOUT);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_TRUE(out.empty());
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
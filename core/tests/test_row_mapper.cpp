@@ -0,0 +1,111 @@
+/* Unit tests for RowMapper, rows are faked so no DB is needed */
+
+#include <gtest/gtest.h>
+#include "row_mapper.hpp"
+#include "account_service.hpp"
+#include "account_table.hpp"
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+    /** @brief Text field of a FakeRow, nullopt is NULL */
+    struct FakeField {
+        std::string column;
+        std::optional<std::string> text;
+
+        const char* name() const { return column.c_str(); }
+        bool is_null() const { return !text; }
+        std::string_view view() const { return text ? std::string_view(*text) : std::string_view(); }
+    };
+
+    /** @brief The parts of pqxx::row a RowMapper uses */
+    struct FakeRow {
+        std::vector<FakeField> fields;
+
+        std::size_t size() const { return fields.size(); }
+        const FakeField& operator[](int i) const { return fields[static_cast<std::size_t>(i)]; }
+    };
+
+    /** @brief A transactions row, the shape of a future history type */
+    struct HistoryEntry {
+        std::int64_t        transactionID;
+        std::optional<int>  fromAccount;
+        std::optional<int>  toAccount;
+        std::int64_t        amountCents;
+        std::string         description;
+    };
+
+    using HistoryRow = RowMapper<HistoryEntry,
+        Column<"transaction_id", &HistoryEntry::transactionID>,
+        Column<"from_account",   &HistoryEntry::fromAccount>,
+        Column<"to_account",     &HistoryEntry::toAccount>,
+        Column<"amount",         &HistoryEntry::amountCents, parseCents>,
+        Column<"description",    &HistoryEntry::description>>;
+
+    FakeRow accountRow() {
+        return FakeRow{{{"account_id", "7"}, {"customer_id", "3"}, {"customer_name", "Alice Johnson"},
+                        {"customer_email", "alice@bank1.com"}, {"account_type", "checking"},
+                        {"balance", "1584.98"}, {"currency", "USD"}}};
+    }
+}
+
+TEST(RowMapperTest, Account_IsDecodedByPosition) {
+    Account acc = AccountRow::map(accountRow());
+
+    EXPECT_EQ(acc.accountID, 7);
+    EXPECT_EQ(acc.customerID, 3);
+    EXPECT_EQ(acc.customerName, "Alice Johnson");
+    EXPECT_EQ(acc.customerEmail, "alice@bank1.com");
+    EXPECT_EQ(acc.accountType, "checking");
+    EXPECT_DOUBLE_EQ(acc.balance, 1584.98);
+    EXPECT_EQ(acc.currency, "USD");
+}
+
+TEST(RowMapperTest, Nulls_AndCustomDecoders) {
+    HistoryEntry entry = HistoryRow::map(FakeRow{{{"transaction_id", "9000000001"}, {"from_account", std::nullopt},
+                                                  {"to_account", "12"}, {"amount", "250.5"},
+                                                  {"description", "Deposit"}}});
+
+    EXPECT_EQ(entry.transactionID, 9000000001LL);
+    EXPECT_FALSE(entry.fromAccount.has_value());
+    EXPECT_EQ(entry.toAccount, 12);
+    EXPECT_EQ(entry.amountCents, 25050);
+    EXPECT_EQ(entry.description, "Deposit");
+
+    FakeRow nullAmount{{{"transaction_id", "1"}, {"from_account", "1"}, {"to_account", "2"},
+                        {"amount", std::nullopt}, {"description", ""}}};
+    EXPECT_THROW(HistoryRow::map(nullAmount), std::invalid_argument);
+
+    FakeRow badNumber{{{"transaction_id", "1x"}, {"from_account", "1"}, {"to_account", "2"},
+                       {"amount", "1.00"}, {"description", ""}}};
+    EXPECT_THROW(HistoryRow::map(badNumber), std::invalid_argument);
+}
+
+TEST(RowMapperTest, Check_RejectsAnotherShape) {
+    FakeRow missing = accountRow();
+    missing.fields.pop_back();
+    EXPECT_THROW(AccountRow::check(missing), std::runtime_error);
+
+    FakeRow swapped = accountRow();
+    std::swap(swapped.fields[5], swapped.fields[6]);
+    EXPECT_THROW(AccountRow::check(swapped), std::runtime_error);
+
+    EXPECT_NO_THROW(AccountRow::check(accountRow()));
+}
+
+TEST(RowMapperTest, Check_RejectsMembersOutOfOrder) {
+    using Swapped = RowMapper<HistoryEntry,
+        Column<"transaction_id", &HistoryEntry::transactionID>,
+        Column<"to_account",     &HistoryEntry::toAccount>,
+        Column<"from_account",   &HistoryEntry::fromAccount>,
+        Column<"amount",         &HistoryEntry::amountCents, parseCents>,
+        Column<"description",    &HistoryEntry::description>>;
+
+    FakeRow row{{{"transaction_id", "1"}, {"to_account", "2"}, {"from_account", "1"},
+                 {"amount", "1.00"}, {"description", ""}}};
+    EXPECT_THROW(Swapped::check(row), std::runtime_error);
+}
@@ -8,6 +8,8 @@
 
 #include "database_connection.hpp"
 #include "server.hpp"
+#include "metrics.hpp"
+#include "transfer_feed.hpp"
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -23,9 +25,34 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
 
 namespace {
     constexpr int TEST_PORT = 5555;
+
+    /* connected client socket to the test server, -1 on failure */
+    int connectClient() {
+        int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port   = htons(TEST_PORT);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (sock >= 0 && ::connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            ::close(sock);
+            return -1;
+        }
+        return sock;
+    }
+
+    /* one command on an open connection, response with its newline */
+    std::string roundTrip(int sock, const std::string& cmd) {
+        std::string line = cmd + "\n";
+        ::send(sock, line.c_str(), line.size(), MSG_NOSIGNAL);
+        char buffer[512] = {};
+        ssize_t n = ::recv(sock, buffer, sizeof(buffer) - 1, 0);
+        return n > 0 ? std::string(buffer, n) : std::string();
+    }
 }
 
 /**
@@ -107,7 +134,7 @@ class ServerTest : public ::testing::Test {
             return resp;
         }
 
-        std::unique_ptr<Server> server;p
+        std::unique_ptr<Server> server;
 };
 
 /**
@@ -342,4 +369,439 @@ TEST_F(ServerTest, ConcurrentTransfers_AreConsistentWithTotalAmount) {
      * we accept a small epsilon at the cent level. */
     EXPECT_NEAR(fromAfter, expectedFrom, 1e-2);
     EXPECT_NEAR(toAfter,   expectedTo,   1e-2);
-}
\ No newline at end of file
+}
+
+/**
+ * @test Several SO_REUSEPORT acceptors on the same port must all serve clients
+ *
+ * Restarts the server with 4 listening sockets and opens many concurrent
+ * connections, the kernel spreads them between the sockets
+ */
+TEST_F(ServerTest, ReusePortAcceptors_AllServeRequests) {
+    server->stop();
+
+    ServerConfig config;
+    config.acceptors = 4;
+    config.backlog = 256;
+    server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+    server->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    const int numThreads = 50;
+    std::vector<std::thread> threads;
+    std::vector<std::string> responses(numThreads);
+
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([this, i, &responses]() {
+            responses[i] = sendCommand("PING");
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& resp : responses) {
+        EXPECT_EQ(resp, "PONG");
+    }
+}
+
+/**
+ * @test stop() must close connections that are still open and wait for
+ * their workers instead of leaving detached threads behind
+ */
+TEST_F(ServerTest, Stop_ClosesOpenConnectionsAndRecordsDrain) {
+    int sock = connectClient();
+    ASSERT_GE(sock, 0);
+
+    const std::string ping = "PING\n";
+    ASSERT_GT(::send(sock, ping.c_str(), ping.size(), 0), 0);
+
+    char buffer[64] = {};
+    ASSERT_GT(::recv(sock, buffer, sizeof(buffer) - 1, 0), 0);
+    EXPECT_EQ(std::string(buffer), "PONG\n");
+
+    auto drainsBefore = Metrics::getInstance().get("server.drains").load();
+
+    /* the connection is idle, so the drain finishes well before the deadline */
+    server->stop(std::chrono::milliseconds(2000));
+
+    /* the server side was closed: recv sees end of stream */
+    EXPECT_EQ(::recv(sock, buffer, sizeof(buffer), 0), 0);
+    EXPECT_EQ(Metrics::getInstance().get("server.drains").load(), drainsBefore + 1);
+    EXPECT_LT(Metrics::getInstance().get("server.drain_ms").load(), 2000);
+
+    ::close(sock);
+}
+
+/**
+ * @test Commands pipelined in a single send must each get their own
+ * response line, in order
+ */
+TEST_F(ServerTest, PipelinedCommands_AnsweredInOrder) {
+    int sock = connectClient();
+    ASSERT_GE(sock, 0);
+
+    const std::string batch = "BALANCE 1\nBALANCE 2\nBALANCE 999999\nPING\n";
+    ASSERT_EQ(::send(sock, batch.c_str(), batch.size(), 0), static_cast<ssize_t>(batch.size()));
+
+    /* Read until the 4 response lines arrived */
+    std::string received;
+    char buffer[1024];
+    while (std::count(received.begin(), received.end(), '\n') < 4) {
+        ssize_t n = ::recv(sock, buffer, sizeof(buffer), 0);
+        ASSERT_GT(n, 0);
+        received.append(buffer, n);
+    }
+    ::close(sock);
+
+    std::istringstream lines(received);
+    std::string line;
+
+    std::getline(lines, line);
+    EXPECT_EQ(line.rfind("BALANCE 1 ", 0), 0u) << line;
+    std::getline(lines, line);
+    EXPECT_EQ(line.rfind("BALANCE 2 ", 0), 0u) << line;
+    std::getline(lines, line);
+    EXPECT_EQ(line.rfind("ERROR", 0), 0u) << line;
+    std::getline(lines, line);
+    EXPECT_EQ(line, "PONG");
+}
+
+/**
+ * @brief ServerTest restarted on the event loop backend of the parameter
+ */
+class ServerBackendTest : public ServerTest, public ::testing::WithParamInterface<IOBackend> {
+    protected:
+        void SetUp() override {
+            ServerTest::SetUp();
+            server->stop();
+
+            ServerConfig config;
+            config.acceptors = 2;
+            config.backend = GetParam();
+            server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+            server->start();
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+};
+
+/**
+ * @test The event loop backends must answer the same protocol as the
+ * threaded one, including pipelined commands completed by asynchronous
+ * queries. Without io_uring (build flag, kernel) start() falls back to epoll
+ */
+TEST_P(ServerBackendTest, AnswersLikeThreadedBackend) {
+    EXPECT_EQ(sendCommand("PING"), "PONG");
+    EXPECT_EQ(sendCommand("BALANCE 999999").rfind("ERROR", 0), 0u);
+    EXPECT_EQ(sendCommand("FOO"), "ERROR Unknown command");
+
+    /* many clients at once, all served by two loop threads */
+    const int numThreads = 50;
+    std::vector<std::thread> threads;
+    std::vector<std::string> responses(numThreads);
+
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([this, i, &responses]() {
+            responses[i] = sendCommand("BALANCE 1");
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& resp : responses) {
+        EXPECT_EQ(resp.rfind("BALANCE 1 ", 0), 0u) << resp;
+    }
+
+    /* an insufficient funds transfer fails alone, the next query still runs */
+    int sock = connectClient();
+    ASSERT_GE(sock, 0);
+
+    const std::string batch = "TRANSFER 1 2 999999999\nBALANCE 1\nPING\n";
+    ASSERT_EQ(::send(sock, batch.c_str(), batch.size(), 0), static_cast<ssize_t>(batch.size()));
+
+    std::string received;
+    char buffer[1024];
+    while (std::count(received.begin(), received.end(), '\n') < 3) {
+        ssize_t n = ::recv(sock, buffer, sizeof(buffer), 0);
+        ASSERT_GT(n, 0);
+        received.append(buffer, n);
+    }
+    ::close(sock);
+
+    std::istringstream lines(received);
+    std::string line;
+
+    std::getline(lines, line);
+    EXPECT_EQ(line.rfind("ERROR", 0), 0u) << line;
+    std::getline(lines, line);
+    EXPECT_EQ(line.rfind("BALANCE 1 ", 0), 0u) << line;
+    std::getline(lines, line);
+    EXPECT_EQ(line, "PONG");
+}
+
+INSTANTIATE_TEST_SUITE_P(EventLoops, ServerBackendTest, ::testing::Values(IOBackend::Epoll, IOBackend::IoUring),
+                         [](const ::testing::TestParamInfo<IOBackend>& info) {
+                             return info.param == IOBackend::Epoll ? "Epoll" : "IoUring";
+                         });
+
+/**
+ * @test RELOAD answers at once, and moving the event loops to new DB
+ * connections does not interrupt the queries being served
+ */
+TEST_F(ServerTest, Reload_KeepsServingDuringConnectionSwap) {
+    EXPECT_EQ(sendCommand("RELOAD"), "ERROR Reload not available");
+
+    server->stop();
+
+    ServerConfig config;
+    config.acceptors = 2;
+    config.backend = IOBackend::Epoll;
+    server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+
+    std::atomic<int> requested{0};
+    server->setReloadHandler([&requested]() { ++requested; });
+    server->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    EXPECT_EQ(sendCommand("RELOAD"), "OK RELOADING");
+    EXPECT_EQ(requested.load(), 1);
+
+    const int numThreads = 20;
+    std::vector<std::thread> threads;
+    std::vector<std::string> responses(numThreads);
+
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back([this, i, &responses]() {
+            responses[i] = sendCommand("BALANCE 1");
+        });
+    }
+
+    server->reloadDatabase();
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& resp : responses) {
+        EXPECT_EQ(resp.rfind("BALANCE 1 ", 0), 0u) << resp;
+    }
+
+    /* served by the new connections */
+    EXPECT_EQ(sendCommand("BALANCE 1").rfind("BALANCE 1 ", 0), 0u);
+}
+
+/**
+ * @test Commands past the connection limit are refused with a retry hint,
+ * the ones before them are answered
+ */
+TEST_F(ServerTest, RateLimit_RefusesCommandsPastTheBurst) {
+    server->stop();
+
+    ServerConfig config;
+    config.connectionLimit = RateLimit{1, 3};
+    server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+    server->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    int sock = connectClient();
+    ASSERT_GE(sock, 0);
+
+    const std::string batch = "PING\nPING\nPING\nPING\nPING\n";
+    ASSERT_EQ(::send(sock, batch.c_str(), batch.size(), 0), static_cast<ssize_t>(batch.size()));
+
+    std::string received;
+    char buffer[1024];
+    while (std::count(received.begin(), received.end(), '\n') < 5) {
+        ssize_t n = ::recv(sock, buffer, sizeof(buffer), 0);
+        ASSERT_GT(n, 0);
+        received.append(buffer, n);
+    }
+    ::close(sock);
+
+    std::istringstream lines(received);
+    std::string line;
+    for (int i = 0; i < 3; ++i) {
+        std::getline(lines, line);
+        EXPECT_EQ(line, "PONG");
+    }
+    for (int i = 0; i < 2; ++i) {
+        std::getline(lines, line);
+        EXPECT_EQ(line.rfind("ERROR RETRY Rate limited, retry in ", 0), 0u) << line;
+    }
+}
+
+/**
+ * @test DEADLINE wraps any command, a malformed one is refused
+ */
+TEST_F(ServerTest, Deadline_PrefixesCommands) {
+    EXPECT_EQ(sendCommand("DEADLINE 5000 PING"), "PONG");
+    EXPECT_EQ(sendCommand("DEADLINE 5000 BALANCE 1").rfind("BALANCE 1 ", 0), 0u);
+    EXPECT_EQ(sendCommand("DEADLINE 0 PING"), "ERROR Invalid DEADLINE arguments");
+    EXPECT_EQ(sendCommand("DEADLINE 100"), "ERROR Invalid DEADLINE arguments");
+}
+
+/**
+ * @test STATS reports the live connections, this one included
+ */
+TEST_F(ServerTest, Stats_ReportsLiveConnections) {
+    std::string resp = sendCommand("STATS");
+    EXPECT_EQ(resp.rfind("STATS connections_active=1 ", 0), 0u) << resp;
+    EXPECT_NE(resp.find(" idle_timeouts="), std::string::npos) << resp;
+}
+
+/**
+ * @test A connection quiet for idle_timeout, or stuck in the middle of a
+ * command for read_timeout, is closed by the server
+ */
+TEST_F(ServerTest, IdleAndReadTimeouts_CloseConnections) {
+    server->stop();
+
+    ServerConfig config;
+    config.deferAcceptSeconds = 0;
+    config.connections.idleTimeout = std::chrono::milliseconds(300);
+    config.connections.readTimeout = std::chrono::milliseconds(300);
+    server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+    server->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto idleBefore = Metrics::getInstance().get("server.idle_timeouts").load();
+    auto readBefore = Metrics::getInstance().get("server.read_timeouts").load();
+
+    int quiet = connectClient();
+    int slow = connectClient();
+    ASSERT_GE(quiet, 0);
+    ASSERT_GE(slow, 0);
+    EXPECT_EQ(roundTrip(quiet, "PING"), "PONG\n");
+    ::send(slow, "PI", 2, MSG_NOSIGNAL);
+
+    /* both see the end of stream once their timeout passed */
+    char buffer[16];
+    EXPECT_EQ(::recv(quiet, buffer, sizeof(buffer), 0), 0);
+    EXPECT_EQ(::recv(slow, buffer, sizeof(buffer), 0), 0);
+
+    EXPECT_EQ(Metrics::getInstance().get("server.idle_timeouts").load(), idleBefore + 1);
+    EXPECT_EQ(Metrics::getInstance().get("server.read_timeouts").load(), readBefore + 1);
+
+    ::close(quiet);
+    ::close(slow);
+}
+
+/**
+ * @test At max_connections a new client evicts the one idle the longest,
+ * and is refused when nobody has been idle long enough
+ */
+TEST_F(ServerTest, MaxConnections_EvictsIdleOrRefuses) {
+    server->stop();
+
+    ServerConfig config;
+    config.deferAcceptSeconds = 0;
+    config.connections.maxConnections = 1;
+    config.connections.evictIdleAfter = std::chrono::milliseconds(200);
+    server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+    server->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    int first = connectClient();
+    ASSERT_GE(first, 0);
+    EXPECT_EQ(roundTrip(first, "PING"), "PONG\n");
+
+    /* first was idle for a few ms only */
+    int refused = connectClient();
+    ASSERT_GE(refused, 0);
+    char refusal[64] = {};
+    ASSERT_GT(::recv(refused, refusal, sizeof(refusal) - 1, 0), 0);
+    EXPECT_EQ(std::string(refusal), "ERROR RETRY Too many connections\n");
+    ::close(refused);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    int second = connectClient();
+    ASSERT_GE(second, 0);
+    EXPECT_EQ(roundTrip(second, "PING"), "PONG\n");
+
+    char buffer[16];
+    EXPECT_EQ(::recv(first, buffer, sizeof(buffer), 0), 0);
+
+    ::close(first);
+    ::close(second);
+}
+
+namespace {
+    /* reads from sock until count lines arrived */
+    std::string readLines(int sock, long count) {
+        std::string received;
+        char buffer[512];
+        while (std::count(received.begin(), received.end(), '\n') < count) {
+            ssize_t n = ::recv(sock, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            received.append(buffer, n);
+        }
+        return received;
+    }
+}
+
+/**
+ * @test SUBSCRIBE streams the published transfers, and a resume replays the
+ * ones a subscriber missed, with both backends (the feed is fed directly,
+ * the way its LISTEN does)
+ */
+TEST_F(ServerTest, Subscribe_StreamsTransfersAndResumes) {
+    auto& feed = TransferFeed::getInstance();
+    const std::string stream = std::to_string(feed.streamID());
+
+    for (IOBackend backend : {IOBackend::Threads, IOBackend::Epoll}) {
+        server->stop();
+        ServerConfig config;
+        config.deferAcceptSeconds = 0;
+        config.backend = backend;
+        server = std::make_unique<Server>("127.0.0.1", TEST_PORT, config);
+        server->start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        const long long base = backend == IOBackend::Threads ? 900000000 : 900000100;
+
+        int sock = connectClient();
+        ASSERT_GE(sock, 0);
+        std::string subscribed = roundTrip(sock, "PING\nSUBSCRIBE\nPING");
+        subscribed += readLines(sock, 3 - std::count(subscribed.begin(), subscribed.end(), '\n'));
+
+        /* a command pipelined after SUBSCRIBE is answered, not run */
+        std::uint64_t after = feed.lastSequence();
+        EXPECT_EQ(subscribed, "PONG\nSUBSCRIBED " + stream + " " + std::to_string(after) + "\n"
+                              "ERROR Connection is subscribed\n");
+
+        feed.publish(std::to_string(base + 1) + " 1 2 10.00");
+        feed.publish(std::to_string(base + 2) + " 2 1 2.50");
+        EXPECT_EQ(readLines(sock, 2),
+                  "EVENT " + std::to_string(after + 1) + " " + std::to_string(base + 1) + " 1 2 10.00\n"
+                  "EVENT " + std::to_string(after + 2) + " " + std::to_string(base + 2) + " 2 1 2.50\n");
+        ::close(sock);
+
+        /* the subscriber left after the first event, it resumes from there */
+        sock = connectClient();
+        ASSERT_GE(sock, 0);
+        const std::string resume = "SUBSCRIBE " + stream + " " + std::to_string(after + 1) + "\n";
+        ::send(sock, resume.c_str(), resume.size(), MSG_NOSIGNAL);
+        EXPECT_EQ(readLines(sock, 2),
+                  "SUBSCRIBED " + stream + " " + std::to_string(after + 1) + "\n"
+                  "EVENT " + std::to_string(after + 2) + " " + std::to_string(base + 2) + " 2 1 2.50\n");
+        ::close(sock);
+
+        EXPECT_EQ(sendCommand("SUBSCRIBE 1 1").rfind("ERROR Stream 1 has ended", 0), 0u);
+
+        /* a refused SUBSCRIBE keeps the connection a command one, what follows it runs */
+        sock = connectClient();
+        ASSERT_GE(sock, 0);
+        std::string refused = roundTrip(sock, "SUBSCRIBE 1 1\nPING");
+        refused += readLines(sock, 2 - std::count(refused.begin(), refused.end(), '\n'));
+        EXPECT_EQ(refused.rfind("ERROR Stream 1 has ended", 0), 0u);
+        EXPECT_EQ(refused.substr(refused.find('\n') + 1), "PONG\n");
+        ::close(sock);
+    }
+}
+
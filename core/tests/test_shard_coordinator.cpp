@@ -0,0 +1,264 @@
+/* Tests for ShardCoordinator placement and failure handling, they assume:
+ *
+ *  - nothing listens on 127.0.0.1:1
+ *  - /tmp is writable (recovery log)
+ *
+ * ShardRecoveryTest plays both shards with the database of
+ * config/db_credential.json (accounts 1 and 2, max_prepared_transactions > 0)
+ * and is skipped without it. The SQL legs are covered by
+ * database/tests/test_shardTransfer.sql */
+
+#include <gtest/gtest.h>
+#include "shard_coordinator.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace {
+    const std::string UNREACHABLE = "host=127.0.0.1 port=1 dbname=database1 connect_timeout=1";
+    const std::string RECOVERY_LOG = "/tmp/test_shard_recovery.log";
+}
+
+class ShardCoordinatorTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            ::unlink(RECOVERY_LOG.c_str());
+        }
+
+        void TearDown() override {
+            /* leave the singleton unsharded for the other suites */
+            ShardCoordinator::getInstance().configure(ShardSettings{});
+            ::unlink(RECOVERY_LOG.c_str());
+        }
+
+        ShardSettings settings(std::size_t shards, ShardPlacement placement = ShardPlacement::Hash) {
+            ShardSettings s;
+            s.connectionStrings.assign(shards, UNREACHABLE);
+            s.placement = placement;
+            s.recoveryLogPath = RECOVERY_LOG;
+            return s;
+        }
+};
+
+TEST_F(ShardCoordinatorTest, NoShards_Disabled) {
+    auto& coordinator = ShardCoordinator::getInstance();
+    coordinator.configure(ShardSettings{});
+
+    EXPECT_FALSE(coordinator.enabled());
+    EXPECT_EQ(coordinator.shardCount(), 0u);
+}
+
+TEST_F(ShardCoordinatorTest, HashPlacement_StableAndSpread) {
+    auto& coordinator = ShardCoordinator::getInstance();
+    coordinator.configure(settings(4));
+
+    ASSERT_TRUE(coordinator.enabled());
+
+    std::vector<int> perShard(4, 0);
+    for (int id = 1; id <= 4000; ++id) {
+        std::size_t shard = coordinator.shardOf(id);
+        ASSERT_LT(shard, 4u);
+        ++perShard[shard];
+    }
+
+    /* consecutive ids must not pile up on one shard */
+    for (int count : perShard) {
+        EXPECT_GT(count, 800);
+        EXPECT_LT(count, 1200);
+    }
+
+    /* placement depends on the id only, never on the instance */
+    std::size_t before = coordinator.shardOf(1234);
+    coordinator.configure(settings(4));
+    EXPECT_EQ(coordinator.shardOf(1234), before);
+}
+
+TEST_F(ShardCoordinatorTest, RangePlacement_FollowsBounds) {
+    auto& coordinator = ShardCoordinator::getInstance();
+
+    /* shard 0: < 1000, shard 1: [1000, 5000), shard 2: >= 5000 */
+    ShardSettings s = settings(3, ShardPlacement::Range);
+    s.rangeBounds = {1000, 5000};
+    coordinator.configure(s);
+
+    EXPECT_EQ(coordinator.shardOf(1), 0u);
+    EXPECT_EQ(coordinator.shardOf(999), 0u);
+    EXPECT_EQ(coordinator.shardOf(1000), 1u);
+    EXPECT_EQ(coordinator.shardOf(4999), 1u);
+    EXPECT_EQ(coordinator.shardOf(5000), 2u);
+    EXPECT_EQ(coordinator.shardOf(1000000), 2u);
+}
+
+TEST_F(ShardCoordinatorTest, UnreachableShard_TransferFails) {
+    auto& coordinator = ShardCoordinator::getInstance();
+
+    ShardSettings s = settings(2, ShardPlacement::Range);
+    s.rangeBounds = {1000};
+    coordinator.configure(s);
+
+    /* same shard: plain transferMoney() */
+    EXPECT_THROW(coordinator.transfer(1, 2, 10.0, "local"), std::runtime_error);
+
+    /* two shards: aborted before anything was prepared */
+    try {
+        coordinator.transfer(1, 2000, 10.0, "cross shard");
+        FAIL() << "transfer to an unreachable shard succeeded";
+    }
+    catch (const std::runtime_error& e) {
+        EXPECT_NE(std::string(e.what()).find("Transfer failed"), std::string::npos);
+    }
+
+    /* no COMMIT decision was logged, recovery would roll back */
+    std::ifstream log(RECOVERY_LOG);
+    std::stringstream content;
+    content << log.rdbuf();
+    EXPECT_NE(content.str().find("BEGIN bank_"), std::string::npos);
+    EXPECT_NE(content.str().find("ABORT bank_"), std::string::npos);
+    EXPECT_EQ(content.str().find("COMMIT"), std::string::npos);
+}
+
+/**
+ * @class ShardRecoveryTest
+ *
+ * @brief Two "shards" on the test database: account 1 on shard 0, account 2
+ * (and up) on shard 1, so a transfer 1 -> 2 runs the two phase commit
+ */
+class ShardRecoveryTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            ::unlink(RECOVERY_LOG.c_str());
+
+            auto& db = DBConnection::getInstance();
+            try {
+                if (!db.isConnected()) {
+                    db.loadConfig("config/db_credential.json");
+                    db.connect();
+                }
+                conn = std::make_unique<pqxx::connection>(db.getConnectionString());
+                pqxx::nontransaction tx(*conn);
+                if (tx.query_value<int>("SELECT current_setting('max_prepared_transactions')::int") == 0) {
+                    GTEST_SKIP() << "max_prepared_transactions is 0, nothing can be prepared";
+                }
+            }
+            catch (const std::exception& e) {
+                GTEST_SKIP() << "no test database: " << e.what();
+            }
+
+            ShardSettings s;
+            s.connectionStrings.assign(2, db.getConnectionString());
+            s.placement = ShardPlacement::Range;
+            s.rangeBounds = {2};
+            s.recoveryLogPath = RECOVERY_LOG;
+            ShardCoordinator::getInstance().configure(s);
+        }
+
+        void TearDown() override {
+            ShardCoordinator::getInstance().configure(ShardSettings{});
+            ::unlink(RECOVERY_LOG.c_str());
+        }
+
+        std::int64_t balanceCents(int accountID) {
+            pqxx::nontransaction tx(*conn);
+            return tx.query_value<std::int64_t>("SELECT (balance * 100)::bigint FROM accounts WHERE account_id = $1",
+                                                pqxx::params{accountID});
+        }
+
+        /* Runs statement on its own connection and leaves it prepared as gid */
+        std::unique_ptr<pqxx::connection> prepare(const std::string& gid, const std::string& statement) {
+            auto leg = std::make_unique<pqxx::connection>(DBConnection::getInstance().getConnectionString());
+            pqxx::nontransaction tx(*leg);
+            tx.exec("BEGIN");
+            tx.exec(statement);
+            tx.exec("PREPARE TRANSACTION " + leg->quote(gid));
+            return leg;
+        }
+
+        bool prepared(const std::string& gid) {
+            pqxx::nontransaction tx(*conn);
+            return tx.query_value<long long>("SELECT COUNT(*) FROM pg_prepared_xacts WHERE gid = $1",
+                                             pqxx::params{gid}) > 0;
+        }
+
+        std::string logContent() {
+            std::ifstream log(RECOVERY_LOG);
+            std::stringstream content;
+            content << log.rdbuf();
+            return content.str();
+        }
+
+        std::unique_ptr<pqxx::connection> conn;
+};
+
+/**
+ * @test A cross shard transfer commits both legs and logs its decision
+ * under this node's gid
+ */
+TEST_F(ShardRecoveryTest, CrossShardTransfer_CommitsBothLegs) {
+    auto& coordinator = ShardCoordinator::getInstance();
+    ASSERT_NE(coordinator.shardOf(1), coordinator.shardOf(2));
+
+    std::int64_t from = balanceCents(1);
+    std::int64_t to = balanceCents(2);
+    if (from < 100) {
+        GTEST_SKIP() << "Source account 1 has too small balance for a transfer.";
+    }
+
+    ASSERT_NO_THROW(coordinator.transfer(1, 2, 1.00, "Cross shard test"));
+
+    EXPECT_EQ(balanceCents(1), from - 100);
+    EXPECT_EQ(balanceCents(2), to + 100);
+
+    std::string log = logContent();
+    EXPECT_NE(log.find("COMMIT bank_node0_"), std::string::npos) << log;
+    EXPECT_NE(log.find("DONE bank_node0_"), std::string::npos) << log;
+
+    /* nothing of this node stays prepared */
+    EXPECT_EQ(coordinator.recover(), 0u);
+}
+
+/**
+ * @test recover() commits this node's decided gids, rolls back its
+ * undecided ones and leaves the gids of another node alone
+ */
+TEST_F(ShardRecoveryTest, Recover_SettlesOnlyItsOwnNode) {
+    auto& coordinator = ShardCoordinator::getInstance();
+
+    std::int64_t from = balanceCents(1);
+    std::int64_t to = balanceCents(2);
+    if (from < 100) {
+        GTEST_SKIP() << "Source account 1 has too small balance for a transfer.";
+    }
+
+    const std::string tag = std::to_string(::getpid());
+    const std::string debitGid = "bank_node0_crash" + tag + "_1";
+    const std::string creditGid = "bank_node0_crash" + tag + "_2";
+    const std::string undecidedGid = "bank_node0_crash" + tag + "_3";
+    const std::string peerGid = "bank_node1_crash" + tag + "_1";
+
+    /* what a crash between the decision and COMMIT PREPARED leaves behind */
+    auto debit = prepare(debitGid, "SELECT debitTransferLeg(1, 2, 1.00, 'Recovery test')");
+    auto credit = prepare(creditGid, "SELECT creditTransferLeg(1, 2, 1.00, "
+                                     "(SELECT currency FROM accounts WHERE account_id = 1), 'Recovery test')");
+    auto undecided = prepare(undecidedGid, "SELECT 1");
+    auto peer = prepare(peerGid, "SELECT 1");
+    {
+        std::ofstream log(RECOVERY_LOG, std::ios::app);
+        log << "BEGIN " << debitGid << "\nCOMMIT " << debitGid << "\n"
+            << "BEGIN " << creditGid << "\nCOMMIT " << creditGid << "\n"
+            << "BEGIN " << undecidedGid << "\n";
+    }
+
+    EXPECT_EQ(coordinator.recover(), 3u);
+
+    EXPECT_EQ(balanceCents(1), from - 100);
+    EXPECT_EQ(balanceCents(2), to + 100);
+    EXPECT_FALSE(prepared(debitGid));
+    EXPECT_FALSE(prepared(creditGid));
+    EXPECT_FALSE(prepared(undecidedGid));
+
+    /* another server's leg, only its own log can decide it */
+    EXPECT_TRUE(prepared(peerGid));
+    pqxx::nontransaction tx(*conn);
+    tx.exec("ROLLBACK PREPARED " + conn->quote(peerGid));
+}
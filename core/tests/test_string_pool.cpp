@@ -0,0 +1,78 @@
+/* Unit tests for StringPool and the compact AccountColumns layout, no DB needed */
+
+#include <gtest/gtest.h>
+#include "account_loader.hpp"
+#include "string_pool.hpp"
+
+#include <string>
+
+TEST(StringPoolTest, Intern_StoresEachStringOnce) {
+    StringPool pool;
+    auto alice = pool.intern("Alice Johnson");
+    auto bob = pool.intern("Bob Carter");
+
+    EXPECT_NE(alice, bob);
+    EXPECT_EQ(pool.intern(std::string("Alice Johnson")), alice);
+    EXPECT_EQ(pool.view(alice), "Alice Johnson");
+    EXPECT_EQ(pool.view(bob), "Bob Carter");
+    EXPECT_EQ(pool.size(), 3u);
+
+    EXPECT_EQ(pool.intern(""), StringPool::EMPTY);
+    EXPECT_EQ(pool.view(StringPool::EMPTY), "");
+}
+
+TEST(StringPoolTest, Handles_SurviveGrowth) {
+    StringPool pool;
+    std::vector<StringPool::Handle> handles;
+    for (int i = 0; i < 10000; ++i) {
+        handles.push_back(pool.intern("customer" + std::to_string(i) + "@seed.bank1.com"));
+    }
+
+    EXPECT_EQ(pool.size(), 10001u);
+    for (int i = 0; i < 10000; ++i) {
+        EXPECT_EQ(pool.view(handles[i]), "customer" + std::to_string(i) + "@seed.bank1.com");
+        EXPECT_EQ(pool.intern("customer" + std::to_string(i) + "@seed.bank1.com"), handles[i]);
+    }
+
+    pool.clear();
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_EQ(pool.view(pool.intern("again")), "again");
+}
+
+TEST(AccountColumnsTest, Accessors_ReadTheInternedRows) {
+    AccountColumns columns;
+    columns.push(1, 10, 150000, "USD", AccountType::Checking, "Alice Johnson", "alice@bank1.com");
+    columns.push(2, 10, -2500, "EURO", AccountType::Credit, "Alice Johnson", "alice@bank1.com");
+
+    ASSERT_EQ(columns.size(), 2u);
+    EXPECT_EQ(columns.currency(0), "USD");
+    EXPECT_EQ(columns.currency(1), "EUR");
+    EXPECT_EQ(columns.customerName(1), "Alice Johnson");
+    EXPECT_EQ(columns.customerEmail(0), "alice@bank1.com");
+    EXPECT_EQ(columns.customerNames[0], columns.customerNames[1]);
+    EXPECT_EQ(columns.strings.size(), 3u);
+
+    auto records = columns.toRecords();
+    EXPECT_STREQ(records[1].currency, "EUR");
+    EXPECT_EQ(records[1].balanceCents, -2500);
+    EXPECT_EQ(records[1].accountType, AccountType::Credit);
+}
+
+TEST(AccountColumnsTest, Append_ReinternsTheOtherPool) {
+    AccountColumns first;
+    first.push(1, 10, 100, "USD", AccountType::Checking, "Alice Johnson", "alice@bank1.com");
+
+    AccountColumns second;
+    second.push(2, 20, 200, "BRL", AccountType::Savings, "Bob Carter", "bob@bank1.com");
+    second.push(3, 10, 300, "USD", AccountType::Savings, "Alice Johnson", "alice@bank1.com");
+
+    first.append(std::move(second));
+
+    ASSERT_EQ(first.size(), 3u);
+    EXPECT_EQ(second.size(), 0u);
+    EXPECT_EQ(first.customerName(1), "Bob Carter");
+    EXPECT_EQ(first.customerEmail(2), "alice@bank1.com");
+    EXPECT_EQ(first.customerNames[2], first.customerNames[0]);
+    EXPECT_EQ(first.strings.size(), 5u);
+    EXPECT_EQ(first.currency(1), "BRL");
+}
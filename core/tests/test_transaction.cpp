@@ -10,6 +10,7 @@
 #include "database_connection.hpp"
 #include "account_service.hpp"
 #include "transactions.hpp"
+#include "stripe_folder.hpp"
 
 short FROM_USD_ACCOUNT_ID = 1;
 short TO_USD_ACCOUNT_ID = 2;
@@ -217,4 +218,50 @@ TEST_F(TransactionServiceTest, Transfer_ThrowsForCurrencyMismatch) {
      * how much difference acceptable to still say the values are equal */
     EXPECT_NEAR(usdAfter, usdBefore, 1e-6);
     EXPECT_NEAR(eurAfter, eurBefore, 1e-6);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief A striped (hot) destination takes the credit in a stripe, getBalance()
+ * still sees it, before and after the stripes are folded
+ */
+TEST_F(TransactionServiceTest, Transfer_IntoStripedAccountCountsInBalance) {
+    const double amount = 7.0;
+    auto& db = DBConnection::getInstance();
+
+    {
+        auto guard = db.lock();
+        auto tx = db.createWriteTransaction();
+        /* a previous run may have left it striped */
+        tx->exec("SELECT enableStriping($1, 4) "
+                 "WHERE NOT EXISTS (SELECT 1 FROM striped_accounts WHERE account_id = $1)",
+                 pqxx::params{static_cast<int>(TO_USD_ACCOUNT_ID)});
+        tx->commit();
+    }
+
+    auto [fromBefore, toBefore] = getBalances(accountService,
+                                              FROM_USD_ACCOUNT_ID,
+                                              TO_USD_ACCOUNT_ID);
+    ASSERT_GE(fromBefore, amount)
+        << "Source account does not have enough balance for this test.";
+
+    EXPECT_NO_THROW({
+        transactionService.transfer(FROM_USD_ACCOUNT_ID, TO_USD_ACCOUNT_ID, amount,
+                           "Test transfer - striped destination");
+    });
+
+    EXPECT_NEAR(accountService.getBalance(TO_USD_ACCOUNT_ID), toBefore + amount, 1e-6);
+
+    /* folding moves money between rows of the same account, never changes it */
+    StripeFolder folder(std::chrono::milliseconds(1000));
+    EXPECT_GE(folder.fold(), 1);
+    EXPECT_NEAR(accountService.getBalance(TO_USD_ACCOUNT_ID), toBefore + amount, 1e-6);
+
+    {
+        auto guard = db.lock();
+        auto tx = db.createWriteTransaction();
+        tx->exec("SELECT disableStriping($1)", pqxx::params{static_cast<int>(TO_USD_ACCOUNT_ID)});
+        tx->commit();
+    }
+
+    EXPECT_NEAR(accountService.getBalance(TO_USD_ACCOUNT_ID), toBefore + amount, 1e-6);
+}
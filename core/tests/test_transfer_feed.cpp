@@ -0,0 +1,164 @@
+/* Unit tests for TransferFeed, no DB needed: payloads are published the way
+ * a reader does it. The feed is a singleton, every test uses its own
+ * transaction ids */
+
+#include <gtest/gtest.h>
+#include "transfer_feed.hpp"
+
+#include <string>
+
+namespace {
+    std::string payload(long long transactionID, int from, int to, const char* amount) {
+        return std::to_string(transactionID) + " " + std::to_string(from) + " " + std::to_string(to) + " " + amount;
+    }
+}
+
+TEST(TransferFeedTest, Payload_ParsedAndFormatted) {
+    TransferEvent event;
+    ASSERT_TRUE(TransferEvent::parse("42 1 2 30.50", event));
+    EXPECT_EQ(event.transactionID, 42);
+    EXPECT_EQ(event.fromAccountID, 1);
+    EXPECT_EQ(event.toAccountID, 2);
+    EXPECT_EQ(event.cents, 3050);
+
+    event.sequence = 7;
+    EXPECT_EQ(event.line(), "EVENT 7 42 1 2 30.50\n");
+
+    EXPECT_FALSE(TransferEvent::parse("42 1 2", event));
+    EXPECT_FALSE(TransferEvent::parse("42 1 2 abc", event));
+    EXPECT_FALSE(TransferEvent::parse("42 1 2 30.50 extra", event));
+}
+
+TEST(TransferFeedTest, LiveSubscription_GetsOnlyNewEvents) {
+    auto& feed = TransferFeed::getInstance();
+    ASSERT_TRUE(feed.publish(payload(1001, 1, 2, "10.00")));
+
+    std::string error;
+    std::uint64_t after = 0;
+    auto subscription = feed.subscribe(0, after, error);
+    ASSERT_TRUE(subscription) << error;
+    EXPECT_EQ(after, feed.lastSequence());
+
+    ASSERT_TRUE(feed.publish(payload(1002, 2, 1, "5.25")));
+    std::uint64_t sequence = feed.lastSequence();
+    EXPECT_EQ(sequence, after + 1);
+
+    std::string out;
+    EXPECT_TRUE(subscription->take(out));
+    EXPECT_EQ(out, "EVENT " + std::to_string(sequence) + " 1002 2 1 5.25\n");
+
+    feed.unsubscribe(subscription);
+    out.clear();
+    EXPECT_FALSE(subscription->take(out));
+    EXPECT_EQ(out, "");
+}
+
+TEST(TransferFeedTest, Resume_ReplaysWhatWasMissed) {
+    auto& feed = TransferFeed::getInstance();
+    ASSERT_TRUE(feed.publish(payload(2001, 1, 2, "1.00")));
+    std::uint64_t seen = feed.lastSequence();
+    ASSERT_TRUE(feed.publish(payload(2002, 1, 2, "2.00")));
+    ASSERT_TRUE(feed.publish(payload(2003, 1, 2, "3.00")));
+
+    std::string error;
+    auto subscription = feed.subscribe(feed.streamID(), seen, error);
+    ASSERT_TRUE(subscription) << error;
+
+    std::string out;
+    EXPECT_TRUE(subscription->take(out));
+    EXPECT_EQ(out, "EVENT " + std::to_string(seen + 1) + " 2002 1 2 2.00\n"
+                   "EVENT " + std::to_string(seen + 2) + " 2003 1 2 3.00\n");
+    feed.unsubscribe(subscription);
+
+    /* positions that do not belong to this stream are refused */
+    EXPECT_FALSE(feed.subscribe(feed.streamID() + 1, seen, error));
+    EXPECT_NE(error.find("has ended"), std::string::npos) << error;
+    std::uint64_t ahead = feed.lastSequence() + 1;
+    EXPECT_FALSE(feed.subscribe(feed.streamID(), ahead, error));
+    EXPECT_NE(error.find("Unknown sequence"), std::string::npos) << error;
+}
+
+TEST(TransferFeedTest, SameTransaction_PublishedOnce) {
+    auto& feed = TransferFeed::getInstance();
+    EXPECT_TRUE(feed.publish(payload(3001, 1, 2, "7.00")));
+    std::uint64_t sequence = feed.lastSequence();
+
+    /* one row read again after a lost connection */
+    EXPECT_FALSE(feed.publish(payload(3001, 1, 2, "7.00")));
+    EXPECT_EQ(feed.lastSequence(), sequence);
+
+    EXPECT_FALSE(feed.publish("not a transfer"));
+}
+
+TEST(TransferFeedTest, ReadyCallback_FiresOnceOnNextEvent) {
+    auto& feed = TransferFeed::getInstance();
+    std::string error;
+    std::uint64_t after = 0;
+    auto subscription = feed.subscribe(0, after, error);
+    ASSERT_TRUE(subscription) << error;
+
+    int woken = 0;
+    subscription->onReady([&woken]() { ++woken; });
+    EXPECT_EQ(woken, 0);
+
+    feed.publish(payload(4001, 1, 2, "1.00"));
+    feed.publish(payload(4002, 1, 2, "1.00"));
+    EXPECT_EQ(woken, 1);
+
+    /* lines already queued: called right away */
+    subscription->onReady([&woken]() { ++woken; });
+    EXPECT_EQ(woken, 2);
+
+    feed.unsubscribe(subscription);
+}
+
+TEST(TransferFeedTest, SlowSubscriber_IsCutOffWithItsResumePoint) {
+    auto& feed = TransferFeed::getInstance();
+    std::string error;
+    std::uint64_t after = 0;
+    auto slow = feed.subscribe(0, after, error);
+    ASSERT_TRUE(slow) << error;
+    std::size_t before = feed.subscribers();
+
+    /* default buffer of 4096 events, the next one does not fit */
+    const TransferFeedSettings defaults;
+    for (std::size_t i = 0; i <= defaults.subscriberBuffer; ++i) {
+        feed.publish(payload(5000 + static_cast<long long>(i), 1, 2, "1.00"));
+    }
+    std::uint64_t lastQueued = feed.lastSequence() - 1;
+
+    EXPECT_EQ(feed.subscribers(), before - 1);
+
+    std::string out;
+    EXPECT_FALSE(slow->take(out));
+    std::string expected = "ERROR Subscriber too slow, resume after " + std::to_string(lastQueued) + "\n";
+    ASSERT_GE(out.size(), expected.size());
+    EXPECT_EQ(out.substr(out.size() - expected.size()), expected);
+
+    /* the resume point is still in the replay ring */
+    auto resumed = feed.subscribe(feed.streamID(), lastQueued, error);
+    ASSERT_TRUE(resumed) << error;
+    out.clear();
+    resumed->take(out);
+    EXPECT_EQ(out, "EVENT " + std::to_string(lastQueued + 1) + " 9096 1 2 1.00\n");
+    feed.unsubscribe(resumed);
+}
+
+TEST(TransferFeedTest, Resume_RefusedPastTheReplayRing) {
+    auto& feed = TransferFeed::getInstance();
+    const TransferFeedSettings defaults;
+    std::uint64_t first = feed.lastSequence() + 1;
+    for (std::size_t i = 0; i <= defaults.replayCapacity; ++i) {
+        feed.publish(payload(100000 + static_cast<long long>(i), 1, 2, "1.00"));
+    }
+
+    std::string error;
+    std::uint64_t after = first - 1;
+    EXPECT_FALSE(feed.subscribe(feed.streamID(), after, error));
+    EXPECT_NE(error.find("no longer kept"), std::string::npos) << error;
+
+    after = first;
+    auto subscription = feed.subscribe(feed.streamID(), after, error);
+    ASSERT_TRUE(subscription) << error;
+    feed.unsubscribe(subscription);
+}
@@ -0,0 +1,481 @@
+/* Large scale synthetic data seeder for performance work.
+ *
+ * Generates customers, accounts and historical transactions with a realistic
+ * skew (Zipfian hot accounts, several currencies) and loads them with parallel
+ * COPY streams. Same --seed on the same starting database = same data.
+ *
+ * Usage:
+ *   ./build/bin/seed_database --customers 2000000 --accounts 10000000 \
+ *                             --transactions 50000000 --seed 42 --workers 8
+ *
+ * The balance trigger (trg_prevent_direct_balance_update) is respected:
+ * nothing is ever UPDATEd. The history is generated first to compute the
+ * final balance of every account, then accounts are inserted already holding
+ * that balance and the history is generated again (same seed) and copied.
+ * New ids start after the current MAX(id) so the sample data is kept. */
+#include "database_connection.hpp"
+#include "account_table.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    /* Rows generated per chunk, every chunk has its own RNG stream so the
+     * output does not depend on the number of workers */
+    constexpr std::int64_t CHUNK_ROWS = 100000;
+
+    /* History is spread over two years before this fixed instant (2025-01-01 UTC) */
+    constexpr std::int64_t HISTORY_END = 1735689600;
+    constexpr std::int64_t HISTORY_SPAN = 2 * 365 * 24 * 3600;
+
+    struct Currency {
+        const char* code;
+        int         weight;   // out of 100
+    };
+
+    constexpr std::array<Currency, 5> CURRENCIES = {{
+        {"USD", 60}, {"EUR", 20}, {"GBP", 10}, {"BRL", 5}, {"JPY", 5}
+    }};
+
+    constexpr std::array<const char*, 16> FIRST_NAMES = {
+        "Alice", "Benjamin", "Clara", "Daniel", "Eva", "Frank", "Gloria", "Henry",
+        "Isabella", "Jake", "Karen", "Leonardo", "Maria", "Nathan", "Olivia", "Patrick"
+    };
+
+    constexpr std::array<const char*, 16> LAST_NAMES = {
+        "Johnson", "Carter", "Mendes", "Thompson", "Martins", "Liu", "Smith", "Ford",
+        "Costa", "Williams", "Davis", "Pereira", "Lopez", "Rogers", "Turner", "Kim"
+    };
+
+    struct Options {
+        std::int64_t customers    = 1000000;
+        std::int64_t accounts     = 2500000;
+        std::int64_t transactions = 10000000;
+        std::uint64_t seed        = 42;
+        int          workers      = 8;
+        double       zipfExponent = 1.1;
+        std::string  config       = "config/db_credential.json";
+    };
+
+    /* SplitMix64, used to derive one independent seed per (table, chunk) */
+    std::uint64_t mix(std::uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    /* std::mt19937_64 output is fixed by the standard, the distributions are
+     * not, so the conversions below are done by hand to stay reproducible */
+    class Random {
+        public:
+            Random(std::uint64_t seed, std::uint64_t stream, std::uint64_t chunk)
+                : engine(mix(seed ^ mix(stream ^ mix(chunk)))) {
+            }
+
+            double uniform() { return (engine() >> 11) * 0x1.0p-53; }
+
+            std::int64_t below(std::int64_t n) {
+                return static_cast<std::int64_t>(engine() % static_cast<std::uint64_t>(n));
+            }
+
+        private:
+            std::mt19937_64 engine;
+    };
+
+    /**
+     * Zipf distribution over ranks 1..n with exponent s, rejection-inversion
+     * sampling (Hormann and Derflinger) so no table of n weights is needed
+     */
+    class Zipf {
+        public:
+            Zipf(std::int64_t n, double s) : n(n), s(s) {
+                hX1 = hIntegral(1.5) - 1.0;
+                hN = hIntegral(static_cast<double>(n) + 0.5);
+                threshold = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+            }
+
+            std::int64_t operator()(Random& rnd) const {
+                while (true) {
+                    double u = hN + rnd.uniform() * (hX1 - hN);
+                    double x = hIntegralInverse(u);
+                    auto k = static_cast<std::int64_t>(x + 0.5);
+                    k = std::clamp<std::int64_t>(k, 1, n);
+                    if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(static_cast<double>(k))) {
+                        return k;
+                    }
+                }
+            }
+
+        private:
+            static double helper1(double x) {
+                return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+            }
+
+            static double helper2(double x) {
+                return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+            }
+
+            double h(double x) const { return std::exp(-s * std::log(x)); }
+
+            double hIntegral(double x) const {
+                double logX = std::log(x);
+                return helper2((1.0 - s) * logX) * logX;
+            }
+
+            double hIntegralInverse(double x) const {
+                double t = std::max(x * (1.0 - s), -1.0);
+                return std::exp(helper1(t) * x);
+            }
+
+            std::int64_t n;
+            double s;
+            double hX1 = 0.0;
+            double hN = 0.0;
+            double threshold = 0.0;
+    };
+
+    /* Identifies each table in the RNG stream derivation */
+    enum Stream : std::uint64_t { CUSTOMERS = 1, ACCOUNTS = 2, TRANSACTIONS = 3 };
+
+    /**
+     * Everything about the generated dataset that does not depend on RNG state:
+     * id offsets and the currency of each account, grouped so transfers can
+     * pick a destination in the same currency (transferMoney() rejects others)
+     */
+    struct Plan {
+        Options options;
+        std::int64_t firstCustomer = 1;
+        std::int64_t firstAccount = 1;
+        std::int64_t firstTransaction = 1;
+
+        /* currency index of account i (0 based, relative to firstAccount) */
+        std::vector<std::uint8_t> accountCurrency;
+
+        /* accounts of each currency, in a scrambled order: rank r of the Zipf
+         * distribution maps to byCurrency[c][r - 1], so hot accounts are spread
+         * over the id space instead of being the lowest ids */
+        std::vector<std::vector<std::int32_t>> byCurrency;
+        std::vector<Zipf> zipf;
+        std::vector<std::int64_t> currencyCumulative;
+    };
+
+    int pickCurrency(Random& rnd) {
+        std::int64_t roll = rnd.below(100);
+        int acc = 0;
+        for (std::size_t i = 0; i < CURRENCIES.size(); ++i) {
+            acc += CURRENCIES[i].weight;
+            if (roll < acc) {
+                return static_cast<int>(i);
+            }
+        }
+        return 0;
+    }
+
+    /* Deterministic per account: customer and currency */
+    std::int64_t customerOfAccount(const Plan& plan, std::int64_t i) {
+        /* first pass gives every customer one account, the rest are spread */
+        if (i < plan.options.customers) {
+            return plan.firstCustomer + i;
+        }
+        return plan.firstCustomer + static_cast<std::int64_t>(mix(plan.options.seed ^ i) % plan.options.customers);
+    }
+
+    Plan makePlan(const Options& options, pqxx::connection& conn) {
+        Plan plan;
+        plan.options = options;
+
+        pqxx::read_transaction tx(conn);
+        plan.firstCustomer = tx.query_value<std::int64_t>("SELECT COALESCE(MAX(customer_id), 0) + 1 FROM customers");
+        plan.firstAccount = tx.query_value<std::int64_t>("SELECT COALESCE(MAX(account_id), 0) + 1 FROM accounts");
+        plan.firstTransaction = tx.query_value<std::int64_t>("SELECT COALESCE(MAX(transaction_id), 0) + 1 FROM transactions");
+        tx.commit();
+
+        plan.accountCurrency.resize(options.accounts);
+        plan.byCurrency.resize(CURRENCIES.size());
+
+        for (std::int64_t chunk = 0; chunk * CHUNK_ROWS < options.accounts; ++chunk) {
+            Random rnd(options.seed, ACCOUNTS, chunk);
+            std::int64_t end = std::min(options.accounts, (chunk + 1) * CHUNK_ROWS);
+            for (std::int64_t i = chunk * CHUNK_ROWS; i < end; ++i) {
+                int c = pickCurrency(rnd);
+                plan.accountCurrency[i] = static_cast<std::uint8_t>(c);
+                plan.byCurrency[c].push_back(static_cast<std::int32_t>(plan.firstAccount + i));
+            }
+        }
+
+        Random shuffle(options.seed, ACCOUNTS, ~0ull);
+        for (auto& ids : plan.byCurrency) {
+            /* Fisher-Yates with our own RNG, std::shuffle is not portable */
+            for (std::int64_t i = static_cast<std::int64_t>(ids.size()) - 1; i > 0; --i) {
+                std::swap(ids[i], ids[shuffle.below(i + 1)]);
+            }
+            plan.zipf.emplace_back(std::max<std::int64_t>(1, ids.size()), options.zipfExponent);
+        }
+
+        std::int64_t total = 0;
+        for (auto& ids : plan.byCurrency) {
+            total += ids.size() >= 2 ? static_cast<std::int64_t>(ids.size()) : 0;
+            plan.currencyCumulative.push_back(total);
+        }
+
+        if (options.transactions > 0 && total == 0) {
+            throw std::runtime_error("Not enough accounts to generate same currency transfers");
+        }
+
+        return plan;
+    }
+
+    struct Transfer {
+        std::int64_t id;
+        std::int32_t from;
+        std::int32_t to;
+        std::int64_t cents;
+        std::int64_t timestamp;
+    };
+
+    /* Generates transaction i of a chunk, same input = same transfer */
+    Transfer makeTransfer(const Plan& plan, Random& rnd, std::int64_t i) {
+        /* currency chosen proportionally to its number of accounts */
+        std::int64_t roll = rnd.below(plan.currencyCumulative.back());
+        std::size_t c = 0;
+        while (roll >= plan.currencyCumulative[c]) {
+            ++c;
+        }
+
+        const auto& ids = plan.byCurrency[c];
+        std::int64_t fromRank = plan.zipf[c](rnd);
+        std::int64_t toRank = plan.zipf[c](rnd);
+        if (toRank == fromRank) {
+            toRank = fromRank % static_cast<std::int64_t>(ids.size()) + 1;
+        }
+
+        Transfer t;
+        t.id = plan.firstTransaction + i;
+        t.from = ids[fromRank - 1];
+        t.to = ids[toRank - 1];
+        /* mostly small payments, log-uniform between 1.00 and 10000.00 */
+        t.cents = static_cast<std::int64_t>(100.0 * std::exp(rnd.uniform() * std::log(10000.0)));
+        t.timestamp = HISTORY_END - HISTORY_SPAN + i * HISTORY_SPAN / std::max<std::int64_t>(1, plan.options.transactions);
+        return t;
+    }
+
+    std::string formatTimestamp(std::int64_t unixSeconds) {
+        std::time_t t = static_cast<std::time_t>(unixSeconds);
+        std::tm tm{};
+        gmtime_r(&t, &tm);
+        char buffer[32];
+        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &tm);
+        return buffer;
+    }
+
+    /**
+     * Runs fn(chunk) for every chunk of rows, spread over the workers.
+     * Each worker gets its own dedicated connection
+     */
+    void forEachChunk(const Options& options, std::int64_t rows,
+                      const std::function<void(pqxx::connection*, std::int64_t)>& fn,
+                      bool needsConnection = true) {
+        std::int64_t chunks = (rows + CHUNK_ROWS - 1) / CHUNK_ROWS;
+        std::atomic<std::int64_t> next{0};
+        std::vector<std::thread> threads;
+
+        for (int w = 0; w < options.workers; ++w) {
+            threads.emplace_back([&]() {
+                std::unique_ptr<pqxx::connection> conn;
+                if (needsConnection) {
+                    conn = DBConnection::getInstance().openDedicatedConnection();
+                }
+                for (std::int64_t chunk = next++; chunk < chunks; chunk = next++) {
+                    fn(conn.get(), chunk);
+                }
+            });
+        }
+
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
+
+    void seedCustomers(const Plan& plan) {
+        const auto& o = plan.options;
+        forEachChunk(o, o.customers, [&](pqxx::connection* conn, std::int64_t chunk) {
+            Random rnd(o.seed, CUSTOMERS, chunk);
+            pqxx::work tx(*conn);
+            auto stream = pqxx::stream_to::table(tx, {"customers"},
+                {"customer_id", "full_name", "email", "phone", "date_of_birth", "address"});
+
+            std::int64_t end = std::min(o.customers, (chunk + 1) * CHUNK_ROWS);
+            for (std::int64_t i = chunk * CHUNK_ROWS; i < end; ++i) {
+                std::int64_t id = plan.firstCustomer + i;
+                std::string name = std::string(FIRST_NAMES[rnd.below(FIRST_NAMES.size())]) + " " +
+                                   LAST_NAMES[rnd.below(LAST_NAMES.size())];
+                std::string email = "customer" + std::to_string(id) + "@seed.bank1.com";
+                std::string phone = "555-" + std::to_string(1000 + rnd.below(9000));
+                std::string birth = formatTimestamp(HISTORY_END - (18 + rnd.below(60)) * 365 * 24 * 3600).substr(0, 10);
+                std::string address = std::to_string(1 + rnd.below(999)) + " Seed Street";
+
+                stream.write_values(id, name, email, phone, birth, address);
+            }
+
+            stream.complete();
+            tx.commit();
+        });
+    }
+
+    /* Pass 1: replays the whole history to get the net movement of every account */
+    std::vector<std::int64_t> computeDeltas(const Plan& plan) {
+        const auto& o = plan.options;
+        std::vector<std::atomic<std::int64_t>> deltas(o.accounts);
+
+        forEachChunk(o, o.transactions, [&](pqxx::connection*, std::int64_t chunk) {
+            Random rnd(o.seed, TRANSACTIONS, chunk);
+            std::int64_t end = std::min(o.transactions, (chunk + 1) * CHUNK_ROWS);
+            for (std::int64_t i = chunk * CHUNK_ROWS; i < end; ++i) {
+                Transfer t = makeTransfer(plan, rnd, i);
+                deltas[t.from - plan.firstAccount].fetch_sub(t.cents, std::memory_order_relaxed);
+                deltas[t.to - plan.firstAccount].fetch_add(t.cents, std::memory_order_relaxed);
+            }
+        }, false);
+
+        std::vector<std::int64_t> out(o.accounts);
+        for (std::int64_t i = 0; i < o.accounts; ++i) {
+            out[i] = deltas[i].load();
+        }
+        return out;
+    }
+
+    void seedAccounts(const Plan& plan, const std::vector<std::int64_t>& deltas) {
+        const auto& o = plan.options;
+        forEachChunk(o, o.accounts, [&](pqxx::connection* conn, std::int64_t chunk) {
+            Random rnd(o.seed, ACCOUNTS, chunk + 0x100000000ull);
+            pqxx::work tx(*conn);
+            auto stream = pqxx::stream_to::table(tx, {"accounts"},
+                {"account_id", "customer_id", "account_type", "balance", "currency"});
+
+            std::int64_t end = std::min(o.accounts, (chunk + 1) * CHUNK_ROWS);
+            for (std::int64_t i = chunk * CHUNK_ROWS; i < end; ++i) {
+                static constexpr std::array<const char*, 3> TYPES = {"checking", "savings", "credit"};
+                const char* type = TYPES[rnd.below(10) < 6 ? 0 : (rnd.below(2) ? 1 : 2)];
+
+                /* the opening balance covers what the generated history takes
+                 * out, so the final balance is at least 100.00 and always equals
+                 * the opening plus the copied transfers */
+                std::int64_t opening = 10000 + rnd.below(5000000) + std::max<std::int64_t>(0, -deltas[i]);
+                std::int64_t balance = opening + deltas[i];
+
+                stream.write_values(plan.firstAccount + i, customerOfAccount(plan, i), std::string(type),
+                                    formatCents(balance), std::string(CURRENCIES[plan.accountCurrency[i]].code));
+            }
+
+            stream.complete();
+            tx.commit();
+        });
+    }
+
+    /* Pass 2: same RNG streams as computeDeltas(), now the rows are copied */
+    void seedTransactions(const Plan& plan) {
+        const auto& o = plan.options;
+        forEachChunk(o, o.transactions, [&](pqxx::connection* conn, std::int64_t chunk) {
+            Random rnd(o.seed, TRANSACTIONS, chunk);
+            pqxx::work tx(*conn);
+            auto stream = pqxx::stream_to::table(tx, {"transactions"},
+                {"transaction_id", "from_account", "to_account", "amount", "description", "timestamp", "status"});
+
+            std::int64_t end = std::min(o.transactions, (chunk + 1) * CHUNK_ROWS);
+            for (std::int64_t i = chunk * CHUNK_ROWS; i < end; ++i) {
+                Transfer t = makeTransfer(plan, rnd, i);
+                stream.write_values(t.id, t.from, t.to, formatCents(t.cents), std::string("Seeded transfer"),
+                                    formatTimestamp(t.timestamp), std::string("completed"));
+            }
+
+            stream.complete();
+            tx.commit();
+        });
+    }
+
+    /* SERIAL sequences must continue after the explicit ids we copied */
+    void resetSequences(pqxx::connection& conn) {
+        pqxx::work tx(conn);
+        tx.exec("SELECT setval(pg_get_serial_sequence('customers', 'customer_id'), MAX(customer_id)) FROM customers");
+        tx.exec("SELECT setval(pg_get_serial_sequence('accounts', 'account_id'), MAX(account_id)) FROM accounts");
+        tx.exec("SELECT setval(pg_get_serial_sequence('transactions', 'transaction_id'), MAX(transaction_id)) FROM transactions");
+        tx.commit();
+    }
+
+    Options parseArgs(int argc, char* argv[]) {
+        Options o;
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string key = argv[i];
+            std::string value = argv[i + 1];
+
+            if (key == "--customers")         o.customers = std::stoll(value);
+            else if (key == "--accounts")     o.accounts = std::stoll(value);
+            else if (key == "--transactions") o.transactions = std::stoll(value);
+            else if (key == "--seed")         o.seed = std::stoull(value);
+            else if (key == "--workers")      o.workers = std::stoi(value);
+            else if (key == "--zipf")         o.zipfExponent = std::stod(value);
+            else if (key == "--config")       o.config = value;
+            else throw std::runtime_error("Unknown option: " + key);
+        }
+
+        if (o.customers <= 0 || o.accounts < o.customers || o.workers <= 0 || o.zipfExponent <= 0.0) {
+            throw std::runtime_error("Invalid options: need customers > 0, accounts >= customers, "
+                                     "workers > 0 and zipf > 0");
+        }
+        return o;
+    }
+
+    template <typename F>
+    void timed(const char* step, F&& f) {
+        auto started = std::chrono::steady_clock::now();
+        std::cout << "[Seeder] " << step << "...\n";
+        f();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << "[Seeder] " << step << " done in " << seconds << "s\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseArgs(argc, argv);
+
+        auto& db = DBConnection::getInstance();
+        db.loadConfig(options.config);
+        auto conn = db.openDedicatedConnection();
+
+        std::cout << "[Seeder] " << options.customers << " customers, " << options.accounts << " accounts, "
+                  << options.transactions << " transactions, seed " << options.seed
+                  << ", zipf " << options.zipfExponent << ", " << options.workers << " workers\n";
+
+        Plan plan;
+        timed("Planning", [&]() { plan = makePlan(options, *conn); });
+
+        std::vector<std::int64_t> deltas;
+        timed("Computing balances", [&]() { deltas = computeDeltas(plan); });
+        timed("Copying customers", [&]() { seedCustomers(plan); });
+        timed("Copying accounts", [&]() { seedAccounts(plan, deltas); });
+        timed("Copying transactions", [&]() { seedTransactions(plan); });
+        timed("Resetting sequences", [&]() { resetSequences(*conn); });
+
+        std::cout << "[Seeder] Done. Run ANALYZE before benchmarking.\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << "[FATAL] " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -14,6 +14,9 @@ CREATE DATABASE database1;
 
 /* If the tables exist, delete (drop) */
 
+DROP TABLE IF EXISTS internal_accounts CASCADE;
+DROP TABLE IF EXISTS account_stripes CASCADE;
+DROP TABLE IF EXISTS striped_accounts CASCADE;
 DROP TABLE IF EXISTS transactions CASCADE;
 DROP TABLE IF EXISTS accounts CASCADE;
 DROP TABLE IF EXISTS customers CASCADE;
@@ -47,6 +50,20 @@ CREATE TABLE accounts (
 CREATE INDEX idx_accounts_customer
     ON accounts(customer_id);
 
+-- Hot accounts take their credits in K sub-balances, see accountStripes.sql
+
+CREATE TABLE striped_accounts (
+    account_id      INT PRIMARY KEY REFERENCES accounts(account_id),
+    stripes         INT NOT NULL CHECK (stripes BETWEEN 2 AND 64)
+);
+
+CREATE TABLE account_stripes (
+    account_id      INT NOT NULL REFERENCES striped_accounts(account_id),
+    stripe          INT NOT NULL,
+    balance         NUMERIC(14,2) DEFAULT 0 NOT NULL,
+    PRIMARY KEY (account_id, stripe)
+);
+
 CREATE TABLE transactions (
     transaction_id  SERIAL PRIMARY KEY,
     from_account    INT REFERENCES accounts(account_id),
@@ -60,6 +77,13 @@ CREATE TABLE transactions (
 CREATE INDEX idx_transactions_timestamp
     ON transactions(timestamp);
 
+-- Transfers between internal accounts are netted by the server (NettingService),
+-- their individual records get status 'netted'
+
+CREATE TABLE internal_accounts (
+    account_id      INT PRIMARY KEY REFERENCES accounts(account_id)
+);
+
 -- These logs are going to be useful for audit purposes
 
 CREATE TABLE audit_logs (
@@ -78,9 +102,15 @@ some triggers to add extra security layer */
 \echo 'Loading sample data...'
 \i database/procedures/sample.sql
 
+\echo 'Loading account striping...'
+\i database/procedures/accountStripes.sql
+
 \echo 'Loading transfer procedure...'
 \i database/procedures/transferMoney.sql
 
+\echo 'Loading cross shard transfer legs...'
+\i database/procedures/shardTransfer.sql
+
 \echo 'Loading triggers...'
 \i database/procedures/triggers.sql
 
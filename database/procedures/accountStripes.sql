@@ -0,0 +1,137 @@
+/* Striping of hot accounts (merchant settlement accounts and the like).
+ *
+ * Every transferMoney() into an account locks its row, so thousands of
+ * credits per second into one account run one after the other. A striped
+ * account takes its credits in one of K sub-balances (account_stripes) chosen
+ * by hash, credits into different stripes never wait on each other.
+ *
+ * The balance of a striped account is accounts.balance plus the sum of its
+ * stripes. A debit first uses accounts.balance and folds the stripes into it
+ * only when that is not enough, so accounts.balance never goes negative. The
+ * server folds all stripes periodically with foldAllAccountStripes().
+ *
+ * enableStriping(account_id, stripes)
+ * disableStriping(account_id)
+ * accountStripeOf(stripes, from_account_id) -> stripe
+ * foldAccountStripes(account_id) -> amount folded
+ * foldAllAccountStripes() -> accounts folded */
+
+CREATE OR REPLACE FUNCTION enableStriping(
+    stripe_account INT,
+    stripe_count   INT DEFAULT 8
+)
+RETURNS VOID AS $$
+BEGIN
+    IF stripe_count < 2 OR stripe_count > 64 THEN
+        RAISE EXCEPTION 'Stripe count must be between 2 and 64, got %', stripe_count;
+    END IF;
+
+    IF NOT EXISTS (SELECT 1 FROM accounts WHERE account_id = stripe_account) THEN
+        RAISE EXCEPTION 'Account % does not exist', stripe_account;
+    END IF;
+
+    IF EXISTS (SELECT 1 FROM striped_accounts WHERE account_id = stripe_account) THEN
+        RAISE EXCEPTION 'Account % is already striped', stripe_account;
+    END IF;
+
+    INSERT INTO striped_accounts (account_id, stripes)
+    VALUES (stripe_account, stripe_count);
+
+    INSERT INTO account_stripes (account_id, stripe, balance)
+    SELECT stripe_account, s, 0
+    FROM generate_series(0, stripe_count - 1) s;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION disableStriping(
+    stripe_account INT
+)
+RETURNS VOID AS $$
+BEGIN
+    IF NOT EXISTS (SELECT 1 FROM striped_accounts WHERE account_id = stripe_account) THEN
+        RAISE EXCEPTION 'Account % is not striped', stripe_account;
+    END IF;
+
+    -- Everything back into accounts.balance, stripes stay locked until commit
+    PERFORM foldAccountStripes(stripe_account);
+
+    DELETE FROM account_stripes WHERE account_id = stripe_account;
+    DELETE FROM striped_accounts WHERE account_id = stripe_account;
+END;
+$$ LANGUAGE plpgsql;
+
+/* Stripe of a credit: concurrent sessions land on different stripes, and so
+ * do the different payers of one session */
+CREATE OR REPLACE FUNCTION accountStripeOf(
+    stripe_count       INT,
+    transf_from_account INT
+)
+RETURNS INT AS $$
+BEGIN
+    RETURN mod(mod(hashint8((pg_backend_pid()::BIGINT << 32) | transf_from_account::BIGINT), stripe_count)
+               + stripe_count, stripe_count);
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION foldAccountStripes(
+    fold_account INT
+)
+RETURNS NUMERIC AS $$
+DECLARE
+    folded NUMERIC;
+BEGIN
+    -- Account row first, then its stripes: the order of transferMoney()
+    PERFORM 1 FROM accounts WHERE account_id = fold_account FOR UPDATE;
+    PERFORM 1 FROM account_stripes WHERE account_id = fold_account FOR UPDATE;
+
+    SELECT COALESCE(SUM(balance), 0)
+    INTO folded
+    FROM account_stripes
+    WHERE account_id = fold_account;
+
+    IF folded = 0 THEN
+        RETURN 0;
+    END IF;
+
+    BEGIN
+        PERFORM set_config('database1.allow_balance_update', 'on', true);
+
+        UPDATE account_stripes
+        SET balance = 0
+        WHERE account_id = fold_account AND balance <> 0;
+
+        UPDATE accounts
+        SET balance = balance + folded
+        WHERE account_id = fold_account;
+
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+    EXCEPTION WHEN OTHERS THEN
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+        RAISE;
+    END;
+
+    RETURN folded;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION foldAllAccountStripes()
+RETURNS INT AS $$
+DECLARE
+    fold_account INT;
+    folded_count INT := 0;
+BEGIN
+    -- Accounts being debited right now are skipped, the next run gets them
+    FOR fold_account IN
+        SELECT a.account_id
+        FROM accounts a JOIN striped_accounts s ON a.account_id = s.account_id
+        ORDER BY a.account_id
+        FOR UPDATE OF a SKIP LOCKED
+    LOOP
+        IF foldAccountStripes(fold_account) <> 0 THEN
+            folded_count := folded_count + 1;
+        END IF;
+    END LOOP;
+
+    RETURN folded_count;
+END;
+$$ LANGUAGE plpgsql;
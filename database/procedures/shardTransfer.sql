@@ -0,0 +1,143 @@
+/* Legs of a transfer between two accounts living on different shards.
+ * The coordinator (ShardCoordinator in core/) runs each leg inside an explicit
+ * transaction on its shard, PREPAREs both and only then COMMITs them, so either
+ * both balances change or none does.
+ *
+ * Each shard only holds its own accounts, the transactions row of a leg keeps
+ * the peer account in the description (from_account / to_account reference
+ * local accounts only, the remote side is NULL)
+ *
+ * Striped accounts are handled like in transferMoney(), see accountStripes.sql
+ *
+ * debitTransferLeg(from_account_id, to_account_id, amount, description) -> currency
+ * creditTransferLeg(from_account_id, to_account_id, amount, currency, description) */
+
+CREATE OR REPLACE FUNCTION debitTransferLeg(
+    transf_from_account INT,
+    transf_to_account   INT,
+    transf_amount       NUMERIC(12,2),
+    transf_description  TEXT DEFAULT 'Transfer'
+)
+RETURNS TEXT AS $$
+DECLARE
+    ver_from_balance   NUMERIC;
+    ver_from_currency  TEXT;
+BEGIN
+    -- Validate the amount
+    IF transf_amount <= 0 THEN
+        RAISE EXCEPTION 'Transfer amount must be positive';
+    END IF;
+
+    -- Lock source account row, held until COMMIT/ROLLBACK PREPARED
+    SELECT balance, currency
+    INTO ver_from_balance, ver_from_currency
+    FROM accounts
+    WHERE account_id = transf_from_account
+    FOR UPDATE;
+
+    IF ver_from_currency IS NULL THEN
+        RAISE EXCEPTION 'Source account % does not exist', transf_from_account;
+    END IF;
+
+    -- Sufficient funds, counting the stripes of a striped source
+    IF ver_from_balance < transf_amount THEN
+        ver_from_balance := ver_from_balance + foldAccountStripes(transf_from_account);
+    END IF;
+
+    IF ver_from_balance < transf_amount THEN
+        RAISE EXCEPTION
+            'Insufficient funds in account %, balance: %, attempted: %',
+            transf_from_account, ver_from_balance, transf_amount;
+    END IF;
+
+    BEGIN
+        PERFORM set_config('database1.allow_balance_update', 'on', true);
+
+        UPDATE accounts
+        SET balance = balance - transf_amount
+        WHERE account_id = transf_from_account;
+
+        INSERT INTO transactions (from_account, to_account, amount, description, status)
+        VALUES (transf_from_account, NULL, transf_amount,
+                transf_description || ' (to account ' || transf_to_account || ')', 'cross_shard');
+
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+    EXCEPTION WHEN OTHERS THEN
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+        RAISE;
+    END;
+
+    -- The credit leg checks the destination has the same currency
+    RETURN ver_from_currency;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION creditTransferLeg(
+    transf_from_account INT,
+    transf_to_account   INT,
+    transf_amount       NUMERIC(12,2),
+    transf_currency     TEXT,
+    transf_description  TEXT DEFAULT 'Transfer'
+)
+RETURNS VOID AS $$
+DECLARE
+    ver_to_currency    TEXT;
+    ver_to_stripes     INT;
+BEGIN
+    IF transf_amount <= 0 THEN
+        RAISE EXCEPTION 'Transfer amount must be positive';
+    END IF;
+
+    -- Lock destination account row, unless it is striped (hot account)
+    SELECT stripes
+    INTO ver_to_stripes
+    FROM striped_accounts
+    WHERE account_id = transf_to_account;
+
+    IF ver_to_stripes IS NULL THEN
+        SELECT currency
+        INTO ver_to_currency
+        FROM accounts
+        WHERE account_id = transf_to_account
+        FOR UPDATE;
+    ELSE
+        SELECT currency
+        INTO ver_to_currency
+        FROM accounts
+        WHERE account_id = transf_to_account;
+    END IF;
+
+    IF ver_to_currency IS NULL THEN
+        RAISE EXCEPTION 'Destination account % does not exist', transf_to_account;
+    END IF;
+
+    -- Same currency check
+    IF transf_currency <> ver_to_currency THEN
+        RAISE EXCEPTION 'Currency mismatch: % vs %', transf_currency, ver_to_currency;
+    END IF;
+
+    BEGIN
+        PERFORM set_config('database1.allow_balance_update', 'on', true);
+
+        IF ver_to_stripes IS NULL THEN
+            UPDATE accounts
+            SET balance = balance + transf_amount
+            WHERE account_id = transf_to_account;
+        ELSE
+            UPDATE account_stripes
+            SET balance = balance + transf_amount
+            WHERE account_id = transf_to_account
+              AND stripe = accountStripeOf(ver_to_stripes, transf_from_account);
+        END IF;
+
+        INSERT INTO transactions (from_account, to_account, amount, description, status)
+        VALUES (NULL, transf_to_account, transf_amount,
+                transf_description || ' (from account ' || transf_from_account || ')', 'cross_shard');
+
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+    EXCEPTION WHEN OTHERS THEN
+        PERFORM set_config('database1.allow_balance_update', 'off', true);
+        RAISE;
+    END;
+END;
+$$ LANGUAGE plpgsql;
@@ -1,17 +1,24 @@
 /* Function to safely transfers money between two accounts.
- * transferMoney(from_account_id, to_account_id, amount, description) */
+ * transferMoney(from_account_id, to_account_id, amount, description)
+ *
+ * applyTransferBalances(from_account_id, to_account_id, amount) is the same
+ * without the transactions row, for callers recording it themselves (the net
+ * transfers of NettingService, which COPY the individual records)
+ *
+ * Credits into a striped account go to one of its stripes instead of its
+ * row, see accountStripes.sql */
 
-CREATE OR REPLACE FUNCTION transferMoney(
+CREATE OR REPLACE FUNCTION applyTransferBalances(
     transf_from_account INT,
     transf_to_account   INT,
-    transf_amount       NUMERIC(12,2),
-    transf_description  TEXT DEFAULT 'Transfer'
+    transf_amount       NUMERIC(12,2)
 )
 RETURNS VOID AS $$
 DECLARE
     ver_from_balance   NUMERIC;
     ver_from_currency  TEXT;
     ver_to_currency    TEXT;
+    ver_to_stripes     INT;
 BEGIN
     -- Validate the amount
     IF transf_amount <= 0 THEN
@@ -25,12 +32,24 @@ BEGIN
     WHERE account_id = transf_from_account
     FOR UPDATE;
 
-    -- Lock destination account row
-    SELECT currency
-    INTO ver_to_currency
-    FROM accounts
-    WHERE account_id = transf_to_account
-    FOR UPDATE;
+    -- Lock destination account row, unless it is striped (hot account)
+    SELECT stripes
+    INTO ver_to_stripes
+    FROM striped_accounts
+    WHERE account_id = transf_to_account;
+
+    IF ver_to_stripes IS NULL THEN
+        SELECT currency
+        INTO ver_to_currency
+        FROM accounts
+        WHERE account_id = transf_to_account
+        FOR UPDATE;
+    ELSE
+        SELECT currency
+        INTO ver_to_currency
+        FROM accounts
+        WHERE account_id = transf_to_account;
+    END IF;
 
     -- Verify if accounts exist
     IF ver_from_currency IS NULL THEN
@@ -46,7 +65,11 @@ BEGIN
         RAISE EXCEPTION 'Currency mismatch: % vs %', ver_from_currency, ver_to_currency;
     END IF;
 
-    -- Sufficient funds
+    -- Sufficient funds, counting the stripes of a striped source
+    IF ver_from_balance < transf_amount THEN
+        ver_from_balance := ver_from_balance + foldAccountStripes(transf_from_account);
+    END IF;
+
     IF ver_from_balance < transf_amount THEN
         RAISE EXCEPTION
             'Insufficient funds in account %, balance: %, attempted: %',
@@ -62,13 +85,16 @@ BEGIN
         SET balance = balance - transf_amount
         WHERE account_id = transf_from_account;
 
-        UPDATE accounts
-        SET balance = balance + transf_amount
-        WHERE account_id = transf_to_account;
-
-        -- Record transaction
-        INSERT INTO transactions (from_account, to_account, amount, description)
-        VALUES (transf_from_account, transf_to_account, transf_amount, transf_description);
+        IF ver_to_stripes IS NULL THEN
+            UPDATE accounts
+            SET balance = balance + transf_amount
+            WHERE account_id = transf_to_account;
+        ELSE
+            UPDATE account_stripes
+            SET balance = balance + transf_amount
+            WHERE account_id = transf_to_account
+              AND stripe = accountStripeOf(ver_to_stripes, transf_from_account);
+        END IF;
 
         -- Optionally turn the flag off again
         PERFORM set_config('database1.allow_balance_update', 'off', true);
@@ -78,4 +104,20 @@ BEGIN
         RAISE;
     END;
 END;
-$$ LANGUAGE plpgsql;
\ No newline at end of file
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION transferMoney(
+    transf_from_account INT,
+    transf_to_account   INT,
+    transf_amount       NUMERIC(12,2),
+    transf_description  TEXT DEFAULT 'Transfer'
+)
+RETURNS VOID AS $$
+BEGIN
+    PERFORM applyTransferBalances(transf_from_account, transf_to_account, transf_amount);
+
+    -- Record transaction
+    INSERT INTO transactions (from_account, to_account, amount, description)
+    VALUES (transf_from_account, transf_to_account, transf_amount, transf_description);
+END;
+$$ LANGUAGE plpgsql;
@@ -28,6 +28,16 @@ BEFORE UPDATE OF balance ON accounts
 FOR EACH ROW
 EXECUTE FUNCTION prevent_direct_balance_update();
 
+/* Same for the stripes of hot accounts, only transferMoney() and the fold
+ * functions of accountStripes.sql may change them */
+
+DROP TRIGGER IF EXISTS trg_prevent_direct_stripe_update ON account_stripes;
+
+CREATE TRIGGER trg_prevent_direct_stripe_update
+BEFORE UPDATE OF balance ON account_stripes
+FOR EACH ROW
+EXECUTE FUNCTION prevent_direct_balance_update();
+
 /* Transactions immutable (no UPDATE, no DELETE)
  * transactions can be only added on the table, but not updated or modified */
 
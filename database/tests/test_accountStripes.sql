@@ -0,0 +1,147 @@
+/* Unit tests for hot account striping (accountStripes.sql) and the striped
+ * paths of transferMoney() */
+
+-- Load pgTAP if not already loaded on our database
+CREATE EXTENSION IF NOT EXISTS pgtap;
+
+BEGIN;
+
+SELECT plan(13);
+
+CREATE SCHEMA IF NOT EXISTS test_env;
+
+SET search_path TO test_env, public;
+
+CREATE TABLE accounts (
+    account_id SERIAL PRIMARY KEY,
+    balance NUMERIC(12,2) NOT NULL,
+    currency TEXT NOT NULL
+);
+
+CREATE TABLE transactions (
+    transaction_id SERIAL PRIMARY KEY,
+    from_account INT,
+    to_account INT,
+    amount NUMERIC(12,2),
+    description TEXT,
+    created_at TIMESTAMP DEFAULT NOW()
+);
+
+CREATE TABLE striped_accounts (
+    account_id INT PRIMARY KEY,
+    stripes INT NOT NULL
+);
+
+CREATE TABLE account_stripes (
+    account_id INT NOT NULL,
+    stripe INT NOT NULL,
+    balance NUMERIC(12,2) DEFAULT 0 NOT NULL,
+    PRIMARY KEY (account_id, stripe)
+);
+
+\i database/procedures/accountStripes.sql
+\i database/procedures/transferMoney.sql
+
+-- Account 2 plays the merchant (hot) account
+INSERT INTO accounts (balance, currency) VALUES
+    (100.00, 'USD'),
+    (50.00,  'USD'),
+    (10.00,  'EUR');
+
+-- Tests 1 and 2: striping creates K empty stripes
+
+SELECT lives_ok(
+    $$ SELECT enableStriping(2, 4); $$,
+    'Striping account 2 should succeed'
+);
+
+SELECT is(
+    (SELECT COUNT(*)::int FROM account_stripes WHERE account_id = 2 AND balance = 0),
+    4,
+    'Account 2 should have 4 empty stripes'
+);
+
+-- Tests 3 to 5: a credit lands in a stripe, the account row is untouched
+
+SELECT lives_ok(
+    $$ SELECT transferMoney(1, 2, 30.00, 'Into a stripe'); $$,
+    'Transfer into a striped account should succeed'
+);
+
+SELECT is(
+    (SELECT balance FROM accounts WHERE account_id = 2),
+    50.00::numeric,
+    'Account 2 row should still hold 50.00'
+);
+
+SELECT is(
+    (SELECT SUM(balance) FROM account_stripes WHERE account_id = 2),
+    30.00::numeric,
+    'Stripes of account 2 should hold 30.00'
+);
+
+-- Tests 6 and 7: a debit above the row balance folds the stripes first
+
+SELECT lives_ok(
+    $$ SELECT transferMoney(2, 1, 70.00, 'Out of the aggregate'); $$,
+    'Debit covered by row and stripes together should succeed'
+);
+
+SELECT results_eq(
+    $$ SELECT (SELECT balance FROM accounts WHERE account_id = 2),
+              (SELECT SUM(balance) FROM account_stripes WHERE account_id = 2) $$,
+    $$ VALUES (10.00::numeric, 0.00::numeric) $$,
+    'Account 2 should hold 10.00 in its row and nothing in its stripes'
+);
+
+-- Tests 8 and 9: the periodic fold
+
+SELECT transferMoney(1, 2, 5.00, 'Folded later');
+
+SELECT is(
+    foldAllAccountStripes(),
+    1,
+    'One striped account should be folded'
+);
+
+SELECT is(
+    (SELECT balance FROM accounts WHERE account_id = 2),
+    15.00::numeric,
+    'Account 2 row should hold 15.00 after the fold'
+);
+
+-- Test 10: insufficient funds counts the stripes too
+
+SELECT transferMoney(1, 2, 5.00, 'Counted');
+
+SELECT throws_ok(
+    $$ SELECT transferMoney(2, 1, 999.00, 'Too big'); $$,
+    'Insufficient funds in account 2, balance: 20.00, attempted: 999.00',
+    'Should throw on insufficient aggregate balance'
+);
+
+-- Tests 11 and 12: unstriping folds everything back into the row
+
+SELECT lives_ok(
+    $$ SELECT disableStriping(2); $$,
+    'Unstriping account 2 should succeed'
+);
+
+SELECT results_eq(
+    $$ SELECT (SELECT balance FROM accounts WHERE account_id = 2),
+              (SELECT COUNT(*) FROM account_stripes WHERE account_id = 2) $$,
+    $$ VALUES (20.00::numeric, 0::bigint) $$,
+    'Account 2 should hold 20.00 in its row and have no stripe left'
+);
+
+-- Test 13: stripe count bounds
+
+SELECT throws_ok(
+    $$ SELECT enableStriping(3, 1); $$,
+    'Stripe count must be between 2 and 64, got 1',
+    'Should throw on a single stripe'
+);
+
+SELECT * FROM finish();
+
+ROLLBACK;
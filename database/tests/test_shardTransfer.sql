@@ -0,0 +1,125 @@
+/* Unit tests for the cross shard transfer legs
+ * debitTransferLeg() and creditTransferLeg() */
+
+-- Load pgTAP if not already loaded on our database
+CREATE EXTENSION IF NOT EXISTS pgtap;
+
+BEGIN;
+
+SELECT plan(9);
+
+CREATE SCHEMA IF NOT EXISTS test_env;
+
+SET search_path TO test_env, public;
+
+CREATE TABLE accounts (
+    account_id SERIAL PRIMARY KEY,
+    balance NUMERIC(12,2) NOT NULL,
+    currency TEXT NOT NULL
+);
+
+CREATE TABLE transactions (
+    id SERIAL PRIMARY KEY,
+    from_account INT,
+    to_account INT,
+    amount NUMERIC(12,2),
+    description TEXT,
+    status VARCHAR(20) DEFAULT 'completed',
+    created_at TIMESTAMP DEFAULT NOW()
+);
+
+CREATE TABLE striped_accounts (
+    account_id INT PRIMARY KEY,
+    stripes INT NOT NULL
+);
+
+CREATE TABLE account_stripes (
+    account_id INT NOT NULL,
+    stripe INT NOT NULL,
+    balance NUMERIC(12,2) DEFAULT 0 NOT NULL,
+    PRIMARY KEY (account_id, stripe)
+);
+
+\i database/procedures/accountStripes.sql
+\i database/procedures/shardTransfer.sql
+
+-- Account 1 and 2 play the local side of each leg, 3 has another currency
+INSERT INTO accounts (balance, currency) VALUES
+    (100.00, 'USD'),
+    (50.00,  'USD'),
+    (10.00,  'EUR');
+
+-- Test 1: debit leg returns the currency for the credit leg
+
+SELECT is(
+    debitTransferLeg(1, 42, 30.00, 'Cross shard'),
+    'USD',
+    'Debit leg should return the source currency'
+);
+
+-- Test 2: only the local account changes
+
+SELECT is(
+    (SELECT balance FROM accounts WHERE account_id = 1),
+    70.00::numeric,
+    'Account 1 should have 70.00 after the debit leg'
+);
+
+-- Test 3: the leg is recorded with the remote side in the description
+
+SELECT isnt_empty(
+    $$ SELECT * FROM transactions WHERE from_account = 1 AND to_account IS NULL
+       AND status = 'cross_shard' AND description = 'Cross shard (to account 42)' $$,
+    'Debit leg should be recorded'
+);
+
+-- Test 4: insufficient funds
+
+SELECT throws_ok(
+    $$ SELECT debitTransferLeg(2, 42, 999.00, 'Too big'); $$,
+    'Insufficient funds in account 2, balance: 50.00, attempted: 999.00',
+    'Debit leg should throw on insufficient balance'
+);
+
+-- Test 5: missing source account
+
+SELECT throws_ok(
+    $$ SELECT debitTransferLeg(999, 42, 10, 'Invalid'); $$,
+    'Source account 999 does not exist',
+    'Debit leg should throw on non-existing source account'
+);
+
+-- Test 6: credit leg
+
+SELECT lives_ok(
+    $$ SELECT creditTransferLeg(42, 2, 30.00, 'USD', 'Cross shard'); $$,
+    'Credit leg into account 2 should succeed'
+);
+
+-- Test 7: credited balance
+
+SELECT is(
+    (SELECT balance FROM accounts WHERE account_id = 2),
+    80.00::numeric,
+    'Account 2 should have 80.00 after the credit leg'
+);
+
+-- Test 8: currency of the debit leg must match
+
+SELECT throws_ok(
+    $$ SELECT creditTransferLeg(42, 3, 10.00, 'USD', 'Wrong currency'); $$,
+    'Currency mismatch: USD vs EUR',
+    'Credit leg should throw when currencies differ'
+);
+
+-- Test 9: missing destination account
+
+SELECT throws_ok(
+    $$ SELECT creditTransferLeg(42, 999, 10, 'USD', 'Invalid'); $$,
+    'Destination account 999 does not exist',
+    'Credit leg should throw on non-existing destination account'
+);
+
+SELECT * FROM finish();
+
+ROLLBACK;
@@ -7,7 +7,7 @@ CREATE EXTENSION IF NOT EXISTS pgtap;
 -- Start the test set
 BEGIN;
 
-SELECT plan(10);
+SELECT plan(12);
 
 -- Create test schema test envirnoment
 CREATE SCHEMA IF NOT EXISTS test_env;
@@ -22,7 +22,7 @@ CREATE TABLE accounts (
 );
 
 CREATE TABLE transactions (
-    id SERIAL PRIMARY KEY,
+    transaction_id SERIAL PRIMARY KEY,
     from_account INT,
     to_account INT,
     amount NUMERIC(12,2),
@@ -30,6 +30,21 @@ CREATE TABLE transactions (
     created_at TIMESTAMP DEFAULT NOW()
 );
 
+CREATE TABLE striped_accounts (
+    account_id INT PRIMARY KEY,
+    stripes INT NOT NULL
+);
+
+CREATE TABLE account_stripes (
+    account_id INT NOT NULL,
+    stripe INT NOT NULL,
+    balance NUMERIC(12,2) DEFAULT 0 NOT NULL,
+    PRIMARY KEY (account_id, stripe)
+);
+
+-- Striping tables stay empty here, see test_accountStripes.sql
+\i database/procedures/accountStripes.sql
+
 -- Load the function transferMoney under test
 \i database/procedures/transferMoney.sql
 
@@ -118,6 +133,20 @@ SELECT throws_ok(
     'Should throw on non-existing destination account'
 );
 
+-- Tests 11 and 12: applyTransferBalances() moves money without a record
+
+SELECT lives_ok(
+    $$ SELECT applyTransferBalances(2, 1, 5.00); $$,
+    'Net transfer between accounts 2 and 1 should succeed'
+);
+
+SELECT results_eq(
+    $$ SELECT (SELECT balance FROM accounts WHERE account_id = 1),
+              (SELECT COUNT(*) FROM transactions WHERE amount = 5) $$,
+    $$ VALUES (75.00::numeric, 0::bigint) $$,
+    'Account 1 should have 75.00 and no 5.00 transaction recorded'
+);
+
 /* Finish test */
 SELECT * FROM finish();
 